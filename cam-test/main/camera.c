@@ -1,4 +1,11 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
 #include "esp_camera.h"
+#include "esp_heap_caps.h"
 #include "esp_timer.h"
 #include "esp_vfs.h"
 #include "esp_log.h"
@@ -7,6 +14,8 @@
 
 #include "common.h"
 
+#define CAMERA_FRAME_TIMEOUT_US 1000000
+
 #define CAM_PIN_PWDN    32
 #define CAM_PIN_RESET   -1
 #define CAM_PIN_XCLK    0 
@@ -27,6 +36,25 @@
 
 static const char *TAG = "mod:cam";
 
+/* times in us exported in seconds, from 16 us up to 2 min */
+struct histogram camera_hist[CAM_HIST_MAX] = {
+	[CAM_HIST_FLASH] = HISTOGRAM("cam_flash_seconds",
+				     "Flash LED on until a frame exposed with it is ready", 4, 1e-6),
+	[CAM_HIST_FB_GET] = HISTOGRAM("cam_fb_get_seconds",
+				      "Time in esp_camera_fb_get(), waiting for the sensor", 4, 1e-6),
+	[CAM_HIST_FILE_WRITE] = HISTOGRAM("cam_file_write_seconds",
+					  "Picture stored to SPIFFS by the persist task", 4, 1e-6),
+	[CAM_HIST_HTTP_SEND] = HISTOGRAM("cam_http_send_seconds",
+					 "Frame sent to a client, single capture or stream part", 4, 1e-6),
+	[CAM_HIST_END_TO_END] = HISTOGRAM("cam_end_to_end_seconds",
+					  "Request to frame sent or picture stored", 4, 1e-6),
+	[CAM_HIST_FRAME_SIZE] = HISTOGRAM("cam_frame_size_bytes",
+					  "JPEG frame size of every captured frame", 10, 1),
+};
+
+static uint32_t capture_errors;
+static uint32_t persist_dropped;
+
 static camera_config_t camera_config = {
 	.pin_pwdn  = CAM_PIN_PWDN,
 	.pin_reset = CAM_PIN_RESET,
@@ -63,13 +91,19 @@ static camera_config_t camera_config = {
 	/* 0-63, for OV series camera sensors, lower number means higher quality */
 	.jpeg_quality = 10,
 
-	/* When jpeg mode is used, if fb_count more than one, the driver will work in continuous mode. */
-	.fb_count = 1,
+	/* When jpeg mode is used, if fb_count more than one, the driver will work in continuous mode.
+	 * Frame ring holds CONFIG_CAM_RING_DEPTH of them, one more is filled by the driver.
+	 */
+	.fb_count = CONFIG_CAM_RING_DEPTH + 1,
+	.fb_location = CAMERA_FB_IN_PSRAM,
 
 	/* CAMERA_GRAB_LATEST. Sets when buffers should be filled */
 	.grab_mode = CAMERA_GRAB_LATEST
 };
 
+static esp_err_t camera_ring_init(void);
+static esp_err_t camera_persist_init(void);
+
 esp_err_t camera_init(void)
 {
 	/* Init Flash LED */
@@ -91,55 +125,295 @@ esp_err_t camera_init(void)
 		return err;
 	}
 
-	return ESP_OK;
+	/* before any frame source: httpd and the motion detector may persist at once */
+	err = camera_persist_init();
+	if (err != ESP_OK)
+		return err;
+
+	return camera_ring_init();
 }
 
-esp_err_t camera_capture(char *filepath)
+/* camera frame buffers as a frame source, for the capture task only */
+
+static int camera_frame_get(void *ctx, struct frame *f)
 {
-	camera_fb_t * fb = NULL;
-	size_t fb_len = 0;
-	FILE *fd = NULL;
-	int64_t fr_start;
-	int64_t fr_end;
+	static uint32_t seq;
+	camera_fb_t *fb;
+	int64_t start;
 
-	gpio_set_level(CONFIG_FLASH_LED_PIN, 1);
-	fr_start = esp_timer_get_time();
-	esp_camera_return_all();
+	start = esp_timer_get_time();
 	fb = esp_camera_fb_get();
+	hist_record(&camera_hist[CAM_HIST_FB_GET], esp_timer_get_time() - start);
+
 	if (!fb) {
 		ESP_LOGE(TAG, "Camera Capture Failed");
-		return ESP_FAIL;
+		capture_errors++;
+		return -1;
 	}
 
-	gpio_set_level(CONFIG_FLASH_LED_PIN, 0);
-
 	if (fb->format != PIXFORMAT_JPEG) {
 		ESP_LOGE(TAG, "Camera format is not JPEG: %d", fb->format);
-		return ESP_FAIL;
+		esp_camera_fb_return(fb);
+		capture_errors++;
+		return -1;
+	}
+
+	hist_record(&camera_hist[CAM_HIST_FRAME_SIZE], fb->len);
+
+	f->buf = fb->buf;
+	f->len = fb->len;
+	f->seq = seq++;
+	f->timestamp_us = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+	f->priv = fb;
+
+	return 0;
+}
+
+static void camera_frame_put(void *ctx, struct frame *f)
+{
+	esp_camera_fb_return(f->priv);
+}
+
+static const struct frame_source camera_source = {
+	.get = camera_frame_get,
+	.put = camera_frame_put,
+};
+
+/*
+ * Capture task: the sensor runs continuously and every frame goes to the
+ * ring. HTTP handlers only take references to ring frames, so viewers
+ * share frames and never wait for a capture of their own.
+ */
+
+static struct frame_ring ring;
+
+static void capture_task(void *args)
+{
+	struct frame f;
+
+	while (1) {
+		if (camera_source.get(NULL, &f)) {
+			vTaskDelay(pdMS_TO_TICKS(100));
+			continue;
+		}
+
+		/* readers hold every slot: frame goes back to the driver */
+		if (ring_publish(&ring, &f))
+			camera_source.put(NULL, &f);
+
+		if (f.seq % 1000 == 999)
+			ESP_LOGI(TAG, "frames: %lu published, %lu dropped, %u referenced",
+				ring.stats.published, ring.stats.dropped, ring_refs(&ring));
 	}
+}
 
-	fb_len = fb->len;
+static esp_err_t camera_ring_init(void)
+{
+	if (ring_init(&ring, &camera_source, CONFIG_CAM_RING_DEPTH)) {
+		ESP_LOGE(TAG, "Failed to init frame ring");
+		return ESP_FAIL;
+	}
 
-	fd = fopen(filepath, "w");
-	if (!fd) {
-		ESP_LOGE(TAG, "Failed to create file : %s", filepath);
+	/* above httpd: frames are taken from the driver as soon as they are ready */
+	if (xTaskCreate(capture_task, "capture_task", 3072, NULL, tskIDLE_PRIORITY + 6, NULL) != pdPASS) {
+		ESP_LOGE(TAG, "Failed to start capture task");
 		return ESP_FAIL;
 	}
 
-	if (fb_len && (fb_len != fwrite(fb->buf, 1, fb_len, fd))) {
-		ESP_LOGE(TAG, "Failed to store picture to file");
-		/* delete broken file on failure */
-		fclose(fd);
-		unlink(filepath);
+	return ESP_OK;
+}
+
+/* stream of the newest ring frames, each one newer than the previous */
+void camera_stream_source(struct ring_reader *rd, struct frame_source *src)
+{
+	ring_reader_init(rd, &ring, CAMERA_FRAME_TIMEOUT_US, src);
+}
+
+/*
+ * Newest frame, return it with camera_release(). With the flash on, waits
+ * for a frame whose exposure started after the led was switched on: the
+ * one being captured at that moment is skipped.
+ */
+const struct frame *camera_snapshot(int flash)
+{
+	const struct frame *f;
+	int64_t start;
+	uint32_t seq;
+
+	if (!flash)
+		return ring_get(&ring, NULL, CAMERA_FRAME_TIMEOUT_US);
+
+	start = esp_timer_get_time();
+	gpio_set_level(CONFIG_FLASH_LED_PIN, 1);
+
+	f = ring_get(&ring, NULL, CAMERA_FRAME_TIMEOUT_US);
+	if (f) {
+		seq = f->seq + 1;
+		ring_put(&ring, f);
+		f = ring_get(&ring, &seq, 2 * CAMERA_FRAME_TIMEOUT_US);
+	}
+
+	gpio_set_level(CONFIG_FLASH_LED_PIN, 0);
+
+	if (!f)
+		ESP_LOGE(TAG, "No frame in %u ms", CAMERA_FRAME_TIMEOUT_US / 1000);
+	else
+		hist_record(&camera_hist[CAM_HIST_FLASH], esp_timer_get_time() - start);
+
+	return f;
+}
+
+void camera_release(const struct frame *f)
+{
+	ring_put(&ring, f);
+}
+
+/*
+ * Pictures are stored to flash by a background task: the frame is copied
+ * to PSRAM, so the frame buffer goes back to the driver right away and
+ * slow SPIFFS writes are out of the request path. One picture is queued
+ * at a time, newer ones are dropped while it is written.
+ */
+
+struct persist_job {
+	char path[64];
+	int64_t start;		/* request time, 0 - not a request of its own */
+	size_t len;
+	uint8_t data[];
+};
+
+static QueueHandle_t persist_queue;
+
+static void persist_task(void *args)
+{
+	struct persist_job *job;
+	int64_t start, done;
+	FILE *fd;
+
+	while (1) {
+		xQueuePeek(persist_queue, &job, portMAX_DELAY);
+
+		start = esp_timer_get_time();
+
+		fd = fopen(job->path, "w");
+		if (!fd) {
+			ESP_LOGE(TAG, "Failed to create file : %s", job->path);
+		} else if (job->len != fwrite(job->data, 1, job->len, fd)) {
+			ESP_LOGE(TAG, "Failed to store picture to file");
+			/* delete broken file on failure */
+			fclose(fd);
+			unlink(job->path);
+		} else {
+			fclose(fd);
+			done = esp_timer_get_time();
+
+			hist_record(&camera_hist[CAM_HIST_FILE_WRITE], done - start);
+			if (job->start)
+				hist_record(&camera_hist[CAM_HIST_END_TO_END], done - job->start);
+
+			ESP_LOGI(TAG, "JPEG stored to file: %lu KB %lu ms", (uint32_t)(job->len / 1024),
+				(uint32_t)((done - start) / 1000));
+		}
+
+		/* slot is free only now: queue holds one job, at most one picture in PSRAM */
+		xQueueReceive(persist_queue, &job, 0);
+		free(job);
+	}
+}
+
+static esp_err_t camera_persist_init(void)
+{
+	persist_queue = xQueueCreate(1, sizeof(struct persist_job *));
+	if (!persist_queue) {
+		ESP_LOGE(TAG, "Failed to create persist queue");
+		return ESP_ERR_NO_MEM;
+	}
+
+	if (xTaskCreate(persist_task, "persist_task", 3072, NULL, tskIDLE_PRIORITY, NULL) != pdPASS) {
+		ESP_LOGE(TAG, "Failed to start persist task");
 		return ESP_FAIL;
 	}
 
-	fclose(fd);
-	esp_camera_fb_return(fb);
+	return ESP_OK;
+}
+
+static esp_err_t persist_queue_job(const struct frame *f, const char *filepath, int64_t start)
+{
+	struct persist_job *job;
 
-	fr_end = esp_timer_get_time();
-	ESP_LOGI(TAG, "JPEG stored to file: %lu KB %lu ms",
-		(uint32_t)(fb_len / 1024), (uint32_t)((fr_end - fr_start) / 1000));
+	if (!uxQueueSpacesAvailable(persist_queue)) {
+		ESP_LOGW(TAG, "Previous picture is still being stored: dropped");
+		persist_dropped++;
+		return ESP_ERR_NO_MEM;
+	}
+
+	job = heap_caps_malloc(sizeof(*job) + f->len, MALLOC_CAP_SPIRAM);
+	if (!job) {
+		ESP_LOGE(TAG, "No PSRAM for %u bytes", f->len);
+		return ESP_ERR_NO_MEM;
+	}
+
+	strlcpy(job->path, filepath, sizeof(job->path));
+	job->start = start;
+	job->len = f->len;
+	memcpy(job->data, f->buf, f->len);
+
+	/* another caller took the slot after the check above */
+	if (xQueueSend(persist_queue, &job, 0) != pdTRUE) {
+		ESP_LOGW(TAG, "Previous picture is still being stored: dropped");
+		persist_dropped++;
+		free(job);
+		return ESP_ERR_NO_MEM;
+	}
 
 	return ESP_OK;
 }
+
+esp_err_t camera_persist(const struct frame *f, const char *filepath)
+{
+	return persist_queue_job(f, filepath, 0);
+}
+
+/* POST /shot: store a picture, writing to flash is done in the background */
+esp_err_t camera_capture(char *filepath)
+{
+	int64_t start = esp_timer_get_time();
+	const struct frame *f;
+	esp_err_t ret;
+
+	f = camera_snapshot(1);
+	if (!f)
+		return ESP_FAIL;
+
+	/* end to end: request until the picture is stored */
+	ret = persist_queue_job(f, filepath, start);
+	camera_release(f);
+
+	return ret;
+}
+
+/*
+ * Pipeline metrics: stage histograms, ring and persist counters, memory.
+ * Counters are read without locks, they are 32-bit and only ever grow.
+ */
+void camera_metrics(struct metrics_out *out)
+{
+	for (unsigned int i = 0; i < CAM_HIST_MAX; i++)
+		metrics_hist(out, &camera_hist[i]);
+
+	metrics_counter(out, "cam_frames_published_total", "Frames published to the ring", ring.stats.published);
+	metrics_counter(out, "cam_frames_evicted_total", "Ring frames replaced by newer ones", ring.stats.evicted);
+	metrics_counter(out, "cam_frames_dropped_total", "Frames dropped, viewers held every ring slot",
+			ring.stats.dropped);
+	metrics_counter(out, "cam_capture_errors_total", "Failed esp_camera_fb_get() calls", capture_errors);
+	metrics_counter(out, "cam_persist_dropped_total", "Pictures dropped while the previous one was stored",
+			persist_dropped);
+
+	metrics_gauge(out, "cam_ring_refs", "Ring frames referenced by readers", ring_refs(&ring));
+	metrics_gauge(out, "cam_psram_free_bytes", "Free PSRAM", heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+	metrics_gauge(out, "cam_psram_min_free_bytes", "Lowest free PSRAM since boot",
+		      heap_caps_get_minimum_free_size(MALLOC_CAP_SPIRAM));
+	metrics_gauge(out, "cam_psram_total_bytes", "PSRAM heap size", heap_caps_get_total_size(MALLOC_CAP_SPIRAM));
+	metrics_gauge(out, "cam_internal_free_bytes", "Free internal RAM",
+		      heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+}
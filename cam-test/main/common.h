@@ -1,7 +1,47 @@
 #include "esp_event.h"
 
+#include "stream.h"
+#include "ring.h"
+#include "metrics.h"
+
 void heartbeat_task(void *args);
 void http_task(void *args);
 
 esp_err_t camera_init(void);
 esp_err_t camera_capture(char *filepath);
+const struct frame *camera_snapshot(int flash);
+void camera_release(const struct frame *f);
+esp_err_t camera_persist(const struct frame *f, const char *filepath);
+void camera_stream_source(struct ring_reader *rd, struct frame_source *src);
+
+/* capture pipeline metrics, served at GET /metrics */
+
+enum {
+	CAM_HIST_FLASH,
+	CAM_HIST_FB_GET,
+	CAM_HIST_FILE_WRITE,
+	CAM_HIST_HTTP_SEND,
+	CAM_HIST_END_TO_END,
+	CAM_HIST_FRAME_SIZE,
+	CAM_HIST_MAX,
+};
+
+extern struct histogram camera_hist[CAM_HIST_MAX];
+
+void camera_metrics(struct metrics_out *out);
+
+struct detector_stats {
+	uint32_t frames;	/* analysed */
+	uint32_t active;	/* flagged blocks of the last frame */
+	int64_t time_us;	/* decode and analysis, all frames */
+	uint32_t events;
+	uint32_t last_seq;	/* first frame of the last event */
+	int64_t last_us;
+	uint32_t last_blocks;
+	unsigned int w;
+	unsigned int h;
+	unsigned int blocks;
+};
+
+esp_err_t detector_init(void);
+void detector_stats(struct detector_stats *st);
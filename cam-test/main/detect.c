@@ -0,0 +1,179 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "esp_camera.h"
+#include "esp_jpg_decode.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+
+#include "common.h"
+#include "motion.h"
+
+/*
+ * Motion detection task: takes the newest ring frame every
+ * CONFIG_CAM_MOTION_INTERVAL_MS and decodes it at 1/8 scale, which only
+ * needs DC coefficients: VGA gives 80x60 luma, each pixel the mean of an
+ * 8x8 pixel block. Luma goes to the frame difference kernels, an event
+ * starts when CONFIG_CAM_MOTION_MIN_BLOCKS blocks are flagged after a
+ * quiet frame.
+ */
+
+static const char *TAG = "mod:motion";
+
+struct luma_decode {
+	const struct frame *f;
+	uint8_t *luma;
+	unsigned int w;
+	unsigned int h;
+};
+
+static struct motion motion;
+static struct detector_stats stats;
+static port_mutex_t lock;
+
+static size_t jpg_read(void *arg, size_t index, uint8_t *buf, size_t len)
+{
+	struct luma_decode *d = arg;
+
+	/* no buffer: decoder skips input */
+	if (buf)
+		memcpy(buf, d->f->buf + index, len);
+
+	return len;
+}
+
+/* RGB888 block of the scaled picture, columns beyond whole motion blocks are cropped */
+static bool luma_write(void *arg, uint16_t x, uint16_t y, uint16_t w, uint16_t h, uint8_t *data)
+{
+	struct luma_decode *d = arg;
+
+	/* start and end of the picture */
+	if (!data)
+		return true;
+
+	for (unsigned int j = 0; j < h && y + j < d->h; j++) {
+		const uint8_t *p = data + 3 * j * w;
+		uint8_t *out = d->luma + (y + j) * d->w;
+
+		for (unsigned int i = 0; i < w && x + i < d->w; i++, p += 3)
+			out[x + i] = (77 * p[0] + 150 * p[1] + 29 * p[2]) >> 8;
+	}
+
+	return true;
+}
+
+static void motion_event(const struct frame *f, unsigned int active)
+{
+	ESP_LOGI(TAG, "motion: frame %lu, %u blocks", f->seq, active);
+
+#ifdef CONFIG_CAM_MOTION_CAPTURE
+	/* copy to PSRAM, the file is written in the background */
+	camera_persist(f, "/storage/motion.jpeg");
+#endif
+}
+
+static void detect_task(void *args)
+{
+	struct luma_decode *d = args;
+	struct frame_source src;
+	struct ring_reader rd;
+	unsigned int prev = 0;
+	struct frame f;
+
+	camera_stream_source(&rd, &src);
+
+	while (1) {
+		unsigned int active;
+		int64_t start;
+		int event;
+
+		vTaskDelay(pdMS_TO_TICKS(CONFIG_CAM_MOTION_INTERVAL_MS));
+
+		if (src.get(src.ctx, &f))
+			continue;
+
+		start = esp_timer_get_time();
+
+		d->f = &f;
+		if (esp_jpg_decode(f.len, JPG_SCALE_8X, jpg_read, luma_write, d) != ESP_OK) {
+			ESP_LOGE(TAG, "%s: failed to decode frame %lu", __func__, f.seq);
+			src.put(src.ctx, &f);
+			continue;
+		}
+
+		active = motion_update(&motion, d->luma);
+		event = active >= CONFIG_CAM_MOTION_MIN_BLOCKS && prev < CONFIG_CAM_MOTION_MIN_BLOCKS;
+		prev = active;
+
+		if (event)
+			motion_event(&f, active);
+
+		port_mutex_lock(&lock);
+		stats.frames++;
+		stats.active = active;
+		stats.time_us += esp_timer_get_time() - start;
+		if (event) {
+			stats.events++;
+			stats.last_seq = f.seq;
+			stats.last_us = f.timestamp_us;
+			stats.last_blocks = active;
+		}
+		port_mutex_unlock(&lock);
+
+		src.put(src.ctx, &f);
+	}
+}
+
+esp_err_t detector_init(void)
+{
+	static struct luma_decode d;
+	sensor_t *s = esp_camera_sensor_get();
+	framesize_t fs;
+
+	if (!s) {
+		ESP_LOGE(TAG, "%s: camera is not initialized", __func__);
+		return ESP_FAIL;
+	}
+
+	/* 1/8 scale, cropped to whole blocks */
+	fs = s->status.framesize;
+	d.w = resolution[fs].width / 8 / MOTION_BLOCK * MOTION_BLOCK;
+	d.h = resolution[fs].height / 8;
+
+	if (motion_init(&motion, d.w, d.h, CONFIG_CAM_MOTION_LEARN_SHIFT, CONFIG_CAM_MOTION_THRESHOLD)) {
+		ESP_LOGE(TAG, "%s: frame %ux%u is not supported", __func__, d.w, d.h);
+		return ESP_FAIL;
+	}
+
+	d.luma = malloc(d.w * d.h);
+	if (!d.luma || port_mutex_init(&lock)) {
+		ESP_LOGE(TAG, "%s: no memory for %ux%u luma", __func__, d.w, d.h);
+		motion_deinit(&motion);
+		free(d.luma);
+		return ESP_ERR_NO_MEM;
+	}
+
+	stats.w = d.w;
+	stats.h = d.h;
+	stats.blocks = motion.cols * motion.rows;
+
+	/* below the capture task and httpd: analysis takes whatever time is left */
+	if (xTaskCreate(detect_task, "detect_task", 4096, &d, tskIDLE_PRIORITY + 2, NULL) != pdPASS) {
+		ESP_LOGE(TAG, "Failed to start motion detection task");
+		return ESP_FAIL;
+	}
+
+	ESP_LOGI(TAG, "%s: %ux%u luma, %u blocks", __func__, d.w, d.h, stats.blocks);
+
+	return ESP_OK;
+}
+
+void detector_stats(struct detector_stats *st)
+{
+	port_mutex_lock(&lock);
+	*st = stats;
+	port_mutex_unlock(&lock);
+}
@@ -1,3 +1,5 @@
+#include <stdatomic.h>
+
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
@@ -15,20 +17,21 @@
 #include "common.h"
 
 #define FILE_PATH_MAX (ESP_VFS_PATH_MAX + CONFIG_SPIFFS_OBJ_NAME_LEN)
-#define HTTP_RESP_SIZE 65536
+#define FILE_CHUNK_SIZE 4096
 
 static const char* base_path = "/storage";
 static const char *TAG = "mod:http";
 
 static httpd_handle_t server = NULL;
-static char resp[HTTP_RESP_SIZE];
+static char chunk[FILE_CHUNK_SIZE];
 
 static esp_err_t http_404_error_handler(httpd_req_t *req, httpd_err_code_t err)
 {
-	memset(resp, 0, sizeof(resp));
-	snprintf(resp, HTTP_RESP_SIZE, "URI %s is not available", req->uri);
+	char msg[64 + CONFIG_HTTPD_MAX_URI_LEN];
+
+	snprintf(msg, sizeof(msg), "URI %s is not available", req->uri);
 
-	httpd_resp_send_err(req, err, resp);
+	httpd_resp_send_err(req, err, msg);
 	return ESP_FAIL;
 }
 
@@ -64,6 +67,220 @@ done:
 	return ESP_OK;
 }
  
+static int http_chunk_send(void *ctx, const void *buf, size_t len)
+{
+	return (httpd_resp_send_chunk(ctx, buf, len) == ESP_OK) ? 0 : -1;
+}
+
+/* fresh frame sent from the frame buffer, no flash round trip */
+static esp_err_t capture_get_handler(httpd_req_t *req)
+{
+	struct stream_sink sink = { .ctx = req, .send = http_chunk_send };
+	int64_t start = esp_timer_get_time();
+	const struct frame *f;
+	int64_t grab, sent;
+	uint32_t len;
+	int ret;
+
+	ESP_LOGI(TAG, "%s: requested uri '%s'", __func__, req->uri);
+
+	/* newest frame of the capture task, shared with other viewers */
+	f = camera_snapshot(0);
+	if (!f)
+		return http_404_error_handler(req, HTTPD_500_INTERNAL_SERVER_ERROR);
+
+	grab = esp_timer_get_time();
+
+	httpd_resp_set_type(req, "image/jpeg");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+	httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+
+	ret = frame_send(&sink, f, CONFIG_CAM_SEND_CHUNK_SIZE);
+	len = f->len;
+
+	sent = esp_timer_get_time();
+	if (!ret)
+		hist_record(&camera_hist[CAM_HIST_HTTP_SEND], sent - grab);
+
+#ifdef CONFIG_CAM_CAPTURE_PERSIST
+	/* copy to PSRAM, the file is written in the background */
+	if (!ret) {
+		char filepath[FILE_PATH_MAX];
+
+		strcpy(filepath, base_path);
+		strlcat(filepath, "/shot.jpeg", sizeof(filepath));
+		camera_persist(f, filepath);
+	}
+#endif
+
+	camera_release(f);
+
+	if (ret || httpd_resp_send_chunk(req, NULL, 0) != ESP_OK) {
+		ESP_LOGE(TAG, "%s: failed to send frame", __func__);
+		return ESP_FAIL;
+	}
+
+	hist_record(&camera_hist[CAM_HIST_END_TO_END], esp_timer_get_time() - start);
+
+	ESP_LOGI(TAG, "%s: %lu KB, wait %lu ms, send %lu ms, total %lu ms", __func__, len / 1024,
+			(uint32_t)((grab - start) / 1000), (uint32_t)((sent - grab) / 1000),
+			(uint32_t)((esp_timer_get_time() - start) / 1000));
+
+	return ESP_OK;
+}
+
+#ifdef CONFIG_CAM_MOTION
+/* motion detector state as JSON, poll it for new events */
+static esp_err_t motion_get_handler(httpd_req_t *req)
+{
+	struct detector_stats st;
+	char msg[320];
+
+	detector_stats(&st);
+
+	snprintf(msg, sizeof(msg),
+		 "{\"luma\": \"%ux%u\", \"blocks\": %u, \"frames\": %lu, \"active_blocks\": %lu, "
+		 "\"avg_frame_us\": %lu, \"events\": %lu, \"last_event\": {\"seq\": %lu, "
+		 "\"timestamp_us\": %lld, \"blocks\": %lu}}\n",
+		 st.w, st.h, st.blocks, st.frames, st.active,
+		 (uint32_t)(st.frames ? st.time_us / st.frames : 0), st.events, st.last_seq,
+		 st.last_us, st.last_blocks);
+
+	httpd_resp_set_type(req, "application/json");
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+	return httpd_resp_sendstr(req, msg);
+}
+#endif
+
+/*
+ * Each viewer is served by its own task from an async copy of the request,
+ * so the server keeps accepting requests and viewers share ring frames.
+ * The copy refers to server state: viewers end their streams before the
+ * server is stopped.
+ */
+
+#define VIEWERS_STOP_TIMEOUT_US (10 * 1000000)
+
+static atomic_int viewers;
+static atomic_int viewers_stop;
+static atomic_uint viewer_skipped;
+
+/* frame source recording how long each frame is held, i.e. sent as a stream part */
+
+struct timed_source {
+	const struct frame_source *src;
+	int64_t start;
+};
+
+static int timed_get(void *ctx, struct frame *f)
+{
+	struct timed_source *ts = ctx;
+	int ret;
+
+	/* server is being stopped: end of the stream */
+	if (atomic_load(&viewers_stop))
+		return -1;
+
+	ret = ts->src->get(ts->src->ctx, f);
+	ts->start = esp_timer_get_time();
+
+	return ret;
+}
+
+static void timed_put(void *ctx, struct frame *f)
+{
+	struct timed_source *ts = ctx;
+
+	hist_record(&camera_hist[CAM_HIST_HTTP_SEND], esp_timer_get_time() - ts->start);
+	ts->src->put(ts->src->ctx, f);
+}
+
+static void viewer_task(void *args)
+{
+	httpd_req_t *req = args;
+	struct stream_sink sink = { .ctx = req, .send = http_chunk_send };
+	struct frame_source src, timed;
+	struct stream_stats stats;
+	struct timed_source ts;
+	struct ring_reader rd;
+
+	camera_stream_source(&rd, &src);
+
+	ts.src = &src;
+	timed.ctx = &ts;
+	timed.get = timed_get;
+	timed.put = timed_put;
+
+	mjpeg_stream(&timed, &sink, CONFIG_CAM_STREAM_FPS_MAX, 0, &stats);
+	atomic_fetch_add(&viewer_skipped, rd.skipped);
+
+	ESP_LOGI(TAG, "%s: stream closed: %lu frames, %lu skipped, %lu KB, %lu ms", __func__,
+			stats.frames, rd.skipped, (uint32_t)(stats.bytes / 1024),
+			(uint32_t)(stats.elapsed_us / 1000));
+
+	httpd_req_async_handler_complete(req);
+	atomic_fetch_sub(&viewers, 1);
+	vTaskDelete(NULL);
+}
+
+static esp_err_t stream_get_handler(httpd_req_t *req)
+{
+	httpd_req_t *copy;
+
+	ESP_LOGI(TAG, "%s: requested uri '%s'", __func__, req->uri);
+
+	/* counted before the stop check: server stop waits for this one or it backs out */
+	if (atomic_fetch_add(&viewers, 1) >= CONFIG_CAM_STREAM_MAX_VIEWERS || atomic_load(&viewers_stop)) {
+		atomic_fetch_sub(&viewers, 1);
+		httpd_resp_set_status(req, "503 Service Unavailable");
+		httpd_resp_sendstr(req, "Too many viewers");
+		return ESP_OK;
+	}
+
+	if (httpd_req_async_handler_begin(req, &copy) != ESP_OK) {
+		atomic_fetch_sub(&viewers, 1);
+		return http_404_error_handler(req, HTTPD_500_INTERNAL_SERVER_ERROR);
+	}
+
+	httpd_resp_set_type(copy, MJPEG_CONTENT_TYPE);
+	httpd_resp_set_hdr(copy, "Cache-Control", "no-cache");
+
+	if (xTaskCreate(viewer_task, "viewer_task", 4096, copy, tskIDLE_PRIORITY + 4, NULL) != pdPASS) {
+		ESP_LOGE(TAG, "%s: failed to start viewer task", __func__);
+		httpd_req_async_handler_complete(copy);
+		atomic_fetch_sub(&viewers, 1);
+		return ESP_FAIL;
+	}
+
+	return ESP_OK;
+}
+
+/* Prometheus text format: per stage latency histograms, frame counters, memory */
+static esp_err_t metrics_get_handler(httpd_req_t *req)
+{
+	struct stream_sink sink = { .ctx = req, .send = http_chunk_send };
+	static struct metrics_out out;
+
+	httpd_resp_set_type(req, METRICS_CONTENT_TYPE);
+	httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+
+	/* static: off the httpd stack, handlers run one at a time in the httpd task */
+	metrics_begin(&out, &sink);
+
+	camera_metrics(&out);
+
+	metrics_gauge(&out, "cam_stream_viewers", "Open GET /stream responses", atomic_load(&viewers));
+	metrics_counter(&out, "cam_stream_skipped_total", "Frames skipped by closed stream viewers, slow clients",
+			atomic_load(&viewer_skipped));
+
+	if (metrics_end(&out) || httpd_resp_send_chunk(req, NULL, 0) != ESP_OK) {
+		ESP_LOGE(TAG, "%s: failed to send metrics", __func__);
+		return ESP_FAIL;
+	}
+
+	return ESP_OK;
+}
+
 static esp_err_t main_get_handler(httpd_req_t *req)
 {
 	char filepath[FILE_PATH_MAX];
@@ -92,17 +309,23 @@ static esp_err_t main_get_handler(httpd_req_t *req)
 		return http_404_error_handler(req, HTTPD_500_INTERNAL_SERVER_ERROR);
 	}
 
-	memset(resp, 0, sizeof(resp));
-	size = fread(resp, 1, sizeof(resp), fd);
-	fclose(fd);
-
 	if (strcmp(req->uri, "/shot.jpeg") == 0) {
 		httpd_resp_set_type(req, "image/jpeg");
 	} else {
 		httpd_resp_set_type(req, "text/html");
 	}
 
-	httpd_resp_send(req, resp, size);
+	/* any file size: sent in chunks */
+	while ((size = fread(chunk, 1, sizeof(chunk), fd)) > 0) {
+		if (httpd_resp_send_chunk(req, chunk, size) != ESP_OK) {
+			ESP_LOGE(TAG, "Failed to send file: %s", filepath);
+			fclose(fd);
+			return ESP_FAIL;
+		}
+	}
+
+	fclose(fd);
+	httpd_resp_send_chunk(req, NULL, 0);
 
 	return ESP_OK;
 }
@@ -113,6 +336,32 @@ static const httpd_uri_t main = {
 	.handler   = main_get_handler,
 };
 
+static const httpd_uri_t capture = {
+	.uri       = "/capture.jpg",
+	.method    = HTTP_GET,
+	.handler   = capture_get_handler,
+};
+
+static const httpd_uri_t stream = {
+	.uri       = "/stream",
+	.method    = HTTP_GET,
+	.handler   = stream_get_handler,
+};
+
+#ifdef CONFIG_CAM_MOTION
+static const httpd_uri_t motion = {
+	.uri       = "/motion",
+	.method    = HTTP_GET,
+	.handler   = motion_get_handler,
+};
+#endif
+
+static const httpd_uri_t metrics = {
+	.uri       = "/metrics",
+	.method    = HTTP_GET,
+	.handler   = metrics_get_handler,
+};
+
 static const httpd_uri_t shot = {
 	.uri       = "/shot",
 	.method    = HTTP_POST,
@@ -130,6 +379,13 @@ static httpd_handle_t start_http_server(void)
 	ESP_LOGI(TAG, "%s: starting http server on port: '%d'", __func__, cfg.server_port);
 
 	if (httpd_start(&srv, &cfg) == ESP_OK) {
+		/* handlers are matched in order: specific uris before the wildcard */
+		httpd_register_uri_handler(srv, &capture);
+		httpd_register_uri_handler(srv, &stream);
+		httpd_register_uri_handler(srv, &metrics);
+#ifdef CONFIG_CAM_MOTION
+		httpd_register_uri_handler(srv, &motion);
+#endif
 		httpd_register_uri_handler(srv, &main);
 		httpd_register_uri_handler(srv, &shot);
 		httpd_register_err_handler(srv, HTTPD_404_NOT_FOUND, http_404_error_handler);
@@ -138,9 +394,28 @@ static httpd_handle_t start_http_server(void)
 	return srv;
 }
 
+/* open streams end at their next frame, a stuck client send times out */
 static esp_err_t stop_http_server(httpd_handle_t srv)
 {
-	return httpd_stop(srv);
+	int64_t start = esp_timer_get_time();
+	esp_err_t ret;
+
+	atomic_store(&viewers_stop, 1);
+
+	while (atomic_load(&viewers)) {
+		if (esp_timer_get_time() - start > VIEWERS_STOP_TIMEOUT_US) {
+			ESP_LOGE(TAG, "%s: %d viewers are still open", __func__, atomic_load(&viewers));
+			atomic_store(&viewers_stop, 0);
+			return ESP_ERR_TIMEOUT;
+		}
+
+		vTaskDelay(pdMS_TO_TICKS(10));
+	}
+
+	ret = httpd_stop(srv);
+	atomic_store(&viewers_stop, 0);
+
+	return ret;
 }
 
 static void connect_handler(void *arg, esp_event_base_t event_base,
@@ -150,6 +425,10 @@ static void connect_handler(void *arg, esp_event_base_t event_base,
 
 	ESP_LOGI(TAG, "STA got ipaddr:" IPSTR, IP2STR(&event->ip_info.ip));
 
+	/* failed to stop on disconnect: keeps serving */
+	if (server)
+		return;
+
 	server = start_http_server();
 	if (!server)
 		ESP_LOGE(TAG, "Error starting server!");
@@ -85,6 +85,10 @@ void app_main(void)
 
 	camera_init();
 
+#ifdef CONFIG_CAM_MOTION
+	detector_init();
+#endif
+
 	/* init wifi */ 
 
 	ESP_ERROR_CHECK(esp_netif_init());
@@ -0,0 +1,128 @@
+/*
+ * Pipeline metrics: log bucketed histograms and Prometheus text export.
+ *
+ * Bucket of a value is its rounded up log2, so recording costs a count
+ * leading zeros and two relaxed atomic adds, and a histogram takes the
+ * same memory whatever the number of samples. Export sums the buckets
+ * into cumulative counts, total count is their sum, so +Inf bucket and
+ * count always agree even while other tasks record.
+ */
+
+#include <stdarg.h>
+#include <inttypes.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "metrics.h"
+
+static inline unsigned int hist_bucket(const struct histogram *h, uint32_t v)
+{
+	/* ceil(log2(v)) */
+	unsigned int bits = v > 1 ? 32 - __builtin_clz(v - 1) : 0;
+
+	if (bits <= h->shift)
+		return 0;
+
+	bits -= h->shift;
+
+	return bits < HIST_BUCKETS ? bits : HIST_BUCKETS;
+}
+
+void hist_record(struct histogram *h, uint32_t v)
+{
+	atomic_fetch_add_explicit(&h->buckets[hist_bucket(h, v)], 1, memory_order_relaxed);
+	atomic_fetch_add_explicit(&h->sum, v, memory_order_relaxed);
+}
+
+uint32_t hist_count(const struct histogram *h)
+{
+	uint32_t count = 0;
+
+	for (unsigned int i = 0; i <= HIST_BUCKETS; i++)
+		count += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+
+	return count;
+}
+
+static void metrics_flush(struct metrics_out *out)
+{
+	if (out->len && !out->err && out->sink->send(out->sink->ctx, out->buf, out->len))
+		out->err = -1;
+
+	out->len = 0;
+}
+
+/* one line at most METRICS_BUF_SIZE long */
+static void metrics_printf(struct metrics_out *out, const char *fmt, ...)
+{
+	va_list ap;
+	int n;
+
+	for (int retry = 0; retry < 2; retry++) {
+		va_start(ap, fmt);
+		n = vsnprintf(out->buf + out->len, sizeof(out->buf) - out->len, fmt, ap);
+		va_end(ap);
+
+		if (n >= 0 && (size_t)n < sizeof(out->buf) - out->len) {
+			out->len += n;
+			return;
+		}
+
+		/* does not fit: send what is buffered and format again */
+		metrics_flush(out);
+	}
+
+	out->err = -1;
+}
+
+static void metrics_header(struct metrics_out *out, const char *name, const char *help, const char *type)
+{
+	metrics_printf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void metrics_begin(struct metrics_out *out, const struct stream_sink *sink)
+{
+	out->sink = sink;
+	out->len = 0;
+	out->err = 0;
+}
+
+void metrics_hist(struct metrics_out *out, const struct histogram *h)
+{
+	uint64_t count = 0;
+
+	metrics_header(out, h->name, h->help, "histogram");
+
+	for (unsigned int i = 0; i < HIST_BUCKETS; i++) {
+		count += atomic_load_explicit(&h->buckets[i], memory_order_relaxed);
+		metrics_printf(out, "%s_bucket{le=\"%.15g\"} %" PRIu64 "\n", h->name,
+			       (double)(1ULL << (h->shift + i)) * h->scale, count);
+	}
+
+	count += atomic_load_explicit(&h->buckets[HIST_BUCKETS], memory_order_relaxed);
+
+	metrics_printf(out, "%s_bucket{le=\"+Inf\"} %" PRIu64 "\n", h->name, count);
+	metrics_printf(out, "%s_sum %.15g\n", h->name,
+		       (double)atomic_load_explicit(&h->sum, memory_order_relaxed) * h->scale);
+	metrics_printf(out, "%s_count %" PRIu64 "\n", h->name, count);
+}
+
+void metrics_counter(struct metrics_out *out, const char *name, const char *help, uint64_t v)
+{
+	metrics_header(out, name, help, "counter");
+	metrics_printf(out, "%s %" PRIu64 "\n", name, v);
+}
+
+void metrics_gauge(struct metrics_out *out, const char *name, const char *help, double v)
+{
+	metrics_header(out, name, help, "gauge");
+	metrics_printf(out, "%s %.15g\n", name, v);
+}
+
+/* sends the rest of the buffer: returns 0 when all of the text is sent */
+int metrics_end(struct metrics_out *out)
+{
+	metrics_flush(out);
+
+	return out->err;
+}
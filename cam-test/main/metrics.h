@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stream.h"
+
+/*
+ * Fixed memory histograms with power of two buckets: bucket i counts
+ * values up to 2^(shift + i), the last one all values above. Recording is
+ * lock free and can be done from any task.
+ */
+
+#define HIST_BUCKETS 24
+
+struct histogram {
+	const char *name;
+	const char *help;
+	unsigned int shift;
+	double scale;		/* exported unit per recorded unit, e.g. 1e-6 for us to seconds */
+	atomic_uint buckets[HIST_BUCKETS + 1];
+	atomic_ullong sum;
+};
+
+#define HISTOGRAM(n, h, s, sc) { .name = (n), .help = (h), .shift = (s), .scale = (sc) }
+
+void hist_record(struct histogram *h, uint32_t v);
+uint32_t hist_count(const struct histogram *h);
+
+/* Prometheus text format: lines are buffered and sent through the sink when the buffer fills up */
+
+#define METRICS_BUF_SIZE 1024
+
+struct metrics_out {
+	const struct stream_sink *sink;
+	size_t len;
+	int err;
+	char buf[METRICS_BUF_SIZE];
+};
+
+void metrics_begin(struct metrics_out *out, const struct stream_sink *sink);
+void metrics_hist(struct metrics_out *out, const struct histogram *h);
+void metrics_counter(struct metrics_out *out, const char *name, const char *help, uint64_t v);
+void metrics_gauge(struct metrics_out *out, const char *name, const char *help, double v);
+int metrics_end(struct metrics_out *out);
+
+#define METRICS_CONTENT_TYPE "text/plain; version=0.0.4"
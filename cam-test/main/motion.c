@@ -0,0 +1,206 @@
+/*
+ * Frame difference motion detection kernels
+ *
+ * Kernels work a 32-bit word (four luma pixels) at a time with the bytes
+ * split into two words of 16-bit lanes, even and odd pixels, so sums and
+ * differences never carry into the neighbour lane. Rows of odd width and
+ * stride start anywhere, hence memcpy word loads, and the even/odd split
+ * takes pixel 0 from the low byte.
+ *
+ * Background is kept in 8.8 fixed point in the same lane layout: word 2i
+ * holds pixels 4i and 4i+2, word 2i+1 pixels 4i+1 and 4i+3. Each update
+ * moves it by 1/2^shift towards the frame with shifts and adds only:
+ * bg - bg/2^shift + (luma << 8)/2^shift, lanes stay within 0..0xff00.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "motion.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "motion kernels assume little endian byte order"
+#endif
+
+#define EVEN 0x00ff00ffu
+
+static inline uint32_t load32(const void *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void store32(void *p, uint32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+/* |a - b| of 16-bit lanes holding bytes: 256 + a - b has bit 8 clear where b > a */
+static inline uint32_t absdiff_lanes(uint32_t a, uint32_t b)
+{
+	uint32_t d = (a | 0x01000100) - b;
+	uint32_t neg = ~d >> 8 & 0x00010001;
+
+	return ((d & EVEN) ^ (neg * 0xff)) + neg;
+}
+
+int motion_init(struct motion *m, unsigned int w, unsigned int h, unsigned int shift, unsigned int threshold)
+{
+	memset(m, 0, sizeof(*m));
+
+	if (!w || w % MOTION_BLOCK || h < MOTION_BLOCK || shift > 8 ||
+	    (w / MOTION_BLOCK) * (h / MOTION_BLOCK) > MOTION_MAX_BLOCKS)
+		return -1;
+
+	m->w = w;
+	m->h = h;
+	m->cols = w / MOTION_BLOCK;
+	m->rows = h / MOTION_BLOCK;
+	m->shift = shift;
+	m->threshold = threshold;
+
+	m->bg = malloc(w * h / 2 * sizeof(*m->bg));
+	m->sad = malloc(m->cols * m->rows * sizeof(*m->sad));
+	m->flags = malloc(m->cols * m->rows);
+
+	if (!m->bg || !m->sad || !m->flags) {
+		motion_deinit(m);
+		return -1;
+	}
+
+	return 0;
+}
+
+void motion_deinit(struct motion *m)
+{
+	free(m->bg);
+	free(m->sad);
+	free(m->flags);
+	m->bg = NULL;
+	m->sad = NULL;
+	m->flags = NULL;
+}
+
+/* first frame is the background */
+static void motion_prime(struct motion *m, const uint8_t *luma)
+{
+	for (size_t i = 0; i < (size_t)m->w * m->h / 4; i++) {
+		uint32_t c = load32(luma + 4 * i);
+
+		m->bg[2 * i] = (c & EVEN) << 8;
+		m->bg[2 * i + 1] = c & ~EVEN;
+	}
+}
+
+/*
+ * One pass over the frame: difference to the background, per block sums
+ * and background update. Rows below the last full block row only update
+ * the background. Returns the number of flagged blocks.
+ */
+unsigned int motion_update(struct motion *m, const uint8_t *luma)
+{
+	const uint32_t keep = 0xffffu >> m->shift;
+	const uint32_t limit = m->threshold * MOTION_BLOCK * MOTION_BLOCK;
+	const unsigned int s = m->shift;
+	const unsigned int words = m->w / 4;
+
+	if (!m->primed) {
+		motion_prime(m, luma);
+		m->primed = 1;
+		memset(m->sad, 0, m->cols * m->rows * sizeof(*m->sad));
+		memset(m->flags, 0, m->cols * m->rows);
+		m->active = 0;
+		return 0;
+	}
+
+	memset(m->sad, 0, m->cols * m->rows * sizeof(*m->sad));
+
+	for (unsigned int y = 0; y < m->h; y++) {
+		const uint8_t *row = luma + (size_t)y * m->w;
+		uint32_t *bg = m->bg + (size_t)y * m->w / 2;
+		uint32_t *sad = m->sad + (y / MOTION_BLOCK) * m->cols;
+		int counted = y / MOTION_BLOCK < m->rows;
+
+		for (unsigned int x = 0; x < words; x += MOTION_BLOCK / 4) {
+			uint32_t acc = 0;
+
+			for (unsigned int k = x; k < x + MOTION_BLOCK / 4; k++) {
+				uint32_t c = load32(row + 4 * k);
+				uint32_t ce = c & EVEN, co = c >> 8 & EVEN;
+				uint32_t be = bg[2 * k], bo = bg[2 * k + 1];
+
+				/* 8 pixels of a block row in two lanes: at most 4 * 255 each */
+				acc += absdiff_lanes(ce, be >> 8 & EVEN) + absdiff_lanes(co, bo >> 8 & EVEN);
+
+				bg[2 * k] = be - (be >> s & (keep * 0x00010001)) + ((ce << 8) >> s & (keep * 0x00010001));
+				bg[2 * k + 1] = bo - (bo >> s & (keep * 0x00010001)) +
+					((co << 8) >> s & (keep * 0x00010001));
+			}
+
+			if (counted)
+				sad[x / (MOTION_BLOCK / 4)] += (acc & 0xffff) + (acc >> 16);
+		}
+	}
+
+	m->active = 0;
+	for (unsigned int b = 0; b < m->cols * m->rows; b++) {
+		m->flags[b] = m->sad[b] > limit;
+		m->active += m->flags[b];
+	}
+
+	return m->active;
+}
+
+/* 2x2 box filter, rounded: rows are summed in 16-bit lanes, 8 pixels -> 4 */
+void motion_decimate_gray(uint8_t *dst, const uint8_t *src, unsigned int w, unsigned int h, size_t stride)
+{
+	for (unsigned int y = 0; y + 1 < h; y += 2) {
+		const uint8_t *r0 = src + y * stride;
+		const uint8_t *r1 = r0 + stride;
+		uint8_t *out = dst + (y / 2) * (w / 2);
+		unsigned int x;
+
+		for (x = 0; x + 8 <= w; x += 8) {
+			uint32_t a0 = load32(r0 + x), b0 = load32(r1 + x);
+			uint32_t a1 = load32(r0 + x + 4), b1 = load32(r1 + x + 4);
+			uint32_t s0 = (a0 & EVEN) + (a0 >> 8 & EVEN) + (b0 & EVEN) + (b0 >> 8 & EVEN) + 0x00020002;
+			uint32_t s1 = (a1 & EVEN) + (a1 >> 8 & EVEN) + (b1 & EVEN) + (b1 >> 8 & EVEN) + 0x00020002;
+
+			/* lanes are sums of 4: divide by 4 and pack two lanes of each word */
+			s0 = s0 >> 2 & EVEN;
+			s1 = s1 >> 2 & EVEN;
+			store32(out + x / 2, (s0 & 0xff) | (s0 >> 8 & 0xff00) | (s1 & 0xff) << 16 | (s1 >> 8 & 0xff00) << 16);
+		}
+
+		for (; x + 1 < w; x += 2)
+			out[x / 2] = (r0[x] + r0[x + 1] + r1[x] + r1[x + 1] + 2) >> 2;
+	}
+}
+
+/* YUYV: even bytes are luma, a word is two luma pixels: 2x2 luma -> 1 */
+void motion_decimate_yuyv(uint8_t *dst, const uint8_t *src, unsigned int w, unsigned int h, size_t stride)
+{
+	for (unsigned int y = 0; y + 1 < h; y += 2) {
+		const uint8_t *r0 = src + y * stride;
+		const uint8_t *r1 = r0 + stride;
+		uint8_t *out = dst + (y / 2) * (w / 2);
+		unsigned int x;
+
+		for (x = 0; x + 8 <= w; x += 8) {
+			uint32_t s[4];
+
+			for (int k = 0; k < 4; k++) {
+				uint32_t v = (load32(r0 + 2 * x + 4 * k) & EVEN) + (load32(r1 + 2 * x + 4 * k) & EVEN);
+
+				s[k] = ((v & 0xffff) + (v >> 16) + 2) >> 2;
+			}
+
+			store32(out + x / 2, s[0] | s[1] << 8 | s[2] << 16 | s[3] << 24);
+		}
+
+		for (; x + 1 < w; x += 2)
+			out[x / 2] = (r0[2 * x] + r0[2 * x + 2] + r1[2 * x] + r1[2 * x + 2] + 2) >> 2;
+	}
+}
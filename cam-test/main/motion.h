@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Motion detector on downscaled 8-bit luma: running background in 8.8
+ * fixed point, blocks of MOTION_BLOCK x MOTION_BLOCK pixels are flagged
+ * when their mean absolute difference to the background exceeds the
+ * threshold. Width is a multiple of MOTION_BLOCK.
+ */
+
+#define MOTION_BLOCK		8
+#define MOTION_MAX_BLOCKS	1200	/* 320x240 luma */
+
+struct motion {
+	unsigned int w;
+	unsigned int h;
+	unsigned int cols;	/* blocks */
+	unsigned int rows;
+	unsigned int shift;	/* background follows the frame by 1/2^shift per update */
+	unsigned int threshold;	/* mean absolute difference per pixel */
+	int primed;
+	uint32_t *bg;		/* two 8.8 pixels per word, see motion.c */
+	uint32_t *sad;		/* per block, of the last update */
+	uint8_t *flags;		/* per block, of the last update */
+	unsigned int active;	/* flagged blocks of the last update */
+};
+
+int motion_init(struct motion *m, unsigned int w, unsigned int h, unsigned int shift, unsigned int threshold);
+void motion_deinit(struct motion *m);
+unsigned int motion_update(struct motion *m, const uint8_t *luma);
+
+/*
+ * luma downscaling by 2 in both directions: 8-bit grayscale, and YUYV (YUV422)
+ *
+ * Host tests only: on the device luma comes from the JPEG decoder at 1/8
+ * scale (detect.c), these run recorded raw frames through the detector.
+ */
+
+void motion_decimate_gray(uint8_t *dst, const uint8_t *src, unsigned int w, unsigned int h, size_t stride);
+void motion_decimate_yuyv(uint8_t *dst, const uint8_t *src, unsigned int w, unsigned int h, size_t stride);
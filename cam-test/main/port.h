@@ -0,0 +1,202 @@
+/*
+ * Minimal platform shim, so that streaming code builds both for ESP32 and
+ * for the Linux host tests:
+ * - ESP32: esp_timer, FreeRTOS delays, mutexes and task notifications
+ * - Linux host: clock_gettime, nanosleep and pthreads
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+static inline int64_t port_time_us(void)
+{
+	return esp_timer_get_time();
+}
+
+/* tick granularity: rounded up, at least one tick */
+static inline void port_sleep_us(int64_t us)
+{
+	TickType_t ticks = pdMS_TO_TICKS((us + 999) / 1000);
+
+	vTaskDelay(ticks ? ticks : 1);
+}
+
+typedef SemaphoreHandle_t port_mutex_t;
+
+static inline int port_mutex_init(port_mutex_t *m)
+{
+	*m = xSemaphoreCreateMutex();
+	return *m ? 0 : -1;
+}
+
+static inline void port_mutex_lock(port_mutex_t *m)
+{
+	xSemaphoreTake(*m, portMAX_DELAY);
+}
+
+static inline void port_mutex_unlock(port_mutex_t *m)
+{
+	xSemaphoreGive(*m);
+}
+
+static inline void port_mutex_destroy(port_mutex_t *m)
+{
+	vSemaphoreDelete(*m);
+}
+
+/*
+ * Broadcast wakeup: each waiter puts itself on a list under the mutex and
+ * sleeps on its task notification, broadcast notifies the tasks on the
+ * list. Notification is latched, so a broadcast between the unlock and
+ * the wait is not lost. Broadcast must be called with the mutex held, and
+ * the notification of a waiting task is not used for anything else. A late
+ * notification after a timeout makes the next wait return early, so
+ * waiters re-check their condition in a loop.
+ */
+struct port_cond_waiter {
+	TaskHandle_t task;
+	struct port_cond_waiter *next;
+};
+
+typedef struct {
+	struct port_cond_waiter *waiters;
+} port_cond_t;
+
+static inline int port_cond_init(port_cond_t *c)
+{
+	c->waiters = NULL;
+	return 0;
+}
+
+static inline void port_cond_wait(port_cond_t *c, port_mutex_t *m, int64_t timeout_us)
+{
+	TickType_t ticks = pdMS_TO_TICKS((timeout_us + 999) / 1000);
+	struct port_cond_waiter w = {
+		.task = xTaskGetCurrentTaskHandle(),
+		.next = c->waiters,
+	};
+
+	c->waiters = &w;
+
+	port_mutex_unlock(m);
+	ulTaskNotifyTake(pdTRUE, ticks ? ticks : 1);
+	port_mutex_lock(m);
+
+	/* timed out: still on the list */
+	for (struct port_cond_waiter **p = &c->waiters; *p; p = &(*p)->next) {
+		if (*p == &w) {
+			*p = w.next;
+			break;
+		}
+	}
+}
+
+static inline void port_cond_broadcast(port_cond_t *c)
+{
+	struct port_cond_waiter *w = c->waiters;
+
+	c->waiters = NULL;
+
+	while (w) {
+		struct port_cond_waiter *next = w->next;
+
+		xTaskNotifyGive(w->task);
+		w = next;
+	}
+}
+
+static inline void port_cond_destroy(port_cond_t *c)
+{
+	c->waiters = NULL;
+}
+
+#else
+
+#include <pthread.h>
+#include <time.h>
+
+static inline int64_t port_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static inline void port_sleep_us(int64_t us)
+{
+	struct timespec ts = {
+		.tv_sec = us / 1000000,
+		.tv_nsec = (us % 1000000) * 1000,
+	};
+
+	nanosleep(&ts, NULL);
+}
+
+typedef pthread_mutex_t port_mutex_t;
+
+static inline int port_mutex_init(port_mutex_t *m)
+{
+	return pthread_mutex_init(m, NULL);
+}
+
+static inline void port_mutex_lock(port_mutex_t *m)
+{
+	pthread_mutex_lock(m);
+}
+
+static inline void port_mutex_unlock(port_mutex_t *m)
+{
+	pthread_mutex_unlock(m);
+}
+
+static inline void port_mutex_destroy(port_mutex_t *m)
+{
+	pthread_mutex_destroy(m);
+}
+
+typedef pthread_cond_t port_cond_t;
+
+static inline int port_cond_init(port_cond_t *c)
+{
+	pthread_condattr_t attr;
+	int ret;
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	ret = pthread_cond_init(c, &attr);
+	pthread_condattr_destroy(&attr);
+
+	return ret;
+}
+
+static inline void port_cond_wait(port_cond_t *c, port_mutex_t *m, int64_t timeout_us)
+{
+	int64_t t = port_time_us() + timeout_us;
+	struct timespec ts = {
+		.tv_sec = t / 1000000,
+		.tv_nsec = (t % 1000000) * 1000,
+	};
+
+	pthread_cond_timedwait(c, m, &ts);
+}
+
+static inline void port_cond_broadcast(port_cond_t *c)
+{
+	pthread_cond_broadcast(c);
+}
+
+static inline void port_cond_destroy(port_cond_t *c)
+{
+	pthread_cond_destroy(c);
+}
+
+#endif
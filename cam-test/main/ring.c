@@ -0,0 +1,204 @@
+/*
+ * Frame ring: the capture task publishes every frame, readers take a
+ * reference to the newest one and send it at their own pace. Readers
+ * never trigger a capture and never block the writer: publishing evicts
+ * the oldest frame nobody holds. When readers hold every slot the new
+ * frame is dropped instead, it goes straight back to the source.
+ *
+ * Frames are not copied: on ESP32 slots hold camera frame buffers in
+ * PSRAM, they are returned to the driver on eviction.
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include "ring.h"
+
+/* sequence numbers wrap around */
+static inline int seq_after(uint32_t a, uint32_t b)
+{
+	return (int32_t)(a - b) > 0;
+}
+
+int ring_init(struct frame_ring *r, const struct frame_source *src, unsigned int depth)
+{
+	if (!depth || depth > RING_MAX_DEPTH)
+		return -1;
+
+	memset(r, 0, sizeof(*r));
+	r->src = src;
+	r->depth = depth;
+
+	if (port_mutex_init(&r->lock))
+		return -1;
+
+	if (port_cond_init(&r->cond)) {
+		port_mutex_destroy(&r->lock);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* no readers left: frames go back to the source */
+void ring_deinit(struct frame_ring *r)
+{
+	for (unsigned int i = 0; i < r->depth; i++)
+		if (r->slots[i].used)
+			r->src->put(r->src->ctx, &r->slots[i].f);
+
+	port_cond_destroy(&r->cond);
+	port_mutex_destroy(&r->lock);
+}
+
+/* free slot, or the oldest one without references */
+static struct ring_slot *ring_victim(struct frame_ring *r)
+{
+	struct ring_slot *victim = NULL;
+
+	for (unsigned int i = 0; i < r->depth; i++) {
+		struct ring_slot *s = &r->slots[i];
+
+		if (!s->used)
+			return s;
+
+		if (!s->refs && (!victim || seq_after(victim->f.seq, s->f.seq)))
+			victim = s;
+	}
+
+	return victim;
+}
+
+int ring_publish(struct frame_ring *r, const struct frame *f)
+{
+	struct frame old;
+	struct ring_slot *s;
+	int evict;
+
+	port_mutex_lock(&r->lock);
+
+	s = ring_victim(r);
+	if (!s) {
+		r->stats.dropped++;
+		port_mutex_unlock(&r->lock);
+		return -1;
+	}
+
+	evict = s->used;
+	old = s->f;
+
+	s->f = *f;
+	s->refs = 0;
+	s->used = 1;
+
+	r->newest = s;
+	r->stats.published++;
+	r->stats.evicted += evict;
+
+	port_cond_broadcast(&r->cond);
+	port_mutex_unlock(&r->lock);
+
+	/* outside of the lock: returning a camera frame buffer takes a while */
+	if (evict)
+		r->src->put(r->src->ctx, &old);
+
+	return 0;
+}
+
+/*
+ * Reference to the newest frame, newer than *after unless it is NULL.
+ * Waits up to timeout_us for such a frame, returns NULL on timeout.
+ */
+const struct frame *ring_get(struct frame_ring *r, const uint32_t *after, int64_t timeout_us)
+{
+	int64_t deadline = port_time_us() + timeout_us;
+	struct ring_slot *s;
+
+	port_mutex_lock(&r->lock);
+
+	while (1) {
+		int64_t left;
+
+		s = r->newest;
+		if (s && (!after || seq_after(s->f.seq, *after)))
+			break;
+
+		left = deadline - port_time_us();
+		if (left <= 0) {
+			s = NULL;
+			break;
+		}
+
+		port_cond_wait(&r->cond, &r->lock, left);
+	}
+
+	if (s)
+		s->refs++;
+
+	port_mutex_unlock(&r->lock);
+
+	return s ? &s->f : NULL;
+}
+
+void ring_put(struct frame_ring *r, const struct frame *f)
+{
+	struct ring_slot *s = (struct ring_slot *)((uint8_t *)f - offsetof(struct ring_slot, f));
+
+	port_mutex_lock(&r->lock);
+	s->refs--;
+	port_mutex_unlock(&r->lock);
+}
+
+unsigned int ring_refs(struct frame_ring *r)
+{
+	unsigned int refs = 0;
+
+	port_mutex_lock(&r->lock);
+	for (unsigned int i = 0; i < r->depth; i++)
+		refs += r->slots[i].refs;
+	port_mutex_unlock(&r->lock);
+
+	return refs;
+}
+
+/* reader as a frame source: frame is a copy of the slot header, priv points to the slot frame */
+
+static int ring_reader_get(void *ctx, struct frame *f)
+{
+	struct ring_reader *rd = ctx;
+	const struct frame *rf;
+
+	rf = ring_get(rd->ring, rd->started ? &rd->last : NULL, rd->timeout_us);
+	if (!rf)
+		return -1;
+
+	if (rd->started)
+		rd->skipped += rf->seq - rd->last - 1;
+
+	rd->last = rf->seq;
+	rd->started = 1;
+
+	*f = *rf;
+	f->priv = (void *)rf;
+
+	return 0;
+}
+
+static void ring_reader_put(void *ctx, struct frame *f)
+{
+	struct ring_reader *rd = ctx;
+
+	ring_put(rd->ring, f->priv);
+}
+
+void ring_reader_init(struct ring_reader *rd, struct frame_ring *r, int64_t timeout_us,
+		      struct frame_source *src)
+{
+	memset(rd, 0, sizeof(*rd));
+	rd->ring = r;
+	rd->timeout_us = timeout_us;
+
+	src->ctx = rd;
+	src->get = ring_reader_get;
+	src->put = ring_reader_put;
+}
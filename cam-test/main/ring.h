@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "stream.h"
+#include "port.h"
+
+/*
+ * Ring of the most recent frames: one writer publishes frames, readers
+ * take references to the newest one. Frames are owned by the ring until
+ * they are evicted, then they go back to their source.
+ */
+
+#define RING_MAX_DEPTH 8
+
+struct ring_slot {
+	struct frame f;
+	unsigned int refs;
+	int used;
+};
+
+struct ring_stats {
+	uint32_t published;
+	uint32_t evicted;
+	uint32_t dropped;	/* every slot was referenced: frame went back to the source */
+};
+
+struct frame_ring {
+	port_mutex_t lock;
+	port_cond_t cond;
+	const struct frame_source *src;
+	struct ring_slot slots[RING_MAX_DEPTH];
+	unsigned int depth;
+	struct ring_slot *newest;
+	struct ring_stats stats;
+};
+
+int ring_init(struct frame_ring *r, const struct frame_source *src, unsigned int depth);
+void ring_deinit(struct frame_ring *r);
+int ring_publish(struct frame_ring *r, const struct frame *f);
+const struct frame *ring_get(struct frame_ring *r, const uint32_t *after, int64_t timeout_us);
+void ring_put(struct frame_ring *r, const struct frame *f);
+unsigned int ring_refs(struct frame_ring *r);
+
+/* frame source on top of the ring: each frame is newer than the previous one */
+
+struct ring_reader {
+	struct frame_ring *ring;
+	int64_t timeout_us;
+	uint32_t last;
+	int started;
+	uint32_t skipped;	/* frames published between two gets */
+};
+
+void ring_reader_init(struct ring_reader *rd, struct frame_ring *r, int64_t timeout_us,
+		      struct frame_source *src);
@@ -0,0 +1,100 @@
+/*
+ * Frame streaming. Single frames are sent in chunks straight from the
+ * frame buffer.
+ *
+ * MJPEG: each frame is one part of a multipart/x-mixed-replace
+ * response. Part headers are formatted on the stack and the frame buffer
+ * goes to the sink as it is, so there is no copy and no staging buffer
+ * whatever the frame size. Frame is put back as soon as it is sent.
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+
+#include "stream.h"
+#include "port.h"
+
+#define PART_HDR_SIZE 128
+
+static const char trailer[] = "\r\n--" MJPEG_BOUNDARY "--\r\n";
+
+/* chunks point into the frame buffer: nothing is copied on the way to the sink */
+int frame_send(const struct stream_sink *sink, const struct frame *f, size_t chunk)
+{
+	for (size_t off = 0, n; off < f->len; off += n) {
+		n = (f->len - off < chunk) ? f->len - off : chunk;
+
+		if (sink->send(sink->ctx, f->buf + off, n))
+			return -1;
+	}
+
+	return 0;
+}
+
+/* CRLF closing the previous part is sent with the next header: two sends per frame */
+static int part_header(char *hdr, const struct frame *f, int first)
+{
+	return snprintf(hdr, PART_HDR_SIZE,
+			"%s--" MJPEG_BOUNDARY "\r\n"
+			"Content-Type: image/jpeg\r\n"
+			"Content-Length: %zu\r\n"
+			"X-Timestamp: %" PRId64 ".%06" PRId64 "\r\n\r\n",
+			first ? "" : "\r\n", f->len, f->timestamp_us / 1000000, f->timestamp_us % 1000000);
+}
+
+/*
+ * Streams until the sink or the source fails, or max_frames are sent
+ * (0 - no limit). fps_max caps the frame rate, 0 - as fast as frames come.
+ * Returns 0 only when max_frames are sent.
+ */
+int mjpeg_stream(const struct frame_source *src, const struct stream_sink *sink, unsigned int fps_max,
+		 uint32_t max_frames, struct stream_stats *stats)
+{
+	const int64_t period = fps_max ? 1000000 / fps_max : 0;
+	int64_t start = port_time_us();
+	int64_t due = start;
+	char hdr[PART_HDR_SIZE];
+	int ret = 0;
+
+	stats->frames = 0;
+	stats->bytes = 0;
+
+	while (!max_frames || stats->frames < max_frames) {
+		struct frame f;
+		int64_t now;
+		int len;
+
+		/* cap: wait for the slot of this frame, restart the schedule when late */
+		now = port_time_us();
+		if (now < due)
+			port_sleep_us(due - now);
+		else
+			due = now;
+		due += period;
+
+		if (src->get(src->ctx, &f)) {
+			ret = -1;
+			break;
+		}
+
+		len = part_header(hdr, &f, !stats->frames);
+		ret = sink->send(sink->ctx, hdr, len) || sink->send(sink->ctx, f.buf, f.len);
+
+		src->put(src->ctx, &f);
+
+		if (ret) {
+			ret = -1;
+			break;
+		}
+
+		stats->frames++;
+		stats->bytes += f.len;
+	}
+
+	if (!ret && stats->frames)
+		ret = sink->send(sink->ctx, trailer, sizeof(trailer) - 1) ? -1 : 0;
+
+	stats->elapsed_us = port_time_us() - start;
+
+	return ret;
+}
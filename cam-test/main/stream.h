@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* frame from a frame source: buffer stays valid until the frame is put back */
+
+struct frame {
+	const uint8_t *buf;
+	size_t len;
+	uint32_t seq;
+	int64_t timestamp_us;
+	void *priv;		/* owned by the source, e.g. camera_fb_t */
+};
+
+struct frame_source {
+	void *ctx;
+	int (*get)(void *ctx, struct frame *f);
+	void (*put)(void *ctx, struct frame *f);
+};
+
+/* response body: returns 0 when all the bytes are sent, e.g. httpd_resp_send_chunk() */
+
+struct stream_sink {
+	void *ctx;
+	int (*send)(void *ctx, const void *buf, size_t len);
+};
+
+/* single frame as the whole response body, in chunks of at most chunk bytes */
+
+int frame_send(const struct stream_sink *sink, const struct frame *f, size_t chunk);
+
+/* MJPEG over multipart/x-mixed-replace: frame buffers are sent as they are */
+
+#define MJPEG_BOUNDARY		"frame"
+#define MJPEG_CONTENT_TYPE	"multipart/x-mixed-replace;boundary=" MJPEG_BOUNDARY
+
+struct stream_stats {
+	uint32_t frames;
+	uint64_t bytes;		/* jpeg data only */
+	int64_t elapsed_us;
+};
+
+int mjpeg_stream(const struct frame_source *src, const struct stream_sink *sink, unsigned int fps_max,
+		 uint32_t max_frames, struct stream_stats *stats);
@@ -0,0 +1,326 @@
+/*
+ * Pipeline metrics test:
+ * - bucket of each value against a reference, bucket bounds and overflow
+ * - Prometheus text parsed back: headers, cumulative buckets with
+ *   increasing bounds, +Inf bucket equal to count, sum in exported units
+ * - output is sent in buffer sized pieces of whole lines, sink errors
+ * - concurrent recording from several threads: no lost samples
+ * - cycles per sample and export size, JSON lines
+ */
+
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "metrics.h"
+#include "host_test.h"
+
+#define TEXT_MAX	(64 << 10)
+#define THREADS		4
+#define SAMPLES		1000000
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+/* sink collecting the text */
+
+struct text_sink {
+	char buf[TEXT_MAX];
+	size_t len;
+	unsigned int sends;
+	size_t max_send;
+	int split_lines;
+	unsigned int fail_at;	/* fail this send, 0 - never */
+};
+
+static int text_send(void *ctx, const void *buf, size_t len)
+{
+	struct text_sink *t = ctx;
+
+	if (++t->sends == t->fail_at || t->len + len >= sizeof(t->buf))
+		return -1;
+
+	if (!len || ((const char *)buf)[len - 1] != '\n')
+		t->split_lines++;
+
+	if (len > t->max_send)
+		t->max_send = len;
+
+	memcpy(t->buf + t->len, buf, len);
+	t->len += len;
+	t->buf[t->len] = 0;
+
+	return 0;
+}
+
+static unsigned int ref_bucket(unsigned int shift, uint32_t v)
+{
+	for (unsigned int i = 0; i < HIST_BUCKETS; i++)
+		if (v <= (1ULL << (shift + i)))
+			return i;
+
+	return HIST_BUCKETS;
+}
+
+static int check_buckets(unsigned int shift)
+{
+	static struct histogram h;
+	uint32_t values[256];
+	unsigned int n = 0;
+	int fails = 0;
+
+	/* powers of two and their neighbours, random values */
+	values[n++] = 0;
+	values[n++] = UINT32_MAX;
+	for (unsigned int k = 0; k < 32; k++) {
+		values[n++] = (1u << k) - 1;
+		values[n++] = 1u << k;
+		values[n++] = (1u << k) + 1;
+	}
+	while (n < sizeof(values) / sizeof(values[0]))
+		values[n++] = rnd() >> (rnd() % 24);
+
+	for (unsigned int i = 0; i < n; i++) {
+		memset(&h, 0, sizeof(h));
+		h.shift = shift;
+
+		hist_record(&h, values[i]);
+
+		if (atomic_load(&h.buckets[ref_bucket(shift, values[i])]) != 1 || hist_count(&h) != 1 ||
+		    atomic_load(&h.sum) != values[i]) {
+			printf("value %u, shift %u: wrong bucket\n", values[i], shift);
+			fails++;
+		}
+	}
+
+	printf("buckets, shift %-2u       %s\n", shift, fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+/* histogram lines of the text: cumulative counts and bounds as exported */
+static int parse_hist(const char *text, const struct histogram *h, uint64_t count, double sum)
+{
+	char key[128], type[160];
+	double le, prev_le = -1, val;
+	uint64_t c, prev = 0;
+	const char *p;
+	int buckets = 0;
+
+	snprintf(type, sizeof(type), "# TYPE %s histogram\n", h->name);
+	p = strstr(text, type);
+	if (!p || !strstr(text, "# HELP"))
+		return 1;
+
+	p = strchr(p, '\n') + 1;
+
+	snprintf(key, sizeof(key), "%s_bucket{le=\"", h->name);
+
+	while (!strncmp(p, key, strlen(key))) {
+		p += strlen(key);
+
+		if (!strncmp(p, "+Inf\"} ", 7)) {
+			if (sscanf(p + 7, "%" SCNu64, &c) != 1 || c != count || c < prev)
+				return 1;
+			p = strchr(p, '\n') + 1;
+			buckets++;
+			break;
+		}
+
+		if (sscanf(p, "%lf\"} %" SCNu64, &le, &c) != 2 || le <= prev_le || c < prev)
+			return 1;
+
+		/* bound is 2^(shift + i) scaled */
+		if (fabs(le - (double)(1ULL << (h->shift + buckets)) * h->scale) > 1e-9 * le)
+			return 1;
+
+		prev_le = le;
+		prev = c;
+		buckets++;
+		p = strchr(p, '\n') + 1;
+	}
+
+	if (buckets != HIST_BUCKETS + 1)
+		return 1;
+
+	snprintf(key, sizeof(key), "%s_sum %%lf\n%s_count %%" SCNu64, h->name, h->name);
+	if (sscanf(p, key, &val, &c) != 2 || c != count || fabs(val - sum) > 1e-6 * (sum + 1))
+		return 1;
+
+	return 0;
+}
+
+static int check_export(void)
+{
+	static struct histogram lat = HISTOGRAM("test_latency_seconds", "Stage time", 4, 1e-6);
+	static struct histogram size = HISTOGRAM("test_frame_size_bytes", "Frame size", 10, 1);
+	static struct histogram more[8];
+	struct stream_sink sink;
+	static struct text_sink t;
+	struct metrics_out out;
+	uint64_t lat_sum = 0, size_sum = 0;
+	char name[8][32];
+	int fails = 0;
+
+	for (int i = 0; i < 1000; i++) {
+		uint32_t us = rnd() % 200000, len = 20000 + rnd() % 60000;
+
+		hist_record(&lat, us);
+		hist_record(&size, len);
+		lat_sum += us;
+		size_sum += len;
+	}
+
+	/* enough text for several sends */
+	for (int i = 0; i < 8; i++) {
+		snprintf(name[i], sizeof(name[i]), "test_more_%d_seconds", i);
+		more[i].name = name[i];
+		more[i].help = "More";
+		more[i].scale = 1e-6;
+		hist_record(&more[i], i);
+	}
+
+	memset(&t, 0, sizeof(t));
+	sink.ctx = &t;
+	sink.send = text_send;
+
+	metrics_begin(&out, &sink);
+	metrics_hist(&out, &lat);
+	metrics_hist(&out, &size);
+	for (int i = 0; i < 8; i++)
+		metrics_hist(&out, &more[i]);
+	metrics_counter(&out, "test_dropped_total", "Dropped frames", 42);
+	metrics_gauge(&out, "test_psram_free_bytes", "Free PSRAM", 3145728);
+
+	if (metrics_end(&out))
+		fails++;
+
+	if (parse_hist(t.buf, &lat, 1000, lat_sum * 1e-6) || parse_hist(t.buf, &size, 1000, size_sum))
+		fails++;
+
+	for (int i = 0; i < 8; i++)
+		if (parse_hist(t.buf, &more[i], 1, i * 1e-6))
+			fails++;
+
+	if (!strstr(t.buf, "# TYPE test_dropped_total counter\ntest_dropped_total 42\n") ||
+	    !strstr(t.buf, "# TYPE test_psram_free_bytes gauge\ntest_psram_free_bytes 3145728\n"))
+		fails++;
+
+	if (t.sends < 2 || t.max_send > METRICS_BUF_SIZE || t.split_lines)
+		fails++;
+
+	printf("export, %u sends        %s\n", t.sends, fails ? "FAIL" : "PASS");
+
+	/* sink error: reported at the end, nothing sent after it */
+	memset(&t, 0, sizeof(t));
+	t.fail_at = 2;
+
+	metrics_begin(&out, &sink);
+	for (int i = 0; i < 8; i++)
+		metrics_hist(&out, &lat);
+
+	if (!metrics_end(&out) || t.sends != 2) {
+		printf("sink error: %u sends\n", t.sends);
+		fails++;
+	}
+
+	printf("export, sink error       %s\n", fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+static struct histogram shared = HISTOGRAM("test_shared_seconds", "Shared", 4, 1e-6);
+
+static void *record_thread(void *arg)
+{
+	uint32_t v = (uintptr_t)arg;
+
+	for (int i = 0; i < SAMPLES; i++)
+		hist_record(&shared, v + (i & 0xfff));
+
+	return NULL;
+}
+
+static int check_threads(void)
+{
+	pthread_t tid[THREADS];
+	uint64_t sum = 0;
+	int fails = 0;
+
+	for (int i = 0; i < THREADS; i++) {
+		pthread_create(&tid[i], NULL, record_thread, (void *)(uintptr_t)(i * 100000));
+		for (int k = 0; k < SAMPLES; k++)
+			sum += i * 100000 + (k & 0xfff);
+	}
+
+	for (int i = 0; i < THREADS; i++)
+		pthread_join(tid[i], NULL);
+
+	if (hist_count(&shared) != THREADS * SAMPLES || atomic_load(&shared.sum) != sum)
+		fails++;
+
+	printf("threads, %d x %d    %s\n", THREADS, SAMPLES, fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+static void bench(void)
+{
+	static struct histogram h = HISTOGRAM("bench_seconds", "Bench", 4, 1e-6);
+	static struct text_sink t;
+	struct stream_sink sink = { .ctx = &t, .send = text_send };
+	uint64_t best = UINT64_MAX, export = UINT64_MAX;
+	struct metrics_out out;
+	uint32_t v[1024];
+
+	for (int i = 0; i < 1024; i++)
+		v[i] = rnd() >> (rnd() % 24);
+
+	for (int run = 0; run < 5; run++) {
+		uint64_t c = cycles();
+
+		for (int i = 0; i < SAMPLES; i++)
+			hist_record(&h, v[i & 1023]);
+		c = cycles() - c;
+		if (c < best)
+			best = c;
+
+		memset(&t, 0, sizeof(t));
+		c = cycles();
+		metrics_begin(&out, &sink);
+		metrics_hist(&out, &h);
+		metrics_end(&out);
+		c = cycles() - c;
+		if (c < export)
+			export = c;
+	}
+
+	printf("{\"bench\": \"metrics\", \"cycles_per_record\": %.2f, \"hist_text_bytes\": %zu, "
+	       "\"hist_export_cycles\": %llu, \"hist_memory_bytes\": %zu}\n",
+	       (double)best / SAMPLES, t.len, (unsigned long long)export, sizeof(h));
+}
+
+int main(void)
+{
+	int fails = 0;
+
+	fails += check_buckets(0);
+	fails += check_buckets(4);
+	fails += check_buckets(10);
+
+	fails += check_export();
+	fails += check_threads();
+
+	bench();
+
+	return test_done(fails);
+}
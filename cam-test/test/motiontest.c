@@ -0,0 +1,413 @@
+/*
+ * Motion detector test:
+ * - decimation of grayscale and YUYV frames against a scalar reference,
+ *   odd widths, strides and unaligned buffers
+ * - block sums and background update bit for bit against a per pixel
+ *   reference over random frames and learning rates
+ * - static scene with sensor noise and a slow light change: no blocks
+ * - moving square: flagged blocks are the ones it covers
+ * - cycles per frame vs luma size, JSON lines
+ * - recorded sequences: binary PGM (P5) frames given as arguments are
+ *   downscaled by 2 and run through the detector, JSON line per frame
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "motion.h"
+#include "host_test.h"
+
+#define BENCH_FRAMES	200
+#define THRESHOLD	12
+#define SHIFT		3
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+/* scalar references */
+
+static void ref_decimate(uint8_t *dst, const uint8_t *src, unsigned int w, unsigned int h, size_t stride,
+			 unsigned int step)
+{
+	for (unsigned int y = 0; y + 1 < h; y += 2)
+		for (unsigned int x = 0; x + 1 < w; x += 2) {
+			const uint8_t *p = src + y * stride + x * step;
+
+			dst[(y / 2) * (w / 2) + x / 2] = (p[0] + p[step] + p[stride] + p[stride + step] + 2) >> 2;
+		}
+}
+
+struct ref_motion {
+	unsigned int w, h, shift;
+	uint16_t *bg;
+	uint32_t sad[MOTION_MAX_BLOCKS];
+};
+
+static void ref_update(struct ref_motion *r, const uint8_t *luma, int first)
+{
+	unsigned int cols = r->w / MOTION_BLOCK;
+
+	memset(r->sad, 0, sizeof(r->sad));
+
+	for (unsigned int y = 0; y < r->h; y++)
+		for (unsigned int x = 0; x < r->w; x++) {
+			unsigned int i = y * r->w + x;
+			int d = luma[i] - (r->bg[i] >> 8);
+
+			if (first) {
+				r->bg[i] = luma[i] << 8;
+				continue;
+			}
+
+			if (y / MOTION_BLOCK < r->h / MOTION_BLOCK)
+				r->sad[(y / MOTION_BLOCK) * cols + x / MOTION_BLOCK] += d < 0 ? -d : d;
+
+			r->bg[i] = r->bg[i] - (r->bg[i] >> r->shift) + ((luma[i] << 8) >> r->shift);
+		}
+}
+
+static int check_decimate(unsigned int w, unsigned int h, unsigned int pad)
+{
+	size_t stride = (size_t)w + pad;
+	uint8_t *src = malloc(2 * stride * h + 1);
+	uint8_t *out = malloc(w * h / 4 + 1);
+	uint8_t *ref = malloc(w * h / 4 + 1);
+	int fails = 0;
+
+	for (size_t i = 0; i < 2 * stride * h + 1; i++)
+		src[i] = rnd();
+
+	/* unaligned source and destination */
+	motion_decimate_gray(out + 1, src + 1, w, h, stride);
+	ref_decimate(ref, src + 1, w, h, stride, 1);
+	if (memcmp(out + 1, ref, (w / 2) * (h / 2)))
+		fails++;
+
+	motion_decimate_yuyv(out, src, w, h, 2 * stride);
+	ref_decimate(ref, src, w, h, 2 * stride, 2);
+	if (memcmp(out, ref, (w / 2) * (h / 2)))
+		fails++;
+
+	printf("decimate %3ux%-3u pad %u   %s\n", w, h, pad, fails ? "FAIL" : "PASS");
+
+	free(src);
+	free(out);
+	free(ref);
+
+	return fails;
+}
+
+static int check_update(unsigned int w, unsigned int h, unsigned int shift)
+{
+	uint8_t *luma = malloc(w * h + 1);
+	struct ref_motion r = { .w = w, .h = h, .shift = shift };
+	struct motion m;
+	int fails = 0;
+
+	r.bg = calloc(w * h, sizeof(*r.bg));
+	if (motion_init(&m, w, h, shift, THRESHOLD))
+		fails++;
+
+	for (int n = 0; n < 20 && !fails; n++) {
+		/* full range frames, and frames close to the background */
+		for (unsigned int i = 0; i < w * h; i++)
+			luma[i + 1] = n % 2 ? rnd() : (r.bg[i] >> 8) + (rnd() % 32) - 16;
+
+		motion_update(&m, luma + 1);
+		ref_update(&r, luma + 1, !n);
+
+		if (memcmp(m.sad, r.sad, m.cols * m.rows * sizeof(*m.sad)))
+			fails++;
+
+		for (unsigned int i = 0; i < w * h; i++) {
+			uint32_t word = m.bg[i / 4 * 2 + i % 2];
+			uint16_t bg = word >> (i % 4 / 2 * 16);
+
+			if (bg != r.bg[i]) {
+				fails++;
+				break;
+			}
+		}
+
+		for (unsigned int b = 0; b < m.cols * m.rows; b++)
+			if (m.flags[b] != (r.sad[b] > THRESHOLD * MOTION_BLOCK * MOTION_BLOCK))
+				fails++;
+	}
+
+	printf("update   %3ux%-3u shift %u %s\n", w, h, shift, fails ? "FAIL" : "PASS");
+
+	motion_deinit(&m);
+	free(r.bg);
+	free(luma);
+
+	return fails;
+}
+
+/* scene: gradient background, noise, optional light drift and a bright square */
+
+struct scene {
+	unsigned int w, h;
+	int noise;
+	int light;
+	int sq_x, sq_y, sq_size;
+};
+
+static void scene_render(const struct scene *s, uint8_t *luma)
+{
+	for (unsigned int y = 0; y < s->h; y++)
+		for (unsigned int x = 0; x < s->w; x++) {
+			int v = 40 + (int)(x + y) / 2 + s->light;
+
+			if ((int)x >= s->sq_x && (int)x < s->sq_x + s->sq_size &&
+			    (int)y >= s->sq_y && (int)y < s->sq_y + s->sq_size)
+				v = 230;
+
+			if (s->noise)
+				v += (int)(rnd() % (2 * s->noise + 1)) - s->noise;
+
+			luma[y * s->w + x] = v < 0 ? 0 : v > 255 ? 255 : v;
+		}
+}
+
+static int check_static(void)
+{
+	struct scene s = { .w = 80, .h = 60, .noise = 6, .sq_size = 0 };
+	uint8_t luma[80 * 60];
+	unsigned int active = 0;
+	struct motion m;
+	int fails = 0;
+
+	motion_init(&m, s.w, s.h, SHIFT, THRESHOLD);
+
+	/* slow light change: a step per frame, the background follows */
+	for (int n = 0; n < 300; n++) {
+		s.light = n < 100 ? 0 : n < 200 ? (n - 100) / 4 : 25;
+		scene_render(&s, luma);
+		active += motion_update(&m, luma);
+	}
+
+	if (active)
+		fails++;
+
+	printf("static scene, noise %d   %s\n", s.noise, fails ? "FAIL" : "PASS");
+
+	motion_deinit(&m);
+
+	return fails;
+}
+
+/* pixels of a block span covered by a square span */
+static int overlap(int b, int pos, int size)
+{
+	int lo = b > pos ? b : pos;
+	int hi = b + MOTION_BLOCK < pos + size ? b + MOTION_BLOCK : pos + size;
+
+	return hi > lo ? hi - lo : 0;
+}
+
+static int check_moving(void)
+{
+	struct scene s = { .w = 80, .h = 60, .noise = 6, .sq_size = 16, .sq_y = 16 };
+	uint8_t luma[80 * 60];
+	struct motion m;
+	int fails = 0;
+
+	motion_init(&m, s.w, s.h, SHIFT, THRESHOLD);
+
+	/* learn the empty scene, square is out of the frame */
+	s.sq_x = -100;
+	for (int n = 0; n < 20; n++) {
+		scene_render(&s, luma);
+		if (motion_update(&m, luma))
+			fails++;
+	}
+
+	/* square enters by 4 pixels per frame: blocks it covers by half at least are flagged */
+	for (s.sq_x = -16; s.sq_x < (int)s.w; s.sq_x += 4) {
+		scene_render(&s, luma);
+		motion_update(&m, luma);
+
+		for (unsigned int b = 0; b < m.cols * m.rows; b++) {
+			int bx = (b % m.cols) * MOTION_BLOCK, by = (b / m.cols) * MOTION_BLOCK;
+			int ox = overlap(bx, s.sq_x, s.sq_size), oy = overlap(by, s.sq_y, s.sq_size);
+
+			/* half covered: flagged, never covered yet: not flagged, trail may be either */
+			if (ox * oy >= MOTION_BLOCK * MOTION_BLOCK / 2 && !m.flags[b])
+				fails++;
+			if ((!oy || bx >= s.sq_x + s.sq_size) && m.flags[b])
+				fails++;
+		}
+	}
+
+	printf("moving square            %s\n", fails ? "FAIL" : "PASS");
+
+	motion_deinit(&m);
+
+	return fails;
+}
+
+static void bench(unsigned int w, unsigned int h)
+{
+	uint8_t *frames[4], *src = malloc(4 * w * h);
+	uint64_t best = UINT64_MAX, best_dec = UINT64_MAX;
+	uint8_t *luma = malloc(w * h);
+	struct motion m;
+
+	for (int i = 0; i < 4; i++) {
+		frames[i] = malloc(w * h);
+		for (unsigned int j = 0; j < w * h; j++)
+			frames[i][j] = rnd();
+	}
+
+	for (unsigned int j = 0; j < 4 * w * h; j++)
+		src[j] = rnd();
+
+	motion_init(&m, w, h, SHIFT, THRESHOLD);
+
+	for (int run = 0; run < 5; run++) {
+		uint64_t t = cycles();
+
+		for (int n = 0; n < BENCH_FRAMES; n++)
+			motion_update(&m, frames[n % 4]);
+		t = cycles() - t;
+		if (t < best)
+			best = t;
+
+		t = cycles();
+		for (int n = 0; n < BENCH_FRAMES; n++)
+			motion_decimate_gray(luma, src, 2 * w, 2 * h, 2 * w);
+		t = cycles() - t;
+		if (t < best_dec)
+			best_dec = t;
+	}
+
+	printf("{\"bench\": \"motion\", \"w\": %u, \"h\": %u, \"blocks\": %u, \"update_cycles_per_frame\": %.0f, "
+	       "\"update_cycles_per_pixel\": %.2f, \"decimate_cycles_per_frame\": %.0f}\n",
+	       w, h, m.cols * m.rows, (double)best / BENCH_FRAMES, (double)best / BENCH_FRAMES / (w * h),
+	       (double)best_dec / BENCH_FRAMES);
+
+	motion_deinit(&m);
+	for (int i = 0; i < 4; i++)
+		free(frames[i]);
+	free(luma);
+	free(src);
+}
+
+/* binary PGM, 8-bit */
+static uint8_t *pgm_load(const char *path, unsigned int *w, unsigned int *h)
+{
+	unsigned int maxval;
+	uint8_t *img;
+	FILE *fd;
+
+	fd = fopen(path, "rb");
+	if (!fd)
+		return NULL;
+
+	if (fscanf(fd, "P5 %u %u %u", w, h, &maxval) != 3 || maxval != 255 || fgetc(fd) == EOF) {
+		fclose(fd);
+		return NULL;
+	}
+
+	img = malloc((size_t)*w * *h);
+	if (img && fread(img, 1, (size_t)*w * *h, fd) != (size_t)*w * *h) {
+		free(img);
+		img = NULL;
+	}
+
+	fclose(fd);
+
+	return img;
+}
+
+/* frames are downscaled by 2 and cropped to whole blocks */
+static int run_sequence(int count, char **paths)
+{
+	unsigned int w0 = 0, h0 = 0, w = 0, h = 0, events = 0, prev = 0;
+	uint64_t total = 0;
+	uint8_t *luma = NULL;
+	struct motion m;
+
+	for (int i = 0; i < count; i++) {
+		unsigned int fw, fh, active;
+		uint8_t *img;
+		uint64_t t;
+
+		img = pgm_load(paths[i], &fw, &fh);
+		if (!img) {
+			fprintf(stderr, "%s: not a binary 8-bit PGM\n", paths[i]);
+			return 1;
+		}
+
+		if (!luma) {
+			w0 = fw;
+			h0 = fh;
+			w = fw / 2 / MOTION_BLOCK * MOTION_BLOCK;
+			h = fh / 2;
+			luma = malloc(w * h);
+			if (!luma || motion_init(&m, w, h, SHIFT, THRESHOLD)) {
+				fprintf(stderr, "%s: %ux%u is not supported\n", paths[i], fw, fh);
+				return 1;
+			}
+		} else if (fw != w0 || fh != h0) {
+			fprintf(stderr, "%s: frame size changed\n", paths[i]);
+			return 1;
+		}
+
+		t = cycles();
+		motion_decimate_gray(luma, img, 2 * w, 2 * h, fw);
+		active = motion_update(&m, luma);
+		t = cycles() - t;
+		total += t;
+
+		if (active && !prev)
+			events++;
+		prev = active;
+
+		printf("{\"frame\": \"%s\", \"active_blocks\": %u, \"cycles\": %llu}\n",
+		       paths[i], active, (unsigned long long)t);
+
+		free(img);
+	}
+
+	printf("{\"sequence\": %d, \"w\": %u, \"h\": %u, \"events\": %u, \"cycles_per_frame\": %.0f}\n",
+	       count, w, h, events, (double)total / count);
+
+	motion_deinit(&m);
+	free(luma);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	int fails = 0;
+
+	if (argc > 1)
+		return run_sequence(argc - 1, argv + 1);
+
+	fails += check_decimate(160, 120, 0);
+	fails += check_decimate(86, 31, 3);
+	fails += check_decimate(14, 2, 1);
+
+	fails += check_update(80, 60, 0);
+	fails += check_update(80, 60, SHIFT);
+	fails += check_update(24, 17, 8);
+	fails += check_update(160, 120, 5);
+
+	fails += check_static();
+	fails += check_moving();
+
+	bench(80, 60);
+	bench(160, 120);
+	bench(320, 240);
+
+	return test_done(fails);
+}
@@ -0,0 +1,357 @@
+/*
+ * Frame ring test with a fake camera:
+ * - newest frame, eviction of the oldest unreferenced frame, drop when
+ *   readers hold every slot, frames go back to the source exactly once
+ * - wait for a newer frame, timeout, sequence wrap around
+ * - capture thread and reader threads of different speeds: each reader
+ *   sees newer frames only, frame data is intact while it is referenced,
+ *   one capture per frame whatever the number of readers
+ * - publish cost, frame age at the reader and sharing, JSON lines
+ */
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "ring.h"
+
+#define FRAME_SIZE	4096
+#define POOL		16
+#define READERS		6
+#define RUN_US		1000000
+
+/* fake camera: pool of buffers like driver frame buffers, poisoned when put back */
+
+struct fake_cam {
+	uint8_t *bufs[POOL];
+	atomic_int busy[POOL];
+	atomic_uint gets;
+	atomic_uint puts;
+	atomic_int errors;
+	uint32_t seq;
+};
+
+static int fake_get(void *ctx, struct frame *f)
+{
+	struct fake_cam *c = ctx;
+
+	for (unsigned int i = 0; i < POOL; i++) {
+		int idle = 0;
+
+		if (!atomic_compare_exchange_strong(&c->busy[i], &idle, 1))
+			continue;
+
+		memset(c->bufs[i], (uint8_t)c->seq, FRAME_SIZE);
+		memcpy(c->bufs[i], &c->seq, sizeof(c->seq));
+
+		f->buf = c->bufs[i];
+		f->len = FRAME_SIZE;
+		f->seq = c->seq++;
+		f->timestamp_us = port_time_us();
+		f->priv = (void *)(uintptr_t)i;
+
+		atomic_fetch_add(&c->gets, 1);
+		return 0;
+	}
+
+	return -1;
+}
+
+static void fake_put(void *ctx, struct frame *f)
+{
+	struct fake_cam *c = ctx;
+	unsigned int i = (uintptr_t)f->priv;
+
+	if (f->buf != c->bufs[i] || !atomic_load(&c->busy[i]))
+		atomic_fetch_add(&c->errors, 1);
+
+	memset(c->bufs[i], 0xa5, FRAME_SIZE);
+	atomic_store(&c->busy[i], 0);
+	atomic_fetch_add(&c->puts, 1);
+}
+
+static void fake_init(struct fake_cam *c, struct frame_source *src, uint32_t seq)
+{
+	memset(c, 0, sizeof(*c));
+	c->seq = seq;
+
+	for (unsigned int i = 0; i < POOL; i++)
+		c->bufs[i] = malloc(FRAME_SIZE);
+
+	src->ctx = c;
+	src->get = fake_get;
+	src->put = fake_put;
+}
+
+static void fake_free(struct fake_cam *c)
+{
+	for (unsigned int i = 0; i < POOL; i++)
+		free(c->bufs[i]);
+}
+
+static int frame_intact(const struct frame *f)
+{
+	uint32_t seq;
+
+	memcpy(&seq, f->buf, sizeof(seq));
+	if (seq != f->seq)
+		return 0;
+
+	for (size_t i = sizeof(seq); i < f->len; i++)
+		if (f->buf[i] != (uint8_t)f->seq)
+			return 0;
+
+	return 1;
+}
+
+static int check_basic(uint32_t first_seq)
+{
+	const struct frame *held[3];
+	const struct frame *f;
+	struct frame_source src;
+	struct frame_ring r;
+	struct fake_cam cam;
+	struct frame nf;
+	uint32_t after;
+	int64_t start;
+	int fails = 0;
+
+	fake_init(&cam, &src, first_seq);
+	ring_init(&r, &src, 3);
+
+	/* empty ring: timeout */
+	start = port_time_us();
+	if (ring_get(&r, NULL, 20000) || port_time_us() - start < 20000)
+		fails++;
+
+	for (int i = 0; i < 3; i++) {
+		src.get(src.ctx, &nf);
+		if (ring_publish(&r, &nf))
+			fails++;
+	}
+
+	/* newest, and nothing newer than it */
+	f = ring_get(&r, NULL, 0);
+	if (!f || f->seq != first_seq + 2 || !frame_intact(f))
+		fails++;
+	after = f->seq;
+	if (ring_get(&r, &after, 1000))
+		fails++;
+	ring_put(&r, f);
+
+	/* hold all three: fourth frame is dropped, not evicted */
+	for (int i = 0; i < 3; i++) {
+		held[i] = ring_get(&r, NULL, 0);
+		if (i < 2) {
+			src.get(src.ctx, &nf);
+			ring_publish(&r, &nf);
+		}
+	}
+
+	/* slots: newest published twice more, every slot has one reference now */
+	if (ring_refs(&r) != 3 || held[0] == held[1] || held[1] == held[2])
+		fails++;
+
+	src.get(src.ctx, &nf);
+	if (!ring_publish(&r, &nf) || r.stats.dropped != 1)
+		fails++;
+	src.put(src.ctx, &nf);
+
+	/* release the oldest held: it is the one evicted next */
+	ring_put(&r, held[0]);
+	src.get(src.ctx, &nf);
+	if (ring_publish(&r, &nf) || !frame_intact(held[1]) || !frame_intact(held[2]))
+		fails++;
+
+	ring_put(&r, held[1]);
+	ring_put(&r, held[2]);
+
+	if (ring_refs(&r))
+		fails++;
+
+	ring_deinit(&r);
+
+	if (cam.gets != cam.puts || cam.errors)
+		fails++;
+
+	printf("%-24s %s\n", first_seq ? "basic, seq wrap" : "basic", fails ? "FAIL" : "PASS");
+
+	fake_free(&cam);
+
+	return fails;
+}
+
+/* capture thread and readers */
+
+struct run {
+	struct frame_ring ring;
+	struct frame_source src;
+	struct fake_cam cam;
+	atomic_int done;
+	int64_t max_publish_us;
+	uint32_t dropped;
+};
+
+struct reader {
+	struct run *run;
+	int64_t hold_us;	/* slow network */
+	uint32_t frames;
+	uint32_t skipped;
+	int64_t age_us;
+	int64_t max_age_us;
+	int errors;
+};
+
+static void *capture_thread(void *arg)
+{
+	struct run *run = arg;
+	struct frame f;
+
+	while (!atomic_load(&run->done)) {
+		int64_t t;
+
+		if (run->src.get(run->src.ctx, &f)) {
+			run->dropped++;
+			port_sleep_us(100);
+			continue;
+		}
+
+		t = port_time_us();
+		if (ring_publish(&run->ring, &f))
+			run->src.put(run->src.ctx, &f);
+		t = port_time_us() - t;
+
+		if (t > run->max_publish_us)
+			run->max_publish_us = t;
+
+		/* about 1000 fps */
+		port_sleep_us(1000);
+	}
+
+	return NULL;
+}
+
+static void *reader_thread(void *arg)
+{
+	struct reader *rd = arg;
+	struct ring_reader rr;
+	struct frame_source src;
+	uint32_t last = 0;
+	struct frame f;
+
+	ring_reader_init(&rr, &rd->run->ring, 100000, &src);
+
+	while (!atomic_load(&rd->run->done)) {
+		int64_t age;
+
+		if (src.get(src.ctx, &f))
+			continue;
+
+		age = port_time_us() - f.timestamp_us;
+		rd->age_us += age;
+		if (age > rd->max_age_us)
+			rd->max_age_us = age;
+
+		if (rd->frames && (int32_t)(f.seq - last) <= 0)
+			rd->errors++;
+		last = f.seq;
+
+		if (!frame_intact(&f))
+			rd->errors++;
+
+		port_sleep_us(rd->hold_us);
+
+		/* still ours: not evicted while referenced */
+		if (!frame_intact(&f))
+			rd->errors++;
+
+		src.put(src.ctx, &f);
+		rd->frames++;
+	}
+
+	rd->skipped = rr.skipped;
+
+	return NULL;
+}
+
+static int check_readers(unsigned int depth)
+{
+	static struct run run;
+	struct reader rd[READERS] = { 0 };
+	pthread_t cap, tid[READERS];
+	uint64_t delivered = 0;
+	int64_t age = 0, max_age = 0;
+	int fails = 0;
+
+	memset(&run, 0, sizeof(run));
+	fake_init(&run.cam, &run.src, 0);
+	ring_init(&run.ring, &run.src, depth);
+	atomic_init(&run.done, 0);
+
+	pthread_create(&cap, NULL, capture_thread, &run);
+
+	for (int i = 0; i < READERS; i++) {
+		rd[i].run = &run;
+		rd[i].hold_us = (i % 3) * 3000;		/* fast, 3 ms and 6 ms per frame */
+		pthread_create(&tid[i], NULL, reader_thread, &rd[i]);
+	}
+
+	port_sleep_us(RUN_US);
+	atomic_store(&run.done, 1);
+
+	for (int i = 0; i < READERS; i++) {
+		pthread_join(tid[i], NULL);
+
+		fails += rd[i].errors;
+		delivered += rd[i].frames;
+		age += rd[i].age_us;
+		if (rd[i].max_age_us > max_age)
+			max_age = rd[i].max_age_us;
+		if (!rd[i].frames)
+			fails++;
+	}
+
+	pthread_join(cap, NULL);
+
+	if (ring_refs(&run.ring))
+		fails++;
+
+	/* one capture per frame: published or dropped, never per reader */
+	if (run.cam.gets != run.ring.stats.published + run.ring.stats.dropped)
+		fails++;
+
+	ring_deinit(&run.ring);
+
+	if (run.cam.gets != run.cam.puts || run.cam.errors)
+		fails++;
+
+	printf("{\"test\": \"readers\", \"depth\": %u, \"readers\": %d, \"captured\": %u, \"ring_dropped\": %u, "
+	       "\"no_buffer\": %u, \"delivered\": %llu, \"delivered_per_capture\": %.2f, \"avg_age_us\": %lld, "
+	       "\"max_age_us\": %lld, \"max_publish_us\": %lld, \"status\": \"%s\"}\n",
+	       depth, READERS, run.cam.gets, run.ring.stats.dropped, run.dropped,
+	       (unsigned long long)delivered, (double)delivered / run.cam.gets,
+	       (long long)(delivered ? age / (int64_t)delivered : 0), (long long)max_age,
+	       (long long)run.max_publish_us, fails ? "FAIL" : "PASS");
+
+	fake_free(&run.cam);
+
+	return fails;
+}
+
+int main(void)
+{
+	int fails = 0;
+
+	fails += check_basic(0);
+	fails += check_basic(UINT32_MAX - 1);
+
+	fails += check_readers(1);
+	fails += check_readers(3);
+	fails += check_readers(7);
+
+	fprintf(stderr, "%s\n", fails ? "FAILED" : "PASSED");
+	return fails ? 1 : 0;
+}
@@ -0,0 +1,464 @@
+/*
+ * Frame streaming test with a fake frame source:
+ * - multipart body is parsed back: boundaries, headers, Content-Length and
+ *   frame data for every part, closing boundary
+ * - frame data is sent straight from the frame buffer, no copies
+ * - every frame taken from the source is put back, also on sink and
+ *   source errors, at most one frame is held at a time
+ * - single frame in chunks: sizes, order and no copies
+ * - frame rate cap
+ * - throughput in fps and KB/s over a local socket, JSON lines; JPEG
+ *   files given on the command line are streamed instead of fake frames
+ */
+
+#include <sys/socket.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "stream.h"
+#include "port.h"
+
+#define MAX_FRAMES	16
+#define BODY_MAX	(8 << 20)
+
+/* fake camera: frames of different sizes with SOI/EOI markers */
+
+struct fake_cam {
+	uint8_t *frames[MAX_FRAMES];
+	size_t lens[MAX_FRAMES];
+	unsigned int count;
+	uint32_t seq;
+	unsigned int held;
+	unsigned int max_held;
+	unsigned int gets;
+	unsigned int puts;
+	unsigned int fail_at;	/* fail this get, 0 - never */
+};
+
+static int fake_get(void *ctx, struct frame *f)
+{
+	struct fake_cam *c = ctx;
+	unsigned int i = c->seq % c->count;
+
+	if (c->fail_at && ++c->gets == c->fail_at)
+		return -1;
+
+	f->buf = c->frames[i];
+	f->len = c->lens[i];
+	f->seq = c->seq++;
+	f->timestamp_us = 1700000000000000LL + f->seq * 33333;
+	f->priv = c;
+
+	if (++c->held > c->max_held)
+		c->max_held = c->held;
+
+	return 0;
+}
+
+static void fake_put(void *ctx, struct frame *f)
+{
+	struct fake_cam *c = ctx;
+
+	c->held--;
+	c->puts++;
+}
+
+static void fake_init(struct fake_cam *c, struct frame_source *src)
+{
+	uint32_t x = 1;
+
+	memset(c, 0, sizeof(*c));
+
+	for (unsigned int i = 0; i < MAX_FRAMES; i++) {
+		size_t len = 4 + 1000 * (i * 7 % 61) + i;
+
+		c->frames[i] = malloc(len);
+		for (size_t k = 0; k < len; k++) {
+			x = x * 1103515245 + 12345;
+			c->frames[i][k] = x >> 24;
+		}
+
+		memcpy(c->frames[i], "\xff\xd8", 2);
+		memcpy(c->frames[i] + len - 2, "\xff\xd9", 2);
+		c->lens[i] = len;
+	}
+
+	c->count = MAX_FRAMES;
+
+	src->ctx = c;
+	src->get = fake_get;
+	src->put = fake_put;
+}
+
+static void fake_free(struct fake_cam *c)
+{
+	for (unsigned int i = 0; i < c->count; i++)
+		free(c->frames[i]);
+}
+
+/* collects the body, checks frame data is not copied before it is sent */
+
+struct capture {
+	struct fake_cam *cam;
+	uint8_t *body;
+	size_t len;
+	unsigned int sends;
+	unsigned int direct;	/* sends of a whole frame buffer */
+	unsigned int inside;	/* sends pointing into a frame buffer */
+	unsigned int fail_at;
+};
+
+static int capture_send(void *ctx, const void *buf, size_t len)
+{
+	struct capture *c = ctx;
+
+	if (++c->sends == c->fail_at)
+		return -1;
+
+	for (unsigned int i = 0; i < c->cam->count; i++) {
+		const uint8_t *p = buf, *frame = c->cam->frames[i];
+
+		if (p == frame && len == c->cam->lens[i])
+			c->direct++;
+		if (p >= frame && p + len <= frame + c->cam->lens[i])
+			c->inside++;
+	}
+
+	if (c->len + len > BODY_MAX)
+		return -1;
+
+	memcpy(c->body + c->len, buf, len);
+	c->len += len;
+
+	return 0;
+}
+
+/* parses the multipart body back, returns the number of good parts or -1 */
+static int parse_body(const struct capture *c, const struct fake_cam *cam, unsigned int frames)
+{
+	static const char trailer[] = "\r\n--" MJPEG_BOUNDARY "--\r\n";
+	const char *p = (const char *)c->body;
+	const char *end = p + c->len;
+	unsigned int n;
+
+	for (n = 0; n < frames; n++) {
+		const char *hdr_end;
+		long long sec, usec;
+		unsigned int i = n % cam->count;
+		size_t len;
+		char hdr[256];
+
+		if (n && (end - p < 2 || memcmp(p, "\r\n", 2)))
+			return -1;
+		if (n)
+			p += 2;
+
+		hdr_end = memmem(p, end - p, "\r\n\r\n", 4);
+		if (!hdr_end || hdr_end - p >= (long)sizeof(hdr))
+			return -1;
+
+		memcpy(hdr, p, hdr_end - p);
+		hdr[hdr_end - p] = 0;
+
+		if (sscanf(hdr, "--" MJPEG_BOUNDARY "\r\nContent-Type: image/jpeg\r\nContent-Length: %zu\r\n"
+			   "X-Timestamp: %lld.%lld", &len, &sec, &usec) != 3)
+			return -1;
+
+		if (sec * 1000000 + usec != 1700000000000000LL + n * 33333LL)
+			return -1;
+
+		p = hdr_end + 4;
+		if (len != cam->lens[i] || (size_t)(end - p) < len || memcmp(p, cam->frames[i], len))
+			return -1;
+
+		p += len;
+	}
+
+	if ((size_t)(end - p) != sizeof(trailer) - 1 || memcmp(p, trailer, sizeof(trailer) - 1))
+		return -1;
+
+	return n;
+}
+
+static int check_stream(void)
+{
+	struct stream_sink sink = { 0 };
+	struct stream_stats stats;
+	struct frame_source src;
+	struct capture cap = { 0 };
+	struct fake_cam cam;
+	uint64_t bytes = 0;
+	int fails = 0;
+	int ret;
+
+	fake_init(&cam, &src);
+
+	cap.cam = &cam;
+	cap.body = malloc(BODY_MAX);
+	sink.ctx = &cap;
+	sink.send = capture_send;
+
+	ret = mjpeg_stream(&src, &sink, 0, 40, &stats);
+
+	for (unsigned int i = 0; i < 40; i++)
+		bytes += cam.lens[i % cam.count];
+
+	if (ret || stats.frames != 40 || stats.bytes != bytes)
+		fails++;
+	if (parse_body(&cap, &cam, 40) != 40)
+		fails++;
+	if (cap.direct != 40 || cam.held || cam.max_held != 1 || cam.puts != 40)
+		fails++;
+
+	printf("%-24s %s\n", "stream", fails ? "FAIL" : "PASS");
+
+	free(cap.body);
+	fake_free(&cam);
+
+	return fails;
+}
+
+/* chunk sizes around the frame length, sink error on the last chunk */
+static int check_frame_send(void)
+{
+	static const size_t chunks[] = { 1, 1000, 4095, 4096, 16384, 65536 };
+	struct stream_sink sink = { 0 };
+	struct frame_source src;
+	struct fake_cam cam;
+	struct frame f;
+	int fails = 0;
+
+	fake_init(&cam, &src);
+
+	for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+		for (unsigned int i = 0; i < 4; i++) {
+			struct capture cap = { 0 };
+			size_t expect;
+
+			src.get(src.ctx, &f);
+
+			cap.cam = &cam;
+			cap.body = malloc(BODY_MAX);
+			sink.ctx = &cap;
+			sink.send = capture_send;
+
+			expect = (f.len + chunks[c] - 1) / chunks[c];
+
+			if (frame_send(&sink, &f, chunks[c]) || cap.len != f.len || memcmp(cap.body, f.buf, f.len))
+				fails++;
+			if (cap.inside != expect || cap.sends != expect)
+				fails++;
+
+			/* fail the last chunk */
+			cap.len = 0;
+			cap.sends = 0;
+			cap.fail_at = expect;
+			if (!frame_send(&sink, &f, chunks[c]))
+				fails++;
+
+			src.put(src.ctx, &f);
+			free(cap.body);
+		}
+	}
+
+	printf("%-24s %s\n", "frame_send", fails ? "FAIL" : "PASS");
+
+	fake_free(&cam);
+
+	return fails;
+}
+
+/* sink error at every send of the first frames, source error: all frames put back */
+static int check_errors(void)
+{
+	struct stream_sink sink = { 0 };
+	struct stream_stats stats;
+	struct frame_source src;
+	struct fake_cam cam;
+	int fails = 0;
+
+	for (unsigned int at = 1; at <= 8; at++) {
+		struct capture cap = { 0 };
+
+		fake_init(&cam, &src);
+		cap.cam = &cam;
+		cap.body = malloc(BODY_MAX);
+		cap.fail_at = at;
+		sink.ctx = &cap;
+		sink.send = capture_send;
+
+		if (!mjpeg_stream(&src, &sink, 0, 0, &stats) || cam.held || cam.puts != cam.seq)
+			fails++;
+		if (stats.frames != (at - 1) / 2)
+			fails++;
+
+		free(cap.body);
+		fake_free(&cam);
+	}
+
+	for (unsigned int at = 1; at <= 3; at++) {
+		struct capture cap = { 0 };
+
+		fake_init(&cam, &src);
+		cam.fail_at = at;
+		cap.cam = &cam;
+		cap.body = malloc(BODY_MAX);
+		sink.ctx = &cap;
+		sink.send = capture_send;
+
+		if (!mjpeg_stream(&src, &sink, 0, 10, &stats) || cam.held || stats.frames != at - 1)
+			fails++;
+
+		free(cap.body);
+		fake_free(&cam);
+	}
+
+	printf("%-24s %s\n", "errors", fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+/* 20 frames at 50 fps: 19 periods at least, not much more */
+static int check_fps_cap(void)
+{
+	struct stream_sink sink = { 0 };
+	struct stream_stats stats;
+	struct frame_source src;
+	struct capture cap = { 0 };
+	struct fake_cam cam;
+	int fails = 0;
+
+	fake_init(&cam, &src);
+	cap.cam = &cam;
+	cap.body = malloc(BODY_MAX);
+	sink.ctx = &cap;
+	sink.send = capture_send;
+
+	if (mjpeg_stream(&src, &sink, 50, 20, &stats))
+		fails++;
+	if (stats.elapsed_us < 19 * 20000 || stats.elapsed_us > 19 * 20000 * 3 / 2)
+		fails++;
+
+	printf("{\"test\": \"fps_cap\", \"fps_max\": 50, \"frames\": %u, \"fps\": %.1f, \"status\": \"%s\"}\n",
+	       stats.frames, stats.frames * 1e6 / stats.elapsed_us, fails ? "FAIL" : "PASS");
+
+	free(cap.body);
+	fake_free(&cam);
+
+	return fails;
+}
+
+/* throughput: stream to a local socket drained by another thread, like a browser would */
+
+static int socket_send(void *ctx, const void *buf, size_t len)
+{
+	int fd = *(int *)ctx;
+	const uint8_t *p = buf;
+
+	while (len) {
+		ssize_t n = write(fd, p, len);
+
+		if (n <= 0)
+			return -1;
+
+		p += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+static void *drain(void *arg)
+{
+	int fd = *(int *)arg;
+	static uint8_t buf[65536];
+
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	return NULL;
+}
+
+static uint8_t *load(const char *path, size_t *len)
+{
+	uint8_t *buf;
+	FILE *fd;
+	long n;
+
+	fd = fopen(path, "rb");
+	if (!fd)
+		return NULL;
+
+	fseek(fd, 0, SEEK_END);
+	n = ftell(fd);
+	rewind(fd);
+
+	buf = malloc(n);
+	*len = fread(buf, 1, n, fd);
+	fclose(fd);
+
+	return buf;
+}
+
+static void bench(const char *name, struct fake_cam *cam, struct frame_source *src)
+{
+	struct stream_sink sink = { 0 };
+	struct stream_stats stats;
+	pthread_t tid;
+	int fds[2];
+
+	socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	pthread_create(&tid, NULL, drain, &fds[1]);
+
+	sink.ctx = &fds[0];
+	sink.send = socket_send;
+
+	mjpeg_stream(src, &sink, 0, 2000, &stats);
+
+	close(fds[0]);
+	pthread_join(tid, NULL);
+	close(fds[1]);
+
+	printf("{\"bench\": \"%s\", \"frames\": %u, \"avg_frame_kb\": %.1f, \"fps\": %.0f, \"kb_per_s\": %.0f}\n",
+	       name, stats.frames, stats.bytes / 1024.0 / stats.frames, stats.frames * 1e6 / stats.elapsed_us,
+	       stats.bytes / 1024.0 * 1e6 / stats.elapsed_us);
+}
+
+int main(int argc, char **argv)
+{
+	struct frame_source src;
+	struct fake_cam cam;
+	int fails = 0;
+
+	fails += check_stream();
+	fails += check_frame_send();
+	fails += check_errors();
+	fails += check_fps_cap();
+
+	fake_init(&cam, &src);
+
+	/* recorded frames instead of the fake ones */
+	if (argc > 1) {
+		fake_free(&cam);
+		cam.count = 0;
+
+		for (int i = 1; i < argc && cam.count < MAX_FRAMES; i++) {
+			cam.frames[cam.count] = load(argv[i], &cam.lens[cam.count]);
+			if (!cam.frames[cam.count]) {
+				fprintf(stderr, "failed to load %s\n", argv[i]);
+				return 1;
+			}
+			cam.count++;
+		}
+	}
+
+	bench(argc > 1 ? "files" : "fake", &cam, &src);
+	fake_free(&cam);
+
+	fprintf(stderr, "%s\n", fails ? "FAILED" : "PASSED");
+	return fails ? 1 : 0;
+}
@@ -0,0 +1,127 @@
+/*
+ * Q15 gain stage: y = x * g / 2^15, rounded, saturated to 16 bits
+ *
+ * Gain changes are spread over the next block as a linear ramp with a step
+ * per frame, which avoids zipper noise of block-wise jumps. Ramp position
+ * has GAIN_RAMP_SHIFT extra fraction bits, so slow fades over long blocks
+ * still move every frame.
+ *
+ * Dither: requantization of the 31-bit product to out_bits adds error
+ * correlated with the signal; triangular (TPDF) noise of +-1 output LSB,
+ * the difference of two uniform randoms, turns it into a flat noise floor.
+ * Both randoms come from one xorshift32 output.
+ */
+
+#include <math.h>
+
+#include "gain.h"
+
+void gain_init(struct gain *g, unsigned int channels, int32_t q15)
+{
+	g->current = q15;
+	g->target = q15;
+	g->channels = channels;
+	g->drop = 0;
+	g->dither = 0;
+	g->rng = 1;
+}
+
+void gain_set(struct gain *g, int32_t q15)
+{
+	g->target = (q15 < 0) ? 0 : (q15 > GAIN_MAX) ? GAIN_MAX : q15;
+}
+
+int32_t gain_from_db10(int db10)
+{
+	float v = powf(10.0f, db10 / 200.0f) * GAIN_UNITY + 0.5f;
+
+	return (v >= GAIN_MAX) ? GAIN_MAX : (int32_t)v;
+}
+
+void gain_set_dither(struct gain *g, unsigned int out_bits, uint32_t seed)
+{
+	if (out_bits < 8 || out_bits > 16) {
+		g->dither = 0;
+		g->drop = 0;
+		return;
+	}
+
+	g->dither = 1;
+	g->drop = 16 - out_bits;
+	g->rng = seed ? seed : 1;
+}
+
+static inline int16_t sat16(int32_t v)
+{
+	return (v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v;
+}
+
+/* no dither: round half up; product and rounding constant fit in 32 bits for gain <= GAIN_MAX */
+static void gain_round(int16_t *buf, size_t frames, unsigned int ch, int32_t acc, int32_t step)
+{
+	if (!step) {
+		const int32_t k = acc >> GAIN_RAMP_SHIFT;
+
+		for (size_t i = 0; i < frames * ch; i++)
+			buf[i] = sat16((buf[i] * k + (1 << (GAIN_SHIFT - 1))) >> GAIN_SHIFT);
+
+		return;
+	}
+
+	for (size_t i = 0; i < frames; i++, acc += step) {
+		const int32_t k = acc >> GAIN_RAMP_SHIFT;
+
+		for (unsigned int c = 0; c < ch; c++, buf++)
+			*buf = sat16((*buf * k + (1 << (GAIN_SHIFT - 1))) >> GAIN_SHIFT);
+	}
+}
+
+static void gain_tpdf(struct gain *g, int16_t *buf, size_t frames, int32_t acc, int32_t step)
+{
+	const unsigned int shift = GAIN_SHIFT + g->drop;
+	const int32_t max = INT16_MAX >> g->drop;
+	const int32_t min = INT16_MIN >> g->drop;
+	const unsigned int ch = g->channels;
+	uint32_t x = g->rng;
+
+	for (size_t i = 0; i < frames; i++, acc += step) {
+		const int32_t k = acc >> GAIN_RAMP_SHIFT;
+
+		for (unsigned int c = 0; c < ch; c++, buf++) {
+			int32_t noise, y;
+
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+
+			/* (r1 - r2) / 2^16 output LSB: triangular in (-1, 1) LSB */
+			noise = ((int32_t)(x & 0xffff) - (int32_t)(x >> 16)) * (1 << g->drop) / 2;
+
+			y = ((int64_t)*buf * k + noise + (1 << (shift - 1))) >> shift;
+			y = (y > max) ? max : (y < min) ? min : y;
+
+			*buf = y * (1 << g->drop);
+		}
+	}
+
+	g->rng = x;
+}
+
+void gain_apply(struct gain *g, int16_t *buf, size_t frames)
+{
+	int32_t acc = g->current << GAIN_RAMP_SHIFT;
+	int32_t step = 0;
+
+	if (!frames)
+		return;
+
+	if (g->target != g->current)
+		step = (int32_t)((g->target - g->current) * (1 << GAIN_RAMP_SHIFT)) / (int32_t)frames;
+
+	if (g->dither)
+		gain_tpdf(g, buf, frames, acc, step);
+	else if (step || g->current != GAIN_UNITY)
+		gain_round(buf, frames, g->channels, acc, step);
+
+	g->current = g->target;
+}
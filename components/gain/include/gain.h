@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Q15 gain stage for 16-bit PCM blocks, shared by the i2s examples:
+ * - applied in place, frame by frame, same gain for all channels
+ * - a new gain is reached by a linear ramp over the next block
+ * - results saturate to 16 bits instead of wrapping
+ * - optional TPDF dither when the output is requantized to fewer bits
+ */
+
+#define GAIN_SHIFT	15
+#define GAIN_UNITY	(1 << GAIN_SHIFT)
+#define GAIN_MAX	(2 << GAIN_SHIFT)	/* +6 dB: product still fits in 32 bits */
+#define GAIN_RAMP_SHIFT	8			/* extra fraction bits of the ramp step */
+
+struct gain {
+	int32_t current;	/* Q15, gain at the start of the next block */
+	int32_t target;		/* Q15, reached at the end of the next block */
+	unsigned int channels;
+	unsigned int drop;	/* low bits cleared in the output, with dither */
+	int dither;
+	uint32_t rng;		/* xorshift32 state */
+};
+
+void gain_init(struct gain *g, unsigned int channels, int32_t q15);
+void gain_set(struct gain *g, int32_t q15);
+
+/* Q15 gain for a level in tenths of dB, clamped to 0 .. GAIN_MAX */
+int32_t gain_from_db10(int db10);
+
+/* out_bits 8..16: TPDF dither and requantization to out_bits; 0 - rounding, no dither */
+void gain_set_dither(struct gain *g, unsigned int out_bits, uint32_t seed);
+
+void gain_apply(struct gain *g, int16_t *buf, size_t frames);
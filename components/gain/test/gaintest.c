@@ -0,0 +1,262 @@
+/*
+ * Gain stage test and benchmark:
+ * - bit exact against a per-sample 64-bit reference: constant gain, ramps
+ *   up and down over odd block sizes, with and without dither
+ * - ramp reaches the target, saturation instead of wrap, unity is a no-op
+ * - dither: cleared low bits, bounded error, a level below one output LSB
+ *   survives on average where plain rounding makes it silence
+ * - cycles per sample for constant gain, ramp and dither, JSON lines
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "gain.h"
+#include "host_test.h"
+
+#define MAX_FRAMES	301
+#define BENCH_FRAMES	(16 * 1024)
+#define BENCH_RUNS	20
+
+static uint32_t seed = 12345;
+
+static uint32_t rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed;
+}
+
+static void fill(int16_t *buf, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		buf[i] = rnd() >> 16;
+}
+
+/* reference: the same arithmetic written per sample in 64 bits */
+struct ref {
+	int64_t current;
+	int64_t target;
+	unsigned int channels;
+	unsigned int drop;
+	int dither;
+	uint32_t rng;
+};
+
+static void ref_apply(struct ref *r, int16_t *buf, size_t frames)
+{
+	int64_t step = (r->target - r->current) * 256 / (int64_t)frames;
+	int64_t max = 32767 >> r->drop << r->drop;
+
+	for (size_t i = 0; i < frames; i++) {
+		int64_t k = (r->current * 256 + step * (int64_t)i) >> 8;
+
+		for (unsigned int c = 0; c < r->channels; c++) {
+			int16_t *p = &buf[i * r->channels + c];
+			int64_t noise = 0;
+			int64_t y;
+
+			if (r->dither) {
+				r->rng ^= r->rng << 13;
+				r->rng ^= r->rng >> 17;
+				r->rng ^= r->rng << 5;
+				noise = ((int64_t)(r->rng & 0xffff) - (r->rng >> 16)) * (1 << r->drop) / 2;
+			}
+
+			y = ((*p * k + noise + (1LL << (14 + r->drop))) >> (15 + r->drop)) * (1 << r->drop);
+			*p = (y > max) ? max : (y < -32768) ? -32768 : y;
+		}
+	}
+
+	r->current = r->target;
+}
+
+static int check_exact(unsigned int channels, unsigned int out_bits)
+{
+	static const int32_t targets[] = { GAIN_UNITY, 0, GAIN_MAX, 12345, 12345, GAIN_UNITY, 1, 40000 };
+	int16_t a[MAX_FRAMES * 2], b[MAX_FRAMES * 2];
+	struct gain g;
+	struct ref r;
+	int fails = 0;
+
+	gain_init(&g, channels, GAIN_UNITY / 2);
+	gain_set_dither(&g, out_bits, 7);
+
+	r = (struct ref){ GAIN_UNITY / 2, GAIN_UNITY / 2, channels, out_bits ? 16 - out_bits : 0, !!out_bits, 7 };
+
+	for (size_t t = 0; t < sizeof(targets) / sizeof(targets[0]); t++) {
+		for (size_t frames = 1; frames <= MAX_FRAMES; frames += 37) {
+			fill(a, frames * channels);
+			memcpy(b, a, sizeof(a[0]) * frames * channels);
+
+			gain_set(&g, targets[t]);
+			r.target = (targets[t] > GAIN_MAX) ? GAIN_MAX : targets[t];
+
+			gain_apply(&g, a, frames);
+			ref_apply(&r, b, frames);
+
+			if (memcmp(a, b, sizeof(a[0]) * frames * channels) || g.current != r.current)
+				fails++;
+		}
+	}
+
+	printf("exact ch %u bits %-10u %s\n", channels, out_bits, fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+/* behaviour which does not depend on the reference */
+static int check_behaviour(void)
+{
+	int16_t buf[MAX_FRAMES * 2];
+	struct gain g;
+	int fails = 0;
+
+	/* unity without dither leaves data as it is */
+	gain_init(&g, 2, GAIN_UNITY);
+	fill(buf, MAX_FRAMES * 2);
+	{
+		int16_t copy[MAX_FRAMES * 2];
+
+		memcpy(copy, buf, sizeof(buf));
+		gain_apply(&g, buf, MAX_FRAMES);
+		if (memcmp(copy, buf, sizeof(buf)))
+			fails++;
+	}
+
+	/* fade in of full scale: monotonic, from silence towards the target */
+	gain_init(&g, 1, 0);
+	gain_set(&g, GAIN_UNITY);
+	for (int i = 0; i < 256; i++)
+		buf[i] = 32767;
+	gain_apply(&g, buf, 256);
+	if (buf[0] != 0 || buf[255] < 32767 - 256)
+		fails++;
+	for (int i = 1; i < 256; i++)
+		if (buf[i] < buf[i - 1])
+			fails++;
+	if (g.current != GAIN_UNITY)
+		fails++;
+
+	/* +6 dB saturates, both signs */
+	gain_init(&g, 2, GAIN_MAX);
+	buf[0] = 20000;
+	buf[1] = -20000;
+	buf[2] = -32768;
+	buf[3] = 100;
+	gain_apply(&g, buf, 2);
+	if (buf[0] != 32767 || buf[1] != -32768 || buf[2] != -32768 || buf[3] != 200)
+		fails++;
+
+	/* out of range gain is clamped */
+	gain_set(&g, -5);
+	if (g.target != 0)
+		fails++;
+	gain_set(&g, GAIN_MAX * 4);
+	if (g.target != GAIN_MAX)
+		fails++;
+
+	if (gain_from_db10(0) != GAIN_UNITY || gain_from_db10(-60) != 16423 || gain_from_db10(200) != GAIN_MAX ||
+	    gain_from_db10(-600) != 33 || gain_from_db10(-1200) != 0)
+		fails++;
+
+	printf("%-24s %s\n", "behaviour", fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+/* level of a quarter output LSB at 8 bits: rounding gives silence, dither keeps it */
+static int check_dither(void)
+{
+	enum { N = 64 * 1024 };
+	int16_t *buf = malloc(N * sizeof(*buf));
+	int64_t sum = 0;
+	struct gain g;
+	int fails = 0;
+	double mean;
+
+	gain_init(&g, 1, GAIN_UNITY);
+	gain_set_dither(&g, 8, 1);
+
+	for (int i = 0; i < N; i++)
+		buf[i] = 64;
+	gain_apply(&g, buf, N);
+
+	for (int i = 0; i < N; i++) {
+		if (buf[i] & 0xff || buf[i] < -256 || buf[i] > 256)
+			fails++;
+		sum += buf[i];
+	}
+
+	mean = (double)sum / N;
+	if (mean < 60 || mean > 68)
+		fails++;
+
+	gain_set_dither(&g, 0, 0);
+	for (int i = 0; i < N; i++)
+		buf[i] = 64;
+	gain_apply(&g, buf, N);
+	for (int i = 0; i < N; i++)
+		if (buf[i] != 64)
+			fails++;
+
+	printf("{\"test\": \"dither\", \"bits\": 8, \"level\": 64, \"mean\": %.2f, \"status\": \"%s\"}\n",
+	       mean, fails ? "FAIL" : "PASS");
+
+	free(buf);
+
+	return fails;
+}
+
+static void bench(const char *name, int32_t from, int32_t to, unsigned int out_bits)
+{
+	int16_t *buf = malloc(BENCH_FRAMES * 2 * sizeof(*buf));
+	uint64_t best = UINT64_MAX;
+	struct gain g;
+
+	gain_init(&g, 2, from);
+	gain_set_dither(&g, out_bits, 1);
+
+	for (int r = 0; r < BENCH_RUNS; r++) {
+		uint64_t start;
+
+		fill(buf, BENCH_FRAMES * 2);
+		g.current = from;
+		gain_set(&g, to);
+
+		start = cycles();
+		gain_apply(&g, buf, BENCH_FRAMES);
+		start = cycles() - start;
+		if (start < best)
+			best = start;
+	}
+
+	printf("{\"gain\": \"%s\", \"samples\": %d, \"cycles_per_sample\": %.3f}\n",
+	       name, BENCH_FRAMES * 2, (double)best / (BENCH_FRAMES * 2));
+
+	free(buf);
+}
+
+int main(void)
+{
+	int fails = 0;
+
+	for (unsigned int ch = 1; ch <= 2; ch++) {
+		fails += check_exact(ch, 0);
+		fails += check_exact(ch, 16);
+		fails += check_exact(ch, 12);
+		fails += check_exact(ch, 8);
+	}
+
+	fails += check_behaviour();
+	fails += check_dither();
+
+	bench("unity", GAIN_UNITY, GAIN_UNITY, 0);
+	bench("constant", 20000, 20000, 0);
+	bench("ramp", 0, GAIN_MAX, 0);
+	bench("dither", 20000, 20000, 16);
+	bench("ramp-dither", 0, GAIN_MAX, 12);
+
+	return test_done(fails);
+}
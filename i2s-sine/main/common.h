@@ -0,0 +1,159 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* sine generators: fill 'samples' values, return size of the buffer in bytes */
+
+typedef size_t (*sine_gen_t)(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
+
+size_t sine_float(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
+size_t sine_cordic16(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
+size_t sine_cordic16_v2(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
+size_t sine_cordic32(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
+size_t sine_cordic32_batch(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
+size_t sine_cordic32_v2(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
+size_t sine_dds(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
+
+/* generator registry: backends with min/avg/max cpu cycles per sample */
+
+struct sine_backend {
+	const char *name;
+	sine_gen_t gen;
+
+	uint32_t calls;
+	uint64_t samples;
+	uint64_t cycles;
+	float min_cps;
+	float max_cps;
+};
+
+extern struct sine_backend sine_backends[];
+extern const unsigned int sine_backends_count;
+
+struct sine_backend *sine_backend_find(const char *name);
+size_t sine_backend_run(struct sine_backend *b, int freq, unsigned int samples_per_sec, int amp,
+			int16_t *sine, unsigned int samples);
+float sine_backend_avg_cps(const struct sine_backend *b);
+void sine_backend_reset(struct sine_backend *b);
+
+/* dds helpers: phase step for the tone and a single sample at given phase */
+
+uint32_t dds_step(int freq, unsigned int samples_per_sec);
+int16_t dds_sample(uint32_t phase, int amp);
+
+/* renderers: fill 'samples' values starting from given phase */
+
+typedef void (*sine_render_t)(uint32_t phase, uint32_t step, int amp, int16_t *sine, unsigned int samples);
+
+void dds_render(uint32_t phase, uint32_t step, int amp, int16_t *sine, unsigned int samples);
+void cordic32_render(uint32_t phase, uint32_t step, int amp, int16_t *sine, unsigned int samples);
+
+/* cordic kernels: sin and cos pair for dds phase, see cordic.h */
+
+void cordic16_sincos(uint32_t phase, int32_t *s, int32_t *c);
+void cordic32_sincos(uint32_t phase, int64_t *s, int64_t *c);
+void cordic32_sincos_batch(const uint32_t *phase, int64_t *s, int64_t *c, unsigned int n);
+
+/* streaming dds generator: phase is continuous across blocks and tone changes */
+
+struct sine_stream {
+	uint32_t phase;
+	uint32_t step;
+	int amp;
+	unsigned int samples_per_sec;
+};
+
+void sine_stream_init(struct sine_stream *s, unsigned int samples_per_sec);
+void sine_stream_set(struct sine_stream *s, int freq, int amp);
+size_t sine_stream_fill(struct sine_stream *s, int16_t *sine, unsigned int samples);
+
+/* tone cache: exact super-period of the tone, played as wrap-around reads */
+
+#define TONE_CACHE_SLOTS 16
+
+struct tone {
+	sine_gen_t gen;
+	int freq;
+	unsigned int samples_per_sec;
+	int amp;
+	unsigned int samples;
+	unsigned int refs;	/* being played: not evicted */
+	uint32_t last_used;
+	int16_t *sine;
+};
+
+struct tone_cache {
+	struct tone tones[TONE_CACHE_SLOTS];
+	size_t budget;
+	size_t used;
+	uint32_t clock;
+	uint32_t hits;
+	uint32_t misses;
+	uint32_t evictions;
+};
+
+unsigned int tone_period(int freq, unsigned int samples_per_sec);
+void tone_cache_init(struct tone_cache *c, size_t budget);
+void tone_cache_flush(struct tone_cache *c);
+struct tone *tone_cache_find(struct tone_cache *c, sine_gen_t gen, int freq,
+			     unsigned int samples_per_sec, int amp);
+struct tone *tone_cache_lookup(struct tone_cache *c, sine_gen_t gen, int freq,
+			       unsigned int samples_per_sec, int amp);
+struct tone *tone_cache_alloc(struct tone_cache *c, sine_gen_t gen, int freq,
+			      unsigned int samples_per_sec, int amp);
+struct tone *tone_cache_insert(struct tone_cache *c, sine_gen_t gen, int freq,
+			       unsigned int samples_per_sec, int amp, int16_t *sine);
+struct tone *tone_cache_get(struct tone_cache *c, sine_gen_t gen, int freq,
+			    unsigned int samples_per_sec, int amp);
+size_t tone_read(struct tone *t, unsigned int *pos, int16_t *sine, unsigned int samples);
+
+/* parallel renderer: block is split between worker tasks, one per core */
+
+#define SINE_PAR_MAX_WORKERS 8
+
+struct sine_par;
+
+struct sine_par *sine_par_create(unsigned int workers);
+void sine_par_destroy(struct sine_par *p);
+void sine_par_render(struct sine_par *p, sine_render_t render, uint32_t phase, uint32_t step,
+		     int amp, int16_t *sine, unsigned int samples);
+size_t sine_stream_fill_par(struct sine_stream *s, struct sine_par *p, sine_render_t render,
+			    int16_t *sine, unsigned int samples);
+
+/* embedded note tables: exact super-period in flash, generated at build time */
+
+struct note {
+	int freq;
+	unsigned int samples;
+	const int16_t *sine;
+};
+
+extern const struct note notes[];
+extern const unsigned int notes_count;
+extern const unsigned int notes_samples_per_sec;
+extern const int notes_amp;
+
+/* spsc ring of DMA-sized blocks between generator and i2s writer */
+
+struct ring {
+	int16_t *blocks;
+	unsigned int nblocks;
+	unsigned int block_samples;
+	atomic_uint_least32_t head;
+	atomic_uint_least32_t tail;
+	atomic_uint_least32_t underruns;	/* times the consumer ran dry after the first block */
+
+	/* consumer side only */
+	int streaming;
+	int starved;
+};
+
+int ring_init(struct ring *r, unsigned int nblocks, unsigned int block_samples);
+void ring_deinit(struct ring *r);
+unsigned int ring_count(struct ring *r);
+int16_t *ring_produce_begin(struct ring *r);
+void ring_produce_commit(struct ring *r);
+int16_t *ring_consume_begin(struct ring *r);
+void ring_consume_commit(struct ring *r);
@@ -0,0 +1,171 @@
+/*
+ * Cordic kernel template: CORDIC_DEFINE(name, type, frac, angle_bits, niter)
+ *
+ * Defines name##_sincos(phase, &sin, &cos) computing both sin and cos of
+ * the phase in signed fixed point math:
+ * - type: signed integer type for x/y/z registers, e.g. int32_t or int64_t
+ * - frac: number of fraction bits in results, i.e. 1.0 = 1 << frac
+ * - angle_bits: resolution of z register, full turn is 1 << angle_bits
+ * - niter: number of iterations, up to CORDIC_MAX_ITER
+ *
+ * Also defines name##_sincos_batch(phase[], sin[], cos[], n) rotating
+ * CORDIC_LANES independent phases in lock-step: registers are kept as
+ * structure of arrays and the lane loop is innermost, so there is no serial
+ * dependency between lanes. It gives ILP on Xtensa and auto-vectorizes on
+ * host without any SIMD intrinsics. Results are equal to name##_sincos.
+ *
+ * Phase is a binary angle: full turn is 2^32, same as dds phase accumulator.
+ * Arctan table and gain for the given number of iterations are constant
+ * expressions, so they are computed by compiler at build time.
+ *
+ * Source: https://www.dcs.gla.ac.uk/~jhw/cordic/index.html
+ */
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+
+#define CORDIC_MAX_ITER 32
+#define CORDIC_LANES 8
+
+/* atan(x) for x <= 1/2: Horner form of Taylor series, error < 1e-12 */
+#define CORDIC_ATAN_SERIES(x, x2) \
+	((x) * (1 - (x2) * (1.0 / 3 - (x2) * (1.0 / 5 - (x2) * (1.0 / 7 - (x2) * (1.0 / 9 - \
+	(x2) * (1.0 / 11 - (x2) * (1.0 / 13 - (x2) * (1.0 / 15 - (x2) * (1.0 / 17 - \
+	(x2) * (1.0 / 19 - (x2) * (1.0 / 21 - (x2) * (1.0 / 23 - (x2) * (1.0 / 25 - \
+	(x2) * (1.0 / 27 - (x2) * (1.0 / 29 - (x2) * (1.0 / 31 - (x2) * (1.0 / 33 - \
+	(x2) * (1.0 / 35 - (x2) * (1.0 / 37 - (x2) * (1.0 / 39)))))))))))))))))))))
+
+#define CORDIC_POW2(k) (1.0 / (double)(1ULL << (k)))
+
+/* atan(2^-k) in turns */
+#define CORDIC_ATAN_TURN(k) \
+	(((k) == 0) ? 0.125 : \
+	 CORDIC_ATAN_SERIES(CORDIC_POW2(k), CORDIC_POW2(2 * (k))) / (2 * M_PI))
+
+#define CORDIC_ATAN(type, bits, k) \
+	((type)(CORDIC_ATAN_TURN(k) * (double)(1ULL << (bits)) + 0.5))
+
+#define CORDIC_ATAN_TABLE(type, bits) \
+	CORDIC_ATAN(type, bits, 0),  CORDIC_ATAN(type, bits, 1),  \
+	CORDIC_ATAN(type, bits, 2),  CORDIC_ATAN(type, bits, 3),  \
+	CORDIC_ATAN(type, bits, 4),  CORDIC_ATAN(type, bits, 5),  \
+	CORDIC_ATAN(type, bits, 6),  CORDIC_ATAN(type, bits, 7),  \
+	CORDIC_ATAN(type, bits, 8),  CORDIC_ATAN(type, bits, 9),  \
+	CORDIC_ATAN(type, bits, 10), CORDIC_ATAN(type, bits, 11), \
+	CORDIC_ATAN(type, bits, 12), CORDIC_ATAN(type, bits, 13), \
+	CORDIC_ATAN(type, bits, 14), CORDIC_ATAN(type, bits, 15), \
+	CORDIC_ATAN(type, bits, 16), CORDIC_ATAN(type, bits, 17), \
+	CORDIC_ATAN(type, bits, 18), CORDIC_ATAN(type, bits, 19), \
+	CORDIC_ATAN(type, bits, 20), CORDIC_ATAN(type, bits, 21), \
+	CORDIC_ATAN(type, bits, 22), CORDIC_ATAN(type, bits, 23), \
+	CORDIC_ATAN(type, bits, 24), CORDIC_ATAN(type, bits, 25), \
+	CORDIC_ATAN(type, bits, 26), CORDIC_ATAN(type, bits, 27), \
+	CORDIC_ATAN(type, bits, 28), CORDIC_ATAN(type, bits, 29), \
+	CORDIC_ATAN(type, bits, 30), CORDIC_ATAN(type, bits, 31)
+
+/* 1/sqrt(1 + e) for e <= 1/64: Taylor series, error < 1e-15 */
+#define CORDIC_RSQRT1P(e) \
+	(1 - (e) * (1.0 / 2 - (e) * (3.0 / 8 - (e) * (5.0 / 16 - (e) * (35.0 / 128 - \
+	(e) * (63.0 / 256 - (e) * (231.0 / 1024 - (e) * (429.0 / 2048))))))))
+
+/* scale factor of the k-th iteration: 1/sqrt(1 + 2^-2k) */
+#define CORDIC_SCALE(k) \
+	(((k) == 0) ? M_SQRT1_2 : \
+	 ((k) == 1) ? 0.89442719099991587856 : \
+	 ((k) == 2) ? 0.97014250014533188680 : \
+	 CORDIC_RSQRT1P(CORDIC_POW2(2 * (k))))
+
+#define CORDIC_GAIN_K(n, k) (((k) < (n)) ? CORDIC_SCALE(k) : 1.0)
+
+/* 1/K: product of iteration scale factors for n iterations */
+#define CORDIC_GAIN(n) \
+	(CORDIC_GAIN_K(n, 0)  * CORDIC_GAIN_K(n, 1)  * CORDIC_GAIN_K(n, 2)  * CORDIC_GAIN_K(n, 3)  * \
+	 CORDIC_GAIN_K(n, 4)  * CORDIC_GAIN_K(n, 5)  * CORDIC_GAIN_K(n, 6)  * CORDIC_GAIN_K(n, 7)  * \
+	 CORDIC_GAIN_K(n, 8)  * CORDIC_GAIN_K(n, 9)  * CORDIC_GAIN_K(n, 10) * CORDIC_GAIN_K(n, 11) * \
+	 CORDIC_GAIN_K(n, 12) * CORDIC_GAIN_K(n, 13) * CORDIC_GAIN_K(n, 14) * CORDIC_GAIN_K(n, 15) * \
+	 CORDIC_GAIN_K(n, 16) * CORDIC_GAIN_K(n, 17) * CORDIC_GAIN_K(n, 18) * CORDIC_GAIN_K(n, 19) * \
+	 CORDIC_GAIN_K(n, 20) * CORDIC_GAIN_K(n, 21) * CORDIC_GAIN_K(n, 22) * CORDIC_GAIN_K(n, 23) * \
+	 CORDIC_GAIN_K(n, 24) * CORDIC_GAIN_K(n, 25) * CORDIC_GAIN_K(n, 26) * CORDIC_GAIN_K(n, 27) * \
+	 CORDIC_GAIN_K(n, 28) * CORDIC_GAIN_K(n, 29) * CORDIC_GAIN_K(n, 30) * CORDIC_GAIN_K(n, 31))
+
+/*
+ * Quadrant folding without branches: cordic converges for |z| < 1.74 rad,
+ * so angles in (pi/2, 3pi/2) are mapped to pi - a, which keeps sin and
+ * flips the sign of cos. Mask m is all ones for folded angles.
+ */
+#define CORDIC_FOLD_MASK(phase)		(-(uint32_t)((uint32_t)((phase) + 0x40000000U) >> 31))
+#define CORDIC_FOLD(phase, m)		((int32_t)(uint32_t)(((phase) ^ (m)) - (m) + ((m) & 0x80000000U)))
+
+#define CORDIC_DEFINE(name, type, frac, angle_bits, niter)				\
+											\
+_Static_assert((niter) <= CORDIC_MAX_ITER, "too many cordic iterations");		\
+_Static_assert((angle_bits) <= 32, "cordic angle resolution is limited by phase");	\
+											\
+static const type name##_atan[CORDIC_MAX_ITER] = {					\
+	CORDIC_ATAN_TABLE(type, angle_bits)						\
+};											\
+											\
+static const type name##_1K =								\
+	(type)(CORDIC_GAIN(niter) * (double)((type)1 << (frac)) + 0.5);		\
+											\
+static inline void name##_sincos(uint32_t phase, type *s, type *c)			\
+{											\
+	uint32_t m = CORDIC_FOLD_MASK(phase);						\
+	type z = CORDIC_FOLD(phase, m) >> (32 - (angle_bits));				\
+	type x = name##_1K;								\
+	type y = 0;									\
+	type d, tx;									\
+											\
+	for (int k = 0; k < (niter); k++) {						\
+		d = z >> (sizeof(type) * 8 - 1);					\
+		tx = x - (((y >> k) ^ d) - d);						\
+		y = y + (((x >> k) ^ d) - d);						\
+		z = z - ((name##_atan[k] ^ d) - d);					\
+		x = tx;									\
+	}										\
+											\
+	d = (type)(int32_t)m;								\
+	*c = (x ^ d) - d;								\
+	*s = y;										\
+}											\
+											\
+static inline void name##_sincos_batch(const uint32_t *phase, type *s, type *c,	\
+				       unsigned int n)					\
+{											\
+	type x[CORDIC_LANES], y[CORDIC_LANES], z[CORDIC_LANES];			\
+	type m[CORDIC_LANES], d[CORDIC_LANES], tx[CORDIC_LANES];			\
+	unsigned int i = 0;								\
+											\
+	for (; i + CORDIC_LANES <= n; i += CORDIC_LANES) {				\
+		for (int j = 0; j < CORDIC_LANES; j++) {				\
+			uint32_t mj = CORDIC_FOLD_MASK(phase[i + j]);			\
+											\
+			z[j] = CORDIC_FOLD(phase[i + j], mj) >> (32 - (angle_bits));	\
+			m[j] = (type)(int32_t)mj;					\
+			x[j] = name##_1K;						\
+			y[j] = 0;							\
+		}									\
+											\
+		for (int k = 0; k < (niter); k++) {					\
+			type a = name##_atan[k];					\
+											\
+			for (int j = 0; j < CORDIC_LANES; j++) {			\
+				d[j] = z[j] >> (sizeof(type) * 8 - 1);			\
+				tx[j] = x[j] - (((y[j] >> k) ^ d[j]) - d[j]);		\
+				y[j] = y[j] + (((x[j] >> k) ^ d[j]) - d[j]);		\
+				z[j] = z[j] - ((a ^ d[j]) - d[j]);			\
+				x[j] = tx[j];						\
+			}								\
+		}									\
+											\
+		for (int j = 0; j < CORDIC_LANES; j++) {				\
+			c[i + j] = (x[j] ^ m[j]) - m[j];				\
+			s[i + j] = y[j];						\
+		}									\
+	}										\
+											\
+	for (; i < n; i++)								\
+		name##_sincos(phase[i], &s[i], &c[i]);					\
+}
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+#
+# Generate exact-period int16 sine tables for a set of notes
+#
+# Each table holds rate / gcd(freq, rate) samples, i.e. a whole number of
+# periods, so it can be played in a loop without discontinuities. Tables
+# are 'const', so they are placed into flash. Tables are named by their
+# index in the list, so a frequency may be listed more than once.
+
+import argparse
+import math
+import sys
+
+
+def period(freq, rate):
+    return rate // math.gcd(freq, rate)
+
+
+def table(freq, rate, amp):
+    n = period(freq, rate)
+    return [round(amp * math.sin(2 * math.pi * ((freq * i) % rate) / rate)) for i in range(n)]
+
+
+def main():
+    parser = argparse.ArgumentParser(description='generate embedded note tables')
+    parser.add_argument('--rate', type=int, required=True, help='sample rate, Hz')
+    parser.add_argument('--amp', type=int, required=True, help='amplitude')
+    parser.add_argument('--notes', type=str, required=True, help='space separated note frequencies, Hz')
+    parser.add_argument('--output', type=str, help='output file, stdout by default')
+    args = parser.parse_args()
+
+    notes = [int(f) for f in args.notes.split()]
+    out = open(args.output, 'w') if args.output else sys.stdout
+
+    out.write('/* generated by gen_notes.py: do not edit */\n\n')
+    out.write('#include "common.h"\n\n')
+
+    for i, f in enumerate(notes):
+        v = table(f, args.rate, args.amp)
+        out.write('static const int16_t note_%d[%d] = {\n' % (i, len(v)))
+        for k in range(0, len(v), 12):
+            out.write('\t' + ' '.join('%d,' % x for x in v[k:k + 12]) + '\n')
+        out.write('};\n\n')
+
+    out.write('const struct note notes[] = {\n')
+    for i, f in enumerate(notes):
+        out.write('\t{ %d, %d, note_%d },\n' % (f, period(f, args.rate), i))
+    out.write('};\n\n')
+
+    out.write('const unsigned int notes_count = %d;\n' % len(notes))
+    out.write('const unsigned int notes_samples_per_sec = %d;\n' % args.rate)
+    out.write('const int notes_amp = %d;\n' % args.amp)
+
+    if args.output:
+        out.close()
+
+
+if __name__ == '__main__':
+    main()
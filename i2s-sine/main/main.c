@@ -7,37 +7,99 @@
    CONDITIONS OF ANY KIND, either express or implied.
 */
 
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 
 #include "esp_flash.h"
 #include "esp_log.h"
+#include "esp_random.h"
 
 #include "driver/i2s_std.h"
 
 #include "sdkconfig.h"
 
+#include "common.h"
+#include "gain.h"
+
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
 #define STACK_SIZE 3584
-#define SAMPLING_FREQ 16000
+#define SAMPLING_FREQ CONFIG_SINE_SAMPLE_RATE
+#define AMPLITUDE CONFIG_SINE_AMPLITUDE
 
-static const char *TAG = "sine";
+#ifdef CONFIG_SINE_DITHER
+#define DITHER_BITS CONFIG_SINE_DITHER_BITS
+#else
+#define DITHER_BITS 0
+#endif
+#define BLOCK_SAMPLES 240 /* I2S_CHANNEL_DEFAULT_CONFIG: dma_frame_num */
+#define TONE_CACHE_MAX (CONFIG_SINE_TONE_CACHE_KB * 1024)
+#define RING_BLOCKS 4
+#define RENDER_PRIORITY (tskIDLE_PRIORITY)
+#define PRODUCER_PRIORITY (tskIDLE_PRIORITY + 1)
+#define WRITER_PRIORITY (tskIDLE_PRIORITY + 5)
 
-int freq[] = {261, 293, 329, 349, 392, 440, 493 };
+static const char *TAG = "sine";
 
 static i2s_chan_handle_t tx_handle = NULL;
 
-int16_t sine[SAMPLING_FREQ]; /* duration 1 sec */
+/* tones rendered ahead by the render task, played by the producer */
+static struct tone_cache cache;
+static SemaphoreHandle_t cache_lock;
+
+struct render_job {
+	int freq;
+	struct sine_backend *b;
+	int dump_stats;		/* first tone of a pass over the note set */
+};
+
+/* next tone to render: holds the newest request only */
+static QueueHandle_t render_queue;
+
+/* generator task produces DMA-sized blocks, writer task owns i2s channel */
+static struct ring ring;
+static TaskHandle_t producer_task = NULL;
+static TaskHandle_t consumer_task = NULL;
+static int16_t *out_block = NULL;
+static unsigned int out_pos = 0;
 
-size_t sine_float(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
-size_t sine_cordic16(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
-size_t sine_cordic32(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
+/* updated from i2s isr callbacks */
+static volatile uint32_t dma_sent = 0;
+static volatile uint32_t dma_underruns = 0;
+
+/* output volume, applied by the writer: ramps in from silence on start */
+static struct gain gain;
+
+/* generator output block: one DMA frame */
+static int16_t sine[BLOCK_SAMPLES];
+
+static IRAM_ATTR bool i2s_on_sent(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+	dma_sent++;
+	return false;
+}
+
+/* sending queue overflow: DMA buffer was sent again without new data */
+static IRAM_ATTR bool i2s_on_send_q_ovf(i2s_chan_handle_t handle, i2s_event_data_t *event, void *user_ctx)
+{
+	dma_underruns++;
+	return false;
+}
 
 static esp_err_t i2s_driver_init(void)
 {
+	i2s_event_callbacks_t cbs = {
+		.on_recv = NULL,
+		.on_recv_q_ovf = NULL,
+		.on_sent = i2s_on_sent,
+		.on_send_q_ovf = i2s_on_send_q_ovf,
+	};
+
 	i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
 	chan_cfg.auto_clear = true;
 
@@ -61,87 +123,293 @@ static esp_err_t i2s_driver_init(void)
 	};
 
 	ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_handle, &std_cfg));
+	ESP_ERROR_CHECK(i2s_channel_register_event_callback(tx_handle, &cbs, NULL));
 	ESP_ERROR_CHECK(i2s_channel_enable(tx_handle));
 
 	return ESP_OK;
 }
 
-static void i2s_test(void *args)
+/* producer side: copy samples into ring blocks, wait for a free block if ring is full */
+static void out_write(const int16_t *sine, size_t sz)
 {
-	esp_err_t ret = ESP_OK;
-	size_t bytes_write = 0;
-	uint16_t fq;
-	size_t sz;
+	unsigned int samples = sz / sizeof(*sine);
+	unsigned int len;
 
-	for (int n = 0;; n++) {
-		fq = freq[n % ARRAY_SIZE(freq)];
-
-#if 1
-		sz = sine_float(fq, SAMPLING_FREQ, 2000, &sine[0], ARRAY_SIZE(sine));
-		ESP_LOGI(TAG, "%s: play float sine: freq %u bytes %u", __func__, fq, sz);
+	while (samples) {
+		while (!out_block) {
+			out_block = ring_produce_begin(&ring);
+			if (!out_block)
+				ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
 
-		ret = i2s_channel_write(tx_handle, sine, sz, &bytes_write, portMAX_DELAY);
-		if (ret != ESP_OK) {
-			ESP_LOGE(TAG, "%s: i2s write failed: reason %d", __func__, ret);
-			abort();
+			out_pos = 0;
 		}
 
-		if (bytes_write > 0) {
-			ESP_LOGI(TAG, "%s: i2s sound played, %d bytes are written", __func__, bytes_write);
-		} else {
-			ESP_LOGE(TAG, "%s: i2s sound play failed", __func__);
-			abort();
+		len = BLOCK_SAMPLES - out_pos;
+		len = (samples < len) ? samples : len;
+
+		memcpy(out_block + out_pos, sine, len * sizeof(*sine));
+		out_pos += len;
+		sine += len;
+		samples -= len;
+
+		if (out_pos == BLOCK_SAMPLES) {
+			ring_produce_commit(&ring);
+			xTaskNotifyGive(consumer_task);
+			out_block = NULL;
 		}
+	}
+}
 
-		vTaskDelay(1000 /* ms */ / portTICK_PERIOD_MS);
-#endif
+static void i2s_write(const int16_t *sine, size_t sz)
+{
+	size_t bytes_write = 0;
+	esp_err_t ret;
 
-#if 1
-		sz = sine_cordic16(fq, SAMPLING_FREQ, 2000, &sine[0], ARRAY_SIZE(sine));
-		ESP_LOGI(TAG, "%s: play cordic16 sine: freq %u bytes %u", __func__, fq, sz);
+	ret = i2s_channel_write(tx_handle, sine, sz, &bytes_write, portMAX_DELAY);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "%s: i2s write failed: reason %d", __func__, ret);
+		abort();
+	}
 
-		ret = i2s_channel_write(tx_handle, sine, sz, &bytes_write, portMAX_DELAY);
-		if (ret != ESP_OK) {
-			ESP_LOGE(TAG, "%s: i2s write failed: reason %d", __func__, ret);
-			abort();
-		}
+	if (bytes_write != sz) {
+		ESP_LOGE(TAG, "%s: i2s sound play failed: %d of %d bytes written", __func__, bytes_write, sz);
+		abort();
+	}
+}
 
-		if (bytes_write > 0) {
-			ESP_LOGI(TAG, "%s: i2s sound played, %d bytes are written", __func__, bytes_write);
-		} else {
-			ESP_LOGE(TAG, "%s: i2s sound play failed", __func__);
-			abort();
+/* play embedded note for 1 sec from flash table, no math, one DMA frame at a time */
+static void play_note(const struct note *note)
+{
+	unsigned int pos = 0;
+	unsigned int len;
+
+	ESP_LOGI(TAG, "%s: play embedded sine: freq %u period %u", __func__, note->freq, note->samples);
+
+	for (int i = 0; i < SAMPLING_FREQ; i += len) {
+		len = note->samples - pos;
+		len = (SAMPLING_FREQ - i < len) ? SAMPLING_FREQ - i : len;
+		len = (BLOCK_SAMPLES < len) ? BLOCK_SAMPLES : len;
+
+		out_write(note->sine + pos, len * sizeof(*note->sine));
+
+		pos += len;
+		if (pos == note->samples)
+			pos = 0;
+	}
+}
+
+static void dump_backend_stats(void)
+{
+	for (int i = 0; i < sine_backends_count; i++) {
+		struct sine_backend *b = &sine_backends[i];
+
+		if (!b->calls)
+			continue;
+
+		ESP_LOGI(TAG, "%s: %-14s calls %4lu cycles/sample: min %8.1f avg %8.1f max %8.1f", __func__,
+			b->name, b->calls, b->min_cps, sine_backend_avg_cps(b), b->max_cps);
+	}
+}
+
+/*
+ * Render task: super-period of the tone after the one being played is
+ * generated here by its backend, below the audio tasks, so a slow backend
+ * (soft-float sin() on ESP32) never holds up the producer. Each run is
+ * timed for the backend stats, as wall time: preemption by the audio tasks
+ * shows up in max.
+ */
+static void tone_render(void *args)
+{
+	struct render_job job;
+	unsigned int samples;
+	int16_t *sine;
+	int cached;
+
+	for (;;) {
+		xQueueReceive(render_queue, &job, portMAX_DELAY);
+
+		if (job.dump_stats)
+			dump_backend_stats();
+
+		xSemaphoreTake(cache_lock, portMAX_DELAY);
+		cached = tone_cache_find(&cache, job.b->gen, job.freq, SAMPLING_FREQ, AMPLITUDE) != NULL;
+		xSemaphoreGive(cache_lock);
+
+		if (cached)
+			continue;
+
+		samples = tone_period(job.freq, SAMPLING_FREQ);
+		sine = malloc(samples * sizeof(*sine));
+		if (!sine) {
+			ESP_LOGW(TAG, "%s: no memory for %s sine: freq %u period %u",
+				__func__, job.b->name, job.freq, samples);
+			continue;
 		}
 
-		vTaskDelay(1000 /* ms */ / portTICK_PERIOD_MS);
-#endif
+		sine_backend_run(job.b, job.freq, SAMPLING_FREQ, AMPLITUDE, sine, samples);
 
-#if 1
-		sz = sine_cordic32(fq, SAMPLING_FREQ, 2000, &sine[0], ARRAY_SIZE(sine));
-		ESP_LOGI(TAG, "%s: play cordic32 sine: freq %u bytes %u", __func__, fq, sz);
+		xSemaphoreTake(cache_lock, portMAX_DELAY);
+		if (!tone_cache_insert(&cache, job.b->gen, job.freq, SAMPLING_FREQ, AMPLITUDE, sine))
+			free(sine);
+		xSemaphoreGive(cache_lock);
+	}
+}
 
-		ret = i2s_channel_write(tx_handle, sine, sz, &bytes_write, portMAX_DELAY);
-		if (ret != ESP_OK) {
-			ESP_LOGE(TAG, "%s: i2s write failed: reason %d", __func__, ret);
-			abort();
+/*
+ * Play tone generated by the backend for 1 sec, one DMA frame at a time:
+ * - super-period rendered ahead by the render task is played from the
+ *   cache, it is held so that rendering of the next tone does not evict it
+ * - tone which is not rendered yet is played as cordic stream rendered on
+ *   all cores, block by block
+ *
+ * 1 sec is a whole number of periods, so each tone starts at zero phase.
+ */
+static void play_tone(int fq, struct sine_backend *b, struct sine_par *par, const struct render_job *next)
+{
+	struct sine_stream gen;
+	unsigned int pos = 0;
+	unsigned int len;
+	struct tone *tone;
+
+	xSemaphoreTake(cache_lock, portMAX_DELAY);
+	tone = tone_cache_lookup(&cache, b->gen, fq, SAMPLING_FREQ, AMPLITUDE);
+	if (tone)
+		tone->refs++;
+	xSemaphoreGive(cache_lock);
+
+	/* rendered while this one plays */
+	xQueueOverwrite(render_queue, next);
+
+	if (tone) {
+		ESP_LOGI(TAG, "%s: play %s sine: freq %u period %u hits %lu misses %lu evictions %lu",
+			__func__, b->name, fq, tone->samples, cache.hits, cache.misses, cache.evictions);
+	} else {
+		ESP_LOGI(TAG, "%s: %s sine is not rendered yet, play cordic32 sine: freq %u",
+			__func__, b->name, fq);
+	}
+
+	sine_stream_init(&gen, SAMPLING_FREQ);
+	sine_stream_set(&gen, fq, AMPLITUDE);
+
+	for (int i = 0; i < SAMPLING_FREQ; i += len) {
+		len = (SAMPLING_FREQ - i < ARRAY_SIZE(sine)) ? SAMPLING_FREQ - i : ARRAY_SIZE(sine);
+
+		if (tone)
+			out_write(&sine[0], tone_read(tone, &pos, &sine[0], len));
+		else
+			out_write(&sine[0], sine_stream_fill_par(&gen, par, cordic32_render, &sine[0], len));
+	}
+
+	if (tone) {
+		xSemaphoreTake(cache_lock, portMAX_DELAY);
+		tone->refs--;
+		xSemaphoreGive(cache_lock);
+	}
+}
+
+/*
+ * Whole note set for every backend played, if it fits into the configured
+ * maximum. At least the tone being played and the one rendered ahead.
+ */
+static size_t tone_cache_budget(unsigned int backends)
+{
+	size_t total = 0;
+	size_t max = 0;
+	size_t size;
+
+	for (int i = 0; i < notes_count; i++) {
+		size = tone_period(notes[i].freq, SAMPLING_FREQ) * sizeof(int16_t);
+		total += size;
+		max = (size > max) ? size : max;
+	}
+
+	total *= backends;
+	total = (total < TONE_CACHE_MAX) ? total : TONE_CACHE_MAX;
+
+	return (total > 2 * max) ? total : 2 * max;
+}
+
+/* consumer: owns i2s channel, waits for producer when the ring is empty */
+static void i2s_writer(void *args)
+{
+	int16_t *block;
+
+	for (;;) {
+		block = ring_consume_begin(&ring);
+		if (!block) {
+			ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+			continue;
 		}
 
-		if (bytes_write > 0) {
-			ESP_LOGI(TAG, "%s: i2s sound played, %d bytes are written", __func__, bytes_write);
-		} else {
-			ESP_LOGE(TAG, "%s: i2s sound play failed", __func__);
+		gain_apply(&gain, block, BLOCK_SAMPLES);
+		i2s_write(block, BLOCK_SAMPLES * sizeof(*block));
+		ring_consume_commit(&ring);
+		xTaskNotifyGive(producer_task);
+	}
+}
+
+static void i2s_test(void *args)
+{
+	struct sine_backend *backends = sine_backends;
+	unsigned int nbackends = sine_backends_count;
+	const struct note *note;
+	struct render_job next;
+	struct sine_par *par;
+
+	if (strcmp(CONFIG_SINE_BACKEND, "all")) {
+		backends = sine_backend_find(CONFIG_SINE_BACKEND);
+		nbackends = 1;
+		if (!backends) {
+			ESP_LOGE(TAG, "%s: unknown generator backend: %s", __func__, CONFIG_SINE_BACKEND);
 			abort();
 		}
+	}
 
-		vTaskDelay(1000 /* ms */ / portTICK_PERIOD_MS);
-#endif
+	tone_cache_init(&cache, tone_cache_budget(nbackends));
+	ESP_LOGI(TAG, "%s: tone cache budget %zu bytes", __func__, cache.budget);
 
+	cache_lock = xSemaphoreCreateMutex();
+	render_queue = xQueueCreate(1, sizeof(struct render_job));
+	if (!cache_lock || !render_queue ||
+	    xTaskCreate(tone_render, "tone_render", STACK_SIZE, NULL, RENDER_PRIORITY, NULL) != pdPASS) {
+		ESP_LOGE(TAG, "%s: failed to start render task", __func__);
+		abort();
+	}
+
+	par = sine_par_create(portNUM_PROCESSORS);
+	if (!par) {
+		ESP_LOGE(TAG, "%s: failed to create parallel renderer", __func__);
+		abort();
+	}
+
+	for (int n = 0;; n++) {
+		note = &notes[n % notes_count];
+
+		play_note(note);
+
+		for (int i = 0; i < nbackends; i++) {
+			/* next backend for this note, or the first one for the next note */
+			if (i + 1 < nbackends) {
+				next.freq = note->freq;
+				next.b = &backends[i + 1];
+				next.dump_stats = 0;
+			} else {
+				next.freq = notes[(n + 1) % notes_count].freq;
+				next.b = &backends[0];
+				next.dump_stats = (n % notes_count) == notes_count - 1;
+			}
+
+			play_tone(note->freq, &backends[i], par, &next);
+		}
 	}
 }
 
 void app_main(void)
 {
-	TaskHandle_t xTest1Handle = NULL;
+	if (ring_init(&ring, RING_BLOCKS, BLOCK_SAMPLES)) {
+		ESP_LOGE(TAG, "ring init failed");
+		abort();
+	}
 
 	if (i2s_driver_init() != ESP_OK) {
 		ESP_LOGE(TAG, "i2s driver init failed");
@@ -150,13 +418,25 @@ void app_main(void)
 		ESP_LOGI(TAG, "i2s driver init success");
 	}
 
-	xTaskCreate(i2s_test, "i2s_test", STACK_SIZE, NULL, tskIDLE_PRIORITY, &xTest1Handle);
-	if (!xTest1Handle) {
+	gain_init(&gain, 1, 0);
+	gain_set(&gain, gain_from_db10(CONFIG_SINE_VOLUME_DB10));
+	gain_set_dither(&gain, DITHER_BITS, esp_random());
+
+	/* writer first: producer notifies it as soon as the first block is ready */
+	xTaskCreate(i2s_writer, "i2s_writer", STACK_SIZE, NULL, WRITER_PRIORITY, &consumer_task);
+	if (!consumer_task) {
+		ESP_LOGE(TAG, "Failed to create task i2s_writer");
+		abort();
+	}
+
+	xTaskCreate(i2s_test, "i2s_test", STACK_SIZE, NULL, PRODUCER_PRIORITY, &producer_task);
+	if (!producer_task) {
 		ESP_LOGE(TAG, "Failed to create task i2s_test");
 	}
 
 	while (1) {
-		ESP_LOGI(TAG, "idle...");
+		ESP_LOGI(TAG, "dma sent %lu underruns %lu, ring blocks %u underruns %lu",
+			dma_sent, dma_underruns, ring_count(&ring), atomic_load(&ring.underruns));
 		vTaskDelay(1000 /* ms */ / portTICK_PERIOD_MS);
 	}
 }
@@ -0,0 +1,94 @@
+/*
+ * Lock-free single producer / single consumer ring of fixed-size blocks
+ *
+ * Producer fills the block returned by ring_produce_begin() in place and
+ * publishes it with ring_produce_commit(), consumer does the same with
+ * ring_consume_begin() and ring_consume_commit(). Head is written only by
+ * producer, tail only by consumer, so no locks are needed: release/acquire
+ * ordering makes block contents visible before the index update. Consumer
+ * owns its block until commit and may post-process it in place.
+ *
+ * Ring never blocks: waiting for space or data is up to the caller.
+ *
+ * Underrun is counted once each time the consumer finds the ring empty
+ * after it has got its first block: polls before the start and repeated
+ * polls while the ring stays empty are not underruns.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+
+int ring_init(struct ring *r, unsigned int nblocks, unsigned int block_samples)
+{
+	/* power of 2 number of blocks: free running indexes wrap with a mask */
+	if (!nblocks || (nblocks & (nblocks - 1)))
+		return -1;
+
+	r->blocks = calloc(nblocks * block_samples, sizeof(*r->blocks));
+	if (!r->blocks)
+		return -1;
+
+	r->nblocks = nblocks;
+	r->block_samples = block_samples;
+	atomic_init(&r->head, 0);
+	atomic_init(&r->tail, 0);
+	atomic_init(&r->underruns, 0);
+	r->streaming = 0;
+	r->starved = 0;
+
+	return 0;
+}
+
+void ring_deinit(struct ring *r)
+{
+	free(r->blocks);
+	r->blocks = NULL;
+}
+
+unsigned int ring_count(struct ring *r)
+{
+	return atomic_load_explicit(&r->head, memory_order_acquire) -
+		atomic_load_explicit(&r->tail, memory_order_acquire);
+}
+
+int16_t *ring_produce_begin(struct ring *r)
+{
+	uint32_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+	uint32_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+
+	if (head - tail == r->nblocks)
+		return NULL;
+
+	return r->blocks + (head & (r->nblocks - 1)) * r->block_samples;
+}
+
+void ring_produce_commit(struct ring *r)
+{
+	atomic_fetch_add_explicit(&r->head, 1, memory_order_release);
+}
+
+int16_t *ring_consume_begin(struct ring *r)
+{
+	uint32_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+	uint32_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+
+	if (head == tail) {
+		if (r->streaming && !r->starved)
+			atomic_fetch_add_explicit(&r->underruns, 1, memory_order_relaxed);
+		r->starved = 1;
+		return NULL;
+	}
+
+	r->streaming = 1;
+	r->starved = 0;
+
+	return r->blocks + (tail & (r->nblocks - 1)) * r->block_samples;
+}
+
+void ring_consume_commit(struct ring *r)
+{
+	atomic_fetch_add_explicit(&r->tail, 1, memory_order_release);
+}
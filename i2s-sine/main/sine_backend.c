@@ -0,0 +1,105 @@
+/*
+ * Registry of sine generator backends with per-backend timing stats
+ *
+ * Each run of the backend is timed and converted to cpu cycles per sample:
+ * - ESP32: esp_timer_get_time() and default cpu frequency from Kconfig
+ * - Linux host: CLOCK_MONOTONIC, stats are in ns per sample (1 GHz clock)
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+
+#ifdef ESP_PLATFORM
+
+#include "esp_timer.h"
+#include "sdkconfig.h"
+
+#define CYCLES_PER_US CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ
+
+static int64_t backend_now_us(void)
+{
+	return esp_timer_get_time();
+}
+
+#else
+
+#include <time.h>
+
+#define CYCLES_PER_US 1000
+
+static int64_t backend_now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif
+
+struct sine_backend sine_backends[] = {
+	{ .name = "float",          .gen = sine_float },
+	{ .name = "cordic16",       .gen = sine_cordic16 },
+	{ .name = "cordic16_v2",    .gen = sine_cordic16_v2 },
+	{ .name = "cordic32",       .gen = sine_cordic32 },
+	{ .name = "cordic32_v2",    .gen = sine_cordic32_v2 },
+	{ .name = "cordic32_batch", .gen = sine_cordic32_batch },
+	{ .name = "dds",            .gen = sine_dds },
+};
+
+const unsigned int sine_backends_count = sizeof(sine_backends) / sizeof(sine_backends[0]);
+
+struct sine_backend *sine_backend_find(const char *name)
+{
+	for (int i = 0; i < sine_backends_count; i++)
+		if (!strcmp(sine_backends[i].name, name))
+			return &sine_backends[i];
+
+	return NULL;
+}
+
+size_t sine_backend_run(struct sine_backend *b, int freq, unsigned int samples_per_sec, int amp,
+			int16_t *sine, unsigned int samples)
+{
+	int64_t start, cycles;
+	float cps;
+	size_t sz;
+
+	start = backend_now_us();
+	sz = b->gen(freq, samples_per_sec, amp, sine, samples);
+	cycles = (backend_now_us() - start) * CYCLES_PER_US;
+
+	if (!samples)
+		return sz;
+
+	cps = (float)cycles / samples;
+
+	if (!b->calls || cps < b->min_cps)
+		b->min_cps = cps;
+
+	if (!b->calls || cps > b->max_cps)
+		b->max_cps = cps;
+
+	b->calls++;
+	b->samples += samples;
+	b->cycles += cycles;
+
+	return sz;
+}
+
+float sine_backend_avg_cps(const struct sine_backend *b)
+{
+	return b->samples ? (float)b->cycles / b->samples : 0.0f;
+}
+
+void sine_backend_reset(struct sine_backend *b)
+{
+	b->calls = 0;
+	b->samples = 0;
+	b->cycles = 0;
+	b->min_cps = 0.0f;
+	b->max_cps = 0.0f;
+}
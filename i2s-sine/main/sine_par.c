@@ -0,0 +1,221 @@
+/*
+ * Parallel renderer: each block is split into equal parts, one per worker.
+ * Phase of each part is computed from the block start phase, so output is
+ * bit exact with single threaded rendering of the same block.
+ *
+ * Workers wait on their own start semaphore, caller waits on shared done
+ * semaphore until all the parts are rendered: barrier per block.
+ * - ESP32: FreeRTOS tasks pinned to cores
+ * - Linux host: pthreads with POSIX semaphores
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "common.h"
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+#define PAR_STACK_SIZE 2048
+#define PAR_PRIORITY (tskIDLE_PRIORITY + 2)
+
+typedef SemaphoreHandle_t par_sem_t;
+typedef TaskHandle_t par_thread_t;
+
+static int par_sem_init(par_sem_t *sem)
+{
+	*sem = xSemaphoreCreateCounting(SINE_PAR_MAX_WORKERS, 0);
+	return *sem ? 0 : -1;
+}
+
+#define par_sem_post(sem)	xSemaphoreGive(*(sem))
+#define par_sem_wait(sem)	xSemaphoreTake(*(sem), portMAX_DELAY)
+#define par_sem_destroy(sem)	vSemaphoreDelete(*(sem))
+
+#else
+
+#include <pthread.h>
+#include <semaphore.h>
+
+typedef sem_t par_sem_t;
+typedef pthread_t par_thread_t;
+
+#define par_sem_init(sem)	sem_init(sem, 0, 0)
+#define par_sem_post(sem)	sem_post(sem)
+#define par_sem_wait(sem)	sem_wait(sem)
+#define par_sem_destroy(sem)	sem_destroy(sem)
+
+#endif
+
+struct sine_par_worker {
+	struct sine_par *par;
+	par_thread_t thread;
+	par_sem_t start;
+	unsigned int id;
+
+	/* part of the block */
+	uint32_t phase;
+	int16_t *sine;
+	unsigned int samples;
+};
+
+struct sine_par {
+	struct sine_par_worker workers[SINE_PAR_MAX_WORKERS];
+	unsigned int nworkers;
+	par_sem_t done;
+	int stop;
+
+	/* current block */
+	sine_render_t render;
+	uint32_t step;
+	int amp;
+};
+
+#ifdef ESP_PLATFORM
+static void par_worker(void *args)
+#else
+static void *par_worker(void *args)
+#endif
+{
+	struct sine_par_worker *w = args;
+	struct sine_par *p = w->par;
+
+	for (;;) {
+		par_sem_wait(&w->start);
+
+		if (p->stop)
+			break;
+
+		if (w->samples)
+			p->render(w->phase, p->step, p->amp, w->sine, w->samples);
+
+		par_sem_post(&p->done);
+	}
+
+	par_sem_post(&p->done);
+
+#ifdef ESP_PLATFORM
+	vTaskDelete(NULL);
+#else
+	return NULL;
+#endif
+}
+
+static int par_thread_create(struct sine_par_worker *w)
+{
+#ifdef ESP_PLATFORM
+	/* worker per core: core id is the same as worker id */
+	if (xTaskCreatePinnedToCore(par_worker, "sine_par", PAR_STACK_SIZE, w,
+				    PAR_PRIORITY, &w->thread, w->id) != pdPASS)
+		return -1;
+
+	return 0;
+#else
+	return pthread_create(&w->thread, NULL, par_worker, w);
+#endif
+}
+
+struct sine_par *sine_par_create(unsigned int workers)
+{
+	struct sine_par *p;
+
+#ifdef ESP_PLATFORM
+	if (workers > portNUM_PROCESSORS)
+		workers = portNUM_PROCESSORS;
+#endif
+
+	if (workers < 1 || workers > SINE_PAR_MAX_WORKERS)
+		return NULL;
+
+	p = calloc(1, sizeof(*p));
+	if (!p)
+		return NULL;
+
+	if (par_sem_init(&p->done)) {
+		free(p);
+		return NULL;
+	}
+
+	for (unsigned int i = 0; i < workers; i++) {
+		struct sine_par_worker *w = &p->workers[i];
+
+		w->par = p;
+		w->id = i;
+
+		if (par_sem_init(&w->start))
+			goto err;
+
+		if (par_thread_create(w)) {
+			par_sem_destroy(&w->start);
+			goto err;
+		}
+
+		p->nworkers++;
+	}
+
+	return p;
+
+err:
+	sine_par_destroy(p);
+	return NULL;
+}
+
+void sine_par_destroy(struct sine_par *p)
+{
+	p->stop = 1;
+
+	for (unsigned int i = 0; i < p->nworkers; i++)
+		par_sem_post(&p->workers[i].start);
+
+	for (unsigned int i = 0; i < p->nworkers; i++)
+		par_sem_wait(&p->done);
+
+	for (unsigned int i = 0; i < p->nworkers; i++) {
+#ifndef ESP_PLATFORM
+		pthread_join(p->workers[i].thread, NULL);
+#endif
+		par_sem_destroy(&p->workers[i].start);
+	}
+
+	par_sem_destroy(&p->done);
+	free(p);
+}
+
+void sine_par_render(struct sine_par *p, sine_render_t render, uint32_t phase, uint32_t step,
+		     int amp, int16_t *sine, unsigned int samples)
+{
+	unsigned int start = 0;
+
+	p->render = render;
+	p->step = step;
+	p->amp = amp;
+
+	for (unsigned int i = 0; i < p->nworkers; i++) {
+		struct sine_par_worker *w = &p->workers[i];
+		unsigned int end = (uint64_t)samples * (i + 1) / p->nworkers;
+
+		w->phase = phase + start * step;
+		w->sine = sine + start;
+		w->samples = end - start;
+		start = end;
+
+		par_sem_post(&w->start);
+	}
+
+	/* barrier: wait until all the parts are rendered */
+	for (unsigned int i = 0; i < p->nworkers; i++)
+		par_sem_wait(&p->done);
+}
+
+size_t sine_stream_fill_par(struct sine_stream *s, struct sine_par *p, sine_render_t render,
+			    int16_t *sine, unsigned int samples)
+{
+	sine_par_render(p, render, s->phase, s->step, s->amp, sine, samples);
+	s->phase += samples * s->step;
+
+	return samples * sizeof(*sine);
+}
@@ -0,0 +1,34 @@
+/*
+ * Streaming DDS sine generator:
+ * - generator state is kept between calls, so output can be produced
+ *   in blocks of any size, e.g. one DMA frame at a time
+ * - phase is never reset on frequency or amplitude change, so there are
+ *   no discontinuities between blocks and between notes
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "common.h"
+
+void sine_stream_init(struct sine_stream *s, unsigned int samples_per_sec)
+{
+	s->phase = 0;
+	s->step = 0;
+	s->amp = 0;
+	s->samples_per_sec = samples_per_sec;
+}
+
+void sine_stream_set(struct sine_stream *s, int freq, int amp)
+{
+	s->step = dds_step(freq, s->samples_per_sec);
+	s->amp = amp;
+}
+
+size_t sine_stream_fill(struct sine_stream *s, int16_t *sine, unsigned int samples)
+{
+	dds_render(s->phase, s->step, s->amp, sine, samples);
+	s->phase += samples * s->step;
+
+	return samples * sizeof(*sine);
+}
@@ -0,0 +1,214 @@
+/*
+ * Tone cache: one exact super-period per (generator, freq, rate, amp)
+ *
+ * For integer freq and rate the signal repeats after rate / gcd(freq, rate)
+ * samples, which is exactly freq / gcd(freq, rate) periods of the tone.
+ * Cached samples are played as wrap-around reads, no math is needed.
+ *
+ * Total size of cached samples is limited by memory budget, least recently
+ * used tones are evicted to make room for the new ones, tones with
+ * references are never evicted. Cache is not thread safe, callers from
+ * several tasks serialize access themselves.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+
+static unsigned int gcd(unsigned int a, unsigned int b)
+{
+	while (b) {
+		unsigned int t = a % b;
+
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+unsigned int tone_period(int freq, unsigned int samples_per_sec)
+{
+	return samples_per_sec / gcd(abs(freq), samples_per_sec);
+}
+
+void tone_cache_init(struct tone_cache *c, size_t budget)
+{
+	memset(c, 0, sizeof(*c));
+	c->budget = budget;
+}
+
+static void tone_evict(struct tone_cache *c, struct tone *t)
+{
+	c->used -= t->samples * sizeof(*t->sine);
+	free(t->sine);
+	memset(t, 0, sizeof(*t));
+}
+
+void tone_cache_flush(struct tone_cache *c)
+{
+	for (int i = 0; i < TONE_CACHE_SLOTS; i++)
+		if (c->tones[i].sine)
+			tone_evict(c, &c->tones[i]);
+}
+
+/* no stats and no LRU update: checks if the tone is there */
+struct tone *tone_cache_find(struct tone_cache *c, sine_gen_t gen, int freq,
+			     unsigned int samples_per_sec, int amp)
+{
+	for (int i = 0; i < TONE_CACHE_SLOTS; i++) {
+		struct tone *t = &c->tones[i];
+
+		if (t->sine && t->gen == gen && t->freq == freq &&
+		    t->samples_per_sec == samples_per_sec && t->amp == amp)
+			return t;
+	}
+
+	return NULL;
+}
+
+struct tone *tone_cache_lookup(struct tone_cache *c, sine_gen_t gen, int freq,
+			       unsigned int samples_per_sec, int amp)
+{
+	struct tone *t = tone_cache_find(c, gen, freq, samples_per_sec, amp);
+
+	if (!t) {
+		c->misses++;
+		return NULL;
+	}
+
+	t->last_used = ++c->clock;
+	c->hits++;
+
+	return t;
+}
+
+/* evict least recently used tones until new one fits and a slot is free */
+static struct tone *tone_slot(struct tone_cache *c, size_t size)
+{
+	struct tone *t;
+
+	if (size > c->budget)
+		return NULL;
+
+	for (;;) {
+		struct tone *lru = NULL;
+		struct tone *free_slot = NULL;
+
+		for (int i = 0; i < TONE_CACHE_SLOTS; i++) {
+			t = &c->tones[i];
+
+			if (!t->sine) {
+				free_slot = free_slot ? free_slot : t;
+				continue;
+			}
+
+			if (!t->refs && (!lru || t->last_used < lru->last_used))
+				lru = t;
+		}
+
+		if (free_slot && c->used + size <= c->budget)
+			return free_slot;
+
+		/* the rest is in use */
+		if (!lru)
+			return NULL;
+
+		tone_evict(c, lru);
+		c->evictions++;
+	}
+}
+
+static void tone_set(struct tone_cache *c, struct tone *t, sine_gen_t gen, int freq,
+		     unsigned int samples_per_sec, int amp, unsigned int samples)
+{
+	t->gen = gen;
+	t->freq = freq;
+	t->samples_per_sec = samples_per_sec;
+	t->amp = amp;
+	t->samples = samples;
+	t->refs = 0;
+	t->last_used = ++c->clock;
+	c->used += samples * sizeof(*t->sine);
+}
+
+struct tone *tone_cache_alloc(struct tone_cache *c, sine_gen_t gen, int freq,
+			      unsigned int samples_per_sec, int amp)
+{
+	unsigned int samples = tone_period(freq, samples_per_sec);
+	struct tone *t;
+
+	t = tone_slot(c, samples * sizeof(int16_t));
+	if (!t)
+		return NULL;
+
+	t->sine = malloc(samples * sizeof(int16_t));
+	if (!t->sine)
+		return NULL;
+
+	tone_set(c, t, gen, freq, samples_per_sec, amp, samples);
+
+	return t;
+}
+
+/*
+ * Super-period rendered by the caller outside of the cache: malloc'ed
+ * buffer is owned by the cache on success and left to the caller if there
+ * is no room for it.
+ */
+struct tone *tone_cache_insert(struct tone_cache *c, sine_gen_t gen, int freq,
+			       unsigned int samples_per_sec, int amp, int16_t *sine)
+{
+	unsigned int samples = tone_period(freq, samples_per_sec);
+	struct tone *t;
+
+	t = tone_slot(c, samples * sizeof(int16_t));
+	if (!t)
+		return NULL;
+
+	t->sine = sine;
+	tone_set(c, t, gen, freq, samples_per_sec, amp, samples);
+
+	return t;
+}
+struct tone *tone_cache_get(struct tone_cache *c, sine_gen_t gen, int freq,
+			    unsigned int samples_per_sec, int amp)
+{
+	struct tone *t;
+
+	t = tone_cache_lookup(c, gen, freq, samples_per_sec, amp);
+	if (t)
+		return t;
+
+	t = tone_cache_alloc(c, gen, freq, samples_per_sec, amp);
+	if (!t)
+		return NULL;
+
+	gen(freq, samples_per_sec, amp, t->sine, t->samples);
+
+	return t;
+}
+
+size_t tone_read(struct tone *t, unsigned int *pos, int16_t *sine, unsigned int samples)
+{
+	unsigned int p = *pos;
+	unsigned int n, i = 0;
+
+	while (i < samples) {
+		n = t->samples - p;
+		n = (n < samples - i) ? n : samples - i;
+
+		memcpy(sine + i, t->sine + p, n * sizeof(*sine));
+
+		i += n;
+		p += n;
+		if (p == t->samples)
+			p = 0;
+	}
+
+	*pos = p;
+
+	return samples * sizeof(*sine);
+}
@@ -0,0 +1,256 @@
+/*
+ * Host benchmark and accuracy suite for sine generator backends:
+ * - throughput in samples/s
+ * - max and RMS error against double precision reference
+ * - SINAD and THD estimated from one second of output: whole number of
+ *   periods for integer frequency, so DFT bins are computed exactly
+ *   without windowing
+ *
+ * Cordic kernel is also instantiated for a range of iteration counts to
+ * find the cheapest setting that meets target SINAD, passed as argument.
+ *
+ * Results are printed to stdout in JSON format.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+
+#include "common.h"
+#include "cordic.h"
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+#define MAX_SAMPLING_FREQ 48000
+#define AMPLITUDE 2000
+#define HARMONICS 10
+#define ROUNDS 5
+#define TARGET_SINAD 60.0
+
+
+/* cordic kernels for iteration count sweep */
+
+#define SWEEP_CORDIC(width, type, frac, bits, n)						\
+CORDIC_DEFINE(sweep##width##_##n, type, frac, bits, n)						\
+static size_t sine_sweep##width##_##n(int freq, unsigned int samples_per_sec, int amp,		\
+				      int16_t *sine, unsigned int samples)			\
+{												\
+	uint32_t step = dds_step(freq, samples_per_sec);					\
+	uint32_t phase = 0;									\
+	type s, c;										\
+												\
+	for (int i = 0; i < samples; i++) {							\
+		sweep##width##_##n##_sincos(phase, &s, &c);					\
+		*(sine + i) = (amp * s + ((type)1 << ((frac) - 1))) >> (frac);			\
+		phase += step;									\
+	}											\
+												\
+	return samples * sizeof(*sine);								\
+}
+
+#define SWEEP16(n) SWEEP_CORDIC(16, int32_t, 14, 16, n)
+#define SWEEP32(n) SWEEP_CORDIC(32, int64_t, 30, 32, n)
+
+SWEEP16(6)
+SWEEP16(8)
+SWEEP16(10)
+SWEEP16(12)
+SWEEP16(14)
+SWEEP16(16)
+
+SWEEP32(8)
+SWEEP32(12)
+SWEEP32(16)
+SWEEP32(20)
+SWEEP32(24)
+SWEEP32(28)
+SWEEP32(32)
+
+static const struct {
+	int width;
+	int iterations;
+	sine_gen_t gen;
+} sweep[] = {
+	{ 16, 6,  sine_sweep16_6 },
+	{ 16, 8,  sine_sweep16_8 },
+	{ 16, 10, sine_sweep16_10 },
+	{ 16, 12, sine_sweep16_12 },
+	{ 16, 14, sine_sweep16_14 },
+	{ 16, 16, sine_sweep16_16 },
+	{ 32, 8,  sine_sweep32_8 },
+	{ 32, 12, sine_sweep32_12 },
+	{ 32, 16, sine_sweep32_16 },
+	{ 32, 20, sine_sweep32_20 },
+	{ 32, 24, sine_sweep32_24 },
+	{ 32, 28, sine_sweep32_28 },
+	{ 32, 32, sine_sweep32_32 },
+};
+
+static unsigned int rates[] = { 8000, 16000, 44100, 48000 };
+static int freq[] = { 50, 261, 440, 493, 1000, 3001 };
+
+struct result {
+	double samples_per_sec;
+	double max_error;
+	double rms_error;
+	double sinad;
+	double thd;
+};
+
+int16_t sine[MAX_SAMPLING_FREQ];
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* power of the tone: squared magnitude of its DFT bin, normalized */
+static double tone_power(int freq, unsigned int rate, int16_t *sine, unsigned int samples)
+{
+	double re = 0.0, im = 0.0;
+
+	for (int i = 0; i < samples; i++) {
+		double w = 2 * M_PI * (double)((int64_t)freq * i % rate) / rate;
+
+		re += sine[i] * cos(w);
+		im += sine[i] * sin(w);
+	}
+
+	return 2 * (re * re + im * im) / ((double)samples * samples);
+}
+
+static void analyze(int freq, unsigned int rate, int16_t *sine, unsigned int samples, struct result *res)
+{
+	double err, err_max = 0.0, err_sq = 0.0;
+	double sum = 0.0, sum_sq = 0.0;
+	double total, fund, harm = 0.0;
+
+	for (int i = 0; i < samples; i++) {
+		double ref = AMPLITUDE * sin(2 * M_PI * (double)((int64_t)freq * i % rate) / rate);
+
+		err = fabs(ref - sine[i]);
+		err_max = fmax(err_max, err);
+		err_sq += err * err;
+
+		sum += sine[i];
+		sum_sq += (double)sine[i] * sine[i];
+	}
+
+	/* ac power: total power without dc */
+	total = sum_sq / samples - (sum / samples) * (sum / samples);
+	fund = fmax(tone_power(freq, rate, sine, samples), 1e-12);
+
+	for (int k = 2; k <= HARMONICS && (k * freq) < (rate / 2); k++)
+		harm += tone_power(k * freq, rate, sine, samples);
+
+	res->max_error = err_max;
+	res->rms_error = sqrt(err_sq / samples);
+	res->sinad = 10 * log10(fund / fmax(total - fund, 1e-12));
+	res->thd = 10 * log10(fmax(harm, 1e-12) / fund);
+}
+
+static void print_result(const char *name, unsigned int rate, int freq, struct result *res, int last)
+{
+	fprintf(stdout, "    { \"generator\": \"%s\", \"rate\": %u, \"freq\": %d, "
+		"\"samples_per_sec\": %.0f, \"max_error\": %.4f, \"rms_error\": %.4f, "
+		"\"sinad_db\": %.2f, \"thd_db\": %.2f }%s\n",
+		name, rate, freq, res->samples_per_sec, res->max_error, res->rms_error,
+		res->sinad, res->thd, last ? "" : ",");
+}
+
+/* run generator over all rates and frequencies, summary is the worst case */
+static void run(const char *name, sine_gen_t gen, struct result *sum, int last)
+{
+	uint64_t total_ns = 0, total_samples = 0;
+	struct result res;
+
+	memset(sum, 0, sizeof(*sum));
+	sum->sinad = INFINITY;
+	sum->thd = -INFINITY;
+
+	for (int r = 0; r < ARRAY_SIZE(rates); r++) {
+		for (int f = 0; f < ARRAY_SIZE(freq); f++) {
+			uint64_t ns, start = now_ns();
+
+			for (int n = 0; n < ROUNDS; n++)
+				gen(freq[f], rates[r], AMPLITUDE, &sine[0], rates[r]);
+
+			ns = now_ns() - start;
+			total_ns += ns;
+			total_samples += (uint64_t)ROUNDS * rates[r];
+
+			analyze(freq[f], rates[r], &sine[0], rates[r], &res);
+			res.samples_per_sec = (double)ROUNDS * rates[r] * 1e9 / ns;
+
+			if (name)
+				print_result(name, rates[r], freq[f], &res, last &&
+					(r == ARRAY_SIZE(rates) - 1) && (f == ARRAY_SIZE(freq) - 1));
+
+			sum->max_error = fmax(sum->max_error, res.max_error);
+			sum->rms_error = fmax(sum->rms_error, res.rms_error);
+			sum->sinad = fmin(sum->sinad, res.sinad);
+			sum->thd = fmax(sum->thd, res.thd);
+		}
+	}
+
+	sum->samples_per_sec = (double)total_samples * 1e9 / total_ns;
+}
+
+static void print_summary(const char *name, struct result *sum, int last)
+{
+	fprintf(stdout, "    { \"generator\": \"%s\", \"samples_per_sec\": %.0f, "
+		"\"max_error\": %.4f, \"rms_error\": %.4f, "
+		"\"min_sinad_db\": %.2f, \"max_thd_db\": %.2f }%s\n",
+		name, sum->samples_per_sec, sum->max_error, sum->rms_error,
+		sum->sinad, sum->thd, last ? "" : ",");
+}
+
+int main(int argc, char **argv)
+{
+	double target = (argc > 1) ? atof(argv[1]) : TARGET_SINAD;
+	struct result sum[sine_backends_count];
+	struct result swp[ARRAY_SIZE(sweep)];
+	int cheapest16 = 0, cheapest32 = 0;
+
+	fprintf(stdout, "{\n  \"amplitude\": %d,\n  \"results\": [\n", AMPLITUDE);
+
+	for (int g = 0; g < sine_backends_count; g++)
+		run(sine_backends[g].name, sine_backends[g].gen, &sum[g], g == sine_backends_count - 1);
+
+	fprintf(stdout, "  ],\n  \"summary\": [\n");
+
+	for (int g = 0; g < sine_backends_count; g++)
+		print_summary(sine_backends[g].name, &sum[g], g == sine_backends_count - 1);
+
+	fprintf(stdout, "  ],\n  \"cordic_sweep\": [\n");
+
+	for (int n = 0; n < ARRAY_SIZE(sweep); n++) {
+		run(NULL, sweep[n].gen, &swp[n], 0);
+
+		fprintf(stdout, "    { \"width\": %d, \"iterations\": %d, \"samples_per_sec\": %.0f, "
+			"\"max_error\": %.4f, \"min_sinad_db\": %.2f }%s\n",
+			sweep[n].width, sweep[n].iterations, swp[n].samples_per_sec,
+			swp[n].max_error, swp[n].sinad, (n == ARRAY_SIZE(sweep) - 1) ? "" : ",");
+
+		/* sweep is sorted by iteration count: first match is the cheapest */
+		if (swp[n].sinad >= target) {
+			if (sweep[n].width == 16 && !cheapest16)
+				cheapest16 = sweep[n].iterations;
+			if (sweep[n].width == 32 && !cheapest32)
+				cheapest32 = sweep[n].iterations;
+		}
+	}
+
+	/* zero iterations means that target is not reachable for that width */
+	fprintf(stdout, "  ],\n  \"cordic_target\": { \"min_sinad_db\": %.2f, "
+		"\"iterations16\": %d, \"iterations32\": %d }\n}\n",
+		target, cheapest16, cheapest32);
+
+	return 0;
+}
@@ -0,0 +1,214 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "common.h"
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+#define SAMPLING_FREQ 16000
+#define AMPLITUDE 2000
+#define BLOCK 240
+
+static int freq[] = {261, 293, 329, 349, 392, 440, 493 };
+
+int16_t ref[SAMPLING_FREQ];
+int16_t out[SAMPLING_FREQ];
+
+static int test_period(void)
+{
+	static const struct {
+		int freq;
+		unsigned int rate;
+		unsigned int period;
+	} v[] = {
+		{ 440, 16000, 400 },
+		{ 261, 16000, 16000 },
+		{ 1000, 16000, 16 },
+		{ 441, 44100, 100 },
+		{ 4000, 48000, 12 },
+	};
+	int ret = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(v); i++) {
+		if (tone_period(v[i].freq, v[i].rate) != v[i].period) {
+			fprintf(stderr, "period: freq %d rate %u: %u != %u\n", v[i].freq, v[i].rate,
+				tone_period(v[i].freq, v[i].rate), v[i].period);
+			ret = 1;
+		}
+	}
+
+	if (!ret)
+		fprintf(stdout, "period: ok\n");
+
+	return ret;
+}
+
+/* wrap-around reads of super-period must reproduce one-shot output */
+static int test_playback(void)
+{
+	struct tone_cache c;
+	unsigned int pos, len;
+	struct tone *t;
+	int ret = 0;
+
+	tone_cache_init(&c, 64 * 1024);
+
+	for (int f = 0; f < ARRAY_SIZE(freq); f++) {
+		sine_float(freq[f], SAMPLING_FREQ, AMPLITUDE, &ref[0], SAMPLING_FREQ);
+
+		t = tone_cache_get(&c, sine_float, freq[f], SAMPLING_FREQ, AMPLITUDE);
+		if (!t) {
+			fprintf(stderr, "playback: freq %d: no tone\n", freq[f]);
+			ret = 1;
+			continue;
+		}
+
+		pos = 0;
+		for (int i = 0; i < SAMPLING_FREQ; i += len) {
+			len = (SAMPLING_FREQ - i < BLOCK) ? SAMPLING_FREQ - i : BLOCK;
+			tone_read(t, &pos, &out[i], len);
+		}
+
+		/* float rounding may differ by one LSB between periods */
+		for (int i = 0; i < SAMPLING_FREQ; i++) {
+			if (abs(ref[i] - out[i]) > 1) {
+				fprintf(stderr, "playback: freq %d: mismatch at %d: %d != %d\n",
+					freq[f], i, ref[i], out[i]);
+				ret = 1;
+				break;
+			}
+		}
+
+		if (pos != 0) {
+			fprintf(stderr, "playback: freq %d: 1 sec is not a whole super-period\n", freq[f]);
+			ret = 1;
+		}
+	}
+
+	tone_cache_flush(&c);
+
+	if (!ret)
+		fprintf(stdout, "playback: ok\n");
+
+	return ret;
+}
+
+static int test_lru(void)
+{
+	struct tone_cache c;
+	int ret = 0;
+
+	/* budget for two 16000-sample tones */
+	tone_cache_init(&c, 2 * SAMPLING_FREQ * sizeof(int16_t));
+
+	tone_cache_get(&c, sine_dds, 261, SAMPLING_FREQ, AMPLITUDE);
+	tone_cache_get(&c, sine_dds, 293, SAMPLING_FREQ, AMPLITUDE);
+	tone_cache_get(&c, sine_dds, 261, SAMPLING_FREQ, AMPLITUDE);
+
+	/* 293 is least recently used and has to be evicted */
+	tone_cache_get(&c, sine_dds, 329, SAMPLING_FREQ, AMPLITUDE);
+
+	if (!tone_cache_lookup(&c, sine_dds, 261, SAMPLING_FREQ, AMPLITUDE) ||
+	    tone_cache_lookup(&c, sine_dds, 293, SAMPLING_FREQ, AMPLITUDE) ||
+	    !tone_cache_lookup(&c, sine_dds, 329, SAMPLING_FREQ, AMPLITUDE)) {
+		fprintf(stderr, "lru: wrong tone evicted\n");
+		ret = 1;
+	}
+
+	if (c.evictions != 1 || c.used > c.budget) {
+		fprintf(stderr, "lru: evictions %u used %zu budget %zu\n", c.evictions, c.used, c.budget);
+		ret = 1;
+	}
+
+	/* does not fit at all: period is 50000 samples */
+	if (tone_cache_get(&c, sine_dds, 261, 50000, AMPLITUDE)) {
+		fprintf(stderr, "lru: tone over budget is cached\n");
+		ret = 1;
+	}
+
+	tone_cache_flush(&c);
+
+	if (c.used) {
+		fprintf(stderr, "lru: %zu bytes used after flush\n", c.used);
+		ret = 1;
+	}
+
+	if (!ret)
+		fprintf(stdout, "lru: ok\n");
+
+	return ret;
+}
+
+/* tone rendered outside of the cache, held tone is never evicted */
+static int test_insert(void)
+{
+	unsigned int samples = tone_period(261, SAMPLING_FREQ);
+	struct tone_cache c;
+	struct tone *held, *t;
+	int16_t *sine;
+	int ret = 0;
+
+	/* budget for two 16000-sample tones */
+	tone_cache_init(&c, 2 * SAMPLING_FREQ * sizeof(int16_t));
+
+	held = tone_cache_get(&c, sine_dds, 261, SAMPLING_FREQ, AMPLITUDE);
+	held->refs++;
+
+	tone_cache_get(&c, sine_dds, 293, SAMPLING_FREQ, AMPLITUDE);
+
+	/* 261 is least recently used, but held: 293 goes instead */
+	sine = malloc(samples * sizeof(*sine));
+	sine_dds(329, SAMPLING_FREQ, AMPLITUDE, sine, samples);
+	t = tone_cache_insert(&c, sine_dds, 329, SAMPLING_FREQ, AMPLITUDE, sine);
+
+	if (!t || t->sine != sine || t->samples != samples ||
+	    tone_cache_find(&c, sine_dds, 261, SAMPLING_FREQ, AMPLITUDE) != held ||
+	    tone_cache_find(&c, sine_dds, 293, SAMPLING_FREQ, AMPLITUDE) ||
+	    tone_cache_lookup(&c, sine_dds, 329, SAMPLING_FREQ, AMPLITUDE) != t) {
+		fprintf(stderr, "insert: held tone evicted or inserted tone lost\n");
+		ret = 1;
+	}
+
+	/* find does not count */
+	if (c.hits != 1 || c.misses != 2) {
+		fprintf(stderr, "insert: hits %u misses %u\n", c.hits, c.misses);
+		ret = 1;
+	}
+
+	/* both held: no room, buffer stays with the caller */
+	t->refs++;
+	sine = malloc(samples * sizeof(*sine));
+	if (tone_cache_insert(&c, sine_dds, 349, SAMPLING_FREQ, AMPLITUDE, sine)) {
+		fprintf(stderr, "insert: held tone evicted\n");
+		ret = 1;
+	} else {
+		free(sine);
+	}
+
+	held->refs--;
+	t->refs--;
+	tone_cache_flush(&c);
+
+	if (c.used) {
+		fprintf(stderr, "insert: %zu bytes used after flush\n", c.used);
+		ret = 1;
+	}
+
+	if (!ret)
+		fprintf(stdout, "insert: ok\n");
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0;
+
+	ret |= test_period();
+	ret |= test_playback();
+	ret |= test_lru();
+	ret |= test_insert();
+
+	return ret;
+}
@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#include "common.h"
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+#define SAMPLING_FREQ 16000
+#define AMPLITUDE 2000
+
+static int freq[] = {261, 293, 329, 349, 392, 440, 493, 7999 };
+static unsigned int samples[] = { 1, 7, 8, 9, 240, SAMPLING_FREQ };
+
+int16_t ref[SAMPLING_FREQ];
+int16_t out[SAMPLING_FREQ];
+
+/* batch kernel must match scalar kernel, including the tail of the batch */
+int main(int argc, char **argv)
+{
+	int ret = 0;
+
+	for (int f = 0; f < ARRAY_SIZE(freq); f++) {
+		for (int n = 0; n < ARRAY_SIZE(samples); n++) {
+			sine_cordic32(freq[f], SAMPLING_FREQ, AMPLITUDE, &ref[0], samples[n]);
+			sine_cordic32_batch(freq[f], SAMPLING_FREQ, AMPLITUDE, &out[0], samples[n]);
+
+			for (int i = 0; i < samples[n]; i++) {
+				if (ref[i] != out[i]) {
+					fprintf(stderr, "cordic32 batch: freq %d samples %u: mismatch at %d: %d != %d\n",
+						freq[f], samples[n], i, ref[i], out[i]);
+					ret = 1;
+					break;
+				}
+			}
+		}
+	}
+
+	if (!ret)
+		fprintf(stdout, "cordic32 batch: ok\n");
+
+	return ret;
+}
@@ -0,0 +1,40 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "common.h"
+
+/* embedded note tables must hold exact super-period of the reference sine */
+int main(int argc, char **argv)
+{
+	unsigned int rate = notes_samples_per_sec;
+	int ret = 0;
+
+	for (int n = 0; n < notes_count; n++) {
+		const struct note *note = &notes[n];
+
+		if (note->samples != tone_period(note->freq, rate)) {
+			fprintf(stderr, "embed: freq %d: period %u != %u\n", note->freq,
+				note->samples, tone_period(note->freq, rate));
+			ret = 1;
+			continue;
+		}
+
+		for (int i = 0; i < note->samples; i++) {
+			double ref = notes_amp * sin(2 * M_PI * (double)((int64_t)note->freq * i % rate) / rate);
+
+			if (fabs(ref - note->sine[i]) > 0.5) {
+				fprintf(stderr, "embed: freq %d: mismatch at %d: %f != %d\n",
+					note->freq, i, ref, note->sine[i]);
+				ret = 1;
+				break;
+			}
+		}
+	}
+
+	if (!ret)
+		fprintf(stdout, "embed: %u notes: ok\n", notes_count);
+
+	return ret;
+}
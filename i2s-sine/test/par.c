@@ -0,0 +1,92 @@
+/*
+ * Parallel renderer scaling on host: throughput for 1..N pthread workers,
+ * output is checked against single threaded rendering of the same block.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+#define SAMPLING_FREQ 16000
+#define AMPLITUDE 2000
+#define DURATION 4 /* sec */
+
+static const struct {
+	const char *name;
+	sine_render_t render;
+} renders[] = {
+	{ "dds",      dds_render },
+	{ "cordic32", cordic32_render },
+};
+
+static unsigned int blocks[] = { 240, 1024, 4096 };
+static unsigned int workers[] = { 1, 2, 4 };
+
+int16_t ref[4096];
+int16_t out[4096];
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+	uint32_t step = dds_step(440, SAMPLING_FREQ);
+	int ret = 0;
+
+	fprintf(stdout, "# render block workers samples/s speedup\n");
+
+	for (int r = 0; r < ARRAY_SIZE(renders); r++) {
+		for (int b = 0; b < ARRAY_SIZE(blocks); b++) {
+			double base = 0.0;
+
+			for (int w = 0; w < ARRAY_SIZE(workers); w++) {
+				struct sine_par *p = sine_par_create(workers[w]);
+				unsigned int total = DURATION * SAMPLING_FREQ;
+				uint32_t phase = 0;
+				uint64_t start;
+				double rate;
+
+				if (!p) {
+					fprintf(stderr, "failed to create %u workers\n", workers[w]);
+					return 1;
+				}
+
+				start = now_ns();
+
+				for (unsigned int i = 0; i < total; i += blocks[b]) {
+					sine_par_render(p, renders[r].render, phase, step, AMPLITUDE, &out[0], blocks[b]);
+					phase += blocks[b] * step;
+				}
+
+				rate = (double)total * 1e9 / (now_ns() - start);
+				base = base ? base : rate;
+
+				/* last block must match single threaded rendering */
+				renders[r].render(phase - blocks[b] * step, step, AMPLITUDE, &ref[0], blocks[b]);
+				if (memcmp(ref, out, blocks[b] * sizeof(ref[0]))) {
+					fprintf(stderr, "%s: block %u workers %u: output mismatch\n",
+						renders[r].name, blocks[b], workers[w]);
+					ret = 1;
+				}
+
+				fprintf(stdout, "%-10s %6u %2u %12.0f %6.2f\n", renders[r].name, blocks[b],
+					workers[w], rate, rate / base);
+
+				sine_par_destroy(p);
+			}
+		}
+	}
+
+	return ret;
+}
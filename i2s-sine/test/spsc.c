@@ -0,0 +1,189 @@
+/*
+ * SPSC ring test: producer thread feeds the ring, stub sink consumes one
+ * block per period at fixed rate, like i2s DMA does. Sink checks that the
+ * sample sequence is intact and counts the times it ran dry, which must
+ * match the ring underrun counter. Each producer stall is one of them,
+ * host scheduling may add more.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include "common.h"
+
+#define BLOCKS 4
+#define BLOCK_SAMPLES 240
+#define TOTAL_BLOCKS 1000
+#define PERIOD_NS 500000 /* 240 samples at 480 kHz: faster than real time */
+
+struct test {
+	struct ring ring;
+	unsigned int stall_every; /* producer stalls every N blocks, 0 - never */
+	unsigned int stalls;
+};
+
+static void sleep_ns(long ns)
+{
+	struct timespec ts = { .tv_sec = 0, .tv_nsec = ns };
+
+	nanosleep(&ts, NULL);
+}
+
+static void *producer(void *args)
+{
+	struct test *t = args;
+	int16_t counter = 0;
+	int16_t *block;
+
+	for (unsigned int n = 0; n < TOTAL_BLOCKS; n++) {
+		if (t->stall_every && n && !(n % t->stall_every)) {
+			sleep_ns(10 * PERIOD_NS);
+			t->stalls++;
+		}
+
+		while (!(block = ring_produce_begin(&t->ring)))
+			sched_yield();
+
+		for (int i = 0; i < BLOCK_SAMPLES; i++)
+			block[i] = counter++;
+
+		ring_produce_commit(&t->ring);
+	}
+
+	return NULL;
+}
+
+static int run(const char *name, unsigned int stall_every)
+{
+	struct timespec next;
+	struct test t = { .stall_every = stall_every };
+	const int16_t *block;
+	unsigned int received = 0;
+	unsigned int empty = 0;
+	int16_t expected = 0;
+	int starved = 0;
+	pthread_t thread;
+	int ret = 0;
+
+	if (ring_init(&t.ring, BLOCKS, BLOCK_SAMPLES)) {
+		fprintf(stderr, "%s: ring init failed\n", name);
+		return 1;
+	}
+
+	/* empty before the start: not an underrun */
+	if (ring_consume_begin(&t.ring) || ring_consume_begin(&t.ring)) {
+		fprintf(stderr, "%s: block in empty ring\n", name);
+		ret = 1;
+	}
+
+	pthread_create(&thread, NULL, producer, &t);
+
+	/* let producer prefill the ring before the sink starts */
+	while (ring_count(&t.ring) < BLOCKS)
+		sched_yield();
+
+	clock_gettime(CLOCK_MONOTONIC, &next);
+
+	while (received < TOTAL_BLOCKS) {
+		next.tv_nsec += PERIOD_NS;
+		if (next.tv_nsec >= 1000000000) {
+			next.tv_nsec -= 1000000000;
+			next.tv_sec++;
+		}
+
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+
+		/* empty ring: sink plays silence for this period */
+		block = ring_consume_begin(&t.ring);
+		if (!block) {
+			if (received && !starved)
+				empty++;
+			starved = 1;
+			continue;
+		}
+
+		starved = 0;
+
+		for (int i = 0; i < BLOCK_SAMPLES; i++) {
+			if (block[i] != expected) {
+				fprintf(stderr, "%s: block %u sample %d: %d != %d\n",
+					name, received, i, block[i], expected);
+				ret = 1;
+			}
+			expected = block[i] + 1;
+		}
+
+		ring_consume_commit(&t.ring);
+		received++;
+	}
+
+	pthread_join(thread, NULL);
+
+	/* each stall is longer than the ring: one underrun however many periods it lasts */
+	if (atomic_load(&t.ring.underruns) != empty || empty < t.stalls) {
+		fprintf(stderr, "%s: %u stalls, sink ran dry %u times, %u underruns\n", name, t.stalls,
+			empty, (unsigned int)atomic_load(&t.ring.underruns));
+		ret = 1;
+	}
+
+	fprintf(stdout, "%s: blocks %u stalls %u underruns %u: %s\n", name, received, t.stalls,
+		(unsigned int)atomic_load(&t.ring.underruns), ret ? "fail" : "ok");
+
+	ring_deinit(&t.ring);
+
+	return ret;
+}
+
+/* single thread: underrun count for a known sequence of polls */
+static int underrun_count(void)
+{
+	struct ring r;
+	int ret = 0;
+
+	if (ring_init(&r, BLOCKS, BLOCK_SAMPLES))
+		return 1;
+
+	/* before the first block */
+	ring_consume_begin(&r);
+	ring_consume_begin(&r);
+
+	for (int i = 0; i < 3; i++) {
+		ring_produce_begin(&r);
+		ring_produce_commit(&r);
+		ring_consume_begin(&r);
+		ring_consume_commit(&r);
+
+		/* one underrun however many polls find the ring empty */
+		for (int k = 0; k <= i; k++)
+			ring_consume_begin(&r);
+	}
+
+	if (atomic_load(&r.underruns) != 3) {
+		fprintf(stderr, "underrun count: %u != 3\n", (unsigned int)atomic_load(&r.underruns));
+		ret = 1;
+	}
+
+	fprintf(stdout, "ring underrun count: %s\n", ret ? "fail" : "ok");
+
+	ring_deinit(&r);
+
+	return ret;
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0;
+
+	ret |= underrun_count();
+
+	ret |= run("ring steady", 0);
+	ret |= run("ring stalls", 100);
+
+	return ret;
+}
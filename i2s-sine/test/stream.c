@@ -0,0 +1,97 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+
+#define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
+#define SAMPLING_FREQ 16000
+#define AMPLITUDE 2000
+
+static int freq[] = {261, 293, 329, 349, 392, 440, 493 };
+static unsigned int blocks[] = { 1, 7, 64, 240, 1000, SAMPLING_FREQ };
+
+int16_t ref[SAMPLING_FREQ * ARRAY_SIZE(freq)];
+int16_t out[SAMPLING_FREQ * ARRAY_SIZE(freq)];
+
+static int compare(const char *name, unsigned int block, unsigned int samples)
+{
+	for (int i = 0; i < samples; i++) {
+		if (ref[i] != out[i]) {
+			fprintf(stderr, "%s: block %u: mismatch at sample %d: %d != %d\n",
+				name, block, i, ref[i], out[i]);
+			return 1;
+		}
+	}
+
+	fprintf(stdout, "%s: block %u: ok\n", name, block);
+	return 0;
+}
+
+/* block-wise output of a single tone must match one-shot output */
+static int test_single_tone(unsigned int block)
+{
+	struct sine_stream s;
+	int ret = 0;
+
+	for (int f = 0; f < ARRAY_SIZE(freq); f++) {
+		sine_dds(freq[f], SAMPLING_FREQ, AMPLITUDE, &ref[0], SAMPLING_FREQ);
+
+		sine_stream_init(&s, SAMPLING_FREQ);
+		sine_stream_set(&s, freq[f], AMPLITUDE);
+
+		for (int i = 0; i < SAMPLING_FREQ; i += block)
+			sine_stream_fill(&s, &out[i], (SAMPLING_FREQ - i < block) ? SAMPLING_FREQ - i : block);
+
+		ret |= compare("single tone", block, SAMPLING_FREQ);
+	}
+
+	return ret;
+}
+
+/* phase must stay continuous when the tone is changed between blocks */
+static int test_tone_change(unsigned int block)
+{
+	struct sine_stream s;
+	uint32_t phase = 0;
+	unsigned int n = 0;
+
+	for (int f = 0; f < ARRAY_SIZE(freq); f++) {
+		uint32_t step = dds_step(freq[f], SAMPLING_FREQ);
+
+		for (int i = 0; i < SAMPLING_FREQ; i++) {
+			ref[n++] = dds_sample(phase, AMPLITUDE);
+			phase += step;
+		}
+	}
+
+	sine_stream_init(&s, SAMPLING_FREQ);
+	n = 0;
+
+	for (int f = 0; f < ARRAY_SIZE(freq); f++) {
+		sine_stream_set(&s, freq[f], AMPLITUDE);
+
+		for (int i = 0; i < SAMPLING_FREQ; i += block) {
+			unsigned int len = (SAMPLING_FREQ - i < block) ? SAMPLING_FREQ - i : block;
+
+			sine_stream_fill(&s, &out[n], len);
+			n += len;
+		}
+	}
+
+	return compare("tone change", block, n);
+}
+
+int main(int argc, char **argv)
+{
+	int ret = 0;
+
+	for (int b = 0; b < ARRAY_SIZE(blocks); b++) {
+		ret |= test_single_tone(blocks[b]);
+		ret |= test_tone_change(blocks[b]);
+	}
+
+	return ret;
+}
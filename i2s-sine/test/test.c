@@ -3,14 +3,12 @@
 #include <stdio.h>
 #include <math.h>
 
+#include "common.h"
+
 #define ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
 
 #define SAMPLING_FREQ 16000
 
-size_t sine_float(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
-size_t sine_cordic16(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
-size_t sine_cordic32(int freq, unsigned int samples_per_sec, int amp, int16_t *sine, unsigned int samples);
-
 int16_t sine1[SAMPLING_FREQ];
 int16_t sine2[SAMPLING_FREQ];
 int16_t sine3[SAMPLING_FREQ];
@@ -0,0 +1,66 @@
+/*
+ * Sample bank: a compact table of clips in one read-only image, either
+ * embedded in the application or in a memory-mapped data partition. Clip
+ * data is used in place: voices read samples straight from flash.
+ */
+
+#include <string.h>
+
+#include "common.h"
+
+static inline uint32_t le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/* table and clip data are used in place: image must be word aligned */
+int bank_open(struct bank *b, const void *base, size_t size)
+{
+	const uint8_t *p = base;
+	size_t table;
+
+	memset(b, 0, sizeof(*b));
+
+	if ((uintptr_t)p % 4 || size < BANK_HDR_SIZE || memcmp(p, "SBNK", 4))
+		return -1;
+
+	if ((p[4] | p[5] << 8) != BANK_VERSION)
+		return -1;
+
+	b->count = p[6] | p[7] << 8;
+	b->rate = le32(p + 8);
+
+	table = BANK_HDR_SIZE + b->count * sizeof(struct bank_clip);
+	if (!b->count || b->count > BANK_MAX_CLIPS || !b->rate || table > size) {
+		memset(b, 0, sizeof(*b));
+		return -1;
+	}
+
+	/* host and esp32 are little endian: table entries are read as they are */
+	b->clips = (const struct bank_clip *)(p + BANK_HDR_SIZE);
+
+	for (unsigned int i = 0; i < b->count; i++) {
+		const struct bank_clip *c = &b->clips[i];
+
+		if (c->offset % 4 || c->offset < table || c->offset > size ||
+		    c->frames > (size - c->offset) / sizeof(int16_t)) {
+			memset(b, 0, sizeof(*b));
+			return -1;
+		}
+	}
+
+	b->base = p;
+	b->size = size;
+
+	return 0;
+}
+
+const int16_t *bank_clip(const struct bank *b, unsigned int clip, uint32_t *frames)
+{
+	if (clip >= b->count)
+		return NULL;
+
+	*frames = b->clips[clip].frames;
+
+	return (const int16_t *)(b->base + b->clips[clip].offset);
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+/* byte stream source: sequential reads and forward skips */
+
+struct wav_source {
+	void *ctx;
+	size_t (*read)(void *ctx, void *buf, size_t len);
+	int (*skip)(void *ctx, size_t len);
+};
+
+/* audio sink: returns 0 when all the bytes are accepted */
+
+struct wav_sink {
+	void *ctx;
+	int (*write)(void *ctx, const void *buf, size_t len);
+};
+
+/* memory buffer as a byte source */
+
+struct wav_mem {
+	const uint8_t *buf;
+	size_t len;
+	size_t pos;
+};
+
+void wav_source_mem(struct wav_source *src, struct wav_mem *m, const void *buf, size_t len);
+void wav_source_file(struct wav_source *src, FILE *fd);
+
+/* wav parser */
+
+#define WAV_FORMAT_PCM		0x0001
+#define WAV_FORMAT_FLOAT	0x0003
+#define WAV_FORMAT_IMA_ADPCM	0x0011
+#define WAV_FORMAT_EXTENSIBLE	0xFFFE
+#define WAV_FORMAT_QOA		0x514F	/* not a WAV format: clip is a QOA file */
+
+struct wav_info {
+	uint16_t format;	/* WAV_FORMAT_*, extensible is resolved to its subformat */
+	uint16_t channels;
+	uint32_t sample_rate;
+	uint32_t byte_rate;
+	uint16_t block_align;	/* bytes per frame or per compressed block */
+	uint16_t bits_per_sample;
+	uint16_t samples_per_block;	/* frames per block: 1 for PCM, 0 if unknown */
+	uint32_t fact_frames;	/* frames from 'fact' chunk, 0 if there is none */
+	size_t data_offset;	/* from the start of the file */
+	uint32_t data_size;	/* clamped to the file length for truncated files */
+	uint32_t frames;	/* whole blocks in data chunk */
+};
+
+/* parse wav file in memory, audio data is at buf + info->data_offset */
+int wav_parse(const void *buf, size_t len, struct wav_info *info);
+
+/* read wav header, leave source positioned at the start of audio data */
+int wav_read_header(struct wav_source *src, struct wav_info *info);
+
+/* streaming player: constant memory, double buffered chunks */
+
+struct player_stats {
+	uint32_t chunks;
+	uint32_t bytes;
+	int64_t first_chunk_us;
+	int64_t total_us;
+};
+
+int player_play(struct wav_source *src, uint32_t size, struct wav_sink *sink, size_t chunk,
+		struct player_stats *stats);
+
+/* playback from a memory-mapped flash partition, sink gets pointers into the mapping */
+
+#define MMAP_PAGE	(64 * 1024)	/* flash MMU page: mapping offsets are aligned to it */
+
+struct flash_map {
+	void *ctx;
+	size_t size;
+	const void *(*map)(void *ctx, size_t offset, size_t len, uint32_t *handle);
+	void (*unmap)(void *ctx, uint32_t handle);
+};
+
+struct mmap_stats {
+	uint32_t maps;
+	uint32_t writes;
+	uint32_t bytes;
+	int64_t total_us;
+};
+
+int mmap_read_header(struct flash_map *fm, const struct wav_info *raw, struct wav_info *info);
+int mmap_play(struct flash_map *fm, const struct wav_info *info, struct wav_sink *sink, size_t chunk,
+	      struct mmap_stats *stats);
+
+/*
+ * sample bank: 16-bit mono clips at one rate in a single flash image,
+ * a 12 byte header ("SBNK", version, clip count, rate) and a table of
+ * clip offsets and lengths, all little endian, clip data 4-byte aligned
+ */
+
+#define BANK_VERSION	1
+#define BANK_HDR_SIZE	12
+#define BANK_MAX_CLIPS	256
+
+struct bank_clip {
+	uint32_t offset;	/* from the bank start, bytes */
+	uint32_t frames;
+};
+
+struct bank {
+	const uint8_t *base;
+	size_t size;
+	uint32_t rate;
+	unsigned int count;
+	const struct bank_clip *clips;
+};
+
+int bank_open(struct bank *b, const void *base, size_t size);
+const int16_t *bank_clip(const struct bank *b, unsigned int clip, uint32_t *frames);
+
+/* polyphonic mixer: voices play bank clips, summed into blocks of mono 16-bit PCM */
+
+#define MIXER_BLOCK		240	/* frames: one I2S DMA buffer */
+#define MIXER_MAX_VOICES	32
+#define MIXER_GAIN_MAX		0xffff	/* Q15 voice gain fits 16 bits of a trigger word */
+
+struct mixer_voice {
+	const int16_t *data;	/* NULL - idle */
+	uint32_t frames;
+	uint32_t pos;
+	int32_t gain;
+	atomic_uint_least32_t trigger;	/* pending command from other tasks, 0 - none */
+};
+
+struct mixer {
+	const struct bank *bank;
+	unsigned int voices;
+	unsigned int headroom;	/* mix is shifted down by this many bits before saturation */
+	struct mixer_voice voice[MIXER_MAX_VOICES];
+	int32_t acc[MIXER_BLOCK];
+	uint32_t clipped;	/* saturated output samples */
+};
+
+int mixer_init(struct mixer *m, const struct bank *bank, unsigned int voices, unsigned int headroom);
+int mixer_trigger(struct mixer *m, unsigned int voice, unsigned int clip, int32_t q15);
+void mixer_stop(struct mixer *m, unsigned int voice);
+unsigned int mixer_render(struct mixer *m, int16_t *out, size_t frames);
+
+/* gapless playlist: next track is opened and parsed while the current one drains */
+
+struct playlist_track {
+	struct wav_info info;
+	uint32_t chunks;
+	uint32_t bytes;
+	int64_t gap_us;		/* writer idle between tracks, 0 for the first: audible if over DMA queue length */
+	int64_t total_us;
+};
+
+struct playlist_ops {
+	void *ctx;
+	/* tracks in one pass of a repeating list: it ends after a pass without audio data, 0 - not repeating */
+	unsigned int count;
+	/* position source at audio data of the track: 0 - ok, 1 - end of the list, -1 - error */
+	int (*open)(void *ctx, unsigned int track, struct wav_source *src, struct wav_info *info);
+	void (*close)(void *ctx, unsigned int track);
+	/* called by the writer before the first chunk of each track: sink for its data */
+	int (*start)(void *ctx, unsigned int track, const struct wav_info *info, struct wav_sink *sink);
+	/* optional: called when the last chunk of the track is written */
+	void (*played)(void *ctx, unsigned int track, const struct playlist_track *t);
+};
+
+struct playlist_stats {
+	uint32_t tracks;
+	uint32_t bytes;
+	int64_t first_chunk_us;
+	int64_t max_gap_us;
+	int64_t total_us;
+};
+
+int playlist_play(const struct playlist_ops *ops, size_t chunk, struct playlist_stats *stats);
+
+/* fixed-point polyphase resampler */
+
+#define RESAMPLER_BLOCK		128	/* input frames per processing step */
+#define RESAMPLER_MAX_TAPS	512	/* per phase */
+#define RESAMPLER_MAX_SHIFT	17	/* coefficient fraction bits */
+
+enum resampler_quality {
+	RESAMPLER_LOW,		/* 50 dB stopband, passband to 0.7 of output nyquist */
+	RESAMPLER_MEDIUM,	/* 70 dB stopband, passband to 0.8 */
+	RESAMPLER_HIGH,		/* 75 dB stopband, passband to 0.9 */
+};
+
+struct resampler {
+	uint32_t in_rate;
+	uint32_t out_rate;
+	uint32_t up;		/* in_rate * up == out_rate * down */
+	uint32_t down;
+	uint32_t pass_hz;	/* designed passband and stopband edges */
+	uint32_t stop_hz;
+	unsigned int taps;	/* per phase, 0 when rates are equal */
+	unsigned int shift;	/* coefficient fraction bits */
+	unsigned int headroom;	/* input right shift, keeps accumulator in range */
+	unsigned int channels;
+	unsigned int phase;
+	unsigned int pos;
+	int16_t *coefs;		/* up phases of taps coefficients */
+	int16_t *buf;		/* history and current block, interleaved */
+};
+
+/* taps: per phase, 0 - estimate from quality preset */
+int resampler_init(struct resampler *rs, uint32_t in_rate, uint32_t out_rate, unsigned int channels,
+		   enum resampler_quality quality, unsigned int taps);
+void resampler_deinit(struct resampler *rs);
+void resampler_reset(struct resampler *rs);
+size_t resampler_out_max(const struct resampler *rs, size_t frames);
+size_t resampler_process(struct resampler *rs, const int16_t *in, size_t frames, int16_t *out);
+
+/* resampling stage in front of another sink, trailing partial frame is dropped */
+
+struct gain;
+
+struct resampler_sink {
+	struct resampler *rs;
+	struct wav_sink *next;
+	int16_t *out;
+	struct gain *gain;	/* applied in place to the output, optional */
+};
+
+int resampler_sink_init(struct resampler_sink *s, struct resampler *rs, struct wav_sink *next,
+			struct wav_sink *sink);
+void resampler_sink_deinit(struct resampler_sink *s);
+
+/* ima adpcm decoder */
+
+void ima_adpcm_init(void);
+int ima_adpcm_decode_block(const uint8_t *block, size_t len, unsigned int channels,
+			   unsigned int samples_per_block, int16_t *out);
+
+struct ima_adpcm_sink {
+	unsigned int channels;
+	unsigned int block_align;
+	unsigned int samples_per_block;
+	struct wav_sink *next;
+	int16_t *pcm;		/* one decoded block */
+};
+
+int ima_adpcm_sink_init(struct ima_adpcm_sink *s, const struct wav_info *info, struct wav_sink *next,
+			struct wav_sink *sink);
+void ima_adpcm_sink_deinit(struct ima_adpcm_sink *s);
+
+/* qoa decoder: big endian frames of 256 slices, 20 samples per 64-bit slice */
+
+#define QOA_SLICE_LEN		20
+#define QOA_FRAME_LEN		(256 * QOA_SLICE_LEN)
+#define QOA_MAX_CHANNELS	2
+#define QOA_BATCH_SLICES	16	/* slices per channel decoded before passing PCM on */
+
+struct qoa_lms {
+	int32_t history[4];
+	int32_t weights[4];
+};
+
+size_t qoa_frame_size(unsigned int channels, unsigned int samples);
+
+/* read file header and the first frame header, data_size is the rest of the file */
+int qoa_read_header(struct wav_source *src, struct wav_info *info);
+
+struct qoa_sink {
+	unsigned int channels;
+	uint32_t sample_rate;
+	struct wav_sink *next;
+	struct qoa_lms lms[QOA_MAX_CHANNELS];
+	size_t frame_size;	/* of the current frame, known after its header */
+	size_t have;		/* bytes of the current frame collected */
+	uint8_t *frame;		/* one encoded frame */
+	int16_t *pcm;		/* QOA_BATCH_SLICES decoded slices */
+};
+
+/* decoding stage in front of another sink, writes may be of any size */
+int qoa_sink_init(struct qoa_sink *s, const struct wav_info *info, struct wav_sink *next,
+		  struct wav_sink *sink);
+void qoa_sink_deinit(struct qoa_sink *s);
+
+/* sample format conversion to 16-bit: n is samples, kernels may run in place */
+
+#define CONVERT_BLOCK		256	/* frames per conversion step */
+
+void convert_u8_s16(int16_t *out, const uint8_t *in, size_t n);
+void convert_s24_s16(int16_t *out, const uint8_t *in, size_t n);
+void convert_s24_s32(int32_t *out, const uint8_t *in, size_t n);
+void convert_s32_s16(int16_t *out, const uint8_t *in, size_t n);
+void convert_f32_s16(int16_t *out, const uint8_t *in, size_t n);
+void convert_mono_stereo(int16_t *out, const int16_t *in, size_t frames);
+void convert_stereo_mono(int16_t *out, const int16_t *in, size_t frames);
+
+enum convert_format {
+	CONVERT_S16,
+	CONVERT_U8,
+	CONVERT_S24,
+	CONVERT_S32,
+	CONVERT_F32,
+};
+
+struct convert_sink {
+	enum convert_format in_format;
+	unsigned int in_bytes;	/* per sample */
+	unsigned int in_channels;
+	unsigned int out_channels;
+	struct wav_sink *next;
+	int16_t *block;		/* CONVERT_BLOCK stereo frames */
+};
+
+/* PCM 8/16/24/32-bit or 32-bit float, mono or stereo, to 16-bit with out_channels */
+int convert_sink_init(struct convert_sink *s, const struct wav_info *info, unsigned int out_channels,
+		      struct wav_sink *next, struct wav_sink *sink);
+void convert_sink_deinit(struct convert_sink *s);
@@ -0,0 +1,265 @@
+/*
+ * Sample format conversion to the 16-bit data path
+ *
+ * Kernels work a 32-bit word at a time: four input samples are loaded with
+ * one to three word loads and stored as two words of packed 16-bit pairs.
+ * Words are loaded with memcpy, so buffers need no alignment. Byte layout
+ * is little endian on both ESP32 and the host, kernels rely on it.
+ *
+ * All kernels may run in place (out == in): shrinking conversions walk
+ * forward, expanding ones walk backward, so a sample is always read before
+ * its storage is overwritten.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+#error "conversion kernels assume little endian byte order"
+#endif
+
+static inline uint32_t load32(const void *p)
+{
+	uint32_t v;
+
+	memcpy(&v, p, sizeof(v));
+	return v;
+}
+
+static inline void store32(void *p, uint32_t v)
+{
+	memcpy(p, &v, sizeof(v));
+}
+
+static inline uint32_t pack(uint32_t lo, uint32_t hi)
+{
+	return (lo & 0xffff) | hi << 16;
+}
+
+/* unsigned 8-bit: flip the sign bit and move to the high byte */
+void convert_u8_s16(int16_t *out, const uint8_t *in, size_t n)
+{
+	size_t i = n & ~(size_t)3;
+
+	for (size_t k = n; k > i; k--)
+		out[k - 1] = (in[k - 1] ^ 0x80) << 8;
+
+	while (i) {
+		uint32_t w;
+
+		i -= 4;
+		w = load32(in + i) ^ 0x80808080;
+
+		/* bytes 0..3 -> high bytes of 4 halfwords */
+		store32(out + i + 2, (w >> 8 & 0xff00) | (w & 0xff000000));
+		store32(out + i, (w << 8 & 0xff00) | (w << 16 & 0xff000000));
+	}
+}
+
+/* packed 24-bit: keep the two high bytes of each sample, 12 bytes -> 8 */
+void convert_s24_s16(int16_t *out, const uint8_t *in, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i + 4 <= n; i += 4) {
+		uint32_t w0 = load32(in + 3 * i);
+		uint32_t w1 = load32(in + 3 * i + 4);
+		uint32_t w2 = load32(in + 3 * i + 8);
+
+		store32(out + i, pack(w0 >> 8, w1));
+		store32(out + i + 2, pack(w1 >> 24 | w2 << 8, w2 >> 16));
+	}
+
+	for (; i < n; i++)
+		out[i] = in[3 * i + 1] | in[3 * i + 2] << 8;
+}
+
+/* packed 24-bit to 32-bit left aligned, 12 bytes -> 16 */
+void convert_s24_s32(int32_t *out, const uint8_t *in, size_t n)
+{
+	size_t i = n & ~(size_t)3;
+
+	for (size_t k = n; k > i; k--)
+		out[k - 1] = (uint32_t)(in[3 * k - 3] | in[3 * k - 2] << 8 | in[3 * k - 1] << 16) << 8;
+
+	while (i) {
+		uint32_t w0, w1, w2;
+
+		i -= 4;
+		w0 = load32(in + 3 * i);
+		w1 = load32(in + 3 * i + 4);
+		w2 = load32(in + 3 * i + 8);
+
+		store32(out + i + 3, w2 & 0xffffff00);
+		store32(out + i + 2, w2 << 24 | (w1 >> 8 & 0x00ffff00));
+		store32(out + i + 1, w1 << 16 | (w0 >> 16 & 0x0000ff00));
+		store32(out + i, w0 << 8);
+	}
+}
+
+/* 32-bit: high halfword */
+void convert_s32_s16(int16_t *out, const uint8_t *in, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i + 2 <= n; i += 2)
+		store32(out + i, pack(load32(in + 4 * i) >> 16, load32(in + 4 * i + 4) >> 16));
+
+	for (; i < n; i++)
+		out[i] = load32(in + 4 * i) >> 16;
+}
+
+/* float: scale to 16 bits, round to nearest, saturate; NaN is silence */
+static inline int16_t f32_s16(float v)
+{
+	float x = v * 32768.0f;
+	int32_t t;
+	float frac;
+
+	/* selects, not branches: audio data is unpredictable */
+	x = (x != x) ? 0.0f : x;
+	x = (x < -32768.0f) ? -32768.0f : x;
+	x = (x > 32767.0f) ? 32767.0f : x;
+
+	/* x - trunc(x) is exact, adding 0.5 to x would round in single precision */
+	t = (int32_t)x;
+	frac = x - t;
+
+	return t + (frac >= 0.5f) - (frac < -0.5f);
+}
+
+void convert_f32_s16(int16_t *out, const uint8_t *in, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i + 2 <= n; i += 2) {
+		float a, b;
+
+		memcpy(&a, in + 4 * i, sizeof(a));
+		memcpy(&b, in + 4 * i + 4, sizeof(b));
+		store32(out + i, pack(f32_s16(a), f32_s16(b)));
+	}
+
+	for (; i < n; i++) {
+		float a;
+
+		memcpy(&a, in + 4 * i, sizeof(a));
+		out[i] = f32_s16(a);
+	}
+}
+
+/* duplicate each sample into a left/right pair, one word per frame */
+void convert_mono_stereo(int16_t *out, const int16_t *in, size_t frames)
+{
+	for (size_t i = frames; i > 0; i--) {
+		uint16_t s = in[i - 1];
+
+		store32(out + 2 * (i - 1), s | (uint32_t)s << 16);
+	}
+}
+
+/* average of left and right, rounded down */
+void convert_stereo_mono(int16_t *out, const int16_t *in, size_t frames)
+{
+	for (size_t i = 0; i < frames; i++) {
+		uint32_t w = load32(in + 2 * i);
+
+		out[i] = ((int32_t)(int16_t)w + ((int32_t)w >> 16)) >> 1;
+	}
+}
+
+/* sink adaptor: writes must be whole frames, trailing partial frame is dropped */
+
+static int convert_sink_write(void *ctx, const void *buf, size_t len)
+{
+	struct convert_sink *s = ctx;
+	const uint8_t *in = buf;
+	size_t frame = s->in_channels * s->in_bytes;
+	size_t frames = len / frame;
+	size_t n, samples;
+
+	while (frames) {
+		n = (frames < CONVERT_BLOCK) ? frames : CONVERT_BLOCK;
+		samples = n * s->in_channels;
+
+		switch (s->in_format) {
+		case CONVERT_U8:
+			convert_u8_s16(s->block, in, samples);
+			break;
+		case CONVERT_S24:
+			convert_s24_s16(s->block, in, samples);
+			break;
+		case CONVERT_S32:
+			convert_s32_s16(s->block, in, samples);
+			break;
+		case CONVERT_F32:
+			convert_f32_s16(s->block, in, samples);
+			break;
+		default:
+			memcpy(s->block, in, samples * sizeof(int16_t));
+			break;
+		}
+
+		/* channel count is fixed by i2s slot config: adapt in place */
+		if (s->in_channels == 1 && s->out_channels == 2)
+			convert_mono_stereo(s->block, s->block, n);
+		else if (s->in_channels == 2 && s->out_channels == 1)
+			convert_stereo_mono(s->block, s->block, n);
+
+		if (s->next->write(s->next->ctx, s->block, n * s->out_channels * sizeof(int16_t)))
+			return -1;
+
+		in += n * frame;
+		frames -= n;
+	}
+
+	return 0;
+}
+
+/* 16-bit input with matching channels is only copied, main.c skips the stage for it */
+int convert_sink_init(struct convert_sink *s, const struct wav_info *info, unsigned int out_channels,
+		      struct wav_sink *next, struct wav_sink *sink)
+{
+	memset(s, 0, sizeof(*s));
+
+	if (info->format == WAV_FORMAT_FLOAT && info->bits_per_sample == 32) {
+		s->in_format = CONVERT_F32;
+	} else if (info->format != WAV_FORMAT_PCM) {
+		return -1;
+	} else if (info->bits_per_sample == 8) {
+		s->in_format = CONVERT_U8;
+	} else if (info->bits_per_sample == 16) {
+		s->in_format = CONVERT_S16;
+	} else if (info->bits_per_sample == 24) {
+		s->in_format = CONVERT_S24;
+	} else if (info->bits_per_sample == 32) {
+		s->in_format = CONVERT_S32;
+	} else {
+		return -1;
+	}
+
+	if (info->channels < 1 || info->channels > 2 || out_channels < 1 || out_channels > 2)
+		return -1;
+
+	s->in_bytes = info->bits_per_sample / 8;
+	s->in_channels = info->channels;
+	s->out_channels = out_channels;
+	s->next = next;
+
+	s->block = malloc(CONVERT_BLOCK * 2 * sizeof(*s->block));
+	if (!s->block)
+		return -1;
+
+	sink->ctx = s;
+	sink->write = convert_sink_write;
+
+	return 0;
+}
+
+void convert_sink_deinit(struct convert_sink *s)
+{
+	free(s->block);
+	s->block = NULL;
+}
@@ -0,0 +1,179 @@
+/*
+ * IMA ADPCM decoder for WAV (format 0x11) blocks
+ *
+ * Block layout, for each channel: 4 byte header with the first sample and
+ * step index, then 4 byte groups of 8 samples per channel, interleaved,
+ * low nibble first.
+ *
+ * Decoding is table driven: for each of 89 step indexes and 16 nibbles the
+ * signed difference and the next step index are computed once, so a sample
+ * takes two loads, an add and a clamp. Differences are the same as in IMA
+ * reference algorithm (sum of shifted steps), so the output is bit exact.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#define STEPS 89
+
+static const int16_t step_table[STEPS] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+	19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+	130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+	337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+	876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+	2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+	5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+	15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int8_t index_table[16] = {
+	-1, -1, -1, -1, 2, 4, 6, 8,
+	-1, -1, -1, -1, 2, 4, 6, 8
+};
+
+static int32_t diff_table[STEPS][16];
+static uint8_t next_table[STEPS][16];
+static int tables_ready;
+
+void ima_adpcm_init(void)
+{
+	if (tables_ready)
+		return;
+
+	for (int i = 0; i < STEPS; i++) {
+		for (int n = 0; n < 16; n++) {
+			int step = step_table[i];
+			int diff = step >> 3;
+			int next = i + index_table[n];
+
+			if (n & 4)
+				diff += step;
+			if (n & 2)
+				diff += step >> 1;
+			if (n & 1)
+				diff += step >> 2;
+
+			diff_table[i][n] = (n & 8) ? -diff : diff;
+			next_table[i][n] = (next < 0) ? 0 : (next >= STEPS) ? STEPS - 1 : next;
+		}
+	}
+
+	tables_ready = 1;
+}
+
+static inline int16_t ima_sample(int32_t *pred, unsigned int *index, unsigned int nibble)
+{
+	int32_t p = *pred + diff_table[*index][nibble];
+
+	if (p > INT16_MAX)
+		p = INT16_MAX;
+	else if (p < INT16_MIN)
+		p = INT16_MIN;
+
+	*index = next_table[*index][nibble];
+	*pred = p;
+
+	return p;
+}
+
+/* last block of a file may be short: decode whole groups which are there, returns frames */
+int ima_adpcm_decode_block(const uint8_t *block, size_t len, unsigned int channels,
+			   unsigned int samples_per_block, int16_t *out)
+{
+	unsigned int groups = (samples_per_block - 1) / 8;
+
+	if (!tables_ready)
+		ima_adpcm_init();
+
+	if (len < 4 * channels)
+		return 0;
+
+	if (groups > (len - 4 * channels) / (4 * channels))
+		groups = (len - 4 * channels) / (4 * channels);
+
+	for (unsigned int ch = 0; ch < channels; ch++) {
+		const uint8_t *hdr = block + 4 * ch;
+		const uint8_t *src = block + 4 * channels + 4 * ch;
+		int32_t pred = (int16_t)(hdr[0] | hdr[1] << 8);
+		unsigned int index = hdr[2];
+		int16_t *dst = out + ch;
+
+		if (index >= STEPS)
+			return -1;
+
+		*dst = pred;
+		dst += channels;
+
+		for (unsigned int g = 0; g < groups; g++) {
+			for (unsigned int i = 0; i < 4; i++) {
+				uint8_t b = src[i];
+
+				dst[0] = ima_sample(&pred, &index, b & 0xf);
+				dst[channels] = ima_sample(&pred, &index, b >> 4);
+				dst += 2 * channels;
+			}
+
+			src += 4 * channels;
+		}
+	}
+
+	return 1 + 8 * groups;
+}
+
+/* sink adaptor: decode blocks and pass PCM to the next sink, writes must be block aligned */
+
+static int ima_adpcm_sink_write(void *ctx, const void *buf, size_t len)
+{
+	struct ima_adpcm_sink *s = ctx;
+	const uint8_t *block = buf;
+	size_t n;
+	int frames;
+
+	while (len) {
+		n = (len < s->block_align) ? len : s->block_align;
+
+		frames = ima_adpcm_decode_block(block, n, s->channels, s->samples_per_block, s->pcm);
+		if (frames < 0)
+			return -1;
+
+		if (s->next->write(s->next->ctx, s->pcm, frames * s->channels * sizeof(int16_t)))
+			return -1;
+
+		block += n;
+		len -= n;
+	}
+
+	return 0;
+}
+
+int ima_adpcm_sink_init(struct ima_adpcm_sink *s, const struct wav_info *info, struct wav_sink *next,
+			struct wav_sink *sink)
+{
+	if (info->format != WAV_FORMAT_IMA_ADPCM || !info->samples_per_block)
+		return -1;
+
+	ima_adpcm_init();
+
+	s->channels = info->channels;
+	s->block_align = info->block_align;
+	s->samples_per_block = info->samples_per_block;
+	s->next = next;
+	s->pcm = malloc(s->samples_per_block * s->channels * sizeof(*s->pcm));
+	if (!s->pcm)
+		return -1;
+
+	sink->ctx = s;
+	sink->write = ima_adpcm_sink_write;
+
+	return 0;
+}
+
+void ima_adpcm_sink_deinit(struct ima_adpcm_sink *s)
+{
+	free(s->pcm);
+	s->pcm = NULL;
+}
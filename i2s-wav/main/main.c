@@ -15,74 +15,75 @@
 
 #include "esp_flash.h"
 #include "esp_log.h"
+#include "esp_spiffs.h"
+#include "esp_partition.h"
+#include "esp_random.h"
+#include "esp_timer.h"
 
 #include "driver/i2s_std.h"
 
-#include "format_wav.h"
+#include "common.h"
+#include "gain.h"
 #include "sdkconfig.h"
 
 #define STACK_SIZE 3584
 
+#ifdef CONFIG_WAV_DITHER
+#define DITHER_BITS CONFIG_WAV_DITHER_BITS
+#else
+#define DITHER_BITS 0
+#endif
+
 static const char *TAG = "sound";
 
 static i2s_chan_handle_t tx_handle = NULL;
+static unsigned int i2s_channels;
 
-extern const uint8_t test_wav_start[] asm("_binary_test_wav_start");
-extern const uint8_t test_wav_end[]   asm("_binary_test_wav_end");
-
-static fmt_chunk_t *get_wav_fmt(const uint8_t *start, const uint8_t *end)
+static esp_err_t mount_spiffs_storage(const char *base_path)
 {
-	dsc_chunk_t *dsc = (dsc_chunk_t *)start;
-	fmt_chunk_t *fmt;
+	size_t total = 0;
+	size_t used = 0;
+	esp_err_t ret;
+
+	esp_vfs_spiffs_conf_t conf = {
+		.base_path = base_path,
+		.partition_label = NULL,
+		.max_files = 5,
+		.format_if_mount_failed = false,
+	};
 
-	if (strncmp(dsc->chunk_id, "RIFF", 4)) {
-		return NULL;
+	ret = esp_vfs_spiffs_register(&conf);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "%s: failed to mount SPIFFS (%s)", __func__, esp_err_to_name(ret));
+		return ret;
 	}
 
-	if (strncmp(dsc->chunk_format, "WAVE", 4)) {
-		return NULL;
+	ret = esp_spiffs_info(NULL, &total, &used);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "%s: failed to get SPIFFS info (%s)", __func__, esp_err_to_name(ret));
+		return ret;
 	}
 
-	/* assume that fmt is always after descriptor */
-	fmt = (fmt_chunk_t *)(start + sizeof(dsc_chunk_t));
+	ESP_LOGI(TAG, "%s: partition size: total %d used %d", __func__, total, used);
 
-	if (strncmp(fmt->subchunk_id, "fmt", 3)) {
-		return NULL;
-	}
-
-	return fmt;
+	return ESP_OK;
 }
 
-static data_chunk_t *get_wav_audio(const uint8_t *start, const uint8_t *end)
+static int i2s_sink_write(void *ctx, const void *buf, size_t len)
 {
-	dsc_chunk_t *dsc = (dsc_chunk_t *)start;
-	uint8_t *ptr = (uint8_t *)start;
-	data_chunk_t *sch;
-
-	if (strncmp(dsc->chunk_id, "RIFF", 4)) {
-		return NULL;
-	}
-
-	if (strncmp(dsc->chunk_format, "WAVE", 4)) {
-		return NULL;
-	}
-
-	ptr = ptr + sizeof(dsc_chunk_t);
-	sch = (data_chunk_t *)ptr;
-
-	while(ptr < end) {
-		if (!strncmp(sch->subchunk_id, "data", 4)) {
-			return sch;
-		}
+	size_t bytes_write = 0;
+	esp_err_t ret;
 
-		ptr = ptr + sch->subchunk_size + sizeof(data_chunk_t);
-		sch = (data_chunk_t *)ptr;
+	ret = i2s_channel_write(tx_handle, buf, len, &bytes_write, portMAX_DELAY);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "%s: i2s write failed: reason %d", __func__, ret);
+		return -1;
 	}
 
-	return NULL;
+	return (bytes_write == len) ? 0 : -1;
 }
 
-static esp_err_t i2s_driver_init(void)
+static esp_err_t i2s_driver_init(const struct wav_info *fmt)
 {
 	i2s_chan_config_t chan_cfg = I2S_CHANNEL_DEFAULT_CONFIG(I2S_NUM_AUTO, I2S_ROLE_MASTER);
 	chan_cfg.auto_clear = true;
@@ -106,29 +107,24 @@ static esp_err_t i2s_driver_init(void)
 		},
 	};
 
-	fmt_chunk_t *fmt = get_wav_fmt(test_wav_start, test_wav_end);
-	if (!fmt) {
-		ESP_LOGE(TAG, "%s: failed to find wav file format", __func__);
-		abort();
-	}
-
-	ESP_LOGI(TAG, "%s: format: %u", __func__, fmt->audio_format);
+	ESP_LOGI(TAG, "%s: format: %u", __func__, fmt->format);
 	ESP_LOGI(TAG, "%s: sample_rate: %lu", __func__, fmt->sample_rate);
 	ESP_LOGI(TAG, "%s: bits_per_sample: %u", __func__, fmt->bits_per_sample);
-	ESP_LOGI(TAG, "%s: type: %s", __func__, (fmt->num_of_channels == I2S_SLOT_MODE_MONO) ? "mono" : "stereo");
+	ESP_LOGI(TAG, "%s: type: %s", __func__, (fmt->channels == I2S_SLOT_MODE_MONO) ? "mono" : "stereo");
 
-	if (fmt->audio_format != 1) {
-		ESP_LOGW(TAG, "%s: unexpected audio format: %u != 1 (PCM)", __func__, fmt->audio_format);
-	}
+	/* fixed rate for the lifetime of the channel: clips are resampled to it */
+	std_cfg.clk_cfg.sample_rate_hz = CONFIG_WAV_OUTPUT_RATE;
 
-	std_cfg.clk_cfg.sample_rate_hz = fmt->sample_rate;
+	/* slot mode is fixed too: clips with other channel count are converted */
+	i2s_channels = (fmt->channels == I2S_SLOT_MODE_MONO) ? 1 : 2;
 
-	std_cfg.slot_cfg.slot_mask = (fmt->num_of_channels == I2S_SLOT_MODE_MONO) ? I2S_STD_SLOT_LEFT : I2S_STD_SLOT_BOTH;
-	std_cfg.slot_cfg.slot_mode = fmt->num_of_channels;
+	std_cfg.slot_cfg.slot_mask = (i2s_channels == I2S_SLOT_MODE_MONO) ? I2S_STD_SLOT_LEFT : I2S_STD_SLOT_BOTH;
+	std_cfg.slot_cfg.slot_mode = i2s_channels;
 
-	std_cfg.slot_cfg.msb_right = (fmt->bits_per_sample <= I2S_DATA_BIT_WIDTH_16BIT) ? true : false;
-	std_cfg.slot_cfg.data_bit_width = fmt->bits_per_sample;
-	std_cfg.slot_cfg.ws_width = fmt->bits_per_sample;
+	/* data path is 16-bit PCM: other sample formats are converted, compressed clips decoded */
+	std_cfg.slot_cfg.msb_right = true;
+	std_cfg.slot_cfg.data_bit_width = I2S_DATA_BIT_WIDTH_16BIT;
+	std_cfg.slot_cfg.ws_width = I2S_DATA_BIT_WIDTH_16BIT;
 
 	ESP_ERROR_CHECK(i2s_channel_init_std_mode(tx_handle, &std_cfg));
 	ESP_ERROR_CHECK(i2s_channel_enable(tx_handle));
@@ -136,51 +132,505 @@ static esp_err_t i2s_driver_init(void)
 	return ESP_OK;
 }
 
+/* clip is either a WAV or a QOA file: tell them apart by magic */
+static int wav_open(FILE *fd, struct wav_source *src, struct wav_info *info)
+{
+	char magic[4] = { 0 };
+
+	rewind(fd);
+	fread(magic, 1, sizeof(magic), fd);
+	rewind(fd);
+
+	wav_source_file(src, fd);
+
+	if (!memcmp(magic, "qoaf", sizeof(magic)))
+		return qoa_read_header(src, info);
+
+	return wav_read_header(src, info);
+}
+
+/* playlist: tracks from CONFIG_WAV_PLAYLIST, decoder chain is switched per track */
+
+#define MAX_TRACKS 16
+
+/* bool options are not defined at all when they are off */
+#ifdef CONFIG_WAV_PLAYLIST_REPEAT
+#define PLAYLIST_REPEAT 1
+#else
+#define PLAYLIST_REPEAT 0
+#endif
+
+struct playback {
+	char *paths[MAX_TRACKS];
+	unsigned int count;
+	FILE *fd;
+
+	struct wav_sink i2s_sink;
+	struct resampler rs;
+	struct resampler_sink rs_sink;
+	struct wav_sink rs_in;
+	struct gain gain;	/* kept across tracks: no ramps at gapless joins */
+
+	uint16_t format;	/* of the current chain, 0 - none */
+	struct ima_adpcm_sink adpcm_sink;
+	struct qoa_sink qoa_sink;
+	struct convert_sink conv_sink;
+	struct wav_sink conv_in;
+	int convert;
+};
+
+static int playback_open(void *ctx, unsigned int track, struct wav_source *src, struct wav_info *info)
+{
+	struct playback *pb = ctx;
+	const char *path;
+
+	if (!PLAYLIST_REPEAT && track >= pb->count)
+		return 1;
+
+	path = pb->paths[track % pb->count];
+
+	pb->fd = fopen(path, "rb");
+	if (!pb->fd) {
+		ESP_LOGE(TAG, "%s: failed to open %s", __func__, path);
+		return -1;
+	}
+
+	if (wav_open(pb->fd, src, info)) {
+		ESP_LOGE(TAG, "%s: failed to find audio data in %s", __func__, path);
+		fclose(pb->fd);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void playback_close(void *ctx, unsigned int track)
+{
+	struct playback *pb = ctx;
+
+	fclose(pb->fd);
+	pb->fd = NULL;
+}
+
+static void playback_release(struct playback *pb)
+{
+	if (pb->format == WAV_FORMAT_IMA_ADPCM)
+		ima_adpcm_sink_deinit(&pb->adpcm_sink);
+	else if (pb->format == WAV_FORMAT_QOA)
+		qoa_sink_deinit(&pb->qoa_sink);
+
+	if (pb->convert)
+		convert_sink_deinit(&pb->conv_sink);
+
+	pb->format = 0;
+	pb->convert = 0;
+}
+
+/*
+ * Runs between two chunks: tracks with the same rate keep resampler state,
+ * so the join is seamless. Decoders are set up again, they are cheap.
+ */
+static int playback_start(void *ctx, unsigned int track, const struct wav_info *info, struct wav_sink *sink)
+{
+	struct playback *pb = ctx;
+	struct wav_sink *pcm_sink;
+	struct wav_info pcm;
+
+	playback_release(pb);
+
+	ESP_LOGI(TAG, "%s: track %u: %s: format %u, %u bits, %u channels, %lu Hz", __func__, track,
+			pb->paths[track % pb->count], info->format, info->bits_per_sample,
+			info->channels, info->sample_rate);
+
+	/* filter design is slow on esp32: keep resampler while the clip rate is the same */
+	if (pb->rs.in_rate != info->sample_rate) {
+		resampler_sink_deinit(&pb->rs_sink);
+		resampler_deinit(&pb->rs);
+
+		if (resampler_init(&pb->rs, info->sample_rate, CONFIG_WAV_OUTPUT_RATE, i2s_channels,
+					CONFIG_WAV_RESAMPLER_QUALITY, 0)) {
+			ESP_LOGE(TAG, "%s: failed to init resampler %lu -> %u", __func__,
+					info->sample_rate, CONFIG_WAV_OUTPUT_RATE);
+			return -1;
+		}
+
+		if (resampler_sink_init(&pb->rs_sink, &pb->rs, &pb->i2s_sink, &pb->rs_in)) {
+			ESP_LOGE(TAG, "%s: failed to init resampler sink", __func__);
+			return -1;
+		}
+
+		pb->rs_sink.gain = &pb->gain;
+
+		ESP_LOGI(TAG, "%s: resample %lu -> %u: %lu phases of %u taps", __func__,
+				info->sample_rate, CONFIG_WAV_OUTPUT_RATE, pb->rs.up, pb->rs.taps);
+	}
+
+	/* decoders output 16-bit PCM with the channel count of the clip */
+	pcm = *info;
+	if (info->format == WAV_FORMAT_IMA_ADPCM || info->format == WAV_FORMAT_QOA) {
+		pcm.format = WAV_FORMAT_PCM;
+		pcm.bits_per_sample = 16;
+	}
+
+	/* 16-bit PCM with matching channels goes to resampler as it is, the rest is converted */
+	pb->convert = pcm.format != WAV_FORMAT_PCM || pcm.bits_per_sample != 16 || pcm.channels != i2s_channels;
+	if (pb->convert && convert_sink_init(&pb->conv_sink, &pcm, i2s_channels, &pb->rs_in, &pb->conv_in)) {
+		ESP_LOGE(TAG, "%s: unsupported format %u, %u bits, %u channels", __func__,
+				info->format, info->bits_per_sample, info->channels);
+		pb->convert = 0;
+		return -1;
+	}
+
+	pcm_sink = pb->convert ? &pb->conv_in : &pb->rs_in;
+
+	/* compressed clips: decoder in front of conversion and resampler */
+	if (info->format == WAV_FORMAT_IMA_ADPCM) {
+		if (ima_adpcm_sink_init(&pb->adpcm_sink, info, pcm_sink, sink)) {
+			ESP_LOGE(TAG, "%s: failed to init adpcm decoder", __func__);
+			return -1;
+		}
+	} else if (info->format == WAV_FORMAT_QOA) {
+		if (qoa_sink_init(&pb->qoa_sink, info, pcm_sink, sink)) {
+			ESP_LOGE(TAG, "%s: failed to init qoa decoder", __func__);
+			return -1;
+		}
+	} else {
+		*sink = *pcm_sink;
+	}
+
+	pb->format = info->format;
+
+	return 0;
+}
+
+static void playback_played(void *ctx, unsigned int track, const struct playlist_track *t)
+{
+	ESP_LOGI(TAG, "%s: track %u: %lu bytes in %lu chunks, %lld us, gap before it %lld us",
+			__func__, track, t->bytes, t->chunks, t->total_us, t->gap_us);
+}
+
 static void i2s_test(void *args)
 {
-	esp_err_t ret = ESP_OK;
-	size_t bytes_write = 0;
-	data_chunk_t *data;
+	struct playback *pb = args;
+	struct playlist_stats stats;
+	struct playlist_ops ops = {
+		.ctx = pb,
+		.count = PLAYLIST_REPEAT ? pb->count : 0,
+		.open = playback_open,
+		.close = playback_close,
+		.start = playback_start,
+		.played = playback_played,
+	};
+
+	pb->i2s_sink.write = i2s_sink_write;
+
+	while (1) {
+		ESP_LOGI(TAG, "%s: play %u tracks%s", __func__, pb->count,
+				PLAYLIST_REPEAT ? " in a loop" : "");
+
+		/* chunk size is rounded down to block size of each track, larger blocks fail */
+		if (playlist_play(&ops, CONFIG_WAV_CHUNK_SIZE, &stats)) {
+			ESP_LOGE(TAG, "%s: playlist failed after %lu tracks, %lu bytes",
+					__func__, stats.tracks, stats.bytes);
+			abort();
+		}
+
+		ESP_LOGI(TAG, "%s: %lu tracks, %lu bytes played, first chunk in %lld us, max gap %lld us",
+				__func__, stats.tracks, stats.bytes, stats.first_chunk_us, stats.max_gap_us);
+
+		playback_release(pb);
+
+		ESP_LOGI(TAG, "%s: delay...", __func__);
+		vTaskDelay(1000 /* ms */ / portTICK_PERIOD_MS);
+	}
+}
+
+#ifdef CONFIG_WAV_MMAP
+
+/* raw partition: 16-bit mono PCM at the output rate, up to the partition end */
+static const struct wav_info mmap_raw = {
+	.format = WAV_FORMAT_PCM,
+	.channels = 1,
+	.sample_rate = CONFIG_WAV_OUTPUT_RATE,
+	.byte_rate = CONFIG_WAV_OUTPUT_RATE * 2,
+	.block_align = 2,
+	.bits_per_sample = 16,
+};
+
+static const void *partition_map(void *ctx, size_t offset, size_t len, uint32_t *handle)
+{
+	const esp_partition_t *part = ctx;
+	esp_partition_mmap_handle_t h;
+	const void *ptr;
+	esp_err_t ret;
+
+	ret = esp_partition_mmap(part, offset, len, ESP_PARTITION_MMAP_DATA, &ptr, &h);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "%s: failed to map 0x%x bytes at 0x%x: %s", __func__, len, offset,
+				esp_err_to_name(ret));
+		return NULL;
+	}
+
+	*handle = h;
+	return ptr;
+}
 
-	data = get_wav_audio(test_wav_start, test_wav_end);
-	if (!data) {
-		ESP_LOGE(TAG, "%s: failed to find wav file audio data", __func__);
+static void partition_unmap(void *ctx, uint32_t handle)
+{
+	esp_partition_munmap(handle);
+}
+
+static int flash_map_init(struct flash_map *fm)
+{
+	const esp_partition_t *part;
+
+	part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+			CONFIG_WAV_MMAP_PARTITION);
+	if (!part) {
+		ESP_LOGE(TAG, "%s: partition %s not found", __func__, CONFIG_WAV_MMAP_PARTITION);
+		return -1;
+	}
+
+	fm->ctx = (void *)part;
+	fm->size = part->size;
+	fm->map = partition_map;
+	fm->unmap = partition_unmap;
+
+	return 0;
+}
+
+/* partition clip in a loop: no file system and no read buffers */
+static void mmap_test(void *args)
+{
+	struct playback *pb = args;
+	struct mmap_stats stats;
+	struct flash_map fm;
+	struct wav_sink sink;
+	struct wav_info info;
+	int direct;
+
+	if (flash_map_init(&fm) || mmap_read_header(&fm, &mmap_raw, &info)) {
+		ESP_LOGE(TAG, "%s: no audio in partition %s", __func__, CONFIG_WAV_MMAP_PARTITION);
 		abort();
 	}
 
-	while (1) {
-		ESP_LOGI(TAG, "%s: play audio", __func__);
+	pb->i2s_sink.write = i2s_sink_write;
+
+	/* i2s format at unity volume: mapped flash goes to the driver as it is */
+	direct = info.format == WAV_FORMAT_PCM && info.bits_per_sample == 16 &&
+		info.channels == i2s_channels && info.sample_rate == CONFIG_WAV_OUTPUT_RATE &&
+		!CONFIG_WAV_VOLUME_DB10 && !DITHER_BITS;
 
-		ret = i2s_channel_write(tx_handle, data->data, data->subchunk_size, &bytes_write, portMAX_DELAY);
-		if (ret != ESP_OK) {
-			ESP_LOGE(TAG, "%s: i2s write failed: reason %d", __func__, ret);
+	while (1) {
+		if (direct) {
+			sink = pb->i2s_sink;
+		} else if (playback_start(pb, 0, &info, &sink)) {
 			abort();
 		}
 
-		if (bytes_write > 0) {
-			ESP_LOGI(TAG, "%s: i2s sound played, %d bytes are written", __func__, bytes_write);
-		} else {
-			ESP_LOGE(TAG, "%s: i2s sound play failed", __func__);
+		ESP_LOGI(TAG, "%s: play %lu bytes from partition %s%s", __func__, info.data_size,
+				CONFIG_WAV_MMAP_PARTITION, direct ? " without copies" : "");
+
+		if (mmap_play(&fm, &info, &sink, CONFIG_WAV_CHUNK_SIZE, &stats)) {
+			ESP_LOGE(TAG, "%s: playback failed after %lu bytes", __func__, stats.bytes);
 			abort();
 		}
 
+		ESP_LOGI(TAG, "%s: %lu bytes in %lu writes, %lu windows mapped, %lld us",
+				__func__, stats.bytes, stats.writes, stats.maps, stats.total_us);
+
+		playback_release(pb);
+
 		ESP_LOGI(TAG, "%s: delay...", __func__);
 		vTaskDelay(1000 /* ms */ / portTICK_PERIOD_MS);
 	}
 }
 
+#endif
+
+#ifdef CONFIG_WAV_MIXER
+
+/* sound effects: bank partition stays mapped, voices read clips from flash */
+
+struct sfx {
+	struct playback *pb;
+	struct bank bank;
+	struct mixer mixer;
+	int16_t block[MIXER_BLOCK];
+};
+
+static int sfx_bank_init(struct bank *bank)
+{
+	esp_partition_mmap_handle_t handle;
+	const esp_partition_t *part;
+	const void *ptr;
+	esp_err_t ret;
+
+	part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+			CONFIG_WAV_MIXER_PARTITION);
+	if (!part) {
+		ESP_LOGE(TAG, "%s: partition %s not found", __func__, CONFIG_WAV_MIXER_PARTITION);
+		return -1;
+	}
+
+	ret = esp_partition_mmap(part, 0, part->size, ESP_PARTITION_MMAP_DATA, &ptr, &handle);
+	if (ret != ESP_OK) {
+		ESP_LOGE(TAG, "%s: failed to map partition %s: %s", __func__, CONFIG_WAV_MIXER_PARTITION,
+				esp_err_to_name(ret));
+		return -1;
+	}
+
+	if (bank_open(bank, ptr, part->size)) {
+		ESP_LOGE(TAG, "%s: no sample bank in partition %s", __func__, CONFIG_WAV_MIXER_PARTITION);
+		esp_partition_munmap(handle);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* renders one DMA block at a time: triggers from other tasks start on the next block */
+static void mixer_test(void *args)
+{
+	struct sfx *sfx = args;
+	struct playback *pb = sfx->pb;
+	int64_t max_us = 0;
+	struct wav_sink sink;
+	struct wav_info info = {
+		.format = WAV_FORMAT_PCM,
+		.channels = 1,
+		.sample_rate = sfx->bank.rate,
+		.byte_rate = sfx->bank.rate * 2,
+		.block_align = 2,
+		.bits_per_sample = 16,
+	};
+
+	pb->i2s_sink.write = i2s_sink_write;
+
+	/* mix is mono 16-bit at the bank rate: usual conversion and resampler chain */
+	if (playback_start(pb, 0, &info, &sink))
+		abort();
+
+	for (uint32_t blk = 1;; blk++) {
+		int64_t start = esp_timer_get_time();
+		unsigned int active;
+
+		active = mixer_render(&sfx->mixer, sfx->block, MIXER_BLOCK);
+
+		start = esp_timer_get_time() - start;
+		if (start > max_us)
+			max_us = start;
+
+		if (sink.write(sink.ctx, sfx->block, sizeof(sfx->block))) {
+			ESP_LOGE(TAG, "%s: write failed", __func__);
+			abort();
+		}
+
+		if (blk % 1000 == 0) {
+			ESP_LOGI(TAG, "%s: %lu blocks, %u voices active, %lu samples clipped, max mix %lld us",
+					__func__, blk, active, sfx->mixer.clipped, max_us);
+			max_us = 0;
+		}
+	}
+}
+
+/* stands for game or ui logic: random clips on voices in turn */
+static void trigger_test(void *args)
+{
+	struct sfx *sfx = args;
+	unsigned int voice = 0;
+
+	while (1) {
+		uint32_t r = esp_random();
+
+		mixer_trigger(&sfx->mixer, voice, r % sfx->bank.count, 0x4000 + (r >> 18));
+		voice = (voice + 1) % sfx->mixer.voices;
+
+		vTaskDelay((50 + (r >> 8) % 250) /* ms */ / portTICK_PERIOD_MS);
+	}
+}
+
+#endif
+
 void app_main(void)
 {
+	static struct playback pb;
 	TaskHandle_t xTest1Handle = NULL;
+	struct wav_info info;
+#if defined(CONFIG_WAV_MIXER)
+	static struct sfx sfx;
+
+	pb.paths[pb.count++] = strdup(CONFIG_WAV_MIXER_PARTITION);
+	sfx.pb = &pb;
+
+	if (sfx_bank_init(&sfx.bank) ||
+	    mixer_init(&sfx.mixer, &sfx.bank, CONFIG_WAV_MIXER_VOICES, CONFIG_WAV_MIXER_HEADROOM)) {
+		ESP_LOGE(TAG, "failed to init sound effects mixer");
+		abort();
+	}
+
+	ESP_LOGI(TAG, "sample bank: %u clips at %lu Hz, %u voices", sfx.bank.count, sfx.bank.rate,
+			sfx.mixer.voices);
+
+	/* mixer output is mono */
+	info = (struct wav_info){ .format = WAV_FORMAT_PCM, .channels = 1, .sample_rate = sfx.bank.rate,
+		.bits_per_sample = 16 };
+#elif defined(CONFIG_WAV_MMAP)
+	struct flash_map fm;
+
+	/* i2s slot config is taken from the partition clip */
+	pb.paths[pb.count++] = strdup(CONFIG_WAV_MMAP_PARTITION);
+
+	if (flash_map_init(&fm) || mmap_read_header(&fm, &mmap_raw, &info)) {
+		ESP_LOGE(TAG, "failed to find audio format in partition %s", CONFIG_WAV_MMAP_PARTITION);
+		abort();
+	}
+#else
+	struct wav_source src;
+	char *list;
+
+	ESP_ERROR_CHECK(mount_spiffs_storage("/storage"));
+
+	/* comma separated paths */
+	list = strdup(CONFIG_WAV_PLAYLIST);
+	for (char *path = strtok(list, ","); path && pb.count < MAX_TRACKS; path = strtok(NULL, ","))
+		pb.paths[pb.count++] = path;
+
+	if (!pb.count) {
+		ESP_LOGE(TAG, "empty playlist");
+		abort();
+	}
+
+	/* i2s slot config is taken from the first track */
+	if (playback_open(&pb, 0, &src, &info)) {
+		ESP_LOGE(TAG, "failed to find wav file format");
+		abort();
+	}
+
+	playback_close(&pb, 0);
+#endif
 
-	if (i2s_driver_init() != ESP_OK) {
+	if (i2s_driver_init(&info) != ESP_OK) {
 		ESP_LOGE(TAG, "i2s driver init failed");
 		abort();
 	} else {
 		ESP_LOGI(TAG, "i2s driver init success");
 	}
 
-	xTaskCreate(i2s_test, "i2s_test", STACK_SIZE, NULL, tskIDLE_PRIORITY, &xTest1Handle);
+	/* fade in from silence to the configured volume on the first block */
+	gain_init(&pb.gain, i2s_channels, 0);
+	gain_set(&pb.gain, gain_from_db10(CONFIG_WAV_VOLUME_DB10));
+	gain_set_dither(&pb.gain, DITHER_BITS, esp_random());
+
+#if defined(CONFIG_WAV_MIXER)
+	/* mixer task preempts the trigger task: block deadlines first */
+	xTaskCreate(mixer_test, "mixer_test", STACK_SIZE, &sfx, tskIDLE_PRIORITY + 2, &xTest1Handle);
+	xTaskCreate(trigger_test, "trigger_test", STACK_SIZE, &sfx, tskIDLE_PRIORITY + 1, NULL);
+#elif defined(CONFIG_WAV_MMAP)
+	xTaskCreate(mmap_test, "mmap_test", STACK_SIZE, &pb, tskIDLE_PRIORITY, &xTest1Handle);
+#else
+	xTaskCreate(i2s_test, "i2s_test", STACK_SIZE, &pb, tskIDLE_PRIORITY, &xTest1Handle);
+#endif
 	if (!xTest1Handle) {
 		ESP_LOGE(TAG, "Failed to create task i2s_test");
 	}
@@ -0,0 +1,146 @@
+/*
+ * Polyphonic mixer for sound effects: each voice plays a bank clip from
+ * flash with its own Q15 gain, voices are summed in a 32-bit accumulator
+ * and the mix is shifted down by a fixed headroom and saturated.
+ *
+ * Other tasks start and stop voices with a command word per voice, which
+ * the render task picks up at the start of each block. So a trigger takes
+ * effect at the first sample of the next block: latency is at most one
+ * block whatever the voice count, and a retrigger restarts the clip.
+ */
+
+#include <string.h>
+
+#include "common.h"
+
+#define MIXER_STOP	0xffff
+
+int mixer_init(struct mixer *m, const struct bank *bank, unsigned int voices, unsigned int headroom)
+{
+	if (!voices || voices > MIXER_MAX_VOICES || headroom > 15)
+		return -1;
+
+	memset(m, 0, sizeof(*m));
+	m->bank = bank;
+	m->voices = voices;
+	m->headroom = headroom;
+
+	for (unsigned int v = 0; v < voices; v++)
+		atomic_init(&m->voice[v].trigger, 0);
+
+	return 0;
+}
+
+/* any task: command replaces a pending one, if the render task has not seen it yet */
+int mixer_trigger(struct mixer *m, unsigned int voice, unsigned int clip, int32_t q15)
+{
+	if (voice >= m->voices || clip >= m->bank->count)
+		return -1;
+
+	q15 = (q15 < 0) ? 0 : (q15 > MIXER_GAIN_MAX) ? MIXER_GAIN_MAX : q15;
+	atomic_store_explicit(&m->voice[voice].trigger, (uint32_t)q15 << 16 | (clip + 1), memory_order_release);
+
+	return 0;
+}
+
+void mixer_stop(struct mixer *m, unsigned int voice)
+{
+	if (voice < m->voices)
+		atomic_store_explicit(&m->voice[voice].trigger, MIXER_STOP, memory_order_release);
+}
+
+static void mixer_commands(struct mixer *m)
+{
+	for (unsigned int v = 0; v < m->voices; v++) {
+		struct mixer_voice *voice = &m->voice[v];
+		uint32_t cmd;
+
+		/* plain load first: exchange is a bus-locked op on esp32 */
+		if (!atomic_load_explicit(&voice->trigger, memory_order_relaxed))
+			continue;
+
+		cmd = atomic_exchange_explicit(&voice->trigger, 0, memory_order_acquire);
+		if ((cmd & 0xffff) == MIXER_STOP) {
+			voice->data = NULL;
+			continue;
+		}
+
+		voice->data = bank_clip(m->bank, (cmd & 0xffff) - 1, &voice->frames);
+		voice->gain = cmd >> 16;
+		voice->pos = 0;
+
+		if (!voice->frames)
+			voice->data = NULL;
+	}
+}
+
+/* first voice stores, the rest add: no separate clearing pass for the accumulator */
+static void mixer_voice(struct mixer *m, struct mixer_voice *voice, size_t n, int first)
+{
+	size_t len = (voice->frames - voice->pos < n) ? voice->frames - voice->pos : n;
+	const int16_t *in = voice->data + voice->pos;
+	const int32_t g = voice->gain;
+	int32_t *acc = m->acc;
+
+	if (first) {
+		for (size_t i = 0; i < len; i++)
+			acc[i] = (in[i] * g) >> 15;
+		for (size_t i = len; i < n; i++)
+			acc[i] = 0;
+	} else {
+		for (size_t i = 0; i < len; i++)
+			acc[i] += (in[i] * g) >> 15;
+	}
+
+	voice->pos += len;
+	if (voice->pos == voice->frames)
+		voice->data = NULL;
+}
+
+static void mixer_output(struct mixer *m, int16_t *out, size_t n)
+{
+	const int32_t round = m->headroom ? 1 << (m->headroom - 1) : 0;
+	uint32_t clipped = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		int32_t v = (m->acc[i] + round) >> m->headroom;
+
+		clipped += (v > INT16_MAX) | (v < INT16_MIN);
+		out[i] = (v > INT16_MAX) ? INT16_MAX : (v < INT16_MIN) ? INT16_MIN : v;
+	}
+
+	m->clipped += clipped;
+}
+
+/* returns the number of voices which played in this block */
+unsigned int mixer_render(struct mixer *m, int16_t *out, size_t frames)
+{
+	unsigned int active = 0;
+	size_t n;
+
+	mixer_commands(m);
+
+	for (unsigned int v = 0; v < m->voices; v++)
+		active += !!m->voice[v].data;
+
+	for (; frames; frames -= n, out += n) {
+		int first = 1;
+
+		n = (frames < MIXER_BLOCK) ? frames : MIXER_BLOCK;
+
+		for (unsigned int v = 0; v < m->voices; v++) {
+			if (!m->voice[v].data)
+				continue;
+
+			mixer_voice(m, &m->voice[v], n, first);
+			first = 0;
+		}
+
+		if (first)
+			memset(out, 0, n * sizeof(*out));
+		else
+			mixer_output(m, out, n);
+	}
+
+	return active;
+}
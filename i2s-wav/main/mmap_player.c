@@ -0,0 +1,144 @@
+/*
+ * Playback from a memory-mapped flash partition: audio data is never read
+ * into RAM buffers, sink gets pointers straight into the mapped window.
+ *
+ * Flash MMU maps 64 KB pages, and a mapping of the whole partition would
+ * take a lot of the data address space, so the player maps a window of
+ * two pages and slides it one page at a time. Each step writes the blocks
+ * which start in the first page of the window: the last one may run into
+ * the second page, which is mapped too, so blocks never need to be copied
+ * to join two windows. The next window is mapped before the previous one
+ * is released.
+ */
+
+#include <string.h>
+
+#include "common.h"
+#include "port.h"
+
+#define MMAP_WINDOW (2 * MMAP_PAGE)
+
+static int mmap_window(struct flash_map *fm, size_t page, const uint8_t **ptr, uint32_t *handle,
+		       struct mmap_stats *stats)
+{
+	size_t offset = page * MMAP_PAGE;
+	size_t len = (fm->size - offset < MMAP_WINDOW) ? fm->size - offset : MMAP_WINDOW;
+
+	*ptr = fm->map(fm->ctx, offset, len, handle);
+	if (!*ptr)
+		return -1;
+
+	stats->maps++;
+
+	return 0;
+}
+
+/* WAV or QOA header, anything else is raw audio in the format of raw */
+int mmap_read_header(struct flash_map *fm, const struct wav_info *raw, struct wav_info *info)
+{
+	size_t len = (fm->size < MMAP_WINDOW) ? fm->size : MMAP_WINDOW;
+	struct wav_source src;
+	struct wav_mem mem;
+	const uint8_t *ptr;
+	uint32_t handle;
+	int ret = 0;
+
+	if (!fm->size)
+		return -1;
+
+	ptr = fm->map(fm->ctx, 0, len, &handle);
+	if (!ptr)
+		return -1;
+
+	wav_source_mem(&src, &mem, ptr, len);
+
+	if (len >= 4 && !memcmp(ptr, "RIFF", 4)) {
+		ret = wav_read_header(&src, info);
+	} else if (len >= 4 && !memcmp(ptr, "qoaf", 4)) {
+		ret = qoa_read_header(&src, info);
+	} else {
+		*info = *raw;
+		info->data_offset = 0;
+		info->data_size = fm->size - fm->size % raw->block_align;
+	}
+
+	fm->unmap(fm->ctx, handle);
+
+	/* 16-bit block_align always fits in a page: a block spans two pages at most */
+	if (ret || !info->block_align || info->data_offset > fm->size)
+		return -1;
+
+	/* header may claim more than the partition has */
+	if (info->data_size > fm->size - info->data_offset)
+		info->data_size = fm->size - info->data_offset;
+
+	return 0;
+}
+
+int mmap_play(struct flash_map *fm, const struct wav_info *info, struct wav_sink *sink, size_t chunk,
+	      struct mmap_stats *stats)
+{
+	const size_t align = info->block_align;
+	const size_t end = info->data_offset + info->data_size;
+	size_t pos = info->data_offset;
+	size_t page = pos / MMAP_PAGE;
+	int64_t start = port_time_us();
+	const uint8_t *ptr, *next;
+	uint32_t handle, next_handle;
+	size_t stop, n;
+	int ret = 0;
+
+	memset(stats, 0, sizeof(*stats));
+
+	/* decoders take whole blocks */
+	chunk -= chunk % align;
+	if (!chunk)
+		return -1;
+
+	if (pos == end)
+		return 0;
+
+	if (mmap_window(fm, page, &ptr, &handle, stats))
+		return -1;
+
+	while (pos < end) {
+		/* every block which starts in the first page of the window */
+		stop = (page + 1) * MMAP_PAGE;
+		stop = pos + (stop - pos + align - 1) / align * align;
+		if (stop > end)
+			stop = end;
+
+		while (pos < stop) {
+			n = (stop - pos < chunk) ? stop - pos : chunk;
+
+			if (sink->write(sink->ctx, ptr + pos - page * MMAP_PAGE, n)) {
+				ret = -1;
+				goto out;
+			}
+
+			stats->writes++;
+			stats->bytes += n;
+			pos += n;
+		}
+
+		if (pos == end)
+			break;
+
+		/* slide: map the next window first, then release the current one */
+		if (mmap_window(fm, pos / MMAP_PAGE, &next, &next_handle, stats)) {
+			ret = -1;
+			goto out;
+		}
+
+		fm->unmap(fm->ctx, handle);
+		page = pos / MMAP_PAGE;
+		ptr = next;
+		handle = next_handle;
+	}
+
+out:
+	fm->unmap(fm->ctx, handle);
+	stats->total_us = port_time_us() - start;
+
+	return ret;
+}
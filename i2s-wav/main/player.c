@@ -0,0 +1,130 @@
+/*
+ * Streaming player: audio data is read from the source in fixed-size chunks
+ * by reader task while the previous chunk is written to the sink, so memory
+ * use is two chunks whatever the clip length, and playback starts as soon
+ * as the first chunk is read.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "port.h"
+
+#define READER_PRIORITY 2
+
+struct player {
+	struct wav_source *src;
+	uint32_t remaining;
+	size_t chunk;
+
+	uint8_t *buf[2];
+	size_t len[2];
+
+	port_sem_t empty;
+	port_sem_t full;
+	port_sem_t done;
+	volatile int stop;
+};
+
+static void player_reader(void *args)
+{
+	struct player *p = args;
+	size_t n;
+
+	for (int i = 0;; i ^= 1) {
+		port_sem_wait(&p->empty);
+
+		n = (p->remaining < p->chunk) ? p->remaining : p->chunk;
+		if (n && !p->stop)
+			n = p->src->read(p->src->ctx, p->buf[i], n);
+		else
+			n = 0;
+
+		p->remaining -= n;
+		p->len[i] = n;
+		port_sem_post(&p->full);
+
+		/* zero length chunk: end of data, read error or stop request */
+		if (!n)
+			break;
+	}
+
+	port_sem_post(&p->done);
+	port_thread_exit();
+}
+
+int player_play(struct wav_source *src, uint32_t size, struct wav_sink *sink, size_t chunk,
+		struct player_stats *stats)
+{
+	struct player p = {
+		.src = src,
+		.remaining = size,
+		.chunk = chunk,
+	};
+	int64_t start = port_time_us();
+	int ret = -1;
+
+	memset(stats, 0, sizeof(*stats));
+
+	p.buf[0] = malloc(2 * chunk);
+	if (!p.buf[0])
+		return -1;
+
+	p.buf[1] = p.buf[0] + chunk;
+
+	if (port_sem_init(&p.empty, 2))
+		goto err_empty;
+
+	if (port_sem_init(&p.full, 0))
+		goto err_full;
+
+	if (port_sem_init(&p.done, 0))
+		goto err_done;
+
+	if (port_thread_create(player_reader, &p, "wav_reader", READER_PRIORITY))
+		goto err_thread;
+
+	ret = 0;
+
+	for (int i = 0;; i ^= 1) {
+		port_sem_wait(&p.full);
+
+		if (!p.len[i])
+			break;
+
+		if (!p.stop) {
+			if (!stats->chunks)
+				stats->first_chunk_us = port_time_us() - start;
+
+			if (sink->write(sink->ctx, p.buf[i], p.len[i])) {
+				p.stop = 1;
+				ret = -1;
+			} else {
+				stats->chunks++;
+				stats->bytes += p.len[i];
+			}
+		}
+
+		port_sem_post(&p.empty);
+	}
+
+	port_sem_wait(&p.done);
+
+	/* short read: clip is truncated or source failed */
+	if (stats->bytes != size)
+		ret = -1;
+
+	stats->total_us = port_time_us() - start;
+
+err_thread:
+	port_sem_destroy(&p.done);
+err_done:
+	port_sem_destroy(&p.full);
+err_full:
+	port_sem_destroy(&p.empty);
+err_empty:
+	free(p.buf[0]);
+
+	return ret;
+}
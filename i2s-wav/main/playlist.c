@@ -0,0 +1,245 @@
+/*
+ * Gapless playlist: one reader task streams all the tracks through the same
+ * pair of buffers. As soon as the last chunk of a track is read, the next
+ * track is opened and its header parsed, so that its first chunk is ready
+ * while the previous one still drains to the sink. Writer switches decoder
+ * chain on the first chunk of each track and measures the gap between the
+ * last write of the previous track and the first write of the next one.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "port.h"
+
+#define READER_PRIORITY 2
+
+struct slot {
+	size_t len;		/* 0 - end of the list */
+	int status;		/* with len 0: 0 - end of the list, -1 - error */
+	unsigned int track;
+	int first;
+	int last;
+	struct wav_info info;	/* valid in the first chunk of a track */
+};
+
+struct playlist {
+	const struct playlist_ops *ops;
+	size_t chunk;
+
+	uint8_t *buf[2];
+	struct slot slot[2];
+
+	port_sem_t empty;
+	port_sem_t full;
+	port_sem_t done;
+	volatile int stop;
+};
+
+/* open tracks until one with audio data: 0 ok, 1 end of the list, -1 error */
+static int playlist_open(struct playlist *p, unsigned int *track, struct wav_source *src,
+			 struct wav_info *info)
+{
+	unsigned int skipped = 0;
+	int ret;
+
+	while (1) {
+		ret = p->ops->open(p->ops->ctx, *track, src, info);
+		if (ret)
+			return ret;
+
+		if (info->data_size)
+			return 0;
+
+		p->ops->close(p->ops->ctx, *track);
+		(*track)++;
+
+		/* whole pass of a repeating list without audio data */
+		if (p->ops->count && ++skipped >= p->ops->count)
+			return 1;
+	}
+}
+
+static void playlist_reader(void *args)
+{
+	struct playlist *p = args;
+	unsigned int track = 0;
+	struct wav_source src;
+	struct wav_info info;
+	uint32_t remaining;
+	size_t chunk = 0;
+	int status;
+	size_t n;
+
+	status = playlist_open(p, &track, &src, &info);
+	remaining = info.data_size;
+
+	for (int i = 0;; i ^= 1) {
+		struct slot *s = &p->slot[i];
+
+		port_sem_wait(&p->empty);
+
+		memset(s, 0, sizeof(*s));
+
+		if (status || p->stop) {
+			if (!status)
+				p->ops->close(p->ops->ctx, track);
+
+			s->status = (status < 0) ? -1 : 0;
+			port_sem_post(&p->full);
+			break;
+		}
+
+		/* decoders take whole blocks */
+		if (remaining == info.data_size) {
+			chunk = p->chunk - p->chunk % info.block_align;
+
+			/* block does not fit the buffer: len 0 would end the list quietly */
+			if (!chunk) {
+				p->ops->close(p->ops->ctx, track);
+				status = -1;
+				s->status = -1;
+				port_sem_post(&p->full);
+				break;
+			}
+
+			s->first = 1;
+			s->info = info;
+		}
+
+		n = (remaining < chunk) ? remaining : chunk;
+		s->len = src.read(src.ctx, p->buf[i], n);
+		s->track = track;
+		remaining -= s->len;
+
+		/* short read: source failed or file is truncated */
+		if (s->len != n) {
+			p->ops->close(p->ops->ctx, track);
+			status = -1;
+			s->len = 0;
+			s->status = -1;
+			port_sem_post(&p->full);
+			break;
+		}
+
+		s->last = !remaining;
+		port_sem_post(&p->full);
+
+		/* prefetch: next header is parsed while this chunk drains */
+		if (!remaining) {
+			p->ops->close(p->ops->ctx, track++);
+			status = playlist_open(p, &track, &src, &info);
+			remaining = info.data_size;
+		}
+	}
+
+	port_sem_post(&p->done);
+	port_thread_exit();
+}
+
+int playlist_play(const struct playlist_ops *ops, size_t chunk, struct playlist_stats *stats)
+{
+	struct playlist p = {
+		.ops = ops,
+		.chunk = chunk,
+	};
+	struct playlist_track cur = { 0 };
+	int64_t start = port_time_us();
+	int64_t track_start = 0;
+	int64_t last_end = 0;
+	struct wav_sink sink;
+	int ret = -1;
+	int64_t now;
+
+	memset(stats, 0, sizeof(*stats));
+
+	p.buf[0] = malloc(2 * chunk);
+	if (!p.buf[0])
+		return -1;
+
+	p.buf[1] = p.buf[0] + chunk;
+
+	if (port_sem_init(&p.empty, 2))
+		goto err_empty;
+
+	if (port_sem_init(&p.full, 0))
+		goto err_full;
+
+	if (port_sem_init(&p.done, 0))
+		goto err_done;
+
+	if (port_thread_create(playlist_reader, &p, "wav_reader", READER_PRIORITY))
+		goto err_thread;
+
+	ret = 0;
+
+	for (int i = 0;; i ^= 1) {
+		struct slot *s = &p.slot[i];
+
+		port_sem_wait(&p.full);
+
+		if (!s->len) {
+			if (s->status)
+				ret = -1;
+			break;
+		}
+
+		if (!p.stop && s->first) {
+			if (ops->start(ops->ctx, s->track, &s->info, &sink)) {
+				p.stop = 1;
+				ret = -1;
+			}
+
+			/* gap includes waiting for the chunk and switching decoder chain */
+			now = port_time_us();
+
+			memset(&cur, 0, sizeof(cur));
+			cur.info = s->info;
+			cur.gap_us = stats->tracks ? now - last_end : 0;
+			track_start = now;
+
+			if (!stats->tracks)
+				stats->first_chunk_us = now - start;
+		}
+
+		if (!p.stop) {
+			if (sink.write(sink.ctx, p.buf[i], s->len)) {
+				p.stop = 1;
+				ret = -1;
+			} else {
+				last_end = port_time_us();
+				cur.chunks++;
+				cur.bytes += s->len;
+				stats->bytes += s->len;
+			}
+		}
+
+		if (!p.stop && s->last) {
+			cur.total_us = last_end - track_start;
+			if (cur.gap_us > stats->max_gap_us)
+				stats->max_gap_us = cur.gap_us;
+			stats->tracks++;
+
+			if (ops->played)
+				ops->played(ops->ctx, s->track, &cur);
+		}
+
+		port_sem_post(&p.empty);
+	}
+
+	port_sem_wait(&p.done);
+
+	stats->total_us = port_time_us() - start;
+
+err_thread:
+	port_sem_destroy(&p.done);
+err_done:
+	port_sem_destroy(&p.full);
+err_full:
+	port_sem_destroy(&p.empty);
+err_empty:
+	free(p.buf[0]);
+
+	return ret;
+}
@@ -0,0 +1,136 @@
+/*
+ * Minimal threading shim, so that player code builds both for ESP32 and
+ * for the Linux host tests:
+ * - ESP32: FreeRTOS tasks and counting semaphores
+ * - Linux host: pthreads and POSIX semaphores
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef ESP_PLATFORM
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_timer.h"
+
+#define PORT_STACK_SIZE 3584
+
+typedef SemaphoreHandle_t port_sem_t;
+
+static inline int port_sem_init(port_sem_t *sem, unsigned int count)
+{
+	*sem = xSemaphoreCreateCounting(16, count);
+	return *sem ? 0 : -1;
+}
+
+static inline void port_sem_post(port_sem_t *sem)
+{
+	xSemaphoreGive(*sem);
+}
+
+static inline void port_sem_wait(port_sem_t *sem)
+{
+	xSemaphoreTake(*sem, portMAX_DELAY);
+}
+
+static inline void port_sem_destroy(port_sem_t *sem)
+{
+	vSemaphoreDelete(*sem);
+}
+
+/* thread function must not return: it signals completion and calls port_thread_exit() */
+static inline int port_thread_create(void (*fn)(void *), void *arg, const char *name, int prio)
+{
+	return (xTaskCreate(fn, name, PORT_STACK_SIZE, arg, tskIDLE_PRIORITY + prio, NULL) == pdPASS) ? 0 : -1;
+}
+
+static inline void port_thread_exit(void)
+{
+	vTaskDelete(NULL);
+}
+
+static inline int64_t port_time_us(void)
+{
+	return esp_timer_get_time();
+}
+
+#else
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdlib.h>
+#include <time.h>
+
+typedef sem_t port_sem_t;
+
+static inline int port_sem_init(port_sem_t *sem, unsigned int count)
+{
+	return sem_init(sem, 0, count);
+}
+
+static inline void port_sem_post(port_sem_t *sem)
+{
+	sem_post(sem);
+}
+
+static inline void port_sem_wait(port_sem_t *sem)
+{
+	sem_wait(sem);
+}
+
+static inline void port_sem_destroy(port_sem_t *sem)
+{
+	sem_destroy(sem);
+}
+
+struct port_thread {
+	void (*fn)(void *);
+	void *arg;
+};
+
+static inline void *port_thread_run(void *args)
+{
+	struct port_thread t = *(struct port_thread *)args;
+
+	free(args);
+	t.fn(t.arg);
+
+	return NULL;
+}
+
+static inline int port_thread_create(void (*fn)(void *), void *arg, const char *name, int prio)
+{
+	struct port_thread *t = malloc(sizeof(*t));
+	pthread_t thread;
+
+	if (!t)
+		return -1;
+
+	t->fn = fn;
+	t->arg = arg;
+
+	if (pthread_create(&thread, NULL, port_thread_run, t)) {
+		free(t);
+		return -1;
+	}
+
+	return pthread_detach(thread);
+}
+
+static inline void port_thread_exit(void)
+{
+	pthread_exit(NULL);
+}
+
+static inline int64_t port_time_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+#endif
@@ -0,0 +1,317 @@
+/*
+ * QOA (Quite OK Audio) streaming decoder, see https://qoaformat.org
+ *
+ * File is an 8 byte header ("qoaf", samples per channel) followed by frames
+ * of up to 5120 samples per channel. Each frame is an 8 byte header, LMS
+ * state for each channel and 64-bit slices of 20 samples, interleaved by
+ * channel: 4 bit scale factor and 20 3-bit quantized residuals.
+ *
+ * The sink collects one frame at a time, at most 8 + 2064 bytes per channel,
+ * and decodes it into small PCM batches for the next sink, so neither the
+ * file nor a whole decoded frame is ever kept in memory.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+#define QOA_MAGIC		0x716f6166 /* 'qoaf' */
+#define QOA_FILE_HDR_SIZE	8
+#define QOA_FRAME_HDR_SIZE	8
+#define QOA_LMS_SIZE		16
+#define QOA_SLICE_SIZE		8
+
+static const int16_t qoa_dequant_tab[16][8] = {
+	{   1,    -1,    3,    -3,    5,    -5,     7,     -7},
+	{   5,    -5,   18,   -18,   32,   -32,    49,    -49},
+	{  16,   -16,   53,   -53,   95,   -95,   147,   -147},
+	{  34,   -34,  113,  -113,  203,  -203,   315,   -315},
+	{  63,   -63,  210,  -210,  378,  -378,   588,   -588},
+	{ 104,  -104,  345,  -345,  621,  -621,   966,   -966},
+	{ 158,  -158,  528,  -528,  950,  -950,  1477,  -1477},
+	{ 228,  -228,  760,  -760, 1368, -1368,  2128,  -2128},
+	{ 316,  -316, 1053, -1053, 1895, -1895,  2947,  -2947},
+	{ 422,  -422, 1405, -1405, 2529, -2529,  3934,  -3934},
+	{ 548,  -548, 1828, -1828, 3290, -3290,  5117,  -5117},
+	{ 696,  -696, 2320, -2320, 4176, -4176,  6496,  -6496},
+	{ 868,  -868, 2893, -2893, 5207, -5207,  8099,  -8099},
+	{1064, -1064, 3548, -3548, 6386, -6386,  9933,  -9933},
+	{1286, -1286, 4288, -4288, 7718, -7718, 12005, -12005},
+	{1536, -1536, 5120, -5120, 9216, -9216, 14336, -14336},
+};
+
+static inline uint32_t be16(const uint8_t *p)
+{
+	return p[0] << 8 | p[1];
+}
+
+static inline uint32_t be24(const uint8_t *p)
+{
+	return p[0] << 16 | p[1] << 8 | p[2];
+}
+
+static inline uint32_t be32(const uint8_t *p)
+{
+	return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+static inline uint64_t be64(const uint8_t *p)
+{
+	return (uint64_t)be32(p) << 32 | be32(p + 4);
+}
+
+static inline int16_t qoa_clamp_s16(int32_t v)
+{
+	if ((uint32_t)(v + 32768) > 65535)
+		return (v < -32768) ? -32768 : 32767;
+
+	return v;
+}
+
+size_t qoa_frame_size(unsigned int channels, unsigned int samples)
+{
+	unsigned int slices = (samples + QOA_SLICE_LEN - 1) / QOA_SLICE_LEN;
+
+	return QOA_FRAME_HDR_SIZE + QOA_LMS_SIZE * channels + QOA_SLICE_SIZE * slices * channels;
+}
+
+/* frame sizes are fixed by layout: all frames are full except the last one */
+static size_t qoa_data_size(unsigned int channels, uint32_t samples)
+{
+	uint32_t frames = samples / QOA_FRAME_LEN;
+	uint32_t last = samples % QOA_FRAME_LEN;
+
+	return frames * qoa_frame_size(channels, QOA_FRAME_LEN) + (last ? qoa_frame_size(channels, last) : 0);
+}
+
+/*
+ * Reads file header and the header of the first frame, which has stream
+ * parameters. Source is left after the first frame header: data_size is
+ * the rest of the stream, qoa sink knows the first header from info.
+ */
+int qoa_read_header(struct wav_source *src, struct wav_info *info)
+{
+	uint8_t hdr[QOA_FILE_HDR_SIZE + QOA_FRAME_HDR_SIZE];
+	const uint8_t *fh = hdr + QOA_FILE_HDR_SIZE;
+	uint32_t samples;
+	size_t size;
+
+	memset(info, 0, sizeof(*info));
+
+	if (src->read(src->ctx, hdr, sizeof(hdr)) != sizeof(hdr))
+		return -1;
+
+	/* streaming files with unknown length have zero samples: not supported */
+	samples = be32(hdr + 4);
+	if (be32(hdr) != QOA_MAGIC || !samples)
+		return -1;
+
+	info->channels = fh[0];
+	info->sample_rate = be24(fh + 1);
+
+	if (!info->channels || info->channels > QOA_MAX_CHANNELS || !info->sample_rate)
+		return -1;
+
+	if (be16(fh + 4) != ((samples < QOA_FRAME_LEN) ? samples : QOA_FRAME_LEN) ||
+	    be16(fh + 6) != qoa_frame_size(info->channels, be16(fh + 4)))
+		return -1;
+
+	/* fits in 32 bits for up to 2 channels */
+	size = qoa_data_size(info->channels, samples);
+
+	info->format = WAV_FORMAT_QOA;
+	info->bits_per_sample = 16;
+	info->block_align = 1;
+	info->samples_per_block = QOA_FRAME_LEN;
+	info->fact_frames = samples;
+	info->data_offset = sizeof(hdr);
+	info->data_size = size - QOA_FRAME_HDR_SIZE;
+	info->frames = samples;
+	info->byte_rate = (uint64_t)size * info->sample_rate / samples;
+
+	return 0;
+}
+
+static int qoa_flush(struct qoa_sink *s, unsigned int frames)
+{
+	if (!frames)
+		return 0;
+
+	return s->next->write(s->next->ctx, s->pcm, frames * s->channels * sizeof(int16_t));
+}
+
+/* decode collected frame: slices are decoded into PCM batches */
+static int qoa_decode_frame(struct qoa_sink *s)
+{
+	const unsigned int ch = s->channels;
+	const uint8_t *p = s->frame + QOA_FRAME_HDR_SIZE;
+	unsigned int samples = be16(s->frame + 4);
+	unsigned int batch = 0;
+
+	for (unsigned int c = 0; c < ch; c++) {
+		uint64_t history = be64(p);
+		uint64_t weights = be64(p + 8);
+
+		for (int i = 0; i < 4; i++) {
+			s->lms[c].history[i] = (int16_t)(history >> 48);
+			s->lms[c].weights[i] = (int16_t)(weights >> 48);
+			history <<= 16;
+			weights <<= 16;
+		}
+
+		p += QOA_LMS_SIZE;
+	}
+
+	for (unsigned int si = 0; si < samples; si += QOA_SLICE_LEN) {
+		unsigned int len = (samples - si < QOA_SLICE_LEN) ? samples - si : QOA_SLICE_LEN;
+
+		for (unsigned int c = 0; c < ch; c++) {
+			struct qoa_lms *lms = &s->lms[c];
+			uint64_t slice = be64(p);
+			const int16_t *dequant = qoa_dequant_tab[slice >> 60];
+			int16_t *out = s->pcm + batch * ch + c;
+			int32_t h0 = lms->history[0], h1 = lms->history[1];
+			int32_t h2 = lms->history[2], h3 = lms->history[3];
+			int32_t w0 = lms->weights[0], w1 = lms->weights[1];
+			int32_t w2 = lms->weights[2], w3 = lms->weights[3];
+
+			p += QOA_SLICE_SIZE;
+			slice <<= 4;
+
+			for (unsigned int i = 0; i < len; i++) {
+				int32_t predicted = (w0 * h0 + w1 * h1 + w2 * h2 + w3 * h3) >> 13;
+				int32_t dq = dequant[slice >> 61];
+				int32_t r = qoa_clamp_s16(predicted + dq);
+				int32_t delta = dq >> 4;
+
+				slice <<= 3;
+
+				w0 += (h0 < 0) ? -delta : delta;
+				w1 += (h1 < 0) ? -delta : delta;
+				w2 += (h2 < 0) ? -delta : delta;
+				w3 += (h3 < 0) ? -delta : delta;
+
+				h0 = h1;
+				h1 = h2;
+				h2 = h3;
+				h3 = r;
+
+				*out = r;
+				out += ch;
+			}
+
+			lms->history[0] = h0;
+			lms->history[1] = h1;
+			lms->history[2] = h2;
+			lms->history[3] = h3;
+			lms->weights[0] = w0;
+			lms->weights[1] = w1;
+			lms->weights[2] = w2;
+			lms->weights[3] = w3;
+		}
+
+		batch += len;
+
+		if (batch == QOA_BATCH_SLICES * QOA_SLICE_LEN) {
+			if (qoa_flush(s, batch))
+				return -1;
+			batch = 0;
+		}
+	}
+
+	return qoa_flush(s, batch);
+}
+
+/* frame header: stream parameters must not change, size must match layout */
+static int qoa_frame_header(struct qoa_sink *s)
+{
+	unsigned int samples = be16(s->frame + 4);
+
+	if (s->frame[0] != s->channels || be24(s->frame + 1) != s->sample_rate ||
+	    !samples || samples > QOA_FRAME_LEN)
+		return -1;
+
+	s->frame_size = be16(s->frame + 6);
+	if (s->frame_size != qoa_frame_size(s->channels, samples))
+		return -1;
+
+	return 0;
+}
+
+static int qoa_sink_write(void *ctx, const void *buf, size_t len)
+{
+	struct qoa_sink *s = ctx;
+	const uint8_t *in = buf;
+	size_t n;
+
+	while (len) {
+		/* frame header first, then the rest of the frame */
+		size_t need = (s->have < QOA_FRAME_HDR_SIZE) ? QOA_FRAME_HDR_SIZE : s->frame_size;
+
+		n = need - s->have;
+		if (n > len)
+			n = len;
+
+		memcpy(s->frame + s->have, in, n);
+		s->have += n;
+		in += n;
+		len -= n;
+
+		if (s->have == QOA_FRAME_HDR_SIZE && need == QOA_FRAME_HDR_SIZE) {
+			if (qoa_frame_header(s))
+				return -1;
+		} else if (s->have == s->frame_size) {
+			if (qoa_decode_frame(s))
+				return -1;
+			s->have = 0;
+		}
+	}
+
+	return 0;
+}
+
+int qoa_sink_init(struct qoa_sink *s, const struct wav_info *info, struct wav_sink *next, struct wav_sink *sink)
+{
+	unsigned int samples = (info->frames < QOA_FRAME_LEN) ? info->frames : QOA_FRAME_LEN;
+
+	if (info->format != WAV_FORMAT_QOA)
+		return -1;
+
+	memset(s, 0, sizeof(*s));
+	s->channels = info->channels;
+	s->sample_rate = info->sample_rate;
+	s->next = next;
+
+	s->frame = malloc(qoa_frame_size(s->channels, QOA_FRAME_LEN));
+	s->pcm = malloc(QOA_BATCH_SLICES * QOA_SLICE_LEN * s->channels * sizeof(*s->pcm));
+	if (!s->frame || !s->pcm) {
+		qoa_sink_deinit(s);
+		return -1;
+	}
+
+	/* header of the first frame was consumed by qoa_read_header: restore it */
+	s->frame[0] = s->channels;
+	s->frame[1] = s->sample_rate >> 16;
+	s->frame[2] = s->sample_rate >> 8;
+	s->frame[3] = s->sample_rate;
+	s->frame[4] = samples >> 8;
+	s->frame[5] = samples;
+	s->frame_size = qoa_frame_size(s->channels, samples);
+	s->frame[6] = s->frame_size >> 8;
+	s->frame[7] = s->frame_size;
+	s->have = QOA_FRAME_HDR_SIZE;
+
+	sink->ctx = s;
+	sink->write = qoa_sink_write;
+
+	return 0;
+}
+
+void qoa_sink_deinit(struct qoa_sink *s)
+{
+	free(s->frame);
+	free(s->pcm);
+	s->frame = NULL;
+	s->pcm = NULL;
+}
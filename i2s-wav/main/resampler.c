@@ -0,0 +1,475 @@
+/*
+ * Fixed-point polyphase resampler: in_rate * up = out_rate * down
+ *
+ * Prototype low-pass is a Kaiser windowed sinc at in_rate * up, designed
+ * once at init and split into 'up' phases of 'taps' Q15 coefficients each.
+ * Phase coefficients are stored reversed, so every output sample is a dot
+ * product of two contiguous arrays: the phase and the last 'taps' input
+ * frames. Only the phases which are actually hit are evaluated, e.g. for
+ * 44.1k -> 16k (up 160, down 441) there is one dot product per output.
+ *
+ * Accumulator is 32-bit: coefficients are Q15 unless the worst case phase
+ * gain (sum of its absolute coefficients) can overflow it with full scale
+ * input, then fraction bits are reduced until it can not.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "gain.h"
+
+/* Kaiser estimates are a few dB short when stopband must start exactly at nyquist */
+#define DESIGN_MARGIN_DB 6.0
+
+struct quality {
+	double atten;	/* target stopband attenuation, dB */
+	double pass;	/* passband edge, fraction of output nyquist */
+};
+
+static const struct quality qualities[] = {
+	[RESAMPLER_LOW]    = { .atten = 50.0, .pass = 0.70 },
+	[RESAMPLER_MEDIUM] = { .atten = 70.0, .pass = 0.80 },
+	[RESAMPLER_HIGH]   = { .atten = 75.0, .pass = 0.90 },
+};
+
+static uint32_t gcd(uint32_t a, uint32_t b)
+{
+	while (b) {
+		uint32_t t = a % b;
+
+		a = b;
+		b = t;
+	}
+
+	return a;
+}
+
+static double bessel_i0(double x)
+{
+	double sum = 1.0, term = 1.0;
+
+	for (int k = 1; k < 50; k++) {
+		term *= (x / (2.0 * k)) * (x / (2.0 * k));
+		sum += term;
+		if (term < sum * 1e-12)
+			break;
+	}
+
+	return sum;
+}
+
+static double kaiser_beta(double atten)
+{
+	if (atten > 50.0)
+		return 0.1102 * (atten - 8.7);
+
+	return 0.5842 * pow(atten - 21.0, 0.4) + 0.07886 * (atten - 21.0);
+}
+
+/* Kaiser estimate: number of input frames per output for given transition width */
+static unsigned int kaiser_taps(double atten, double width, uint32_t in_rate)
+{
+	return (unsigned int)ceil((atten - 7.95) / (14.36 * width / in_rate));
+}
+
+/* phase p of the prototype normalized to unity dc gain, returns sum of absolute values */
+static double resampler_phase(const struct resampler *rs, unsigned int p, double beta, double fc, double *h)
+{
+	unsigned int n = rs->taps * rs->up;
+	double i0_beta = bessel_i0(beta);
+	double dc = 0.0, abs_sum = 0.0;
+
+	for (unsigned int k = 0; k < rs->taps; k++) {
+		double t = (double)(k * rs->up + p) - (n - 1) / 2.0;
+		double r = 2.0 * t / (n - 1);
+		double w = bessel_i0(beta * sqrt(fmax(0.0, 1.0 - r * r))) / i0_beta;
+		double s = (fabs(t) < 1e-9) ? 2.0 * fc : sin(2.0 * M_PI * fc * t) / (M_PI * t);
+
+		h[k] = s * w;
+		dc += h[k];
+	}
+
+	for (unsigned int k = 0; k < rs->taps; k++) {
+		h[k] /= dc;
+		abs_sum += fabs(h[k]);
+	}
+
+	return abs_sum;
+}
+
+/* sum of absolute coefficients times full scale input, plus rounding in q_sat(): fits int32 */
+static int acc_fits(double abs_sum, unsigned int shift, unsigned int headroom)
+{
+	return abs_sum * (32768 >> headroom) + (1 << (shift - headroom - 1)) <= INT32_MAX;
+}
+
+static int resampler_design(struct resampler *rs, enum resampler_quality quality)
+{
+	const struct quality *q = &qualities[quality];
+	uint32_t min_rate = (rs->in_rate < rs->out_rate) ? rs->in_rate : rs->out_rate;
+	double atten = q->atten + DESIGN_MARGIN_DB;
+	double beta = kaiser_beta(atten);
+	double stop = min_rate / 2.0;
+	double width, fc, gain = 0.0, peak = 0.0;
+	int32_t one;
+	double *h;
+
+	/* transition band which fits into the given tap count, but keep some passband */
+	width = (atten - 7.95) * rs->in_rate / (14.36 * rs->taps);
+	if (width > stop * 0.5)
+		width = stop * 0.5;
+
+	rs->stop_hz = stop;
+	rs->pass_hz = stop - width;
+
+	/* cutoff in the middle of transition band, normalized to in_rate * up */
+	fc = (stop - width / 2) / ((double)rs->in_rate * rs->up);
+
+	h = malloc(rs->taps * sizeof(*h));
+	if (!h)
+		return -1;
+
+	/*
+	 * Largest coefficient defines fraction bits, worst case gain of any phase
+	 * (sum of absolute values) defines input headroom: it is shifted right on
+	 * the way into history buffer, so that the accumulator can not overflow.
+	 */
+	for (unsigned int p = 0; p < rs->up; p++) {
+		double g = resampler_phase(rs, p, beta, fc, h);
+
+		if (g > gain)
+			gain = g;
+
+		for (unsigned int k = 0; k < rs->taps; k++)
+			if (fabs(h[k]) > peak)
+				peak = fabs(h[k]);
+	}
+
+	for (rs->shift = RESAMPLER_MAX_SHIFT; rs->shift > 15; rs->shift--)
+		if (peak * (1 << rs->shift) < INT16_MAX)
+			break;
+
+	/* no headroom up to 4 bits is enough: fewer fraction bits */
+	for (;;) {
+		for (rs->headroom = 0; rs->headroom < 4; rs->headroom++)
+			if (acc_fits(gain * (1 << rs->shift), rs->shift, rs->headroom))
+				break;
+
+		if (acc_fits(gain * (1 << rs->shift), rs->shift, rs->headroom))
+			break;
+
+		if (rs->shift <= rs->headroom + 1) {
+			free(h);
+			return -1;
+		}
+
+		rs->shift--;
+	}
+
+	one = 1 << rs->shift;
+
+	for (unsigned int p = 0; p < rs->up; p++) {
+		int16_t *c = rs->coefs + p * rs->taps;
+		unsigned int peak = 0;
+		long peak_v = 0;
+		int32_t sum = 0;
+		int64_t abs_sum = 0;
+
+		resampler_phase(rs, p, beta, fc, h);
+
+		/* each phase has exact unity dc gain after rounding: no dc ripple between phases */
+		for (unsigned int k = 0; k < rs->taps; k++) {
+			long v = lround(h[k] * one);
+
+			if (v > INT16_MAX || v < INT16_MIN) {
+				free(h);
+				return -1;
+			}
+
+			c[rs->taps - 1 - k] = v;
+			sum += v;
+
+			if (labs(v) > peak_v) {
+				peak_v = labs(v);
+				peak = rs->taps - 1 - k;
+			}
+		}
+
+		c[peak] += one - sum;
+
+		/* rounded coefficients can add up to a bit more than the estimate */
+		for (unsigned int k = 0; k < rs->taps; k++)
+			abs_sum += abs(c[k]);
+
+		if (!acc_fits(abs_sum, rs->shift, rs->headroom)) {
+			free(h);
+			return -1;
+		}
+	}
+
+	free(h);
+	return 0;
+}
+
+int resampler_init(struct resampler *rs, uint32_t in_rate, uint32_t out_rate, unsigned int channels,
+		   enum resampler_quality quality, unsigned int taps)
+{
+	const struct quality *q;
+	uint32_t g;
+
+	memset(rs, 0, sizeof(*rs));
+
+	if (!in_rate || !out_rate || !channels || quality > RESAMPLER_HIGH)
+		return -1;
+
+	q = &qualities[quality];
+	g = gcd(in_rate, out_rate);
+
+	rs->in_rate = in_rate;
+	rs->out_rate = out_rate;
+	rs->up = out_rate / g;
+	rs->down = in_rate / g;
+	rs->channels = channels;
+
+	/* same rate: plain copy */
+	if (rs->up == 1 && rs->down == 1) {
+		rs->pass_hz = rs->stop_hz = in_rate / 2;
+		return 0;
+	}
+
+	/* default tap count: Kaiser estimate for the quality preset */
+	if (!taps) {
+		uint32_t min_rate = (in_rate < out_rate) ? in_rate : out_rate;
+
+		taps = kaiser_taps(q->atten + DESIGN_MARGIN_DB, (1.0 - q->pass) * min_rate / 2.0, in_rate);
+	}
+
+	if (taps < 2 || taps > RESAMPLER_MAX_TAPS)
+		return -1;
+
+	rs->taps = taps;
+
+	rs->coefs = malloc(rs->up * rs->taps * sizeof(*rs->coefs));
+	rs->buf = calloc((rs->taps - 1 + RESAMPLER_BLOCK) * channels, sizeof(*rs->buf));
+	if (!rs->coefs || !rs->buf)
+		goto err;
+
+	if (resampler_design(rs, quality))
+		goto err;
+
+	resampler_reset(rs);
+
+	return 0;
+
+err:
+	resampler_deinit(rs);
+	return -1;
+}
+
+void resampler_deinit(struct resampler *rs)
+{
+	free(rs->coefs);
+	free(rs->buf);
+	rs->coefs = NULL;
+	rs->buf = NULL;
+}
+
+void resampler_reset(struct resampler *rs)
+{
+	rs->phase = 0;
+	rs->pos = rs->taps ? rs->taps - 1 : 0;
+
+	if (rs->buf)
+		memset(rs->buf, 0, (rs->taps - 1 + RESAMPLER_BLOCK) * rs->channels * sizeof(*rs->buf));
+}
+
+size_t resampler_out_max(const struct resampler *rs, size_t frames)
+{
+	return (frames * rs->up + rs->down - 1) / rs->down + 1;
+}
+
+static inline int16_t q_sat(int32_t acc, unsigned int shift)
+{
+	acc = (acc + (1 << (shift - 1))) >> shift;
+
+	if (acc > INT16_MAX)
+		return INT16_MAX;
+	if (acc < INT16_MIN)
+		return INT16_MIN;
+
+	return acc;
+}
+
+static size_t resampler_block_mono(struct resampler *rs, unsigned int end, int16_t *out)
+{
+	const unsigned int shift = rs->shift - rs->headroom;
+	const unsigned int taps = rs->taps;
+	int16_t *o = out;
+
+	while (rs->pos < end) {
+		const int16_t *c = rs->coefs + rs->phase * taps;
+		const int16_t *x = rs->buf + rs->pos + 1 - taps;
+		int32_t acc = 0;
+
+		for (unsigned int k = 0; k < taps; k++)
+			acc += c[k] * x[k];
+
+		*o++ = q_sat(acc, shift);
+
+		rs->phase += rs->down;
+		rs->pos += rs->phase / rs->up;
+		rs->phase %= rs->up;
+	}
+
+	return o - out;
+}
+
+static size_t resampler_block_stereo(struct resampler *rs, unsigned int end, int16_t *out)
+{
+	const unsigned int shift = rs->shift - rs->headroom;
+	const unsigned int taps = rs->taps;
+	int16_t *o = out;
+
+	while (rs->pos < end) {
+		const int16_t *c = rs->coefs + rs->phase * taps;
+		const int16_t *x = rs->buf + 2 * (rs->pos + 1 - taps);
+		int32_t l = 0, r = 0;
+
+		for (unsigned int k = 0; k < taps; k++) {
+			l += c[k] * x[2 * k];
+			r += c[k] * x[2 * k + 1];
+		}
+
+		*o++ = q_sat(l, shift);
+		*o++ = q_sat(r, shift);
+
+		rs->phase += rs->down;
+		rs->pos += rs->phase / rs->up;
+		rs->phase %= rs->up;
+	}
+
+	return (o - out) / 2;
+}
+
+static size_t resampler_block_any(struct resampler *rs, unsigned int end, int16_t *out)
+{
+	const unsigned int shift = rs->shift - rs->headroom;
+	const unsigned int taps = rs->taps;
+	const unsigned int ch = rs->channels;
+	int16_t *o = out;
+
+	while (rs->pos < end) {
+		const int16_t *c = rs->coefs + rs->phase * taps;
+		const int16_t *x = rs->buf + ch * (rs->pos + 1 - taps);
+
+		for (unsigned int j = 0; j < ch; j++) {
+			int32_t acc = 0;
+
+			for (unsigned int k = 0; k < taps; k++)
+				acc += c[k] * x[ch * k + j];
+
+			*o++ = q_sat(acc, shift);
+		}
+
+		rs->phase += rs->down;
+		rs->pos += rs->phase / rs->up;
+		rs->phase %= rs->up;
+	}
+
+	return (o - out) / ch;
+}
+
+/*
+ * Input is appended to the history of last taps - 1 frames, block by block.
+ * Position is the index of the newest frame in the window of the next output.
+ */
+size_t resampler_process(struct resampler *rs, const int16_t *in, size_t frames, int16_t *out)
+{
+	const unsigned int ch = rs->channels;
+	const unsigned int hist = rs->taps - 1;
+	size_t produced = 0;
+
+	if (!rs->taps) {
+		memcpy(out, in, frames * ch * sizeof(*out));
+		return frames;
+	}
+
+	while (frames) {
+		unsigned int n = (frames < RESAMPLER_BLOCK) ? frames : RESAMPLER_BLOCK;
+		int16_t *o = out + produced * ch;
+
+		if (rs->headroom) {
+			for (unsigned int i = 0; i < n * ch; i++)
+				rs->buf[hist * ch + i] = in[i] >> rs->headroom;
+		} else {
+			memcpy(rs->buf + hist * ch, in, n * ch * sizeof(*in));
+		}
+
+		if (ch == 1)
+			produced += resampler_block_mono(rs, hist + n, o);
+		else if (ch == 2)
+			produced += resampler_block_stereo(rs, hist + n, o);
+		else
+			produced += resampler_block_any(rs, hist + n, o);
+
+		memmove(rs->buf, rs->buf + n * ch, hist * ch * sizeof(*rs->buf));
+		rs->pos -= n;
+
+		in += n * ch;
+		frames -= n;
+	}
+
+	return produced;
+}
+
+/* sink adaptor: resample whole frames and pass them to the next sink */
+
+static int resampler_sink_write(void *ctx, const void *buf, size_t len)
+{
+	struct resampler_sink *s = ctx;
+	const unsigned int frame = s->rs->channels * sizeof(int16_t);
+	const int16_t *in = buf;
+	size_t frames = len / frame;
+	size_t n, out;
+
+	while (frames) {
+		n = (frames < RESAMPLER_BLOCK) ? frames : RESAMPLER_BLOCK;
+		out = resampler_process(s->rs, in, n, s->out);
+
+		/* output block is owned by the sink: cheapest place for volume */
+		if (out && s->gain)
+			gain_apply(s->gain, s->out, out);
+
+		if (out && s->next->write(s->next->ctx, s->out, out * frame))
+			return -1;
+
+		in += n * s->rs->channels;
+		frames -= n;
+	}
+
+	return 0;
+}
+
+int resampler_sink_init(struct resampler_sink *s, struct resampler *rs, struct wav_sink *next,
+			struct wav_sink *sink)
+{
+	s->rs = rs;
+	s->next = next;
+	s->gain = NULL;
+	s->out = malloc(resampler_out_max(rs, RESAMPLER_BLOCK) * rs->channels * sizeof(*s->out));
+	if (!s->out)
+		return -1;
+
+	sink->ctx = s;
+	sink->write = resampler_sink_write;
+
+	return 0;
+}
+
+void resampler_sink_deinit(struct resampler_sink *s)
+{
+	free(s->out);
+	s->out = NULL;
+}
@@ -0,0 +1,283 @@
+/*
+ * RIFF/WAVE parser: walks chunks in arbitrary order in one pass, with bounds
+ * checks and odd-size padding, and returns the layout of the audio data
+ * instead of copying it. Two front ends share the same chunk handling:
+ * - wav_parse: memory buffer, e.g. flash mapped file
+ * - wav_read_header: sequential byte source, e.g. file on SPIFFS
+ *
+ * All fields are read byte by byte as little endian, so the parser makes no
+ * assumptions about alignment of the buffer or host byte order.
+ */
+
+#include <string.h>
+#include <stdio.h>
+
+#include "common.h"
+
+#define RIFF_HDR_SIZE	12
+#define CHUNK_HDR_SIZE	8
+
+/* fmt chunk: 16 bytes for PCM, 18 with cbSize, 20 for IMA ADPCM, 40 for WAVE_FORMAT_EXTENSIBLE */
+#define FMT_MIN_SIZE	16
+#define FMT_ADPCM_SIZE	20
+#define FMT_EXT_SIZE	40
+
+static inline uint16_t le16(const uint8_t *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static inline uint32_t le32(const uint8_t *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline int fourcc(const uint8_t *p, const char *id)
+{
+	return !memcmp(p, id, 4);
+}
+
+static int wav_parse_fmt(const uint8_t *p, uint32_t size, struct wav_info *info)
+{
+	if (size < FMT_MIN_SIZE)
+		return -1;
+
+	info->format = le16(p);
+	info->channels = le16(p + 2);
+	info->sample_rate = le32(p + 4);
+	info->byte_rate = le32(p + 8);
+	info->block_align = le16(p + 12);
+	info->bits_per_sample = le16(p + 14);
+
+	/* extensible: actual format is in the first two bytes of subformat GUID */
+	if (info->format == WAV_FORMAT_EXTENSIBLE) {
+		if (size < FMT_EXT_SIZE || le16(p + 16) < 22)
+			return -1;
+
+		info->format = le16(p + 24);
+	}
+
+	if (!info->channels || !info->sample_rate || !info->block_align || !info->bits_per_sample)
+		return -1;
+
+	/* uncompressed data: frame size is defined by channels and sample width */
+	if (info->format == WAV_FORMAT_PCM || info->format == WAV_FORMAT_FLOAT) {
+		if (info->bits_per_sample > 64 ||
+		    info->block_align != info->channels * ((info->bits_per_sample + 7) / 8))
+			return -1;
+
+		info->samples_per_block = 1;
+	}
+
+	/* ima adpcm: 4 byte header and 4 byte groups of 8 samples per channel */
+	if (info->format == WAV_FORMAT_IMA_ADPCM) {
+		if (size < FMT_ADPCM_SIZE || le16(p + 16) < 2 || info->bits_per_sample != 4)
+			return -1;
+
+		info->samples_per_block = le16(p + 18);
+
+		if (info->block_align <= 4 * info->channels || (info->block_align % (4 * info->channels)) ||
+		    info->samples_per_block != (info->block_align - 4 * info->channels) * 2 / info->channels + 1)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int wav_parse_riff(const uint8_t *p, size_t len, size_t *end)
+{
+	uint32_t riff_size;
+
+	if (len < RIFF_HDR_SIZE || !fourcc(p, "RIFF") || !fourcc(p + 8, "WAVE"))
+		return -1;
+
+	/* zero or oversized RIFF size is common for files written by streaming encoders */
+	riff_size = le32(p + 4);
+	*end = (riff_size >= 4 && riff_size <= len - 8) ? riff_size + 8 : len;
+
+	return 0;
+}
+
+static void wav_finish(struct wav_info *info)
+{
+	info->frames = info->data_size / info->block_align;
+}
+
+int wav_parse(const void *buf, size_t len, struct wav_info *info)
+{
+	const uint8_t *p = buf;
+	int has_fmt = 0;
+	int has_data = 0;
+	uint32_t size;
+	size_t off;
+	size_t end;
+
+	memset(info, 0, sizeof(*info));
+
+	if (wav_parse_riff(p, len, &end))
+		return -1;
+
+	for (off = RIFF_HDR_SIZE; end - off >= CHUNK_HDR_SIZE; ) {
+		const uint8_t *hdr = p + off;
+
+		size = le32(hdr + 4);
+		off += CHUNK_HDR_SIZE;
+
+		if (fourcc(hdr, "data")) {
+			/* truncated file: play what is there */
+			info->data_offset = off;
+			info->data_size = (size <= end - off) ? size : end - off;
+			has_data = 1;
+		} else if (size > end - off) {
+			return -1;
+		} else if (fourcc(hdr, "fmt ")) {
+			if (has_fmt || wav_parse_fmt(p + off, size, info))
+				return -1;
+			has_fmt = 1;
+		} else if (fourcc(hdr, "fact") && size >= 4) {
+			info->fact_frames = le32(p + off);
+		}
+
+		if (has_fmt && has_data)
+			break;
+
+		/* chunks are padded to even size, padding byte may be missing at the end */
+		if (size > end - off)
+			break;
+
+		off += (size_t)size + (size & 1);
+		if (off > end)
+			break;
+	}
+
+	if (!has_fmt || !has_data)
+		return -1;
+
+	wav_finish(info);
+
+	return 0;
+}
+
+static size_t mem_read(void *ctx, void *buf, size_t len)
+{
+	struct wav_mem *m = ctx;
+
+	if (len > m->len - m->pos)
+		len = m->len - m->pos;
+
+	memcpy(buf, m->buf + m->pos, len);
+	m->pos += len;
+
+	return len;
+}
+
+static int mem_skip(void *ctx, size_t len)
+{
+	struct wav_mem *m = ctx;
+
+	if (len > m->len - m->pos)
+		return -1;
+
+	m->pos += len;
+
+	return 0;
+}
+
+void wav_source_mem(struct wav_source *src, struct wav_mem *m, const void *buf, size_t len)
+{
+	m->buf = buf;
+	m->len = len;
+	m->pos = 0;
+
+	src->ctx = m;
+	src->read = mem_read;
+	src->skip = mem_skip;
+}
+
+static size_t file_read(void *ctx, void *buf, size_t len)
+{
+	return fread(buf, 1, len, (FILE *)ctx);
+}
+
+static int file_skip(void *ctx, size_t len)
+{
+	return fseek((FILE *)ctx, len, SEEK_CUR);
+}
+
+void wav_source_file(struct wav_source *src, FILE *fd)
+{
+	src->ctx = fd;
+	src->read = file_read;
+	src->skip = file_skip;
+}
+
+/*
+ * Streamed variant: only chunk headers and fmt body are read, everything
+ * else is skipped. Source can not seek back, so fmt must precede data.
+ */
+int wav_read_header(struct wav_source *src, struct wav_info *info)
+{
+	uint8_t buf[FMT_EXT_SIZE];
+	int has_fmt = 0;
+	size_t off = RIFF_HDR_SIZE;
+	uint32_t size;
+	size_t end;
+	size_t n;
+
+	memset(info, 0, sizeof(*info));
+
+	if (src->read(src->ctx, buf, RIFF_HDR_SIZE) != RIFF_HDR_SIZE)
+		return -1;
+
+	/* total length is unknown: trust RIFF size unless it is zero */
+	if (wav_parse_riff(buf, SIZE_MAX, &end))
+		return -1;
+
+	while (end - off >= CHUNK_HDR_SIZE) {
+		if (src->read(src->ctx, buf, CHUNK_HDR_SIZE) != CHUNK_HDR_SIZE)
+			return -1;
+
+		size = le32(buf + 4);
+		off += CHUNK_HDR_SIZE;
+
+		if (fourcc(buf, "data")) {
+			if (!has_fmt)
+				return -1;
+
+			info->data_offset = off;
+			info->data_size = (size <= end - off) ? size : end - off;
+			wav_finish(info);
+
+			return 0;
+		}
+
+		if (size > end - off)
+			return -1;
+
+		n = 0;
+
+		if (fourcc(buf, "fmt ")) {
+			n = (size < sizeof(buf)) ? size : sizeof(buf);
+			if (has_fmt || src->read(src->ctx, buf, n) != n || wav_parse_fmt(buf, n, info))
+				return -1;
+			has_fmt = 1;
+		} else if (fourcc(buf, "fact") && size >= 4) {
+			n = 4;
+			if (src->read(src->ctx, buf, n) != n)
+				return -1;
+			info->fact_frames = le32(buf);
+		}
+
+		/* last chunk may miss padding byte: stop there */
+		if ((size_t)size + (size & 1) > end - off)
+			break;
+
+		n = (size_t)size + (size & 1) - n;
+		if (n && src->skip(src->ctx, n))
+			return -1;
+
+		off += (size_t)size + (size & 1);
+	}
+
+	return -1;
+}
@@ -0,0 +1,228 @@
+/*
+ * IMA ADPCM test and benchmark:
+ * - known answer block, decoded by hand from IMA tables
+ * - data/test.wav is encoded with the reference IMA encoder, wrapped into
+ *   a WAV file and parsed; decoder sink output is compared bit exact with
+ *   the reference per-sample decoder, including a short last block
+ * - cycles per sample of table driven decoder and reference decoder
+ * With an argument the encoded file is written there, e.g. for data/.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "common.h"
+#include "encoder.h"
+#include "host_test.h"
+
+#define WAV_FILE "../data/test.wav"
+#define BLOCK_ALIGN_PER_CH 512
+
+/* reference decoding of the whole data chunk, returns frames */
+static size_t ref_decode_all(const uint8_t *data, size_t len, const struct wav_info *info, int16_t *out)
+{
+	unsigned int ch = info->channels;
+	size_t frames = 0;
+
+	for (size_t off = 0; off + 4 * ch <= len; off += info->block_align) {
+		const uint8_t *b = data + off;
+		size_t n = (len - off < info->block_align) ? len - off : info->block_align;
+		size_t groups = (n - 4 * ch) / (4 * ch);
+		struct ima_state st[8];
+
+		if (groups > (info->samples_per_block - 1u) / 8)
+			groups = (info->samples_per_block - 1) / 8;
+
+		for (unsigned int c = 0; c < ch; c++) {
+			st[c].pred = (int16_t)(b[4 * c] | b[4 * c + 1] << 8);
+			st[c].index = b[4 * c + 2];
+			out[frames * ch + c] = st[c].pred;
+		}
+
+		for (size_t g = 0; g < groups; g++)
+			for (unsigned int c = 0; c < ch; c++)
+				for (unsigned int i = 0; i < 8; i++) {
+					uint8_t byte = b[4 * ch + g * 4 * ch + 4 * c + i / 2];
+					unsigned int nibble = (i & 1) ? byte >> 4 : byte & 0xf;
+
+					out[(frames + 1 + g * 8 + i) * ch + c] = ima_ref_decode(&st[c], nibble);
+				}
+
+		frames += 1 + groups * 8;
+	}
+
+	return frames;
+}
+
+struct capture {
+	int16_t *buf;
+	size_t len;
+};
+
+static int capture_write(void *ctx, const void *buf, size_t len)
+{
+	struct capture *c = ctx;
+
+	memcpy((uint8_t *)c->buf + c->len, buf, len);
+	c->len += len;
+
+	return 0;
+}
+
+static int known_answer(void)
+{
+	static const uint8_t block[] = { 0x00, 0x00, 0x00, 0x00, 0x77, 0x08, 0x00, 0x00 };
+	static const int16_t expect[] = { 0, 11, 41, 37, 40, 43, 46, 48, 50 };
+	static const uint8_t clamp[] = { 0xff, 0x7f, 88, 0x00, 0x77, 0x77, 0x77, 0x77 };
+	int16_t out[9];
+	int fails = 0;
+
+	if (ima_adpcm_decode_block(block, sizeof(block), 1, 9, out) != 9 || memcmp(out, expect, sizeof(out)))
+		fails++;
+
+	/* positive steps from the top of range and the largest step index */
+	if (ima_adpcm_decode_block(clamp, sizeof(clamp), 1, 9, out) != 9 || out[8] != INT16_MAX)
+		fails++;
+
+	/* bad step index in block header */
+	if (ima_adpcm_decode_block((const uint8_t []){ 0, 0, 89, 0, 0, 0, 0, 0 }, 8, 1, 9, out) >= 0)
+		fails++;
+
+	printf("%-24s %s\n", "known answer", fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+static int run(const int16_t *pcm, size_t frames, unsigned int ch, uint32_t rate, const char *output)
+{
+	struct capture cap;
+	struct wav_sink next = { .ctx = &cap, .write = capture_write };
+	struct ima_adpcm_sink adpcm;
+	struct wav_sink sink;
+	struct wav_info info;
+	int16_t *ref, *mono = NULL;
+	uint64_t start, t_table = 0, t_ref = 0;
+	size_t len, ref_frames, chunk;
+	double err = 0.0, sig = 0.0;
+	const uint8_t *data;
+	uint8_t *file;
+	int fails = 0;
+
+	/* mono clip from the left channel */
+	if (ch == 1) {
+		mono = malloc(frames * sizeof(*mono));
+		for (size_t i = 0; i < frames; i++)
+			mono[i] = pcm[2 * i];
+		pcm = mono;
+	}
+
+	file = ima_adpcm_encode_wav(pcm, frames, ch, rate, BLOCK_ALIGN_PER_CH, &len);
+	if (!file || wav_parse(file, len, &info) || info.format != WAV_FORMAT_IMA_ADPCM ||
+	    info.fact_frames != frames || info.channels != ch) {
+		printf("%u ch: failed to encode or parse: FAIL\n", ch);
+		return 1;
+	}
+
+	if (output) {
+		FILE *fd = fopen(output, "wb");
+
+		if (!fd || fwrite(file, 1, len, fd) != len)
+			printf("failed to write %s\n", output);
+		if (fd)
+			fclose(fd);
+	}
+
+	data = file + info.data_offset;
+	ref = malloc((frames + info.samples_per_block) * ch * sizeof(*ref));
+	cap.buf = malloc((frames + info.samples_per_block) * ch * sizeof(*cap.buf));
+
+	start = cycles();
+	ref_frames = ref_decode_all(data, info.data_size, &info, ref);
+	t_ref = cycles() - start;
+
+	if (ima_adpcm_sink_init(&adpcm, &info, &next, &sink)) {
+		printf("%u ch: failed to init decoder: FAIL\n", ch);
+		return 1;
+	}
+
+	/* block aligned chunks as the player passes them, the last one is short */
+	cap.len = 0;
+	chunk = 4 * info.block_align;
+
+	start = cycles();
+	for (size_t off = 0; off < info.data_size; off += chunk) {
+		size_t n = (info.data_size - off < chunk) ? info.data_size - off : chunk;
+
+		if (sink.write(sink.ctx, data + off, n))
+			fails++;
+	}
+	t_table = cycles() - start;
+
+	ima_adpcm_sink_deinit(&adpcm);
+
+	if (cap.len != ref_frames * ch * sizeof(int16_t) || memcmp(cap.buf, ref, cap.len))
+		fails++;
+
+	/* encoder sanity: decoded clip is close to the original */
+	if (ref_frames < frames)
+		fails++;
+
+	for (size_t i = 0; i < frames * ch; i++) {
+		double d = (double)ref[i] - pcm[i];
+
+		err += d * d;
+		sig += (double)pcm[i] * pcm[i];
+	}
+
+	printf("{\"channels\": %u, \"block_align\": %u, \"samples_per_block\": %u, \"frames\": %zu, "
+	       "\"pcm_kb\": %zu, \"adpcm_kb\": %zu, \"snr_db\": %.1f, "
+	       "\"table_cycles_per_sample\": %.2f, \"ref_cycles_per_sample\": %.2f, \"status\": \"%s\"}\n",
+	       ch, info.block_align, info.samples_per_block, frames,
+	       frames * ch * sizeof(int16_t) / 1024, len / 1024, 10.0 * log10(sig / (err + 1e-9)),
+	       (double)t_table / (ref_frames * ch), (double)t_ref / (ref_frames * ch),
+	       fails ? "FAIL" : "PASS");
+
+	free(ref);
+	free(cap.buf);
+	free(file);
+	free(mono);
+
+	return fails;
+}
+
+int main(int argc, char **argv)
+{
+	struct wav_info info;
+	uint8_t *image;
+	size_t len;
+	FILE *fd;
+	int fails = 0;
+
+	fails += known_answer();
+
+	fd = fopen(WAV_FILE, "rb");
+	if (!fd) {
+		printf("failed to open %s\n", WAV_FILE);
+		return 1;
+	}
+
+	image = malloc(1 << 20);
+	len = fread(image, 1, 1 << 20, fd);
+	fclose(fd);
+
+	if (wav_parse(image, len, &info) || info.format != WAV_FORMAT_PCM || info.bits_per_sample != 16) {
+		printf("unexpected format of %s\n", WAV_FILE);
+		return 1;
+	}
+
+	fails += run((int16_t *)(image + info.data_offset), info.frames, info.channels, info.sample_rate,
+		     (argc > 1) ? argv[1] : NULL);
+	fails += run((int16_t *)(image + info.data_offset), info.frames, 1, info.sample_rate, NULL);
+
+	free(image);
+
+	return test_done(fails);
+}
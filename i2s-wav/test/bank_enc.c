@@ -0,0 +1,54 @@
+/*
+ * Host side sample bank writer: header, clip table and 4-byte aligned clip
+ * data, the layout bank_open() takes in place.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "encoder.h"
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+uint8_t *bank_build(const int16_t *const *clips, const uint32_t *frames, unsigned int count, uint32_t rate,
+		    size_t *len)
+{
+	size_t size = BANK_HDR_SIZE + count * sizeof(struct bank_clip);
+	size_t off;
+	uint8_t *p;
+
+	for (unsigned int i = 0; i < count; i++)
+		size += (frames[i] * sizeof(int16_t) + 3) & ~(size_t)3;
+
+	p = calloc(1, size);
+	if (!p)
+		return NULL;
+
+	memcpy(p, "SBNK", 4);
+	p[4] = BANK_VERSION;
+	p[6] = count;
+	p[7] = count >> 8;
+	put32(p + 8, rate);
+
+	off = BANK_HDR_SIZE + count * sizeof(struct bank_clip);
+
+	for (unsigned int i = 0; i < count; i++) {
+		uint8_t *entry = p + BANK_HDR_SIZE + i * sizeof(struct bank_clip);
+
+		put32(entry, off);
+		put32(entry + 4, frames[i]);
+		memcpy(p + off, clips[i], frames[i] * sizeof(int16_t));
+		off += (frames[i] * sizeof(int16_t) + 3) & ~(size_t)3;
+	}
+
+	*len = size;
+	return p;
+}
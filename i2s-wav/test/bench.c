@@ -0,0 +1,167 @@
+/*
+ * WAV parser benchmark: large synthetic files with a lot of metadata chunks
+ * before audio data. Memory parser does not touch audio data, so its cost
+ * depends on the number of chunks, not on the file size. Reported rate is
+ * file bytes per second, compared with a single memcpy of the file.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+
+#define DATA_SIZE (64u << 20)
+#define BENCH_NS 200000000LL
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+
+	return p + 4;
+}
+
+static uint8_t *put_hdr(uint8_t *p, const char *id, uint32_t size)
+{
+	memcpy(p, id, 4);
+	return put32(p + 4, size);
+}
+
+/* RIFF, nchunks odd sized metadata chunks, fmt, data */
+static uint8_t *build(unsigned int nchunks, size_t *len)
+{
+	size_t size = 12 + nchunks * 24 + 24 + 8 + DATA_SIZE;
+	uint8_t *buf = malloc(size);
+	uint8_t *p = buf;
+
+	/* set on failure too: size that could not be allocated */
+	*len = size;
+	if (!buf)
+		return NULL;
+
+	p = put_hdr(p, "RIFF", size - 8);
+	memcpy(p, "WAVE", 4);
+	p += 4;
+
+	for (unsigned int i = 0; i < nchunks; i++) {
+		p = put_hdr(p, (i & 1) ? "LIST" : "junk", 15);
+		memset(p, 'x', 16);
+		p += 16;
+	}
+
+	p = put_hdr(p, "fmt ", 16);
+	memcpy(p, "\x01\x00\x02\x00\x44\xac\x00\x00\x10\xb1\x02\x00\x04\x00\x10\x00", 16);
+	p += 16;
+
+	p = put_hdr(p, "data", DATA_SIZE);
+	memset(p, 0, DATA_SIZE);
+
+	return buf;
+}
+
+typedef int (*parse_t)(const uint8_t *buf, size_t len, struct wav_info *info);
+
+static int parse_mem(const uint8_t *buf, size_t len, struct wav_info *info)
+{
+	return wav_parse(buf, len, info);
+}
+
+static int parse_stream(const uint8_t *buf, size_t len, struct wav_info *info)
+{
+	struct wav_source src;
+	struct wav_mem m;
+
+	wav_source_mem(&src, &m, buf, len);
+	return wav_read_header(&src, info);
+}
+
+static FILE *bench_fd;
+
+static int parse_file(const uint8_t *buf, size_t len, struct wav_info *info)
+{
+	struct wav_source src;
+
+	rewind(bench_fd);
+	wav_source_file(&src, bench_fd);
+	return wav_read_header(&src, info);
+}
+
+static uint8_t *copy_dst;
+
+static int parse_copy(const uint8_t *buf, size_t len, struct wav_info *info)
+{
+	memcpy(copy_dst, buf, len);
+	return 0;
+}
+
+static void bench(const char *name, parse_t parse, const uint8_t *buf, size_t len, unsigned int nchunks)
+{
+	struct wav_info info;
+	int64_t start, elapsed;
+	unsigned long runs = 0;
+
+	start = now_ns();
+	do {
+		if (parse(buf, len, &info)) {
+			printf("%s: parse failed\n", name);
+			exit(1);
+		}
+		runs++;
+		elapsed = now_ns() - start;
+	} while (elapsed < BENCH_NS);
+
+	printf("{\"parser\": \"%s\", \"chunks\": %u, \"file_mb\": %zu, \"ns_per_parse\": %.1f, "
+	       "\"chunks_per_sec\": %.0f, \"file_gb_per_sec\": %.2f}\n",
+	       name, nchunks + 2, len >> 20, (double)elapsed / runs,
+	       (double)(nchunks + 2) * runs * 1e9 / elapsed,
+	       (double)len * runs / elapsed);
+}
+
+int main(void)
+{
+	static const unsigned int nchunks[] = { 0, 100, 10000, 100000 };
+	uint8_t *buf;
+	size_t len;
+
+	for (unsigned int i = 0; i < sizeof(nchunks) / sizeof(nchunks[0]); i++) {
+		buf = build(nchunks[i], &len);
+		if (!buf) {
+			printf("failed to allocate %zu bytes\n", len);
+			return 1;
+		}
+
+		bench("mem", parse_mem, buf, len, nchunks[i]);
+		bench("stream", parse_stream, buf, len, nchunks[i]);
+
+		bench_fd = tmpfile();
+		if (bench_fd && fwrite(buf, 1, len, bench_fd) == len)
+			bench("file", parse_file, buf, len, nchunks[i]);
+		if (bench_fd)
+			fclose(bench_fd);
+
+		if (!i) {
+			copy_dst = malloc(len);
+			if (copy_dst) {
+				bench("memcpy", parse_copy, buf, len, nchunks[i]);
+				free(copy_dst);
+			}
+		}
+
+		free(buf);
+	}
+
+	return 0;
+}
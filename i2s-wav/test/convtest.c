@@ -0,0 +1,364 @@
+/*
+ * Sample format conversion test and benchmark:
+ * - each kernel against a per-sample reference for lengths around the
+ *   word loop, misaligned buffers, out of place and in place
+ * - float saturation, rounding and NaN
+ * - conversion sink with odd chunk sizes and channel adaptation
+ * - cycles per sample of word-at-a-time kernels vs reference, JSON lines
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "common.h"
+#include "host_test.h"
+
+#define MAX_SAMPLES	67
+#define BENCH_SAMPLES	(64 * 1024)
+#define BENCH_RUNS	20
+
+typedef void (*kernel_t)(void *out, const void *in, size_t n);
+
+static void ref_u8_s16(void *out, const void *in, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		((int16_t *)out)[i] = ((int)((const uint8_t *)in)[i] - 128) * 256;
+}
+
+static void ref_s24_s16(void *out, const void *in, size_t n)
+{
+	const uint8_t *p = in;
+
+	for (size_t i = 0; i < n; i++) {
+		int32_t v = (int32_t)((uint32_t)(p[3 * i] | p[3 * i + 1] << 8 | p[3 * i + 2] << 16) << 8) >> 8;
+
+		((int16_t *)out)[i] = v >> 8;
+	}
+}
+
+static void ref_s24_s32(void *out, const void *in, size_t n)
+{
+	const uint8_t *p = in;
+
+	for (size_t i = 0; i < n; i++) {
+		int32_t v = (int32_t)((uint32_t)(p[3 * i] | p[3 * i + 1] << 8 | p[3 * i + 2] << 16) << 8) >> 8;
+
+		((int32_t *)out)[i] = v * 256;
+	}
+}
+
+static void ref_s32_s16(void *out, const void *in, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		int32_t v;
+
+		memcpy(&v, (const uint8_t *)in + 4 * i, sizeof(v));
+		((int16_t *)out)[i] = v >> 16;
+	}
+}
+
+static void ref_f32_s16(void *out, const void *in, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		float f;
+		double v;
+
+		memcpy(&f, (const uint8_t *)in + 4 * i, sizeof(f));
+		v = floor((double)f * 32768.0 + 0.5);
+
+		((int16_t *)out)[i] = isnan(f) ? 0 : (v > 32767) ? 32767 : (v < -32768) ? -32768 : (int16_t)v;
+	}
+}
+
+static void ref_mono_stereo(void *out, const void *in, size_t n)
+{
+	for (size_t i = 0; i < n; i++)
+		((int16_t *)out)[2 * i] = ((int16_t *)out)[2 * i + 1] = ((const int16_t *)in)[i];
+}
+
+static void ref_stereo_mono(void *out, const void *in, size_t n)
+{
+	const int16_t *p = in;
+
+	for (size_t i = 0; i < n; i++)
+		((int16_t *)out)[i] = (int16_t)floor((p[2 * i] + p[2 * i + 1]) / 2.0);
+}
+
+/* kernels with untyped arguments, as the tables below want them */
+static void k_u8_s16(void *o, const void *i, size_t n) { convert_u8_s16(o, i, n); }
+static void k_s24_s16(void *o, const void *i, size_t n) { convert_s24_s16(o, i, n); }
+static void k_s24_s32(void *o, const void *i, size_t n) { convert_s24_s32(o, i, n); }
+static void k_s32_s16(void *o, const void *i, size_t n) { convert_s32_s16(o, i, n); }
+static void k_f32_s16(void *o, const void *i, size_t n) { convert_f32_s16(o, i, n); }
+static void k_mono_stereo(void *o, const void *i, size_t n) { convert_mono_stereo(o, i, n); }
+static void k_stereo_mono(void *o, const void *i, size_t n) { convert_stereo_mono(o, i, n); }
+
+static const struct kernel {
+	const char *name;
+	kernel_t fast;
+	kernel_t ref;
+	size_t in_size;		/* bytes per unit of n */
+	size_t out_size;
+	int is_float;
+	int in_s16;		/* input is typed, must be aligned */
+} kernels[] = {
+	{ "u8_s16",      k_u8_s16,      ref_u8_s16,      1, 2, 0, 0 },
+	{ "s24_s16",     k_s24_s16,     ref_s24_s16,     3, 2, 0, 0 },
+	{ "s24_s32",     k_s24_s32,     ref_s24_s32,     3, 4, 0, 0 },
+	{ "s32_s16",     k_s32_s16,     ref_s32_s16,     4, 2, 0, 0 },
+	{ "f32_s16",     k_f32_s16,     ref_f32_s16,     4, 2, 1, 0 },
+	{ "mono_stereo", k_mono_stereo, ref_mono_stereo, 2, 4, 0, 1 },
+	{ "stereo_mono", k_stereo_mono, ref_stereo_mono, 4, 2, 0, 1 },
+};
+
+static uint32_t rnd(void)
+{
+	static uint32_t x = 2463534242u;
+
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+
+	return x;
+}
+
+static void fill(uint8_t *buf, size_t n, int is_float)
+{
+	if (!is_float) {
+		for (size_t i = 0; i < n; i++)
+			buf[i] = rnd();
+		return;
+	}
+
+	/* mostly in range, some over full scale */
+	for (size_t i = 0; i + 4 <= n; i += 4) {
+		float f = ((int32_t)rnd() / 2147483648.0f) * 1.25f;
+
+		memcpy(buf + i, &f, sizeof(f));
+	}
+}
+
+static int check_kernel(const struct kernel *k)
+{
+	static uint8_t in[MAX_SAMPLES * 4 + 8] __attribute__((aligned(4)));
+	static uint8_t out[MAX_SAMPLES * 4 + 8] __attribute__((aligned(4)));
+	static uint8_t ref[MAX_SAMPLES * 4 + 8] __attribute__((aligned(4)));
+	static uint8_t inplace[MAX_SAMPLES * 4 + 8] __attribute__((aligned(4)));
+	int fails = 0;
+
+	/* byte input at any offset, output aligned to its sample size */
+	for (size_t n = 0; n <= MAX_SAMPLES; n++) {
+		for (size_t off = 0; off < 4; off++) {
+			size_t in_off = k->in_s16 ? (off & 2) : off;
+			size_t out_off = (k->out_size == 4) ? 0 : (off & 2);
+
+			fill(in + in_off, n * k->in_size, k->is_float);
+
+			memset(out, 0x5a, sizeof(out));
+			memset(ref, 0x5a, sizeof(ref));
+
+			k->ref(ref + out_off, in + in_off, n);
+			k->fast(out + out_off, in + in_off, n);
+
+			/* bytes past the end must stay untouched */
+			if (memcmp(out, ref, sizeof(out)))
+				fails++;
+
+			/* in place: input at the start of the buffer which takes the output */
+			memset(inplace, 0x5a, sizeof(inplace));
+			memcpy(inplace + out_off, in + in_off, n * k->in_size);
+			k->fast(inplace + out_off, inplace + out_off, n);
+
+			if (memcmp(inplace + out_off, ref + out_off, n * k->out_size))
+				fails++;
+		}
+	}
+
+	printf("%-24s %s\n", k->name, fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+static int check_float(void)
+{
+	static const struct {
+		float in;
+		int16_t out;
+	} cases[] = {
+		{ 0.0f, 0 }, { -0.0f, 0 }, { 1.0f, 32767 }, { -1.0f, -32768 },
+		{ 1.5f, 32767 }, { -2.0f, -32768 }, { 1e30f, 32767 }, { -1e30f, -32768 },
+		{ 0.5f / 32768, 1 }, { -0.5f / 32768, 0 }, { 1.5f / 32768, 2 }, { -1.5f / 32768, -1 },
+		{ 32766.0f / 32768, 32766 }, { 1e-30f, 0 },
+	};
+	float special[3] = { NAN, INFINITY, -INFINITY };
+	int16_t expect[3] = { 0, 32767, -32768 };
+	int16_t out[3];
+	int fails = 0;
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		convert_f32_s16(out, (const uint8_t *)&cases[i].in, 1);
+		if (out[0] != cases[i].out) {
+			printf("f32 %g: %d, expected %d\n", cases[i].in, out[0], cases[i].out);
+			fails++;
+		}
+	}
+
+	convert_f32_s16(out, (const uint8_t *)special, 3);
+	if (memcmp(out, expect, sizeof(out)))
+		fails++;
+
+	printf("%-24s %s\n", "f32 saturation", fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+struct capture {
+	int16_t *buf;
+	size_t len;
+};
+
+static int capture_write(void *ctx, const void *buf, size_t len)
+{
+	struct capture *c = ctx;
+
+	memcpy((uint8_t *)c->buf + c->len, buf, len);
+	c->len += len;
+
+	return 0;
+}
+
+/* sink: 24-bit stereo -> mono and 8-bit mono -> stereo, chunks split into odd frame counts */
+static int check_sink(void)
+{
+	static const struct {
+		uint16_t format;
+		uint16_t bits;
+		uint16_t channels;
+		unsigned int out_channels;
+		kernel_t ref;
+		kernel_t adapt;
+	} cases[] = {
+		{ WAV_FORMAT_PCM,   24, 2, 1, ref_s24_s16, ref_stereo_mono },
+		{ WAV_FORMAT_PCM,    8, 1, 2, ref_u8_s16,  ref_mono_stereo },
+		{ WAV_FORMAT_PCM,   32, 2, 2, ref_s32_s16, NULL },
+		{ WAV_FORMAT_FLOAT, 32, 1, 1, ref_f32_s16, NULL },
+		{ WAV_FORMAT_PCM,   16, 2, 1, NULL,        ref_stereo_mono },
+	};
+	const size_t frames = 1000;
+	int fails = 0;
+
+	for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		struct wav_info info = {
+			.format = cases[i].format,
+			.channels = cases[i].channels,
+			.bits_per_sample = cases[i].bits,
+		};
+		size_t frame = cases[i].channels * cases[i].bits / 8;
+		uint8_t *in = malloc(frames * frame);
+		int16_t *tmp = malloc(frames * 2 * sizeof(*tmp));
+		int16_t *ref = malloc(frames * 2 * sizeof(*ref));
+		struct capture cap = { .buf = malloc(frames * 2 * sizeof(int16_t)), .len = 0 };
+		struct wav_sink next = { .ctx = &cap, .write = capture_write };
+		struct convert_sink conv;
+		struct wav_sink sink;
+		size_t samples = frames * cases[i].channels;
+
+		fill(in, frames * frame, cases[i].format == WAV_FORMAT_FLOAT);
+
+		if (cases[i].ref)
+			cases[i].ref(tmp, in, samples);
+		else
+			memcpy(tmp, in, samples * sizeof(int16_t));
+
+		if (cases[i].adapt)
+			cases[i].adapt(ref, tmp, frames);
+		else
+			memcpy(ref, tmp, samples * sizeof(int16_t));
+
+		if (convert_sink_init(&conv, &info, cases[i].out_channels, &next, &sink)) {
+			fails++;
+			continue;
+		}
+
+		/* 1, 2, 3... frames per write, past CONVERT_BLOCK too */
+		for (size_t off = 0, n = 1; off < frames; off += n, n = n * 3 + 1) {
+			size_t len = (frames - off < n) ? frames - off : n;
+
+			if (sink.write(sink.ctx, in + off * frame, len * frame))
+				fails++;
+		}
+
+		convert_sink_deinit(&conv);
+
+		if (cap.len != frames * cases[i].out_channels * sizeof(int16_t) || memcmp(cap.buf, ref, cap.len))
+			fails++;
+
+		free(in);
+		free(tmp);
+		free(ref);
+		free(cap.buf);
+	}
+
+	/* unsupported formats */
+	if (!convert_sink_init(&(struct convert_sink){ 0 },
+			       &(struct wav_info){ .format = WAV_FORMAT_PCM, .channels = 2, .bits_per_sample = 12 },
+			       2, NULL, &(struct wav_sink){ 0 }))
+		fails++;
+	if (!convert_sink_init(&(struct convert_sink){ 0 },
+			       &(struct wav_info){ .format = WAV_FORMAT_PCM, .channels = 6, .bits_per_sample = 16 },
+			       2, NULL, &(struct wav_sink){ 0 }))
+		fails++;
+
+	printf("%-24s %s\n", "sink", fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+static void bench(const struct kernel *k)
+{
+	uint8_t *in = malloc(BENCH_SAMPLES * 4);
+	uint8_t *out = malloc(BENCH_SAMPLES * 4);
+	uint64_t best_fast = UINT64_MAX, best_ref = UINT64_MAX;
+
+	fill(in, BENCH_SAMPLES * k->in_size, k->is_float);
+
+	for (int r = 0; r < BENCH_RUNS; r++) {
+		uint64_t start = cycles();
+
+		k->fast(out, in, BENCH_SAMPLES);
+		start = cycles() - start;
+		if (start < best_fast)
+			best_fast = start;
+
+		start = cycles();
+		k->ref(out, in, BENCH_SAMPLES);
+		start = cycles() - start;
+		if (start < best_ref)
+			best_ref = start;
+	}
+
+	printf("{\"kernel\": \"%s\", \"samples\": %d, \"cycles_per_sample\": %.3f, \"ref_cycles_per_sample\": %.3f}\n",
+	       k->name, BENCH_SAMPLES, (double)best_fast / BENCH_SAMPLES, (double)best_ref / BENCH_SAMPLES);
+
+	free(in);
+	free(out);
+}
+
+int main(void)
+{
+	int fails = 0;
+
+	for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+		fails += check_kernel(&kernels[i]);
+
+	fails += check_float();
+	fails += check_sink();
+
+	for (size_t i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++)
+		bench(&kernels[i]);
+
+	return test_done(fails);
+}
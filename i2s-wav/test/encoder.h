@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* host side reference encoders for test clips, return malloc'ed files */
+
+struct ima_state {
+	int pred;
+	int index;
+};
+
+int16_t ima_ref_decode(struct ima_state *st, unsigned int nibble);
+uint8_t *ima_adpcm_encode_wav(const int16_t *pcm, size_t frames, unsigned int ch, uint32_t rate,
+			      unsigned int align_per_ch, size_t *len);
+
+uint8_t *qoa_encode(const int16_t *pcm, uint32_t frames, unsigned int ch, uint32_t rate, size_t *len);
+
+uint8_t *bank_build(const int16_t *const *clips, const uint32_t *frames, unsigned int count, uint32_t rate,
+		    size_t *len);
@@ -0,0 +1,48 @@
+/*
+ * Fuzz target for wav parsers, libFuzzer entry point. Both front ends parse
+ * the same input, results are checked against each other and against input
+ * bounds. Use fuzz_main.c to run it without libFuzzer, e.g. with AFL or gcc.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	struct wav_info a, b;
+	struct wav_source src;
+	struct wav_mem m;
+	int ra, rb;
+
+	ra = wav_parse(data, size, &a);
+	if (!ra) {
+		if (a.data_offset > size || a.data_size > size - a.data_offset)
+			abort();
+
+		if (!a.block_align || (uint64_t)a.frames * a.block_align > a.data_size)
+			abort();
+	}
+
+	wav_source_mem(&src, &m, data, size);
+	rb = wav_read_header(&src, &b);
+	if (!rb) {
+		if (m.pos != b.data_offset || b.data_offset > size)
+			abort();
+
+		if (!b.block_align)
+			abort();
+	}
+
+	/* byte source sees the same first data chunk, its size may be unclamped */
+	if (!ra && !rb) {
+		if (a.format != b.format || a.channels != b.channels ||
+		    a.sample_rate != b.sample_rate || a.block_align != b.block_align ||
+		    a.data_offset != b.data_offset || a.data_size > b.data_size)
+			abort();
+	}
+
+	return 0;
+}
@@ -0,0 +1,177 @@
+/*
+ * Standalone driver for fuzz target when libFuzzer is not available:
+ * - with arguments: run each file once, e.g. for AFL or crash reproduction
+ * - without arguments: mutate built-in seeds with a fixed random seed
+ * Each input is copied to exactly sized heap buffer so that sanitizers
+ * catch any out of bounds read.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#define MAX_LEN 1024
+#define DEFAULT_RUNS 1000000
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static void run_one(const uint8_t *data, size_t len)
+{
+	uint8_t *buf = malloc(len ? len : 1);
+
+	memcpy(buf, data, len);
+	LLVMFuzzerTestOneInput(buf, len);
+	free(buf);
+}
+
+static int run_file(const char *path)
+{
+	uint8_t *buf;
+	FILE *fd;
+	long len;
+
+	fd = fopen(path, "rb");
+	if (!fd) {
+		printf("failed to open %s\n", path);
+		return 1;
+	}
+
+	fseek(fd, 0, SEEK_END);
+	len = ftell(fd);
+	rewind(fd);
+
+	buf = malloc(len ? len : 1);
+	if (fread(buf, 1, len, fd) != (size_t)len) {
+		printf("failed to read %s\n", path);
+		fclose(fd);
+		free(buf);
+		return 1;
+	}
+
+	fclose(fd);
+
+	LLVMFuzzerTestOneInput(buf, len);
+	free(buf);
+
+	return 0;
+}
+
+static const uint8_t seed_pcm[] =
+	"RIFF\x42\x00\x00\x00WAVE"
+	"fmt \x10\x00\x00\x00\x01\x00\x02\x00\x00\x7d\x00\x00\x00\xf4\x01\x00\x04\x00\x10\x00"
+	"LIST\x0d\x00\x00\x00INFOISFT\x01\x00\x00\x00x\x00"
+	"data\x08\x00\x00\x00\x01\x02\x03\x04\x05\x06\x07\x08";
+
+static const uint8_t seed_ext[] =
+	"RIFF\x00\x00\x00\x00WAVE"
+	"fact\x04\x00\x00\x00\x02\x00\x00\x00"
+	"fmt \x28\x00\x00\x00\xfe\xff\x01\x00\x80\xbb\x00\x00\x80\x32\x02\x00\x03\x00\x18\x00"
+	"\x16\x00\x18\x00\x04\x00\x00\x00\x01\x00\x00\x00\x00\x00\x10\x00\x80\x00\x00\xaa\x00\x38\x9b\x71"
+	"data\xff\xff\xff\xff\x01\x02\x03\x04\x05\x06";
+
+static const struct {
+	const uint8_t *data;
+	size_t len;
+} seeds[] = {
+	{ seed_pcm, sizeof(seed_pcm) - 1 },
+	{ seed_ext, sizeof(seed_ext) - 1 },
+};
+
+static uint32_t rnd_state = 1;
+
+static uint32_t rnd(void)
+{
+	/* xorshift32 */
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 17;
+	rnd_state ^= rnd_state << 5;
+
+	return rnd_state;
+}
+
+static size_t mutate(uint8_t *buf, size_t len)
+{
+	static const uint32_t interesting[] = { 0, 1, 2, 3, 4, 7, 8, 15, 16, 0x7f, 0x80, 0xff,
+		0x7fffffff, 0x80000000, 0xfffffff0, 0xfffffffe, 0xffffffff };
+	unsigned int n = 1 + rnd() % 4;
+	size_t pos;
+	uint32_t v;
+
+	while (n--) {
+		pos = len ? rnd() % len : 0;
+
+		switch (rnd() % 6) {
+		case 0: /* bit flip */
+			if (len)
+				buf[pos] ^= 1 << (rnd() % 8);
+			break;
+		case 1: /* random byte */
+			if (len)
+				buf[pos] = rnd();
+			break;
+		case 2: /* interesting 32-bit value, e.g. chunk size */
+			v = interesting[rnd() % (sizeof(interesting) / sizeof(interesting[0]))];
+			if (pos + 4 <= len)
+				memcpy(buf + pos, &v, 4);
+			break;
+		case 3: /* truncate */
+			len = pos;
+			break;
+		case 4: /* insert bytes */
+			v = 1 + rnd() % 16;
+			if (len + v <= MAX_LEN) {
+				memmove(buf + pos + v, buf + pos, len - pos);
+				for (uint32_t i = 0; i < v; i++)
+					buf[pos + i] = rnd();
+				len += v;
+			}
+			break;
+		case 5: /* duplicate a block, e.g. whole chunk */
+			v = 1 + rnd() % 48;
+			if (pos + v <= len && len + v <= MAX_LEN) {
+				memmove(buf + pos + v, buf + pos, len - pos);
+				len += v;
+			}
+			break;
+		}
+	}
+
+	return len;
+}
+
+int main(int argc, char **argv)
+{
+	unsigned long runs = DEFAULT_RUNS;
+	uint8_t buf[MAX_LEN];
+	size_t len;
+
+	if (argc > 1) {
+		int fails = 0;
+
+		for (int i = 1; i < argc; i++)
+			fails += run_file(argv[i]);
+
+		return fails ? 1 : 0;
+	}
+
+	if (getenv("FUZZ_RUNS"))
+		runs = strtoul(getenv("FUZZ_RUNS"), NULL, 0);
+
+	for (unsigned long i = 0; i < runs; i++) {
+		unsigned int s = i % (sizeof(seeds) / sizeof(seeds[0]));
+
+		memcpy(buf, seeds[s].data, seeds[s].len);
+		len = mutate(buf, seeds[s].len);
+
+		/* keep mutating the same input for a while to go deeper */
+		for (int k = 0; k < 8; k++) {
+			run_one(buf, len);
+			len = mutate(buf, len);
+		}
+	}
+
+	printf("fuzz: %lu inputs: PASSED\n", runs * 8);
+
+	return 0;
+}
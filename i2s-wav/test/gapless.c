@@ -0,0 +1,385 @@
+/*
+ * Gapless playlist test: tracks are WAV files in memory, opening a track
+ * takes a while as on SPIFFS. Sink models I2S DMA with a simulated clock:
+ * it queues up to a fixed amount of audio, blocks while the queue is full
+ * and accounts the time it runs empty as underrun.
+ * - same format tracks: data is delivered in order and there is no underrun
+ *   at track boundaries, while playing them one by one with player_play
+ *   and opening the next file in between does underrun
+ * - format change, empty track, open error and sink error
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+#include "port.h"
+
+#define MAX_TRACKS	8
+#define RATE		16000
+#define FRAMES		8000	/* 0.5 s per track */
+#define CHUNK		4096
+
+/* clock runs SPEEDUP times faster than real audio */
+#define SPEEDUP		4
+#define QUEUE_US	32000	/* two chunks at 4x */
+#define OPEN_US		40000	/* longer than the queue */
+#define MAX_GAP_US	2000	/* scheduling jitter allowed at boundaries */
+
+struct dma_sink {
+	double us_per_byte;
+	int64_t end_us;		/* when the queued audio runs out */
+	int64_t underrun_us;
+	int started;
+
+	uint8_t *buf;		/* everything written, for comparison */
+	size_t len;
+	size_t max;
+	size_t fail_at;		/* fail write at this offset, 0 - never */
+};
+
+static void sleep_us(int64_t us)
+{
+	struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+
+	if (us > 0)
+		nanosleep(&ts, NULL);
+}
+
+static int dma_write(void *ctx, const void *buf, size_t len)
+{
+	struct dma_sink *s = ctx;
+	int64_t now = port_time_us();
+
+	if (s->fail_at && s->len + len > s->fail_at)
+		return -1;
+
+	/* queue ran empty: i2s would repeat or clear the last DMA buffer */
+	if (s->started && now > s->end_us)
+		s->underrun_us += now - s->end_us;
+	if (!s->started || now > s->end_us)
+		s->end_us = now;
+
+	s->started = 1;
+	s->end_us += (int64_t)(len * s->us_per_byte);
+
+	if (s->len + len <= s->max)
+		memcpy(s->buf + s->len, buf, len);
+	s->len += len;
+
+	/* block while more than the queue depth is pending */
+	sleep_us(s->end_us - QUEUE_US - now);
+
+	return 0;
+}
+
+struct track {
+	uint8_t *wav;
+	size_t len;
+	uint32_t rate;
+};
+
+struct list {
+	struct track tracks[MAX_TRACKS];
+	unsigned int count;
+	int open_fail;		/* track which fails to open, -1 - none */
+	int repeat;		/* open wraps around instead of ending the list */
+	int opened;		/* open minus close calls */
+
+	struct dma_sink *dma;
+	struct wav_mem mem;
+	unsigned int started[MAX_TRACKS];
+	uint32_t start_rate[MAX_TRACKS];
+	unsigned int nstarted;
+	struct playlist_track played[MAX_TRACKS];
+	unsigned int nplayed;
+};
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+/* stereo 16-bit PCM with a pattern which tells the track and frame */
+static void make_track(struct track *t, unsigned int index, uint32_t frames, uint32_t rate)
+{
+	uint32_t data = frames * 4;
+
+	t->len = 44 + data;
+	t->rate = rate;
+	t->wav = calloc(1, t->len);
+
+	memcpy(t->wav, "RIFF", 4);
+	put32(t->wav + 4, t->len - 8);
+	memcpy(t->wav + 8, "WAVEfmt ", 8);
+	put32(t->wav + 16, 16);
+	put16(t->wav + 20, WAV_FORMAT_PCM);
+	put16(t->wav + 22, 2);
+	put32(t->wav + 24, rate);
+	put32(t->wav + 28, rate * 4);
+	put16(t->wav + 32, 4);
+	put16(t->wav + 34, 16);
+	memcpy(t->wav + 36, "data", 4);
+	put32(t->wav + 40, data);
+
+	for (uint32_t i = 0; i < frames; i++) {
+		put16(t->wav + 44 + 4 * i, index);
+		put16(t->wav + 46 + 4 * i, i);
+	}
+}
+
+static int list_open(void *ctx, unsigned int track, struct wav_source *src, struct wav_info *info)
+{
+	struct list *l = ctx;
+
+	if (!l->repeat && track >= l->count)
+		return 1;
+
+	track %= l->count;
+
+	/* file open and header parsing on flash */
+	sleep_us(OPEN_US);
+
+	if ((int)track == l->open_fail)
+		return -1;
+
+	wav_source_mem(src, &l->mem, l->tracks[track].wav, l->tracks[track].len);
+	if (wav_read_header(src, info))
+		return -1;
+
+	l->opened++;
+	return 0;
+}
+
+static void list_close(void *ctx, unsigned int track)
+{
+	struct list *l = ctx;
+
+	(void)track;
+	l->opened--;
+}
+
+static int list_start(void *ctx, unsigned int track, const struct wav_info *info, struct wav_sink *sink)
+{
+	struct list *l = ctx;
+
+	l->started[l->nstarted] = track;
+	l->start_rate[l->nstarted++] = info->sample_rate;
+
+	/* 16-bit stereo goes to DMA as it is */
+	sink->ctx = l->dma;
+	sink->write = dma_write;
+
+	return 0;
+}
+
+static void list_played(void *ctx, unsigned int track, const struct playlist_track *t)
+{
+	struct list *l = ctx;
+
+	(void)track;
+	l->played[l->nplayed++] = *t;
+}
+
+static void list_init(struct list *l, struct dma_sink *dma, const uint32_t *frames, const uint32_t *rates,
+		      unsigned int count)
+{
+	memset(l, 0, sizeof(*l));
+	l->count = count;
+	l->open_fail = -1;
+	l->dma = dma;
+
+	for (unsigned int i = 0; i < count; i++)
+		make_track(&l->tracks[i], i, frames[i], rates[i]);
+
+	memset(dma, 0, sizeof(*dma));
+	dma->us_per_byte = 1e6 / (RATE * 4) / SPEEDUP;
+	dma->max = 0;
+	for (unsigned int i = 0; i < count; i++)
+		dma->max += frames[i] * 4;
+	dma->buf = malloc(dma->max);
+}
+
+static void list_free(struct list *l)
+{
+	for (unsigned int i = 0; i < l->count; i++)
+		free(l->tracks[i].wav);
+	free(l->dma->buf);
+}
+
+/* delivered data is the data chunks of the tracks back to back */
+static int list_data_ok(struct list *l, unsigned int count)
+{
+	size_t off = 0;
+
+	for (unsigned int i = 0; i < count; i++) {
+		size_t n = l->tracks[i].len - 44;
+
+		if (off + n > l->dma->len || memcmp(l->dma->buf + off, l->tracks[i].wav + 44, n))
+			return 0;
+		off += n;
+	}
+
+	return off == l->dma->len;
+}
+
+static const struct playlist_ops ops = {
+	.open = list_open,
+	.close = list_close,
+	.start = list_start,
+	.played = list_played,
+};
+
+static int gapless(void)
+{
+	static const uint32_t frames[] = { FRAMES, FRAMES, FRAMES };
+	static const uint32_t rates[] = { RATE, RATE, RATE };
+	struct playlist_ops o = ops;
+	struct playlist_stats stats;
+	struct dma_sink dma;
+	struct list l;
+	int fails = 0;
+	int ret;
+
+	list_init(&l, &dma, frames, rates, 3);
+	o.ctx = &l;
+
+	ret = playlist_play(&o, CHUNK, &stats);
+
+	if (ret || stats.tracks != 3 || l.nstarted != 3 || l.nplayed != 3 || l.opened || !list_data_ok(&l, 3))
+		fails++;
+
+	for (unsigned int i = 0; i < 3; i++)
+		if (l.started[i] != i || l.played[i].bytes != FRAMES * 4)
+			fails++;
+
+	if (dma.underrun_us > MAX_GAP_US)
+		fails++;
+
+	printf("{\"test\": \"playlist\", \"tracks\": %u, \"open_us\": %d, \"queue_us\": %d, "
+	       "\"gap_us\": [%lld, %lld], \"max_gap_us\": %lld, \"underrun_us\": %lld, \"status\": \"%s\"}\n",
+	       stats.tracks, OPEN_US, QUEUE_US, (long long)l.played[1].gap_us, (long long)l.played[2].gap_us,
+	       (long long)stats.max_gap_us, (long long)dma.underrun_us, fails ? "FAIL" : "PASS");
+
+	list_free(&l);
+
+	return fails;
+}
+
+/* the way main.c played clips before: open, play to the end, open the next one */
+static int sequential(void)
+{
+	static const uint32_t frames[] = { FRAMES, FRAMES, FRAMES };
+	static const uint32_t rates[] = { RATE, RATE, RATE };
+	struct player_stats stats;
+	struct wav_source src;
+	struct wav_sink sink;
+	struct wav_info info;
+	struct dma_sink dma;
+	struct list l;
+	int fails = 0;
+
+	list_init(&l, &dma, frames, rates, 3);
+
+	for (unsigned int i = 0; i < 3; i++) {
+		if (list_open(&l, i, &src, &info) || list_start(&l, i, &info, &sink) ||
+		    player_play(&src, info.data_size, &sink, CHUNK, &stats))
+			fails++;
+		list_close(&l, i);
+	}
+
+	/* queue is shorter than open time: it must run dry */
+	if (!list_data_ok(&l, 3) || dma.underrun_us < (OPEN_US - QUEUE_US) / 2)
+		fails++;
+
+	printf("{\"test\": \"sequential\", \"tracks\": 3, \"open_us\": %d, \"queue_us\": %d, "
+	       "\"underrun_us\": %lld, \"status\": \"%s\"}\n",
+	       OPEN_US, QUEUE_US, (long long)dma.underrun_us, fails ? "FAIL" : "PASS");
+
+	list_free(&l);
+
+	return fails;
+}
+
+/* rate change, empty track which is skipped, errors */
+static int edge_cases(void)
+{
+	static const uint32_t frames[] = { 1000, 0, 777, 1000 };
+	static const uint32_t empty[] = { 0, 0, 0 };
+	static const uint32_t rates[] = { RATE, RATE, 22050, RATE };
+	struct playlist_ops o = ops;
+	struct playlist_stats stats;
+	struct dma_sink dma;
+	struct list l;
+	int fails = 0;
+
+	list_init(&l, &dma, frames, rates, 4);
+	o.ctx = &l;
+
+	if (playlist_play(&o, CHUNK, &stats) || stats.tracks != 3 || l.opened || !list_data_ok(&l, 4) ||
+	    l.nstarted != 3 || l.started[1] != 2 || l.start_rate[1] != 22050 || l.started[2] != 3)
+		fails++;
+
+	/* open error: first track is played, then the list stops with an error */
+	dma.len = 0;
+	dma.started = 0;
+	l.open_fail = 1;
+	l.nstarted = l.nplayed = 0;
+	if (!playlist_play(&o, CHUNK, &stats) || stats.tracks != 1 || l.opened || !list_data_ok(&l, 1))
+		fails++;
+
+	/* sink error in the middle of the third track: opened track is closed */
+	dma.len = 0;
+	dma.started = 0;
+	dma.fail_at = 1000 * 4 + 777 * 4 + 100;
+	l.open_fail = -1;
+	if (!playlist_play(&o, 512, &stats) || stats.tracks != 2 || l.opened)
+		fails++;
+
+	/* block larger than the chunk: error, not a quiet end of the list */
+	dma.len = 0;
+	dma.started = 0;
+	dma.fail_at = 0;
+	l.nstarted = l.nplayed = 0;
+	if (!playlist_play(&o, 2, &stats) || stats.tracks || l.nstarted || l.opened || dma.len)
+		fails++;
+
+	printf("%-24s %s\n", "edge cases", fails ? "FAIL" : "PASS");
+
+	list_free(&l);
+
+	/* repeating list of empty tracks ends after one pass */
+	list_init(&l, &dma, empty, rates, 3);
+	l.repeat = 1;
+	o.count = 3;
+	if (playlist_play(&o, CHUNK, &stats) || stats.tracks || l.opened || dma.len)
+		fails++;
+
+	printf("%-24s %s\n", "empty repeating list", fails ? "FAIL" : "PASS");
+
+	list_free(&l);
+
+	return fails;
+}
+
+int main(void)
+{
+	int fails = 0;
+
+	fails += gapless();
+	fails += sequential();
+	fails += edge_cases();
+
+	fprintf(stderr, "%s\n", fails ? "FAILED" : "PASSED");
+	return fails ? 1 : 0;
+}
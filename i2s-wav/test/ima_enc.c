@@ -0,0 +1,166 @@
+/*
+ * Host side IMA ADPCM reference encoder: writes complete WAV files which
+ * the decoder and the player can take as they are.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "encoder.h"
+
+static const int step_table[89] = {
+	7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+	50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+	253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+	1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+	3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+	12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+static const int index_table[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+/* reference decoder, straight from IMA recommended practice */
+int16_t ima_ref_decode(struct ima_state *st, unsigned int nibble)
+{
+	int step = step_table[st->index];
+	int diff = step >> 3;
+
+	if (nibble & 4)
+		diff += step;
+	if (nibble & 2)
+		diff += step >> 1;
+	if (nibble & 1)
+		diff += step >> 2;
+
+	st->pred += (nibble & 8) ? -diff : diff;
+	if (st->pred > 32767)
+		st->pred = 32767;
+	if (st->pred < -32768)
+		st->pred = -32768;
+
+	st->index += index_table[nibble & 7];
+	if (st->index < 0)
+		st->index = 0;
+	if (st->index > 88)
+		st->index = 88;
+
+	return st->pred;
+}
+
+/* reference encoder: nibble which the decoder turns into the closest value */
+static unsigned int ref_encode(struct ima_state *st, int16_t sample)
+{
+	int step = step_table[st->index];
+	int diff = sample - st->pred;
+	unsigned int nibble = 0;
+
+	if (diff < 0) {
+		nibble = 8;
+		diff = -diff;
+	}
+
+	if (diff >= step) {
+		nibble |= 4;
+		diff -= step;
+	}
+	step >>= 1;
+	if (diff >= step) {
+		nibble |= 2;
+		diff -= step;
+	}
+	step >>= 1;
+	if (diff >= step)
+		nibble |= 1;
+
+	ima_ref_decode(st, nibble);
+
+	return nibble;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/* encode interleaved PCM into a complete IMA ADPCM WAV file */
+uint8_t *ima_adpcm_encode_wav(const int16_t *pcm, size_t frames, unsigned int ch, uint32_t rate,
+			      unsigned int align_per_ch, size_t *len)
+{
+	unsigned int align = align_per_ch * ch;
+	unsigned int spb = (align - 4 * ch) * 2 / ch + 1;
+	size_t blocks = (frames + spb - 1) / spb;
+	size_t hdr = 12 + 28 + 12 + 8;
+	struct ima_state st[8];
+	uint8_t *buf, *p;
+
+	/* last block is short: header and whole groups of the remaining frames */
+	size_t last = frames - (blocks - 1) * spb;
+	size_t data = (blocks - 1) * align + 4 * ch + (last - 1 + 7) / 8 * 4 * ch;
+
+	buf = calloc(1, hdr + data + 1);
+	if (!buf)
+		return NULL;
+
+	memcpy(buf, "RIFF", 4);
+	put32(buf + 4, hdr + data + (data & 1) - 8);
+	memcpy(buf + 8, "WAVEfmt ", 8);
+	put32(buf + 16, 20);
+	put16(buf + 20, WAV_FORMAT_IMA_ADPCM);
+	put16(buf + 22, ch);
+	put32(buf + 24, rate);
+	put32(buf + 28, (uint64_t)rate * align / spb);
+	put16(buf + 32, align);
+	put16(buf + 34, 4);
+	put16(buf + 36, 2);
+	put16(buf + 38, spb);
+	memcpy(buf + 40, "fact", 4);
+	put32(buf + 44, 4);
+	put32(buf + 48, frames);
+	memcpy(buf + 52, "data", 4);
+	put32(buf + 56, data);
+
+	p = buf + hdr;
+	memset(st, 0, sizeof(st));
+
+	for (size_t b = 0; b < blocks; b++) {
+		const int16_t *in = pcm + b * spb * ch;
+		size_t n = (b == blocks - 1) ? last : spb;
+		size_t groups = (n - 1 + 7) / 8;
+
+		for (unsigned int c = 0; c < ch; c++) {
+			st[c].pred = in[c];
+			put16(p + 4 * c, in[c]);
+			p[4 * c + 2] = st[c].index;
+			p[4 * c + 3] = 0;
+		}
+		p += 4 * ch;
+
+		for (size_t g = 0; g < groups; g++) {
+			for (unsigned int c = 0; c < ch; c++) {
+				for (unsigned int i = 0; i < 8; i++) {
+					size_t f = 1 + g * 8 + i;
+					/* pad the last group with the last sample */
+					int16_t s = in[((f < n) ? f : n - 1) * ch + c];
+					unsigned int nibble = ref_encode(&st[c], s);
+
+					p[c * 4 + i / 2] |= (i & 1) ? nibble << 4 : nibble;
+				}
+			}
+			p += 4 * ch;
+		}
+	}
+
+	*len = hdr + data;
+	return buf;
+}
@@ -0,0 +1,470 @@
+/*
+ * Sample bank and polyphonic mixer test:
+ * - bank images from the host writer, rejected headers, tables and offsets
+ * - mixer output bit for bit against a 64-bit reference with random
+ *   triggers, retriggers, stops and gains over odd render sizes
+ * - headroom and saturation with all voices at full scale
+ * - trigger from another thread starts the clip at a block boundary, at
+ *   most one block after the block in progress
+ * - cycles per output frame vs number of active voices, JSON lines
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "encoder.h"
+#include "host_test.h"
+
+#define CLIPS		8
+#define RATE		16000
+#define MARKER		0x5a5a
+#define BENCH_BLOCKS	2000
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(void)
+{
+	seed = seed * 1103515245 + 12345;
+	return seed >> 8;
+}
+
+static int16_t *make_clip(uint32_t frames, int full_scale)
+{
+	int16_t *pcm = malloc(frames * sizeof(*pcm) + 1);
+
+	for (uint32_t i = 0; i < frames; i++)
+		pcm[i] = full_scale ? ((i & 1) ? INT16_MIN : INT16_MAX) : (int16_t)rnd();
+
+	return pcm;
+}
+
+/* bank of clips with lengths around the block size, and an empty one */
+static uint8_t *make_bank(int16_t **clips, uint32_t *frames, size_t *len)
+{
+	static const uint32_t lens[CLIPS] = { 1, 239, 240, 241, 1000, 3001, 0, 17 };
+
+	for (unsigned int i = 0; i < CLIPS; i++) {
+		frames[i] = lens[i];
+		clips[i] = make_clip(lens[i], 0);
+	}
+
+	return bank_build((const int16_t *const *)clips, frames, CLIPS, RATE, len);
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static int check_bank(void)
+{
+	int16_t *clips[CLIPS];
+	uint32_t frames[CLIPS];
+	struct bank b;
+	uint32_t *copy;
+	uint8_t *image;
+	size_t len;
+	int fails = 0;
+
+	image = make_bank(clips, frames, &len);
+
+	/* aligned copy: bank_open() wants a word aligned image */
+	copy = malloc(len + 8);
+	memcpy(copy, image, len);
+
+	if (bank_open(&b, copy, len) || b.count != CLIPS || b.rate != RATE)
+		fails++;
+
+	for (unsigned int i = 0; !fails && i < CLIPS; i++) {
+		const int16_t *p;
+		uint32_t n;
+
+		p = bank_clip(&b, i, &n);
+		if (!p || n != frames[i] || memcmp(p, clips[i], n * sizeof(*p)))
+			fails++;
+	}
+
+	if (bank_clip(&b, CLIPS, &frames[0]))
+		fails++;
+
+	/* truncated image: last clip out of range, not only its padding */
+	if (!bank_open(&b, copy, len - 4) || b.count)
+		fails++;
+
+	/* misaligned image */
+	memmove((uint8_t *)copy + 2, image, len);
+	if (!bank_open(&b, (uint8_t *)copy + 2, len))
+		fails++;
+
+	/* header and table corruption */
+	for (int t = 0; t < 6; t++) {
+		uint8_t *p = (uint8_t *)copy;
+
+		memcpy(p, image, len);
+
+		switch (t) {
+		case 0:
+			p[0] = 'X';
+			break;
+		case 1:
+			p[4] = BANK_VERSION + 1;
+			break;
+		case 2:
+			p[6] = p[7] = 0;
+			break;
+		case 3:
+			p[6] = 0xff;
+			p[7] = 0xff;
+			break;
+		case 4:
+			put32(p + BANK_HDR_SIZE, 2);	/* offset inside the table */
+			break;
+		case 5:
+			put32(p + BANK_HDR_SIZE + 4 * 8 + 4, 0x7fffffff);	/* frames past the end */
+			break;
+		}
+
+		if (!bank_open(&b, p, len))
+			fails++;
+	}
+
+	if (!bank_open(&b, copy, BANK_HDR_SIZE - 1))
+		fails++;
+
+	printf("%-24s %s\n", "bank", fails ? "FAIL" : "PASS");
+
+	for (unsigned int i = 0; i < CLIPS; i++)
+		free(clips[i]);
+	free(image);
+	free(copy);
+
+	return fails;
+}
+
+/* reference: same command semantics, per-sample sum in 64 bits */
+struct ref_voice {
+	const int16_t *data;
+	uint32_t frames;
+	uint32_t pos;
+	int32_t gain;
+};
+
+static void ref_render(struct ref_voice *rv, unsigned int voices, unsigned int headroom, int16_t *out,
+		       size_t frames)
+{
+	for (size_t i = 0; i < frames; i++) {
+		int64_t acc = 0;
+
+		for (unsigned int v = 0; v < voices; v++) {
+			if (!rv[v].data)
+				continue;
+
+			acc += ((int32_t)rv[v].data[rv[v].pos] * rv[v].gain) >> 15;
+			if (++rv[v].pos == rv[v].frames)
+				rv[v].data = NULL;
+		}
+
+		if (headroom)
+			acc = (acc + (1 << (headroom - 1))) >> headroom;
+
+		out[i] = (acc > INT16_MAX) ? INT16_MAX : (acc < INT16_MIN) ? INT16_MIN : acc;
+	}
+}
+
+static int check_mix(unsigned int voices, unsigned int headroom)
+{
+	static struct mixer m;
+	struct ref_voice rv[MIXER_MAX_VOICES] = { 0 };
+	int16_t out[3 * MIXER_BLOCK], ref[3 * MIXER_BLOCK];
+	int16_t *clips[CLIPS];
+	uint32_t frames[CLIPS];
+	uint32_t *copy;
+	uint8_t *image;
+	struct bank b;
+	size_t len;
+	int fails = 0;
+
+	image = make_bank(clips, frames, &len);
+	copy = malloc(len);
+	memcpy(copy, image, len);
+
+	if (bank_open(&b, copy, len) || mixer_init(&m, &b, voices, headroom))
+		fails++;
+
+	for (int blk = 0; !fails && blk < 2000; blk++) {
+		size_t n = rnd() % (3 * MIXER_BLOCK) + 1;
+
+		/* a few commands per block, later ones replace pending ones */
+		for (unsigned int c = rnd() % 4; c; c--) {
+			unsigned int v = rnd() % voices;
+			unsigned int clip = rnd() % CLIPS;
+			int32_t g = rnd() % 0x14000 - 0x2000;
+
+			if (rnd() % 8 == 0) {
+				mixer_stop(&m, v);
+				rv[v].data = NULL;
+				continue;
+			}
+
+			if (mixer_trigger(&m, v, clip, g))
+				fails++;
+
+			rv[v].data = clips[clip];
+			rv[v].frames = frames[clip];
+			rv[v].pos = 0;
+			rv[v].gain = (g < 0) ? 0 : (g > MIXER_GAIN_MAX) ? MIXER_GAIN_MAX : g;
+			if (!frames[clip])
+				rv[v].data = NULL;
+		}
+
+		mixer_render(&m, out, n);
+		ref_render(rv, voices, headroom, ref, n);
+
+		if (memcmp(out, ref, n * sizeof(*out))) {
+			fprintf(stderr, "%u voices, headroom %u: block %d of %zu frames differs\n",
+				voices, headroom, blk, n);
+			fails++;
+		}
+	}
+
+	if (!mixer_trigger(&m, voices, 0, 0x8000) || !mixer_trigger(&m, 0, CLIPS, 0x8000))
+		fails++;
+
+	printf("{\"test\": \"mix\", \"voices\": %u, \"headroom\": %u, \"clipped\": %u, \"status\": \"%s\"}\n",
+	       voices, headroom, m.clipped, fails ? "FAIL" : "PASS");
+
+	for (unsigned int i = 0; i < CLIPS; i++)
+		free(clips[i]);
+	free(image);
+	free(copy);
+
+	return fails;
+}
+
+/* full-scale voices: saturate without headroom, exact with enough of it */
+static int check_saturation(void)
+{
+	static struct mixer m;
+	int16_t out[MIXER_BLOCK];
+	const int16_t *clips[1];
+	uint32_t frames = MIXER_BLOCK;
+	int16_t *pcm = make_clip(frames, 1);
+	uint32_t *copy;
+	uint8_t *image;
+	struct bank b;
+	size_t len;
+	int fails = 0;
+
+	clips[0] = pcm;
+	image = bank_build(clips, &frames, 1, RATE, &len);
+	copy = malloc(len);
+	memcpy(copy, image, len);
+
+	if (bank_open(&b, copy, len))
+		fails++;
+
+	for (unsigned int headroom = 0; !fails && headroom <= 4; headroom += 4) {
+		mixer_init(&m, &b, 16, headroom);
+		for (unsigned int v = 0; v < 16; v++)
+			mixer_trigger(&m, v, 0, 0x8000);
+
+		if (mixer_render(&m, out, MIXER_BLOCK) != 16)
+			fails++;
+
+		for (unsigned int i = 0; i < MIXER_BLOCK; i++) {
+			int32_t expect = headroom ? ((16 * pcm[i] + 8) >> 4) : (pcm[i] > 0) ? INT16_MAX : INT16_MIN;
+
+			if (out[i] != expect)
+				fails++;
+		}
+
+		if (headroom ? m.clipped != 0 : m.clipped != MIXER_BLOCK)
+			fails++;
+
+		/* clip is over: silence, nothing playing */
+		if (mixer_render(&m, out, MIXER_BLOCK) || out[0] || out[MIXER_BLOCK - 1])
+			fails++;
+	}
+
+	printf("%-24s %s\n", "saturation", fails ? "FAIL" : "PASS");
+
+	free(pcm);
+	free(image);
+	free(copy);
+
+	return fails;
+}
+
+/* trigger latency: render thread plays blocks back to back, another thread triggers */
+
+#define LATENCY_TRIGGERS 2000
+
+struct latency {
+	struct mixer m;
+	atomic_uint started;	/* index of the block being rendered */
+	atomic_uint seen;	/* block where the marker came out, +1 */
+	atomic_int done;
+	unsigned int misaligned;
+};
+
+static void *render_thread(void *arg)
+{
+	struct latency *l = arg;
+	int16_t out[MIXER_BLOCK];
+
+	for (unsigned int blk = 0; !atomic_load(&l->done); blk++) {
+		atomic_store(&l->started, blk);
+		mixer_render(&l->m, out, MIXER_BLOCK);
+
+		for (unsigned int i = 0; i < MIXER_BLOCK; i++) {
+			if (out[i] != MARKER)
+				continue;
+
+			if (i)
+				l->misaligned++;
+			atomic_store(&l->seen, blk + 1);
+		}
+	}
+
+	return NULL;
+}
+
+static int check_latency(void)
+{
+	static struct latency l;
+	unsigned int hist[3] = { 0 };
+	const int16_t *clips[1];
+	uint32_t frames = 4;
+	int16_t pcm[4] = { MARKER, 0, 0, 0 };
+	uint32_t *copy;
+	uint8_t *image;
+	struct bank b;
+	pthread_t tid;
+	size_t len;
+	int fails = 0;
+
+	clips[0] = pcm;
+	image = bank_build(clips, &frames, 1, RATE, &len);
+	copy = malloc(len);
+	memcpy(copy, image, len);
+
+	if (bank_open(&b, copy, len) || mixer_init(&l.m, &b, 16, 0))
+		return 1;
+
+	atomic_init(&l.started, 0);
+	atomic_init(&l.seen, 0);
+	atomic_init(&l.done, 0);
+
+	pthread_create(&tid, NULL, render_thread, &l);
+
+	for (int t = 0; t < LATENCY_TRIGGERS; t++) {
+		unsigned int s, seen;
+
+		for (unsigned int spin = rnd() % 20000; spin; spin--)
+			__asm__ volatile("" ::: "memory");
+
+		atomic_store(&l.seen, 0);
+		mixer_trigger(&l.m, rnd() % 16, 0, 0x8000);
+		s = atomic_load(&l.started);
+
+		while (!(seen = atomic_load(&l.seen)))
+			;
+
+		/* block in progress at trigger time, or the one after it */
+		seen--;
+		if (seen < s || seen > s + 1)
+			fails++;
+		else
+			hist[seen - s]++;
+	}
+
+	atomic_store(&l.done, 1);
+	pthread_join(tid, NULL);
+
+	if (l.misaligned)
+		fails++;
+
+	printf("{\"test\": \"latency\", \"triggers\": %d, \"same_block\": %u, \"next_block\": %u, "
+	       "\"max_blocks\": 1, \"status\": \"%s\"}\n",
+	       LATENCY_TRIGGERS, hist[0], hist[1], fails ? "FAIL" : "PASS");
+
+	free(image);
+	free(copy);
+
+	return fails;
+}
+
+/* all voices busy with long clips, each block renders every voice */
+static void bench(unsigned int voices)
+{
+	static struct mixer m;
+	const int16_t *clips[1];
+	uint32_t frames = BENCH_BLOCKS * MIXER_BLOCK;
+	int16_t *pcm = make_clip(frames, 0);
+	int16_t out[MIXER_BLOCK];
+	uint64_t best = UINT64_MAX;
+	uint32_t *copy;
+	uint8_t *image;
+	struct bank b;
+	size_t len;
+
+	clips[0] = pcm;
+	image = bank_build(clips, &frames, 1, RATE, &len);
+	copy = malloc(len);
+	memcpy(copy, image, len);
+
+	bank_open(&b, copy, len);
+
+	for (int r = 0; r < 5; r++) {
+		uint64_t start;
+
+		mixer_init(&m, &b, voices, 4);
+		for (unsigned int v = 0; v < voices; v++)
+			mixer_trigger(&m, v, 0, 0x4000);
+
+		start = cycles();
+		for (int blk = 0; blk < BENCH_BLOCKS; blk++)
+			mixer_render(&m, out, MIXER_BLOCK);
+		start = cycles() - start;
+
+		if (start < best)
+			best = start;
+	}
+
+	printf("{\"bench\": \"mixer\", \"voices\": %u, \"block\": %d, \"cycles_per_frame\": %.2f, "
+	       "\"cycles_per_voice_sample\": %.2f, \"cycles_per_block\": %.0f}\n",
+	       voices, MIXER_BLOCK, (double)best / (BENCH_BLOCKS * MIXER_BLOCK),
+	       (double)best / (BENCH_BLOCKS * MIXER_BLOCK * voices), (double)best / BENCH_BLOCKS);
+
+	free(pcm);
+	free(image);
+	free(copy);
+}
+
+int main(void)
+{
+	static const unsigned int counts[] = { 1, 2, 4, 8, 12, 16, 24, 32 };
+	int fails = 0;
+
+	fails += check_bank();
+
+	fails += check_mix(1, 0);
+	fails += check_mix(4, 2);
+	fails += check_mix(16, 4);
+	fails += check_mix(MIXER_MAX_VOICES, 0);
+
+	fails += check_saturation();
+	fails += check_latency();
+
+	for (size_t i = 0; i < sizeof(counts) / sizeof(counts[0]); i++)
+		bench(counts[i]);
+
+	return test_done(fails);
+}
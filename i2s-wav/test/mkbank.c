@@ -0,0 +1,124 @@
+/*
+ * Sample bank tool: packs 16-bit PCM WAV clips, or slices of them, into a
+ * bank image for the mixer. Stereo clips are mixed down to mono, all clips
+ * must have the same rate, e.g.
+ * ./mkbank ../data/sfx.bnk ../data/test.wav@0+400 ../data/test.wav@3000+250
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "encoder.h"
+
+static uint8_t *load(const char *path, size_t *len)
+{
+	uint8_t *image;
+	FILE *fd;
+	long n;
+
+	fd = fopen(path, "rb");
+	if (!fd)
+		return NULL;
+
+	fseek(fd, 0, SEEK_END);
+	n = ftell(fd);
+	rewind(fd);
+
+	image = malloc(n);
+	*len = fread(image, 1, n, fd);
+	fclose(fd);
+
+	return image;
+}
+
+int main(int argc, char **argv)
+{
+	const int16_t *clips[BANK_MAX_CLIPS];
+	uint32_t frames[BANK_MAX_CLIPS];
+	unsigned int count = 0;
+	uint32_t rate = 0;
+	size_t bank_len;
+	uint8_t *bank;
+	FILE *fd;
+
+	if (argc < 3 || argc - 2 > BANK_MAX_CLIPS) {
+		fprintf(stderr, "usage: %s output.bnk input.wav[@start_ms+len_ms] ...\n", argv[0]);
+		return 1;
+	}
+
+	for (int i = 2; i < argc; i++, count++) {
+		char *path = strdup(argv[i]);
+		char *slice = strchr(path, '@');
+		unsigned int start_ms = 0, len_ms = 0;
+		struct wav_info info;
+		uint32_t first, n;
+		uint8_t *image;
+		int16_t *pcm;
+		size_t len;
+
+		if (slice) {
+			*slice++ = 0;
+			if (sscanf(slice, "%u+%u", &start_ms, &len_ms) != 2) {
+				fprintf(stderr, "%s: bad slice, expected @start_ms+len_ms\n", argv[i]);
+				return 1;
+			}
+		}
+
+		image = load(path, &len);
+		if (!image || wav_parse(image, len, &info) || info.format != WAV_FORMAT_PCM ||
+		    info.bits_per_sample != 16 || info.channels > 2) {
+			fprintf(stderr, "%s: not a 16-bit PCM WAV file with up to 2 channels\n", path);
+			return 1;
+		}
+
+		if (rate && info.sample_rate != rate) {
+			fprintf(stderr, "%s: %u Hz, bank rate is %u Hz\n", path, info.sample_rate, rate);
+			return 1;
+		}
+
+		rate = info.sample_rate;
+		first = (uint64_t)start_ms * rate / 1000;
+		n = slice ? (uint64_t)len_ms * rate / 1000 : info.frames;
+
+		if (first > info.frames || n > info.frames - first) {
+			fprintf(stderr, "%s: slice is out of the clip\n", argv[i]);
+			return 1;
+		}
+
+		/* data chunk is not guaranteed to be aligned in the image */
+		pcm = malloc(n * info.channels * sizeof(*pcm));
+		memcpy(pcm, image + info.data_offset + first * info.block_align, n * info.block_align);
+
+		if (info.channels == 2)
+			convert_stereo_mono(pcm, pcm, n);
+
+		clips[count] = pcm;
+		frames[count] = n;
+
+		printf("clip %u: %s: %u frames, %u ms\n", count, argv[i], n, (unsigned int)((uint64_t)n * 1000 / rate));
+
+		free(image);
+		free(path);
+	}
+
+	bank = bank_build(clips, frames, count, rate, &bank_len);
+
+	fd = fopen(argv[1], "wb");
+	if (!bank || !fd || fwrite(bank, 1, bank_len, fd) != bank_len) {
+		fprintf(stderr, "failed to write %s\n", argv[1]);
+		return 1;
+	}
+
+	fclose(fd);
+
+	printf("%s: %u clips at %u Hz, %zu bytes\n", argv[1], count, rate, bank_len);
+
+	for (unsigned int i = 0; i < count; i++)
+		free((void *)clips[i]);
+	free(bank);
+
+	return 0;
+}
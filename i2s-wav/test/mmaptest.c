@@ -0,0 +1,479 @@
+/*
+ * Memory-mapped playback test with a stub flash MMU: each mapping is a
+ * fresh copy of the partition range, poisoned and freed on unmap, so a
+ * sink which is handed a pointer outside of a live mapping reads garbage
+ * (or trips ASan), and the sink checks every buffer it gets lies inside
+ * one of the live windows, i.e. nothing is copied on the way.
+ * - WAV PCM, raw PCM, ADPCM with blocks straddling window pages, QOA
+ *   through the decoder sink, data over many pages, empty and tiny clips
+ * - map offsets are page aligned, at most two windows live at a time,
+ *   all of them are released, also after map and sink errors
+ * - cost per byte compared with the double-buffered player, JSON lines
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "encoder.h"
+#include "port.h"
+
+#define MAX_MAPS	4
+#define CHUNK		4096
+
+struct stub_map {
+	const uint8_t *buf;	/* not mapped */
+	size_t offset;
+	size_t len;
+};
+
+struct stub_flash {
+	const uint8_t *flash;
+	size_t size;
+	struct stub_map maps[MAX_MAPS];
+	unsigned int live;
+	unsigned int max_live;
+	unsigned int total;
+	unsigned int fail_at;	/* fail this map call, 0 - never */
+	int errors;
+};
+
+static const void *stub_map(void *ctx, size_t offset, size_t len, uint32_t *handle)
+{
+	struct stub_flash *f = ctx;
+	uint8_t *buf;
+
+	f->total++;
+	if (f->fail_at && f->total == f->fail_at)
+		return NULL;
+
+	if (offset % MMAP_PAGE || offset + len > f->size || !len)
+		f->errors++;
+
+	for (unsigned int i = 0; i < MAX_MAPS; i++) {
+		if (f->maps[i].buf)
+			continue;
+
+		buf = malloc(len);
+		memcpy(buf, f->flash + offset, len);
+
+		f->maps[i] = (struct stub_map){ buf, offset, len };
+		if (++f->live > f->max_live)
+			f->max_live = f->live;
+
+		*handle = i;
+		return buf;
+	}
+
+	f->errors++;
+	return NULL;
+}
+
+static void stub_unmap(void *ctx, uint32_t handle)
+{
+	struct stub_flash *f = ctx;
+	struct stub_map *m = &f->maps[handle];
+
+	if (handle >= MAX_MAPS || !m->buf) {
+		f->errors++;
+		return;
+	}
+
+	memset((void *)m->buf, 0xa5, m->len);
+	free((void *)m->buf);
+	m->buf = NULL;
+	f->live--;
+}
+
+static void stub_init(struct stub_flash *f, struct flash_map *fm, const uint8_t *flash, size_t size)
+{
+	memset(f, 0, sizeof(*f));
+	f->flash = flash;
+	f->size = size;
+
+	fm->ctx = f;
+	fm->size = size;
+	fm->map = stub_map;
+	fm->unmap = stub_unmap;
+}
+
+/* sink: buffers must be inside a live mapping, data is collected */
+struct capture {
+	struct stub_flash *flash;
+	uint8_t *buf;
+	size_t len;
+	size_t max;
+	size_t align;		/* every write is a multiple of it, except the last */
+	int misaligned;
+	int copied;
+	size_t fail_at;
+};
+
+static int capture_write(void *ctx, const void *buf, size_t len)
+{
+	struct capture *c = ctx;
+	const uint8_t *p = buf;
+	int inside = 0;
+
+	if (c->fail_at && c->len + len > c->fail_at)
+		return -1;
+
+	for (unsigned int i = 0; i < MAX_MAPS; i++) {
+		const struct stub_map *m = &c->flash->maps[i];
+
+		if (m->buf && p >= m->buf && p + len <= m->buf + m->len)
+			inside = 1;
+	}
+
+	if (!inside)
+		c->copied++;
+
+	if (c->align && c->len % c->align)
+		c->misaligned++;
+
+	if (c->len + len <= c->max)
+		memcpy(c->buf + c->len, buf, len);
+	c->len += len;
+
+	return 0;
+}
+
+/* decoded output, for compressed clips */
+static int pcm_write(void *ctx, const void *buf, size_t len)
+{
+	struct capture *c = ctx;
+
+	if (c->len + len <= c->max)
+		memcpy(c->buf + c->len, buf, len);
+	c->len += len;
+
+	return 0;
+}
+
+static void put16(uint8_t *p, uint16_t v)
+{
+	p[0] = v;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v)
+{
+	put16(p, v);
+	put16(p + 2, v >> 16);
+}
+
+static size_t make_wav(uint8_t *p, const int16_t *pcm, uint32_t frames, unsigned int ch, uint32_t rate)
+{
+	uint32_t data = frames * ch * 2;
+
+	memcpy(p, "RIFF", 4);
+	put32(p + 4, 36 + data);
+	memcpy(p + 8, "WAVEfmt ", 8);
+	put32(p + 16, 16);
+	put16(p + 20, WAV_FORMAT_PCM);
+	put16(p + 22, ch);
+	put32(p + 24, rate);
+	put32(p + 28, rate * ch * 2);
+	put16(p + 32, ch * 2);
+	put16(p + 34, 16);
+	memcpy(p + 36, "data", 4);
+	put32(p + 40, data);
+	memcpy(p + 44, pcm, data);
+
+	return 44 + data;
+}
+
+static void make_pcm(int16_t *pcm, size_t n)
+{
+	uint32_t x = 1;
+
+	for (size_t i = 0; i < n; i++) {
+		x = x * 1103515245 + 12345;
+		pcm[i] = (int16_t)(x >> 16) / 4 + (int16_t)(8000 * ((i / 37) % 5) - 16000);
+	}
+}
+
+static const struct wav_info raw_info = {
+	.format = WAV_FORMAT_PCM,
+	.channels = 1,
+	.sample_rate = 16000,
+	.byte_rate = 32000,
+	.block_align = 2,
+	.bits_per_sample = 16,
+};
+
+static int done(struct stub_flash *f)
+{
+	return !f->live && !f->errors && f->max_live <= 2;
+}
+
+/* PCM clip: sink gets mapped flash, content and write alignment are exact */
+static int check_pcm(const char *name, const uint8_t *flash, size_t size, const uint8_t *data, size_t len,
+		     size_t align, size_t chunk)
+{
+	struct capture cap = { .buf = malloc(size), .max = size, .align = align };
+	struct wav_sink sink = { .ctx = &cap, .write = capture_write };
+	struct mmap_stats stats;
+	struct stub_flash f;
+	struct flash_map fm;
+	struct wav_info info;
+	int fails = 0;
+
+	stub_init(&f, &fm, flash, size);
+	cap.flash = &f;
+
+	if (mmap_read_header(&fm, &raw_info, &info) || mmap_play(&fm, &info, &sink, chunk, &stats))
+		fails++;
+	else if (cap.len != len || memcmp(cap.buf, data, len) || stats.bytes != len)
+		fails++;
+
+	if (cap.copied || cap.misaligned || !done(&f))
+		fails++;
+
+	printf("%-10s size %7zu data %7zu align %4zu chunk %5zu: %3u maps %4u writes, max live %u: %s\n",
+	       name, size, len, align, chunk, stats.maps, stats.writes, f.max_live, fails ? "FAIL" : "PASS");
+
+	free(cap.buf);
+
+	return fails;
+}
+
+/* ADPCM: odd block size makes blocks cross window pages, decoded output is exact */
+static int check_adpcm(void)
+{
+	enum { FRAMES = 200000, CH = 2, ALIGN = 1000 };
+	int16_t *pcm = malloc(FRAMES * CH * sizeof(*pcm));
+	struct capture cap = { .max = FRAMES * CH * 2 + 4096 };
+	struct wav_sink out = { .ctx = &cap, .write = pcm_write };
+	struct wav_sink sink;
+	struct ima_adpcm_sink adpcm;
+	struct mmap_stats stats;
+	struct stub_flash f;
+	struct flash_map fm;
+	struct wav_info info;
+	struct wav_source src;
+	struct wav_mem mem;
+	struct capture ref = { .max = cap.max };
+	struct wav_sink ref_out = { .ctx = &ref, .write = pcm_write };
+	struct ima_adpcm_sink ref_adpcm;
+	struct wav_sink ref_sink;
+	size_t len;
+	uint8_t *wav;
+	int fails = 0;
+
+	make_pcm(pcm, FRAMES * CH);
+	wav = ima_adpcm_encode_wav(pcm, FRAMES, CH, 16000, ALIGN / CH, &len);
+	cap.buf = malloc(cap.max);
+	ref.buf = malloc(ref.max);
+
+	/* reference: whole file decoded in one write */
+	wav_source_mem(&src, &mem, wav, len);
+	if (wav_read_header(&src, &info) || ima_adpcm_sink_init(&ref_adpcm, &info, &ref_out, &ref_sink) ||
+	    ref_sink.write(ref_sink.ctx, wav + info.data_offset, info.data_size))
+		fails++;
+
+	stub_init(&f, &fm, wav, len);
+	if (mmap_read_header(&fm, &raw_info, &info) || info.block_align != ALIGN ||
+	    ima_adpcm_sink_init(&adpcm, &info, &out, &sink) || mmap_play(&fm, &info, &sink, CHUNK, &stats))
+		fails++;
+	else if (cap.len != ref.len || memcmp(cap.buf, ref.buf, ref.len))
+		fails++;
+
+	if (!done(&f))
+		fails++;
+
+	printf("%-10s size %7zu align %4u: %3u maps %4u writes, max live %u: %s\n",
+	       "adpcm", len, ALIGN, stats.maps, stats.writes, f.max_live, fails ? "FAIL" : "PASS");
+
+	ima_adpcm_sink_deinit(&adpcm);
+	ima_adpcm_sink_deinit(&ref_adpcm);
+	free(cap.buf);
+	free(ref.buf);
+	free(wav);
+	free(pcm);
+
+	return fails;
+}
+
+/* QOA: header with the first frame header, then frames through the decoder */
+static int check_qoa(void)
+{
+	enum { FRAMES = 100000, CH = 2 };
+	int16_t *pcm = malloc(FRAMES * CH * sizeof(*pcm));
+	struct capture cap = { .max = FRAMES * CH * 2 };
+	struct capture ref = { .max = FRAMES * CH * 2 };
+	struct wav_sink out = { .ctx = &cap, .write = pcm_write };
+	struct wav_sink ref_out = { .ctx = &ref, .write = pcm_write };
+	struct qoa_sink qoa, ref_qoa;
+	struct wav_sink sink, ref_sink;
+	struct mmap_stats stats;
+	struct stub_flash f;
+	struct flash_map fm;
+	struct wav_info info;
+	struct wav_source src;
+	struct wav_mem mem;
+	uint8_t *file;
+	size_t len;
+	int fails = 0;
+
+	make_pcm(pcm, FRAMES * CH);
+	file = qoa_encode(pcm, FRAMES, CH, 16000, &len);
+	cap.buf = malloc(cap.max);
+	ref.buf = malloc(ref.max);
+
+	wav_source_mem(&src, &mem, file, len);
+	if (qoa_read_header(&src, &info) || qoa_sink_init(&ref_qoa, &info, &ref_out, &ref_sink) ||
+	    ref_sink.write(ref_sink.ctx, file + info.data_offset, info.data_size))
+		fails++;
+
+	stub_init(&f, &fm, file, len);
+	if (mmap_read_header(&fm, &raw_info, &info) || info.format != WAV_FORMAT_QOA ||
+	    qoa_sink_init(&qoa, &info, &out, &sink) || mmap_play(&fm, &info, &sink, CHUNK, &stats))
+		fails++;
+	else if (cap.len != FRAMES * CH * 2 || ref.len != cap.len || memcmp(cap.buf, ref.buf, ref.len))
+		fails++;
+
+	if (!done(&f))
+		fails++;
+
+	printf("%-10s size %7zu: %3u maps %4u writes, max live %u: %s\n",
+	       "qoa", len, stats.maps, stats.writes, f.max_live, fails ? "FAIL" : "PASS");
+
+	qoa_sink_deinit(&qoa);
+	qoa_sink_deinit(&ref_qoa);
+	free(cap.buf);
+	free(ref.buf);
+	free(file);
+	free(pcm);
+
+	return fails;
+}
+
+/* map failure at each window, sink failure, bad headers: all mappings released */
+static int check_errors(const uint8_t *flash, size_t size)
+{
+	struct capture cap = { .buf = NULL, .max = 0 };
+	struct wav_sink sink = { .ctx = &cap, .write = capture_write };
+	struct mmap_stats stats;
+	struct stub_flash f;
+	struct flash_map fm;
+	struct wav_info info;
+	uint8_t bad[64];
+	int fails = 0;
+
+	stub_init(&f, &fm, flash, size);
+	cap.flash = &f;
+	if (mmap_read_header(&fm, &raw_info, &info))
+		fails++;
+
+	for (unsigned int n = 1; n <= 4; n++) {
+		stub_init(&f, &fm, flash, size);
+		f.fail_at = n;
+		cap.len = 0;
+		if (!mmap_play(&fm, &info, &sink, CHUNK, &stats) || f.live || f.errors)
+			fails++;
+	}
+
+	stub_init(&f, &fm, flash, size);
+	cap.len = 0;
+	cap.fail_at = 3 * MMAP_PAGE + 100;
+	if (!mmap_play(&fm, &info, &sink, CHUNK, &stats) || f.live || f.errors)
+		fails++;
+
+	/* RIFF magic with a broken header is an error, not raw audio */
+	memset(bad, 0, sizeof(bad));
+	memcpy(bad, "RIFF", 4);
+	stub_init(&f, &fm, bad, sizeof(bad));
+	if (!mmap_read_header(&fm, &raw_info, &info) || f.live)
+		fails++;
+
+	/* empty partition */
+	stub_init(&f, &fm, bad, 0);
+	if (!mmap_read_header(&fm, &raw_info, &info) || f.total)
+		fails++;
+
+	printf("%-24s %s\n", "errors", fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+/* mapping costs nothing here: this is the loop overhead vs copying through player buffers */
+static void bench(const uint8_t *flash, size_t size)
+{
+	struct capture cap = { .buf = NULL, .max = 0 };
+	struct wav_sink sink = { .ctx = &cap, .write = capture_write };
+	struct player_stats pstats;
+	struct mmap_stats stats;
+	struct stub_flash f;
+	struct flash_map fm;
+	struct wav_info info;
+	struct wav_source src;
+	struct wav_mem mem;
+	int64_t best_mmap = INT64_MAX, best_player = INT64_MAX;
+
+	for (int r = 0; r < 5; r++) {
+		stub_init(&f, &fm, flash, size);
+		cap.flash = &f;
+		cap.len = 0;
+		mmap_read_header(&fm, &raw_info, &info);
+		mmap_play(&fm, &info, &sink, CHUNK, &stats);
+		if (stats.total_us < best_mmap)
+			best_mmap = stats.total_us;
+
+		wav_source_mem(&src, &mem, flash, size);
+		wav_read_header(&src, &info);
+		player_play(&src, info.data_size, &(struct wav_sink){ .ctx = &cap, .write = pcm_write },
+			    CHUNK, &pstats);
+		if (pstats.total_us < best_player)
+			best_player = pstats.total_us;
+	}
+
+	printf("{\"bench\": \"mmap\", \"bytes\": %u, \"maps\": %u, \"mmap_us\": %lld, \"player_us\": %lld}\n",
+	       stats.bytes, stats.maps, (long long)best_mmap, (long long)best_player);
+}
+
+int main(void)
+{
+	enum { FRAMES = 300000 };
+	int16_t *pcm = malloc(FRAMES * 2 * sizeof(*pcm));
+	uint8_t *wav = malloc(44 + FRAMES * 4);
+	size_t len;
+	int fails = 0;
+
+	make_pcm(pcm, FRAMES * 2);
+
+	/* stereo over 18 pages, chunk sizes which do and do not divide the page */
+	len = make_wav(wav, pcm, FRAMES, 2, 16000);
+	fails += check_pcm("wav", wav, len, wav + 44, len - 44, 4, CHUNK);
+	fails += check_pcm("wav", wav, len, wav + 44, len - 44, 4, 1000);
+	fails += check_pcm("wav", wav, len, wav + 44, len - 44, 4, 100000);
+
+	/* header claims more than the partition has: data up to the end */
+	fails += check_pcm("truncated", wav, 3 * MMAP_PAGE + 6, wav + 44, 3 * MMAP_PAGE + 6 - 44, 4, CHUNK);
+
+	/* short clips: inside the first window, empty */
+	len = make_wav(wav, pcm, 10, 2, 16000);
+	fails += check_pcm("short", wav, len, wav + 44, 40, 4, CHUNK);
+	len = make_wav(wav, pcm, 0, 2, 16000);
+	fails += check_pcm("empty", wav, len, wav + 44, 0, 4, CHUNK);
+
+	/* raw: whole partition, odd trailing byte dropped */
+	fails += check_pcm("raw", (uint8_t *)pcm, 5 * MMAP_PAGE + 1, (uint8_t *)pcm, 5 * MMAP_PAGE, 2, CHUNK);
+	fails += check_pcm("raw", (uint8_t *)pcm, 3, (uint8_t *)pcm, 2, 2, CHUNK);
+
+	fails += check_adpcm();
+	fails += check_qoa();
+
+	len = make_wav(wav, pcm, FRAMES, 2, 16000);
+	fails += check_errors(wav, len);
+
+	bench(wav, len);
+
+	free(wav);
+	free(pcm);
+
+	fprintf(stderr, "%s\n", fails ? "FAILED" : "PASSED");
+	return fails ? 1 : 0;
+}
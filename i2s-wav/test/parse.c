@@ -0,0 +1,352 @@
+/*
+ * WAV parser test: synthetic files with various chunk layouts are parsed
+ * both from memory and through a byte source, results are compared with
+ * expected layout. Also checks data/test.wav which has LIST before data.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "common.h"
+
+#define WAV_FILE "../data/test.wav"
+
+struct file {
+	uint8_t buf[512];
+	size_t len;
+};
+
+static void put(struct file *f, const void *p, size_t n)
+{
+	memcpy(f->buf + f->len, p, n);
+	f->len += n;
+}
+
+static void put16(struct file *f, uint16_t v)
+{
+	uint8_t b[2] = { v, v >> 8 };
+
+	put(f, b, 2);
+}
+
+static void put32(struct file *f, uint32_t v)
+{
+	uint8_t b[4] = { v, v >> 8, v >> 16, v >> 24 };
+
+	put(f, b, 4);
+}
+
+static void riff(struct file *f)
+{
+	f->len = 0;
+	put(f, "RIFF", 4);
+	put32(f, 0);
+	put(f, "WAVE", 4);
+}
+
+static void riff_size(struct file *f)
+{
+	uint32_t size = f->len - 8;
+
+	memcpy(f->buf + 4, (uint8_t[]){ size, size >> 8, size >> 16, size >> 24 }, 4);
+}
+
+static void chunk(struct file *f, const char *id, const void *p, uint32_t n)
+{
+	put(f, id, 4);
+	put32(f, n);
+	put(f, p, n);
+	if (n & 1)
+		put(f, "", 1);
+}
+
+static void fmt(struct file *f, uint16_t format, uint16_t channels, uint32_t rate, uint16_t bits)
+{
+	uint16_t align = channels * ((bits + 7) / 8);
+
+	put(f, "fmt ", 4);
+	put32(f, 16);
+	put16(f, format);
+	put16(f, channels);
+	put32(f, rate);
+	put32(f, rate * align);
+	put16(f, align);
+	put16(f, bits);
+}
+
+static void fmt_ext(struct file *f, uint16_t subformat, uint16_t channels, uint32_t rate, uint16_t bits)
+{
+	uint16_t align = channels * bits / 8;
+
+	put(f, "fmt ", 4);
+	put32(f, 40);
+	put16(f, WAV_FORMAT_EXTENSIBLE);
+	put16(f, channels);
+	put32(f, rate);
+	put32(f, rate * align);
+	put16(f, align);
+	put16(f, bits);
+	put16(f, 22);
+	put16(f, bits);
+	put32(f, 0x3);
+	put16(f, subformat);
+	put(f, "\x00\x00\x00\x00\x10\x00\x80\x00\x00\xAA\x00\x38\x9B\x71", 14);
+}
+
+static void data(struct file *f, uint32_t n)
+{
+	uint8_t pcm[256];
+
+	for (unsigned int i = 0; i < sizeof(pcm); i++)
+		pcm[i] = i;
+
+	chunk(f, "data", pcm, n);
+}
+
+/* expected result, mem and stream parsers may differ only where a byte source can not seek back */
+struct expect {
+	int mem;
+	int stream;
+	uint16_t format;
+	uint16_t channels;
+	uint16_t bits;
+	size_t offset;
+	uint32_t size;
+	uint32_t fact;
+	uint32_t stream_size;	/* length is unknown to byte source, 0 - same as size */
+};
+
+static int check_info(const char *name, const char *kind, int ret, int exp,
+		      const struct wav_info *info, const struct expect *e, uint32_t size)
+{
+	if (ret != exp) {
+		printf("%-24s %s: ret %d expected %d: FAIL\n", name, kind, ret, exp);
+		return 1;
+	}
+
+	if (ret)
+		return 0;
+
+	if (info->format != e->format || info->channels != e->channels ||
+	    info->bits_per_sample != e->bits || info->data_offset != e->offset ||
+	    info->data_size != size || info->fact_frames != e->fact ||
+	    info->frames != info->data_size / info->block_align) {
+		printf("%-24s %s: format %u channels %u bits %u offset %zu size %u fact %u: FAIL\n",
+		       name, kind, info->format, info->channels, info->bits_per_sample,
+		       info->data_offset, info->data_size, info->fact_frames);
+		return 1;
+	}
+
+	return 0;
+}
+
+static int check(const char *name, const uint8_t *file, size_t len, const struct expect *e)
+{
+	uint8_t *buf = malloc(len ? len : 1);
+	struct wav_info info;
+	struct wav_source src;
+	struct wav_mem m;
+	int fails = 0;
+
+	/* exact size copy: out of bounds reads are visible with sanitizers */
+	memcpy(buf, file, len);
+
+	fails += check_info(name, "mem", wav_parse(buf, len, &info), e->mem, &info, e, e->size);
+
+	wav_source_mem(&src, &m, buf, len);
+	fails += check_info(name, "stream", wav_read_header(&src, &info), e->stream, &info, e,
+			    e->stream_size ? e->stream_size : e->size);
+
+	/* stream is left at the start of audio data */
+	if (!e->stream && m.pos != e->offset) {
+		printf("%-24s stream: position %zu expected %zu: FAIL\n", name, m.pos, e->offset);
+		fails++;
+	}
+
+	printf("%-24s %s\n", name, fails ? "FAIL" : "PASS");
+	free(buf);
+
+	return fails;
+}
+
+int main(void)
+{
+	struct file f;
+	int fails = 0;
+	FILE *fd;
+
+	/* canonical 44 byte header */
+	riff(&f);
+	fmt(&f, WAV_FORMAT_PCM, 2, 44100, 16);
+	data(&f, 64);
+	riff_size(&f);
+	fails += check("canonical", f.buf, f.len,
+		       &(struct expect){ 0, 0, WAV_FORMAT_PCM, 2, 16, 44, 64, 0 });
+
+	/* odd sized LIST chunk with padding, fact chunk */
+	riff(&f);
+	chunk(&f, "LIST", "INFOISFT\x01\x00\x00\x00x", 13);
+	fmt(&f, WAV_FORMAT_PCM, 1, 8000, 8);
+	chunk(&f, "fact", "\x21\x00\x00\x00", 4);
+	data(&f, 33);
+	riff_size(&f);
+	fails += check("odd chunk and fact", f.buf, f.len,
+		       &(struct expect){ 0, 0, WAV_FORMAT_PCM, 1, 8, 78, 33, 33 });
+
+	/* data before fmt: byte source can not go back */
+	riff(&f);
+	data(&f, 16);
+	fmt(&f, WAV_FORMAT_PCM, 1, 16000, 16);
+	riff_size(&f);
+	fails += check("data before fmt", f.buf, f.len,
+		       &(struct expect){ 0, -1, WAV_FORMAT_PCM, 1, 16, 20, 16, 0 });
+
+	/* extensible 24 bit */
+	riff(&f);
+	fmt_ext(&f, WAV_FORMAT_PCM, 2, 48000, 24);
+	data(&f, 60);
+	riff_size(&f);
+	fails += check("extensible", f.buf, f.len,
+		       &(struct expect){ 0, 0, WAV_FORMAT_PCM, 2, 24, 68, 60, 0 });
+
+	/* ima adpcm: 20 byte fmt with samples per block */
+	riff(&f);
+	put(&f, "fmt ", 4);
+	put32(&f, 20);
+	put16(&f, WAV_FORMAT_IMA_ADPCM);
+	put16(&f, 1);
+	put32(&f, 16000);
+	put32(&f, 8110);
+	put16(&f, 512);
+	put16(&f, 4);
+	put16(&f, 2);
+	put16(&f, 1017);
+	data(&f, 64);
+	riff_size(&f);
+	fails += check("ima adpcm", f.buf, f.len,
+		       &(struct expect){ 0, 0, WAV_FORMAT_IMA_ADPCM, 1, 4, 48, 64, 0 });
+
+	/* ima adpcm with samples per block not matching block size */
+	f.buf[38] = 0;
+	fails += check("ima adpcm bad block", f.buf, f.len, &(struct expect){ -1, -1 });
+
+	/* float */
+	riff(&f);
+	fmt(&f, WAV_FORMAT_FLOAT, 1, 48000, 32);
+	data(&f, 64);
+	riff_size(&f);
+	fails += check("float", f.buf, f.len,
+		       &(struct expect){ 0, 0, WAV_FORMAT_FLOAT, 1, 32, 44, 64, 0 });
+
+	/* streaming encoders: zero RIFF size and data size are unknown, memory parser clamps to file */
+	riff(&f);
+	fmt(&f, WAV_FORMAT_PCM, 1, 16000, 16);
+	put(&f, "data", 4);
+	put32(&f, 0xFFFFFFFF);
+	put(&f, "abcdefgh", 8);
+	fails += check("streamed, no sizes", f.buf, f.len,
+		       &(struct expect){ 0, 0, WAV_FORMAT_PCM, 1, 16, 44, 8, 0, 0xFFFFFFFF });
+
+	/* truncated data chunk: memory parser clamps to file length, byte source trusts RIFF size */
+	riff(&f);
+	fmt(&f, WAV_FORMAT_PCM, 1, 16000, 16);
+	data(&f, 64);
+	riff_size(&f);
+	f.len -= 16;
+	fails += check("truncated data", f.buf, f.len,
+		       &(struct expect){ 0, 0, WAV_FORMAT_PCM, 1, 16, 44, 64 - 16, 0, 64 });
+
+	/* no padding byte after the last odd chunk */
+	riff(&f);
+	fmt(&f, WAV_FORMAT_PCM, 1, 16000, 8);
+	data(&f, 15);
+	f.len--;
+	riff_size(&f);
+	fails += check("missing pad", f.buf, f.len,
+		       &(struct expect){ 0, 0, WAV_FORMAT_PCM, 1, 8, 44, 15, 0 });
+
+	/* malformed files */
+	riff(&f);
+	memcpy(f.buf + 8, "AVI ", 4);
+	fmt(&f, WAV_FORMAT_PCM, 1, 16000, 16);
+	data(&f, 16);
+	fails += check("not wave", f.buf, f.len, &(struct expect){ -1, -1 });
+
+	riff(&f);
+	fmt(&f, WAV_FORMAT_PCM, 1, 16000, 16);
+	fails += check("no data", f.buf, f.len, &(struct expect){ -1, -1 });
+
+	riff(&f);
+	data(&f, 16);
+	fails += check("no fmt", f.buf, f.len, &(struct expect){ -1, -1 });
+
+	riff(&f);
+	fmt(&f, WAV_FORMAT_PCM, 0, 16000, 16);
+	data(&f, 16);
+	fails += check("zero channels", f.buf, f.len, &(struct expect){ -1, -1 });
+
+	riff(&f);
+	fmt(&f, WAV_FORMAT_PCM, 2, 16000, 16);
+	f.buf[32] = 3; /* block align */
+	data(&f, 16);
+	fails += check("bad block align", f.buf, f.len, &(struct expect){ -1, -1 });
+
+	riff(&f);
+	chunk(&f, "fmt ", "\x01\x00\x01\x00", 4);
+	data(&f, 16);
+	fails += check("short fmt", f.buf, f.len, &(struct expect){ -1, -1 });
+
+	riff(&f);
+	put(&f, "LIST", 4);
+	put32(&f, 0xFFFFFFF0);
+	fmt(&f, WAV_FORMAT_PCM, 1, 16000, 16);
+	data(&f, 16);
+	fails += check("oversized chunk", f.buf, f.len, &(struct expect){ -1, -1 });
+
+	riff(&f);
+	fmt(&f, WAV_FORMAT_PCM, 1, 16000, 16);
+	fmt(&f, WAV_FORMAT_PCM, 1, 16000, 16);
+	data(&f, 16);
+	fails += check("duplicate fmt", f.buf, f.len, &(struct expect){ -1, -1 });
+
+	/* RIFF size smaller than WAVE id: found by fuzzer */
+	riff(&f);
+	chunk(&f, "fact", "\x02\x00\x00\x00", 4);
+	f.buf[4] = 2;
+	fails += check("tiny riff size", f.buf, f.len - 3, &(struct expect){ -1, -1 });
+
+	fails += check("empty", f.buf, 0, &(struct expect){ -1, -1 });
+	fails += check("short riff", f.buf, 10, &(struct expect){ -1, -1 });
+
+	/* real file: LIST chunk between fmt and data */
+	fd = fopen(WAV_FILE, "rb");
+	if (fd) {
+		struct wav_source src;
+		struct wav_info a, b;
+		static uint8_t image[1 << 20];
+		size_t len = fread(image, 1, sizeof(image), fd);
+
+		rewind(fd);
+		wav_source_file(&src, fd);
+
+		if (wav_parse(image, len, &a) || wav_read_header(&src, &b) ||
+		    memcmp(&a, &b, sizeof(a)) || a.data_offset + a.data_size != len ||
+		    ftell(fd) != (long)a.data_offset) {
+			printf("%-24s FAIL\n", WAV_FILE);
+			fails++;
+		} else {
+			printf("%-24s PASS: %u Hz %u ch %u bit, %u frames at %zu\n", WAV_FILE,
+			       a.sample_rate, a.channels, a.bits_per_sample, a.frames, a.data_offset);
+		}
+
+		fclose(fd);
+	} else {
+		printf("failed to open %s\n", WAV_FILE);
+		fails++;
+	}
+
+	printf("%s\n", fails ? "FAILED" : "PASSED");
+	return fails ? 1 : 0;
+}
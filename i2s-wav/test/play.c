@@ -0,0 +1,168 @@
+/*
+ * Streaming player test: plays data/test.wav from a file source into a stub
+ * sink with different chunk sizes. Sink compares the stream with the data
+ * chunk located directly in the file image, optionally paced like i2s DMA.
+ * Also checks early stop on sink error and truncated files.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "common.h"
+
+#define WAV_FILE "../data/test.wav"
+
+struct sink {
+	const uint8_t *ref;
+	size_t ref_len;
+	size_t pos;
+	size_t fail_at;		/* fail write when this many bytes are reached, 0 - never */
+	long ns_per_byte;	/* pacing, 0 - as fast as possible */
+	int mismatch;
+};
+
+static int sink_write(void *ctx, const void *buf, size_t len)
+{
+	struct sink *s = ctx;
+
+	if (s->fail_at && s->pos + len >= s->fail_at)
+		return -1;
+
+	if (s->pos + len > s->ref_len || memcmp(s->ref + s->pos, buf, len))
+		s->mismatch = 1;
+
+	s->pos += len;
+
+	if (s->ns_per_byte) {
+		long ns = s->ns_per_byte * len;
+		struct timespec ts = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 };
+
+		nanosleep(&ts, NULL);
+	}
+
+	return 0;
+}
+
+static uint8_t *load(const char *path, size_t *len)
+{
+	FILE *fd = fopen(path, "rb");
+	uint8_t *buf;
+	long n;
+
+	if (!fd)
+		return NULL;
+
+	fseek(fd, 0, SEEK_END);
+	n = ftell(fd);
+	rewind(fd);
+
+	buf = malloc(n);
+	if (buf && fread(buf, 1, n, fd) != (size_t)n) {
+		free(buf);
+		buf = NULL;
+	}
+
+	fclose(fd);
+	*len = n;
+	return buf;
+}
+
+static int play(const char *name, const char *path, size_t chunk, struct sink *s, int expect)
+{
+	struct wav_sink sink = { .ctx = s, .write = sink_write };
+	struct player_stats stats;
+	struct wav_source src;
+	struct wav_info info;
+	int ret;
+	FILE *fd;
+
+	fd = fopen(path, "rb");
+	if (!fd) {
+		printf("%s: failed to open %s\n", name, path);
+		return 1;
+	}
+
+	wav_source_file(&src, fd);
+
+	if (wav_read_header(&src, &info)) {
+		printf("%s: failed to parse header\n", name);
+		fclose(fd);
+		return 1;
+	}
+
+	s->pos = 0;
+	s->mismatch = 0;
+
+	ret = player_play(&src, info.data_size, &sink, chunk, &stats);
+	fclose(fd);
+
+	printf("%-12s chunk %6zu mem %6zu: %7u bytes %4u chunks first %6lld us total %8lld us: %s\n",
+	       name, chunk, 2 * chunk, stats.bytes, stats.chunks,
+	       (long long)stats.first_chunk_us, (long long)stats.total_us,
+	       (!!ret == !!expect && !s->mismatch) ? "PASS" : "FAIL");
+
+	return (!!ret == !!expect && !s->mismatch) ? 0 : 1;
+}
+
+int main(void)
+{
+	static const size_t chunks[] = { 512, 4096, 5000, 32768 };
+	size_t len, data_len;
+	uint8_t *image, *data;
+	int fails = 0;
+	FILE *fd;
+
+	image = load(WAV_FILE, &len);
+	if (!image) {
+		printf("failed to load %s\n", WAV_FILE);
+		return 1;
+	}
+
+	/* locate data chunk independently of the parser under test */
+	data = memmem(image + 12, len - 12, "data", 4);
+	if (!data) {
+		printf("no data chunk in %s\n", WAV_FILE);
+		return 1;
+	}
+
+	data_len = data[4] | data[5] << 8 | data[6] << 16 | (uint32_t)data[7] << 24;
+	data += 8;
+
+	struct sink s = { .ref = data, .ref_len = data_len };
+
+	for (unsigned int i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++)
+		fails += play("stream", WAV_FILE, chunks[i], &s, 0);
+
+	if (s.pos != data_len) {
+		printf("stream: %zu of %zu bytes played: FAIL\n", s.pos, data_len);
+		fails++;
+	}
+
+	/* paced sink: 64x faster than 32kHz stereo 16-bit, first chunk is still immediate */
+	s.ns_per_byte = 1000000000L / (32000 * 4 * 64);
+	fails += play("paced", WAV_FILE, 4096, &s, 0);
+	s.ns_per_byte = 0;
+
+	/* sink error stops both reader and writer */
+	s.fail_at = data_len / 3;
+	fails += play("sink error", WAV_FILE, 4096, &s, -1);
+	s.fail_at = 0;
+
+	/* truncated file: header announces more data than available */
+	fd = fopen("truncated.wav", "wb");
+	fwrite(image, 1, (data - image) + data_len / 2, fd);
+	fclose(fd);
+
+	fails += play("truncated", "truncated.wav", 4096, &s, -1);
+	remove("truncated.wav");
+
+	free(image);
+
+	printf("%s\n", fails ? "FAILED" : "PASSED");
+	return fails ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+/*
+ * Host side QOA encoder, same algorithm as the qoa.h reference encoder:
+ * for each slice all 16 scale factors are tried, starting from the previous
+ * one, and the one with the least squared error wins. Large LMS weights are
+ * penalized, so the predictor does not run away on loud clips.
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "common.h"
+#include "encoder.h"
+
+static const int quant_tab[17] = {
+	7, 7, 7, 5, 5, 3, 3, 1,	/* -8..-1 */
+	0,			/*  0     */
+	0, 2, 2, 4, 4, 6, 6, 6	/*  1.. 8 */
+};
+
+static const double dequant_tab[8] = { 0.75, -0.75, 2.5, -2.5, 4.5, -4.5, 7, -7 };
+
+static int scalefactor_tab[16];
+static int reciprocal_tab[16];
+static int dequant[16][8];
+
+static int round_away(double v)
+{
+	return (v < 0) ? -(int)(-v + 0.5) : (int)(v + 0.5);
+}
+
+static void tables_init(void)
+{
+	for (int s = 0; s < 16; s++) {
+		scalefactor_tab[s] = round_away(pow(s + 1, 2.75));
+		reciprocal_tab[s] = ((1 << 16) + scalefactor_tab[s] - 1) / scalefactor_tab[s];
+
+		for (int q = 0; q < 8; q++)
+			dequant[s][q] = round_away(scalefactor_tab[s] * dequant_tab[q]);
+	}
+}
+
+static int clamp(int v, int min, int max)
+{
+	return (v < min) ? min : (v > max) ? max : v;
+}
+
+/* division by scale factor, rounded away from zero */
+static int qoa_div(int v, int s)
+{
+	/* residual of a clipped prediction times 65536 overflows 32 bits */
+	int n = ((int64_t)v * reciprocal_tab[s] + (1 << 15)) >> 16;
+
+	return n + ((v > 0) - (v < 0)) - ((n > 0) - (n < 0));
+}
+
+static int lms_predict(const struct qoa_lms *lms)
+{
+	int p = 0;
+
+	for (int i = 0; i < 4; i++)
+		p += lms->weights[i] * lms->history[i];
+
+	return p >> 13;
+}
+
+static void lms_update(struct qoa_lms *lms, int sample, int residual)
+{
+	int delta = residual >> 4;
+
+	for (int i = 0; i < 4; i++)
+		lms->weights[i] += (lms->history[i] < 0) ? -delta : delta;
+
+	for (int i = 0; i < 3; i++)
+		lms->history[i] = lms->history[i + 1];
+	lms->history[3] = sample;
+}
+
+static uint8_t *put64(uint8_t *p, uint64_t v)
+{
+	for (int i = 0; i < 8; i++)
+		p[i] = v >> (56 - 8 * i);
+
+	return p + 8;
+}
+
+static uint64_t encode_slice(struct qoa_lms *state, const int16_t *in, unsigned int ch, unsigned int len,
+			     int *prev_sf)
+{
+	uint64_t best_rank = UINT64_MAX;
+	uint64_t best_slice = 0;
+	struct qoa_lms best_lms = *state;
+	int best_sf = 0;
+
+	for (int sfi = 0; sfi < 16; sfi++) {
+		int sf = (sfi + *prev_sf) & 15;
+		struct qoa_lms lms = *state;
+		uint64_t slice = sf;
+		uint64_t rank = 0;
+		unsigned int i;
+
+		for (i = 0; i < len; i++) {
+			int sample = in[i * ch];
+			int predicted = lms_predict(&lms);
+			int quantized = quant_tab[clamp(qoa_div(sample - predicted, sf), -8, 8) + 8];
+			int dq = dequant[sf][quantized];
+			int reconstructed = clamp(predicted + dq, -32768, 32767);
+			int penalty = ((lms.weights[0] * lms.weights[0] + lms.weights[1] * lms.weights[1] +
+					lms.weights[2] * lms.weights[2] + lms.weights[3] * lms.weights[3]) >> 18) - 0x8ff;
+			int64_t err = sample - reconstructed;
+
+			if (penalty < 0)
+				penalty = 0;
+
+			rank += err * err + (int64_t)penalty * penalty;
+			if (rank > best_rank)
+				break;
+
+			lms_update(&lms, reconstructed, dq);
+			slice = slice << 3 | quantized;
+		}
+
+		if (i == len && rank < best_rank) {
+			best_rank = rank;
+			best_slice = slice;
+			best_lms = lms;
+			best_sf = sf;
+		}
+	}
+
+	*prev_sf = best_sf;
+	*state = best_lms;
+
+	/* short last slice: residuals are left aligned */
+	return best_slice << (QOA_SLICE_LEN - len) * 3;
+}
+
+uint8_t *qoa_encode(const int16_t *pcm, uint32_t frames, unsigned int ch, uint32_t rate, size_t *len)
+{
+	struct qoa_lms lms[QOA_MAX_CHANNELS];
+	int prev_sf[QOA_MAX_CHANNELS] = { 0 };
+	size_t size = 8;
+	uint8_t *buf, *p;
+
+	if (!frames || !ch || ch > QOA_MAX_CHANNELS)
+		return NULL;
+
+	tables_init();
+
+	for (uint32_t f = 0; f < frames; f += QOA_FRAME_LEN)
+		size += qoa_frame_size(ch, (frames - f < QOA_FRAME_LEN) ? frames - f : QOA_FRAME_LEN);
+
+	buf = malloc(size);
+	if (!buf)
+		return NULL;
+
+	memset(lms, 0, sizeof(lms));
+	for (unsigned int c = 0; c < ch; c++) {
+		lms[c].weights[2] = -(1 << 13);
+		lms[c].weights[3] = 1 << 14;
+	}
+
+	p = put64(buf, (uint64_t)0x716f6166 << 32 | frames);
+
+	for (uint32_t f = 0; f < frames; f += QOA_FRAME_LEN) {
+		unsigned int n = (frames - f < QOA_FRAME_LEN) ? frames - f : QOA_FRAME_LEN;
+
+		p = put64(p, (uint64_t)ch << 56 | (uint64_t)rate << 32 | n << 16 | qoa_frame_size(ch, n));
+
+		for (unsigned int c = 0; c < ch; c++) {
+			uint64_t history = 0, weights = 0;
+
+			for (int i = 0; i < 4; i++) {
+				history = history << 16 | (lms[c].history[i] & 0xffff);
+				weights = weights << 16 | (lms[c].weights[i] & 0xffff);
+			}
+
+			p = put64(p, history);
+			p = put64(p, weights);
+		}
+
+		for (unsigned int si = 0; si < n; si += QOA_SLICE_LEN) {
+			unsigned int slice_len = (n - si < QOA_SLICE_LEN) ? n - si : QOA_SLICE_LEN;
+
+			for (unsigned int c = 0; c < ch; c++)
+				p = put64(p, encode_slice(&lms[c], pcm + (size_t)(f + si) * ch + c, ch,
+							  slice_len, &prev_sf[c]));
+		}
+	}
+
+	*len = size;
+	return buf;
+}
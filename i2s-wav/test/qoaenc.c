@@ -0,0 +1,76 @@
+/*
+ * QOA encoder tool: converts 16-bit PCM WAV clips for the data partition,
+ * e.g. ./qoaenc ../data/test.wav ../data/test.qoa
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "encoder.h"
+
+int main(int argc, char **argv)
+{
+	struct wav_info info;
+	uint8_t *image, *qoa;
+	size_t len, qoa_len;
+	FILE *fd;
+	long n;
+
+	if (argc != 3) {
+		fprintf(stderr, "usage: %s input.wav output.qoa\n", argv[0]);
+		return 1;
+	}
+
+	fd = fopen(argv[1], "rb");
+	if (!fd) {
+		fprintf(stderr, "failed to open %s\n", argv[1]);
+		return 1;
+	}
+
+	fseek(fd, 0, SEEK_END);
+	n = ftell(fd);
+	rewind(fd);
+
+	image = malloc(n);
+	len = fread(image, 1, n, fd);
+	fclose(fd);
+
+	if (wav_parse(image, len, &info) || info.format != WAV_FORMAT_PCM || info.bits_per_sample != 16 ||
+	    info.channels > QOA_MAX_CHANNELS) {
+		fprintf(stderr, "%s: not a 16-bit PCM WAV file with up to %d channels\n",
+			argv[1], QOA_MAX_CHANNELS);
+		return 1;
+	}
+
+	/* data chunk is not guaranteed to be aligned in the image */
+	int16_t *pcm = malloc(info.data_size);
+
+	memcpy(pcm, image + info.data_offset, info.data_size);
+
+	qoa = qoa_encode(pcm, info.frames, info.channels, info.sample_rate, &qoa_len);
+	if (!qoa) {
+		fprintf(stderr, "failed to encode %s\n", argv[1]);
+		return 1;
+	}
+
+	fd = fopen(argv[2], "wb");
+	if (!fd || fwrite(qoa, 1, qoa_len, fd) != qoa_len) {
+		fprintf(stderr, "failed to write %s\n", argv[2]);
+		return 1;
+	}
+
+	fclose(fd);
+
+	printf("%s: %u frames, %u ch, %u Hz: %zu -> %zu bytes, %.2f bits per sample\n", argv[2],
+	       info.frames, info.channels, info.sample_rate, (size_t)info.data_size, qoa_len,
+	       8.0 * qoa_len / ((double)info.frames * info.channels));
+
+	free(qoa);
+	free(pcm);
+	free(image);
+
+	return 0;
+}
@@ -0,0 +1,396 @@
+/*
+ * QOA test and benchmark:
+ * - data/test.wav is encoded with the host encoder and played through the
+ *   streaming player into the decoder sink; output is compared bit exact
+ *   with a per-sample reference decoder written from the specification
+ * - sink is fed in odd chunk sizes, down to single bytes, so frames and
+ *   headers are split at every position
+ * - corrupted headers and frames with changing parameters are rejected
+ * - decode cycles per sample and flash footprint of the same clip as PCM,
+ *   IMA ADPCM and QOA, one JSON line each
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "common.h"
+#include "encoder.h"
+#include "host_test.h"
+
+#define WAV_FILE "../data/test.wav"
+#define ADPCM_ALIGN_PER_CH 512
+
+static const int dequant_tab[8] = { 3, -3, 10, -10, 18, -18, 28, -28 };	/* x 1/4 */
+
+static uint64_t get(const uint8_t *p, int bytes)
+{
+	uint64_t v = 0;
+
+	while (bytes--)
+		v = v << 8 | *p++;
+
+	return v;
+}
+
+static int ref_dequant(int sf, int q)
+{
+	int scale = (int)lround(pow(sf + 1, 2.75));
+	int v = scale * dequant_tab[q];
+
+	/* x / 4 rounded away from zero */
+	return (v < 0) ? -((-v + 2) / 4) : (v + 2) / 4;
+}
+
+/* reference decoder, one sample at a time as the specification reads */
+static size_t ref_decode(const uint8_t *file, size_t len, int16_t *out)
+{
+	uint32_t samples = get(file + 4, 4);
+	size_t off = 8, frames = 0;
+
+	while (frames < samples && off + 8 <= len) {
+		unsigned int ch = file[off];
+		unsigned int n = get(file + off + 4, 2);
+		int history[QOA_MAX_CHANNELS][4], weights[QOA_MAX_CHANNELS][4];
+
+		off += 8;
+
+		for (unsigned int c = 0; c < ch; c++) {
+			for (int i = 0; i < 4; i++) {
+				history[c][i] = (int16_t)get(file + off + 2 * i, 2);
+				weights[c][i] = (int16_t)get(file + off + 8 + 2 * i, 2);
+			}
+			off += 16;
+		}
+
+		for (unsigned int si = 0; si < n; si += QOA_SLICE_LEN) {
+			for (unsigned int c = 0; c < ch; c++) {
+				uint64_t slice = get(file + off, 8);
+				int sf = slice >> 60;
+
+				off += 8;
+
+				for (unsigned int i = 0; i < QOA_SLICE_LEN && si + i < n; i++) {
+					int q = (slice >> (57 - 3 * i)) & 7;
+					int dq = ref_dequant(sf, q);
+					int p = 0, r;
+
+					for (int k = 0; k < 4; k++)
+						p += weights[c][k] * history[c][k];
+
+					r = (p >> 13) + dq;
+					r = (r < -32768) ? -32768 : (r > 32767) ? 32767 : r;
+
+					for (int k = 0; k < 4; k++)
+						weights[c][k] += (history[c][k] < 0) ? -(dq >> 4) : (dq >> 4);
+					for (int k = 0; k < 3; k++)
+						history[c][k] = history[c][k + 1];
+					history[c][3] = r;
+
+					out[(frames + si + i) * ch + c] = r;
+				}
+			}
+		}
+
+		frames += n;
+	}
+
+	return frames;
+}
+
+struct capture {
+	int16_t *buf;
+	size_t len;
+	size_t max;
+};
+
+static int capture_write(void *ctx, const void *buf, size_t len)
+{
+	struct capture *c = ctx;
+
+	if (c->len + len > c->max)
+		return -1;
+
+	memcpy((uint8_t *)c->buf + c->len, buf, len);
+	c->len += len;
+
+	return 0;
+}
+
+static double snr(const int16_t *ref, const int16_t *out, size_t n)
+{
+	double err = 0.0, sig = 0.0;
+
+	for (size_t i = 0; i < n; i++) {
+		double d = (double)out[i] - ref[i];
+
+		err += d * d;
+		sig += (double)ref[i] * ref[i];
+	}
+
+	return 10.0 * log10(sig / (err + 1e-9));
+}
+
+/* whole clip through player and decoder sink, as main.c does it */
+static int play(const uint8_t *file, size_t len, size_t chunk, struct capture *cap)
+{
+	struct wav_sink next = { .ctx = cap, .write = capture_write };
+	struct player_stats stats;
+	struct qoa_sink qoa;
+	struct wav_source src;
+	struct wav_sink sink;
+	struct wav_info info;
+	struct wav_mem m;
+	int ret;
+
+	wav_source_mem(&src, &m, file, len);
+	cap->len = 0;
+
+	if (qoa_read_header(&src, &info) || qoa_sink_init(&qoa, &info, &next, &sink))
+		return -1;
+
+	ret = player_play(&src, info.data_size, &sink, chunk, &stats);
+	qoa_sink_deinit(&qoa);
+
+	return ret;
+}
+
+/* decoder sink fed directly in fixed size pieces */
+static int feed(const uint8_t *file, size_t len, size_t piece, struct capture *cap)
+{
+	struct wav_sink next = { .ctx = cap, .write = capture_write };
+	struct qoa_sink qoa;
+	struct wav_source src;
+	struct wav_sink sink;
+	struct wav_info info;
+	struct wav_mem m;
+	int ret = 0;
+
+	wav_source_mem(&src, &m, file, len);
+	cap->len = 0;
+
+	if (qoa_read_header(&src, &info) || qoa_sink_init(&qoa, &info, &next, &sink))
+		return -1;
+
+	for (size_t off = info.data_offset; off < len && !ret; off += piece)
+		ret = sink.write(sink.ctx, file + off, (len - off < piece) ? len - off : piece);
+
+	qoa_sink_deinit(&qoa);
+
+	return ret;
+}
+
+static int streaming(const uint8_t *file, size_t len, const int16_t *ref, size_t ref_len,
+		     struct capture *cap)
+{
+	static const size_t pieces[] = { 1, 7, 333, 4096, 65536 };
+	static const size_t chunks[] = { 512, 4096, 32768 };
+	int fails = 0;
+
+	for (size_t i = 0; i < sizeof(pieces) / sizeof(pieces[0]); i++) {
+		int ret = feed(file, len, pieces[i], cap);
+
+		if (ret || cap->len != ref_len || memcmp(cap->buf, ref, ref_len))
+			fails++;
+	}
+
+	for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); i++) {
+		int ret = play(file, len, chunks[i], cap);
+
+		if (ret || cap->len != ref_len || memcmp(cap->buf, ref, ref_len))
+			fails++;
+	}
+
+	printf("%-24s %s\n", "streaming", fails ? "FAIL" : "PASS");
+
+	return fails;
+}
+
+static int corrupted(const uint8_t *file, size_t len, struct capture *cap)
+{
+	uint8_t *bad = malloc(len);
+	struct wav_source src;
+	struct wav_info info;
+	struct wav_mem m;
+	int fails = 0;
+
+	/* magic, zero samples, zero channels, frame size */
+	static const size_t offs[] = { 0, 4, 8, 14 };
+	for (size_t i = 0; i < sizeof(offs) / sizeof(offs[0]); i++) {
+		memcpy(bad, file, len);
+		memset(bad + offs[i], 0, (offs[i] == 4) ? 4 : 1);
+		wav_source_mem(&src, &m, bad, len);
+		if (!qoa_read_header(&src, &info))
+			fails++;
+	}
+
+	/* second frame changes channel count or claims more samples */
+	if (len > 8 + qoa_frame_size(file[8], QOA_FRAME_LEN) + 8) {
+		size_t second = 8 + qoa_frame_size(file[8], QOA_FRAME_LEN);
+
+		memcpy(bad, file, len);
+		bad[second] ^= 3;
+		if (!feed(bad, len, 4096, cap))
+			fails++;
+
+		memcpy(bad, file, len);
+		bad[second + 4] = 0xff;
+		if (!feed(bad, len, 4096, cap))
+			fails++;
+	}
+
+	/* truncated header */
+	wav_source_mem(&src, &m, file, 12);
+	if (!qoa_read_header(&src, &info))
+		fails++;
+
+	printf("%-24s %s\n", "corrupted", fails ? "FAIL" : "PASS");
+
+	free(bad);
+
+	return fails;
+}
+
+/* decode speed and flash footprint of the same clip in each format */
+static int bench(const int16_t *pcm, size_t frames, unsigned int ch, uint32_t rate,
+		 const uint8_t *qoa, size_t qoa_len, struct capture *cap)
+{
+	struct wav_sink next = { .ctx = cap, .write = capture_write };
+	size_t pcm_len = frames * ch * sizeof(int16_t);
+	struct ima_adpcm_sink adpcm;
+	size_t adpcm_len, chunk;
+	struct wav_sink sink;
+	struct wav_info info;
+	uint64_t start, t;
+	uint8_t *adpcm_wav;
+	int fails = 0;
+
+	/* pcm: decoding is a copy of the data chunk into the sink */
+	cap->len = 0;
+	start = cycles();
+	for (size_t off = 0; off < pcm_len; off += 4096)
+		capture_write(cap, (const uint8_t *)pcm + off, (pcm_len - off < 4096) ? pcm_len - off : 4096);
+	t = cycles() - start;
+
+	printf("{\"format\": \"pcm\", \"channels\": %u, \"frames\": %zu, \"bytes\": %zu, "
+	       "\"bits_per_sample\": %.2f, \"kbps\": %.1f, \"snr_db\": %.1f, \"cycles_per_sample\": %.2f}\n",
+	       ch, frames, pcm_len, 16.0, 16.0 * ch * rate / 1000, snr(pcm, cap->buf, frames * ch),
+	       (double)t / (frames * ch));
+
+	adpcm_wav = ima_adpcm_encode_wav(pcm, frames, ch, rate, ADPCM_ALIGN_PER_CH, &adpcm_len);
+	if (!adpcm_wav || wav_parse(adpcm_wav, adpcm_len, &info) || ima_adpcm_sink_init(&adpcm, &info, &next, &sink))
+		return 1;
+
+	cap->len = 0;
+	chunk = 4096 - 4096 % info.block_align;
+	start = cycles();
+	for (size_t off = 0; off < info.data_size; off += chunk)
+		fails += !!sink.write(sink.ctx, adpcm_wav + info.data_offset + off,
+				      (info.data_size - off < chunk) ? info.data_size - off : chunk);
+	t = cycles() - start;
+	ima_adpcm_sink_deinit(&adpcm);
+
+	printf("{\"format\": \"ima_adpcm\", \"channels\": %u, \"frames\": %zu, \"bytes\": %zu, "
+	       "\"bits_per_sample\": %.2f, \"kbps\": %.1f, \"snr_db\": %.1f, \"cycles_per_sample\": %.2f}\n",
+	       ch, frames, adpcm_len, 8.0 * adpcm_len / (frames * ch), 8.0 * adpcm_len * rate / frames / 1000,
+	       snr(pcm, cap->buf, frames * ch), (double)t / (frames * ch));
+
+	start = cycles();
+	fails += !!feed(qoa, qoa_len, 4096, cap);
+	t = cycles() - start;
+
+	printf("{\"format\": \"qoa\", \"channels\": %u, \"frames\": %zu, \"bytes\": %zu, "
+	       "\"bits_per_sample\": %.2f, \"kbps\": %.1f, \"snr_db\": %.1f, \"cycles_per_sample\": %.2f}\n",
+	       ch, frames, qoa_len, 8.0 * qoa_len / (frames * ch), 8.0 * qoa_len * rate / frames / 1000,
+	       snr(pcm, cap->buf, frames * ch), (double)t / (frames * ch));
+
+	free(adpcm_wav);
+
+	return fails;
+}
+
+static int run(const int16_t *pcm, size_t frames, unsigned int ch, uint32_t rate)
+{
+	size_t len, ref_frames, ref_len;
+	struct capture cap;
+	uint8_t *file;
+	int16_t *ref;
+	int fails = 0;
+
+	file = qoa_encode(pcm, frames, ch, rate, &len);
+	if (!file) {
+		printf("%u ch: failed to encode: FAIL\n", ch);
+		return 1;
+	}
+
+	ref = malloc(frames * ch * sizeof(*ref));
+	/* adpcm pads the last block to a whole group */
+	cap.max = (frames + 8) * ch * sizeof(*cap.buf);
+	cap.buf = malloc(cap.max);
+
+	ref_frames = ref_decode(file, len, ref);
+	ref_len = ref_frames * ch * sizeof(*ref);
+
+	/* encoder sanity: all frames are there and close to the original */
+	if (ref_frames != frames || snr(pcm, ref, frames * ch) < 30.0) {
+		printf("%u ch: encoded clip: FAIL\n", ch);
+		fails++;
+	}
+
+	fails += streaming(file, len, ref, ref_len, &cap);
+	fails += corrupted(file, len, &cap);
+	fails += bench(pcm, frames, ch, rate, file, len, &cap);
+
+	free(cap.buf);
+	free(ref);
+	free(file);
+
+	return fails;
+}
+
+int main(void)
+{
+	struct wav_info info;
+	int16_t *pcm, *mono;
+	uint8_t *image;
+	size_t len;
+	FILE *fd;
+	int fails = 0;
+
+	fd = fopen(WAV_FILE, "rb");
+	if (!fd) {
+		printf("failed to open %s\n", WAV_FILE);
+		return 1;
+	}
+
+	image = malloc(1 << 20);
+	len = fread(image, 1, 1 << 20, fd);
+	fclose(fd);
+
+	if (wav_parse(image, len, &info) || info.format != WAV_FORMAT_PCM || info.bits_per_sample != 16) {
+		printf("unexpected format of %s\n", WAV_FILE);
+		return 1;
+	}
+
+	pcm = malloc(info.data_size);
+	memcpy(pcm, image + info.data_offset, info.data_size);
+
+	fails += run(pcm, info.frames, info.channels, info.sample_rate);
+
+	/* mono clip from the left channel */
+	if (info.channels == 2) {
+		mono = malloc(info.frames * sizeof(*mono));
+		for (size_t i = 0; i < info.frames; i++)
+			mono[i] = pcm[2 * i];
+
+		fails += run(mono, info.frames, 1, info.sample_rate);
+		free(mono);
+	}
+
+	free(pcm);
+	free(image);
+
+	return test_done(fails);
+}
@@ -0,0 +1,255 @@
+/*
+ * Resampler test and benchmark for 44.1k, 48k and 22.05k to 16k with each
+ * quality preset:
+ * - passband gain for tones below the designed passband edge
+ * - stopband attenuation: worst output level over a sweep of input tones
+ *   above the stopband edge, all of them can only show up as aliases
+ * - output is the same whatever the input block split is, also through
+ *   the sink adaptor, with and without the gain stage on its output
+ * - cycles per output sample: rdtsc on x86, otherwise ns (1 GHz clock)
+ * Results are printed as json lines, check fails if attenuation is more
+ * than 6 dB off the preset target or passband is not flat within 0.5 dB.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+
+#include "common.h"
+#include "gain.h"
+#include "host_test.h"
+
+#define OUT_RATE 16000
+#define AMP 16384
+#define SWEEP_STEPS 48
+#define BENCH_FRAMES (1 << 18)
+
+static const double targets[] = {
+	[RESAMPLER_LOW] = 50.0,
+	[RESAMPLER_MEDIUM] = 70.0,
+	[RESAMPLER_HIGH] = 75.0,
+};
+
+static const char *names[] = {
+	[RESAMPLER_LOW] = "low",
+	[RESAMPLER_MEDIUM] = "medium",
+	[RESAMPLER_HIGH] = "high",
+};
+
+static void tone(int16_t *buf, size_t frames, unsigned int ch, double freq, uint32_t rate)
+{
+	for (size_t i = 0; i < frames; i++)
+		for (unsigned int j = 0; j < ch; j++)
+			buf[i * ch + j] = lrint(AMP * sin(2.0 * M_PI * freq * i / rate));
+}
+
+/* output level of a tone relative to input level, dB */
+static double level(struct resampler *rs, double freq, int16_t *in, size_t frames, int16_t *out)
+{
+	size_t n, skip;
+	double sum = 0.0;
+
+	resampler_reset(rs);
+	tone(in, frames, rs->channels, freq, rs->in_rate);
+	n = resampler_process(rs, in, frames, out);
+
+	/* skip filter transient */
+	skip = rs->taps * rs->up / rs->down + 1;
+
+	for (size_t i = skip; i < n; i++)
+		sum += (double)out[i * rs->channels] * out[i * rs->channels];
+
+	return 10.0 * log10(sum / (n - skip) / (AMP * AMP / 2.0) + 1e-20);
+}
+
+static int check_split(struct resampler *rs, const int16_t *in, size_t frames, int16_t *a, int16_t *b)
+{
+	size_t na, nb = 0, pos = 0, step = 1;
+
+	resampler_reset(rs);
+	na = resampler_process(rs, in, frames, a);
+
+	/* odd sized pieces, from single frames up to several blocks */
+	resampler_reset(rs);
+	while (pos < frames) {
+		size_t n = (frames - pos < step) ? frames - pos : step;
+
+		nb += resampler_process(rs, in + pos * rs->channels, n, b + nb * rs->channels);
+		pos += n;
+		step = step * 3 + 1;
+	}
+
+	return (na == nb && !memcmp(a, b, na * rs->channels * sizeof(*a))) ? 0 : -1;
+}
+
+struct capture {
+	int16_t *buf;
+	size_t len;
+};
+
+static int capture_write(void *ctx, const void *buf, size_t len)
+{
+	struct capture *c = ctx;
+
+	memcpy((uint8_t *)c->buf + c->len, buf, len);
+	c->len += len;
+
+	return 0;
+}
+
+/* sink adaptor gives the same output as direct processing, gain is applied to it */
+static int check_sink(struct resampler *rs, const int16_t *in, size_t frames, int16_t *a, int16_t *b,
+		      int32_t q15)
+{
+	struct capture cap = { .buf = b };
+	struct wav_sink next = { .ctx = &cap, .write = capture_write };
+	struct resampler_sink rs_sink;
+	struct wav_sink sink;
+	struct gain g, ref;
+	size_t frame = rs->channels * sizeof(*in);
+	size_t na, pos = 0;
+	int ret = 0;
+
+	resampler_reset(rs);
+	na = resampler_process(rs, in, frames, a);
+
+	/* constant gain does not depend on the block split */
+	gain_init(&ref, rs->channels, q15);
+	gain_apply(&ref, a, na);
+
+	if (resampler_sink_init(&rs_sink, rs, &next, &sink))
+		return -1;
+
+	gain_init(&g, rs->channels, q15);
+	if (q15 != GAIN_UNITY)
+		rs_sink.gain = &g;
+
+	resampler_reset(rs);
+	while (pos < frames && !ret) {
+		size_t n = (frames - pos < 1000) ? frames - pos : 1000;
+
+		ret = sink.write(sink.ctx, in + pos * rs->channels, n * frame);
+		pos += n;
+	}
+
+	resampler_sink_deinit(&rs_sink);
+
+	return (!ret && cap.len == na * frame && !memcmp(a, b, cap.len)) ? 0 : -1;
+}
+
+/* worst case input can not overflow the accumulator of any phase */
+static int check_headroom(const struct resampler *rs)
+{
+	unsigned int shift = rs->shift - rs->headroom;
+
+	if (rs->shift <= rs->headroom || rs->headroom > 4)
+		return -1;
+
+	for (unsigned int p = 0; p < rs->up; p++) {
+		int64_t sum = 0;
+
+		for (unsigned int k = 0; k < rs->taps; k++)
+			sum += abs(rs->coefs[p * rs->taps + k]);
+
+		if (sum * (32768 >> rs->headroom) + (1 << (shift - 1)) > INT32_MAX)
+			return -1;
+	}
+
+	return 0;
+}
+
+static int run(uint32_t in_rate, unsigned int ch, enum resampler_quality q)
+{
+	size_t frames = in_rate / 4;
+	double atten = 0.0, ripple = 0.0;
+	struct resampler rs;
+	int16_t *in, *out, *out2;
+	uint64_t start, elapsed = 0;
+	size_t produced;
+	int fails = 0;
+
+	if (resampler_init(&rs, in_rate, OUT_RATE, ch, q, 0)) {
+		printf("%u -> %u %s: init failed: FAIL\n", in_rate, OUT_RATE, names[q]);
+		return 1;
+	}
+
+	in = malloc(BENCH_FRAMES * ch * sizeof(*in));
+	out = malloc(resampler_out_max(&rs, BENCH_FRAMES) * ch * sizeof(*out));
+	out2 = malloc(resampler_out_max(&rs, BENCH_FRAMES) * ch * sizeof(*out));
+
+	/* passband: flat within 0.5 dB up to the passband edge */
+	for (double f = 250.0; f < rs.pass_hz; f += 250.0) {
+		double l = fabs(level(&rs, f, in, frames, out));
+
+		if (l > ripple)
+			ripple = l;
+	}
+
+	/* stopband: tones from stopband edge up to input nyquist */
+	for (int i = 0; i < SWEEP_STEPS; i++) {
+		double f = rs.stop_hz + (in_rate / 2.0 - rs.stop_hz) * (i + 0.5) / SWEEP_STEPS;
+		double l = -level(&rs, f, in, frames, out);
+
+		if (!i || l < atten)
+			atten = l;
+	}
+
+	if (check_headroom(&rs) || check_split(&rs, in, frames, out, out2) || check_sink(&rs, in, frames, out, out2, GAIN_UNITY) ||
+	    check_sink(&rs, in, frames, out, out2, gain_from_db10(-60)))
+		fails++;
+
+	/* throughput on noise-like input, all phases are hit */
+	for (size_t i = 0; i < BENCH_FRAMES * ch; i++)
+		in[i] = (int16_t)(i * 2654435761u >> 16) >> 2;
+
+	/* best of few runs */
+	for (int i = 0; i < 3; i++) {
+		uint64_t e;
+
+		resampler_reset(&rs);
+		start = cycles();
+		produced = resampler_process(&rs, in, BENCH_FRAMES, out);
+		e = cycles() - start;
+
+		if (!i || e < elapsed)
+			elapsed = e;
+	}
+
+	if (ripple > 0.5 || atten < targets[q] - 6.0)
+		fails++;
+
+	printf("{\"in_rate\": %u, \"out_rate\": %u, \"channels\": %u, \"quality\": \"%s\", "
+	       "\"taps\": %u, \"phases\": %u, \"coef_kb\": %.1f, \"pass_hz\": %u, \"stop_hz\": %u, "
+	       "\"passband_ripple_db\": %.3f, \"stopband_atten_db\": %.1f, "
+	       "\"cycles_per_output\": %.1f, \"status\": \"%s\"}\n",
+	       in_rate, OUT_RATE, ch, names[q], rs.taps, rs.up,
+	       rs.up * rs.taps * sizeof(int16_t) / 1024.0, rs.pass_hz, rs.stop_hz,
+	       ripple, atten, (double)elapsed / produced, fails ? "FAIL" : "PASS");
+
+	free(in);
+	free(out);
+	free(out2);
+	resampler_deinit(&rs);
+
+	return fails;
+}
+
+int main(void)
+{
+	static const uint32_t rates[] = { 44100, 48000, 22050 };
+	int fails = 0;
+
+	for (unsigned int i = 0; i < sizeof(rates) / sizeof(rates[0]); i++)
+		for (int q = RESAMPLER_LOW; q <= RESAMPLER_HIGH; q++)
+			fails += run(rates[i], 2, q);
+
+	/* mono and generic channel count paths */
+	fails += run(44100, 1, RESAMPLER_MEDIUM);
+	fails += run(48000, 3, RESAMPLER_LOW);
+
+	return test_done(fails);
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ * Helpers shared by the host tests of all the projects: benchmark clock
+ * and the final status line. Test Makefiles add this directory to the
+ * include path.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+/* rdtsc on x86, otherwise ns (1 GHz clock) */
+static inline uint64_t cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+/* PASSED or FAILED on stderr, JSON lines on stdout stay parseable: exit status */
+static inline int test_done(int fails)
+{
+	fprintf(stderr, "%s\n", fails ? "FAILED" : "PASSED");
+	return fails ? 1 : 0;
+}